@@ -0,0 +1,75 @@
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+// counts every allocation through global operator new (including coroutine frames which aren't pooled),
+// if BENCH_COUNT_ALLOCS is defined (cmake option BENCH_COUNT_ALLOCS). otherwise the counts stay 0.
+// replaces the global operator new/delete, so it must only be included by one translation unit of a program.
+// memory allocated with malloc directly or with over-aligned operator new isn't counted,
+// but everything in the lookup path goes through plain operator new
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+namespace alloc_counter
+{
+#ifdef BENCH_COUNT_ALLOCS
+	constexpr bool enabled = true;
+#else
+	constexpr bool enabled = false;
+#endif
+
+	struct counts
+	{
+		std::uint64_t allocs = 0, bytes = 0;
+
+		constexpr counts operator-(const counts& rhs) const { return { allocs - rhs.allocs, bytes - rhs.bytes }; }
+		constexpr counts& operator+=(const counts& rhs)
+		{
+			allocs += rhs.allocs;
+			bytes += rhs.bytes;
+			return *this;
+		}
+		constexpr counts& operator-=(const counts& rhs)
+		{
+			allocs -= rhs.allocs;
+			bytes -= rhs.bytes;
+			return *this;
+		}
+	};
+
+	namespace detail
+	{
+		inline std::atomic<std::uint64_t> num_allocs = 0, num_bytes = 0;
+	}
+
+	// @return allocations so far, by all threads
+	inline counts now() noexcept
+		{ return { detail::num_allocs.load(std::memory_order_relaxed), detail::num_bytes.load(std::memory_order_relaxed) }; }
+}
+
+#ifdef BENCH_COUNT_ALLOCS
+namespace alloc_counter::detail
+{
+	inline void* allocate(std::size_t size)
+	{
+		num_allocs.fetch_add(1, std::memory_order_relaxed);
+		num_bytes.fetch_add(size, std::memory_order_relaxed);
+		if (void* p = std::malloc(std::max<std::size_t>(size, 1)))
+			{ return p; }
+		throw std::bad_alloc();
+	}
+}
+
+void* operator new(std::size_t size) { return alloc_counter::detail::allocate(size); }
+void* operator new[](std::size_t size) { return alloc_counter::detail::allocate(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+#endif
+
+#endif
@@ -0,0 +1,279 @@
+// throughput and tail latency of lookups from many threads sharing one opened dictionary_file
+// usage: bench_concurrency [n_words] [max_threads] (default 100000, std::thread::hardware_concurrency())
+// lookups are of Zipf distributed words (a few hot words and a long tail), as from a server.
+// for 1, 2, 4, ... up to max_threads threads, each mode (positioned reads, with the def cache, and mapped) is run,
+// and every def found is checked against the result of a single threaded lookup of the same word.
+// each result is printed as a line of JSON, e.g.
+// {"bench":"find","words":100000,"threads":4,"ops":400000,"ops_per_sec":5012345.6,"p50_ns":310,"p99_ns":2120,"p999_ns":8830,"mismatches":0}
+// exits with 1 if any lookup returned the wrong def. also built with USE_TSAN, to check for data races
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <iostream>
+#include <latch>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "hash.h"
+#include "sdict_file.h"
+
+namespace
+{
+	constexpr std::string_view filename = "bench_concurrency.sdict";
+	// lookups by each thread
+	constexpr std::size_t lookups_per_thread = 100000;
+	// exponent of the Zipf distribution of lookups. the rank r word is looked up with probability proportional to 1 / r^s
+	constexpr double zipf_exponent = 1.0;
+	// capacity of the def cache when it is enabled
+	constexpr std::size_t def_cache_capacity = 16 * 1024 * 1024;
+	constexpr std::size_t gen_batch_size = 4096;
+
+	// lowercase word, length roughly normally distributed around 8
+	std::string random_word(std::mt19937_64& rng)
+	{
+		std::normal_distribution<double> len_dist(8, 3);
+		std::uniform_int_distribution<int> char_dist('a', 'z');
+		const auto len = static_cast<std::size_t>(std::clamp(std::lround(len_dist(rng)), 1l, 24l));
+		std::string word(len, '\0');
+		for (auto& c : word)
+			{ c = static_cast<char>(char_dist(rng)); }
+		return word;
+	}
+
+	// def sizes are log-normally distributed (median 400 bytes), like CBOR encoded API responses
+	std::vector<std::byte> random_def(std::mt19937_64& rng)
+	{
+		std::lognormal_distribution<double> size_dist(std::log(400.0), 1.0);
+		std::uniform_int_distribution<int> byte_dist(0, 255);
+		const auto size = static_cast<std::size_t>(std::clamp(size_dist(rng), 16.0, 256.0 * 1024));
+		std::vector<std::byte> def(size);
+		for (auto& b : def)
+			{ b = static_cast<std::byte>(byte_dist(rng)); }
+		return def;
+	}
+
+	// samples ranks in [0, n) with a Zipf distribution, by binary search of its cumulative distribution
+	class zipf_distribution
+	{
+	private:
+		std::vector<double> cdf;
+
+	public:
+		zipf_distribution(std::size_t n, double s)
+		{
+			cdf.reserve(n);
+			double sum = 0;
+			for (std::size_t i = 0; i < n; i++)
+			{
+				sum += 1 / std::pow(static_cast<double>(i + 1), s);
+				cdf.push_back(sum);
+			}
+			for (auto& p : cdf)
+				{ p /= sum; }
+		}
+
+		// Complexity: O(log(n))
+		std::size_t operator()(std::mt19937_64& rng) const
+		{
+			const double p = std::uniform_real_distribution<double>(0, 1)(rng);
+			return std::min<std::size_t>(std::ranges::lower_bound(cdf, p) - cdf.begin(), cdf.size() - 1);
+		}
+	};
+
+	// create `filename` with a def for each of `words`
+	void build(const std::vector<std::string>& words)
+	{
+		if (std::filesystem::exists(filename))
+			{ std::filesystem::remove(filename); }
+		std::mt19937_64 rng(7);
+		dictionary_file file(filename, true, false, false);
+		std::vector<std::pair<std::string_view, std::vector<std::byte>>> batch;
+		for (std::size_t i = 0; i < words.size(); i += gen_batch_size)
+		{
+			batch.clear();
+			for (std::size_t j = i; j < std::min(i + gen_batch_size, words.size()); j++)
+				{ batch.emplace_back(words[j], random_def(rng)); }
+			file.add_words<false, true>(batch);
+		}
+		file.flush();
+	}
+
+	enum class mode
+	{
+		// find() through positioned reads
+		find,
+		// find() with the def cache
+		find_cached,
+		// find_view() of the mapped file
+		find_view
+	};
+
+	constexpr std::string_view mode_name(mode m)
+	{
+		switch (m)
+		{
+		case mode::find: return "find";
+		case mode::find_cached: return "find_cached";
+		case mode::find_view: return "find_view";
+		}
+		return "";
+	}
+
+	// @return `q`-quantile of sorted `samples`
+	std::chrono::nanoseconds quantile(std::span<const std::chrono::nanoseconds> samples, double q)
+	{
+		if (samples.empty())
+			{ return {}; }
+		return samples[std::min(static_cast<std::size_t>(q * static_cast<double>(samples.size())), samples.size() - 1)];
+	}
+
+	// look up words drawn from `ranks` on `n_threads` threads at once, and report throughput and latency
+	// @param expected  hash of the def of each word, by rank, from a single threaded lookup
+	// @return number of lookups which didn't return the expected def
+	std::size_t run_threads(const dictionary_file& file, mode m, const std::vector<std::string>& words, const std::vector<std::uint64_t>& expected,
+		const zipf_distribution& ranks, std::size_t n_threads)
+	{
+		std::atomic<std::size_t> mismatches = 0;
+		// latencies of each thread, merged once they finish
+		std::vector<std::vector<std::chrono::nanoseconds>> latencies(n_threads);
+		// threads start together, so that they actually contend
+		std::latch ready(static_cast<std::ptrdiff_t>(n_threads));
+		std::atomic<bool> go = false;
+		std::chrono::steady_clock::time_point start;
+		{
+			std::vector<std::jthread> threads;
+			for (std::size_t t = 0; t < n_threads; t++)
+			{
+				threads.emplace_back([&, t]()
+				{
+					std::mt19937_64 rng(1000 + t);
+					// drawn beforehand, so sampling isn't timed
+					std::vector<std::size_t> lookups(lookups_per_thread);
+					for (auto& rank : lookups)
+						{ rank = ranks(rng); }
+					auto& thread_latencies = latencies[t];
+					thread_latencies.reserve(lookups.size());
+					ready.count_down();
+					go.wait(false);
+					for (const auto rank : lookups)
+					{
+						const auto op_start = std::chrono::steady_clock::now();
+						std::uint64_t hash = 0;
+						bool found;
+						if (m == mode::find_view)
+						{
+							const auto def = file.find_view(words[rank]);
+							found = def.has_value();
+							if (found)
+								{ hash = xxh64(def.value()); }
+						}
+						else
+						{
+							const auto def = file.find(words[rank]);
+							found = def.has_value();
+							if (found)
+								{ hash = xxh64(std::as_bytes(std::span(def.value()))); }
+						}
+						thread_latencies.push_back(std::chrono::steady_clock::now() - op_start);
+						if (!found || hash != expected[rank])
+							{ mismatches.fetch_add(1, std::memory_order_relaxed); }
+					}
+				});
+			}
+			ready.wait();
+			start = std::chrono::steady_clock::now();
+			go = true;
+			go.notify_all();
+		}
+		const auto elapsed = std::chrono::steady_clock::now() - start;
+
+		std::vector<std::chrono::nanoseconds> all;
+		all.reserve(n_threads * lookups_per_thread);
+		for (const auto& thread_latencies : latencies)
+			{ all.insert(all.end(), thread_latencies.begin(), thread_latencies.end()); }
+		std::ranges::sort(all);
+		const double ops_per_sec = static_cast<double>(all.size()) / std::chrono::duration<double>(elapsed).count();
+		std::cout << std::format(R"({{"bench":"{}","words":{},"threads":{},"ops":{},"ops_per_sec":{:.1f},"p50_ns":{},"p99_ns":{},"p999_ns":{},"mismatches":{}}})",
+			mode_name(m), words.size(), n_threads, all.size(), ops_per_sec, quantile(all, 0.5).count(), quantile(all, 0.99).count(),
+			quantile(all, 0.999).count(), mismatches.load()) << std::endl;
+		return mismatches.load();
+	}
+
+	// @return total number of mismatched lookups
+	std::size_t run(std::size_t n_words, std::size_t max_threads)
+	{
+		std::mt19937_64 rng(42);
+		std::unordered_set<std::string> seen;
+		std::vector<std::string> words;
+		words.reserve(n_words);
+		while (words.size() < n_words)
+		{
+			auto word = random_word(rng);
+			if (seen.insert(word).second)
+				{ words.push_back(std::move(word)); }
+		}
+		build(words);
+		// ranks are assigned in generation order, which is unrelated to the order of words and defs in the file
+		const zipf_distribution ranks(words.size(), zipf_exponent);
+
+		// reference results, looked up single threaded
+		std::vector<std::uint64_t> expected;
+		expected.reserve(words.size());
+		{
+			const dictionary_file file(filename, false, false, false);
+			for (const auto& word : words)
+			{
+				const auto def = file.find(word, true).value();
+				expected.push_back(xxh64(std::as_bytes(std::span(def))));
+			}
+		}
+
+		std::size_t mismatches = 0;
+		for (const mode m : { mode::find, mode::find_cached, mode::find_view })
+		{
+			dictionary_file file;
+			if (m == mode::find_view)
+				{ file.open_mapped(filename, false); }
+			else
+				{ file.open(filename, false, false, false); }
+			if (m == mode::find_cached)
+				{ file.set_def_cache_capacity(def_cache_capacity); }
+			for (std::size_t n_threads = 1; n_threads <= max_threads; n_threads = (n_threads * 2 > max_threads && n_threads < max_threads ? max_threads : n_threads * 2))
+				{ mismatches += run_threads(file, m, words, expected, ranks, n_threads); }
+		}
+		std::filesystem::remove(filename);
+		return mismatches;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	const std::size_t n_words = (argc > 1 ? std::stoull(argv[1]) : 100000);
+	const std::size_t max_threads = (argc > 2 ? std::stoull(argv[2]) : std::max(std::thread::hardware_concurrency(), 1u));
+
+	try
+	{
+		if (run(n_words, std::max<std::size_t>(max_threads, 1)) != 0)
+		{
+			std::cerr << "lookups returned the wrong def" << std::endl;
+			return 1;
+		}
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+}
@@ -0,0 +1,295 @@
+// times showing the largest rendered pages of a corpus in a text display set up like ui.text_display, offscreen
+// usage: bench_display <corpus> [n_pages] (default 20)
+// corpus is an sdict file, or a directory of responses as *.json (raw API response) or *.cbor (as stored in the offline dictionary)
+// every definition is parsed and rendered as in search_word, and the n_pages with the most text are kept. each is then
+// parsed and rendered again, and shown: the text and styles are appended to the display's buffers (as a definition is shown),
+// drawn for the first time, scrolled through (drawing at each stop), and resized to twice its size and back (re-wrapping it).
+// pages are shown with lazy wrapping (see Linked_Text_Display::lazy_wrap()) on and off, and with it on, the lines which
+// would be recounted in the background after resizing are recounted at once ("recount").
+// each phase is printed as a line of JSON, e.g.
+// {"bench":"display","lazy_wrap":false,"phase":"fill","pages":20,"samples":100,"avg_chars":183204,"p50_ns":41210,"p99_ns":190022,"max_ns":210311}
+// so that the time spent in the display can be told apart from parsing and rendering.
+// drawing needs a display connection (e.g. run under xvfb-run), even though no window is shown
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include <FL/Fl.H>
+#include <FL/Fl_Double_Window.H>
+#include <FL/Fl_Image_Surface.H>
+#include <FL/Fl_Text_Buffer.H>
+#include <FL/Fl_Text_Display.H>
+#include <FL/platform.H>
+
+#include <jsoncons/json.hpp>
+#include <jsoncons_ext/cbor/cbor.hpp>
+
+#include "def_encoding.h"
+#include "linked_text_display.h"
+#include "links.h"
+#include "render_cache.h"
+#include "render_entries.h"
+#include "sdict_file.h"
+#include "ui.h"
+
+namespace
+{
+	// every page is shown this many times
+	constexpr std::size_t num_passes = 5;
+	// stops when scrolling through a page, evenly spaced from the top to the bottom
+	constexpr std::size_t scroll_stops = 10;
+	// size of ui.text_display in a new window, and the size it is resized to and back from
+	constexpr int display_w = 450, display_h = 260;
+	constexpr int resized_w = display_w * 2, resized_h = display_h * 2;
+
+	struct page
+	{
+		std::string word;
+		// as stored, in `encoding`
+		std::vector<std::byte> def;
+		def_encoding::encoding encoding;
+		std::size_t rendered_chars = 0;
+	};
+
+	struct samples
+	{
+		std::vector<std::chrono::nanoseconds> latencies;
+		std::size_t chars = 0;
+	};
+
+	// measure `f` once, adding its latency to `s`
+	template<typename F>
+	void measure(samples& s, F&& f)
+	{
+		const auto start = std::chrono::steady_clock::now();
+		f();
+		s.latencies.push_back(std::chrono::steady_clock::now() - start);
+	}
+
+	void report(bool lazy_wrap, std::string_view phase, std::size_t num_pages, samples& s)
+	{
+		if (s.latencies.empty())
+			{ return; }
+		std::ranges::sort(s.latencies);
+		const auto n = s.latencies.size();
+		const auto percentile = [&](std::size_t p) { return s.latencies[std::min(n - 1, n * p / 100)].count(); };
+		std::cout << std::format(R"({{"bench":"display","lazy_wrap":{},"phase":"{}","pages":{},"samples":{},"avg_chars":{},"p50_ns":{},"p99_ns":{},"max_ns":{}}})",
+			lazy_wrap, phase, num_pages, n, s.chars / n, percentile(50), percentile(99), s.latencies.back().count()) << std::endl;
+	}
+
+	// @return `def` parsed and rendered, or empty if it can't be parsed
+	std::optional<rendered_def> parse_and_render(std::span<const std::byte> def, def_encoding::encoding encoding)
+	{
+		try
+		{
+			std::vector<def_view::word_info> data;
+			def_encoding::parse(encoding, def, data);
+			rendered_def rendered;
+			render_entries(std::span<const def_view::word_info>(data), {}, rendered);
+			return rendered;
+		}
+		catch (const std::exception&)
+		{
+			// links of the page rendered so far
+			links.clear();
+			return {};
+		}
+	}
+
+	// keeps the `n` pages with the most rendered text which it is offered
+	class largest_pages
+	{
+	private:
+		std::size_t n;
+		std::vector<page> pages;
+
+	public:
+		explicit largest_pages(std::size_t n_) : n(n_) {}
+
+		// Complexity: O(def_size + n)
+		void offer(std::string_view word, std::span<const std::byte> def, def_encoding::encoding encoding)
+		{
+			const auto rendered = parse_and_render(def, encoding);
+			if (!rendered)
+				{ return; }
+			const auto smallest = std::ranges::min_element(pages, {}, &page::rendered_chars);
+			if (pages.size() == n && smallest->rendered_chars >= rendered->text.size())
+				{ return; }
+			page p{ std::string(word), std::vector<std::byte>(def.begin(), def.end()), encoding, rendered->text.size() };
+			if (pages.size() < n)
+				{ pages.push_back(std::move(p)); }
+			else
+				{ *smallest = std::move(p); }
+		}
+
+		// @return the pages, largest first
+		std::vector<page> take()
+		{
+			std::ranges::sort(pages, std::ranges::greater(), &page::rendered_chars);
+			return std::move(pages);
+		}
+	};
+
+	std::vector<page> load_pages(const std::filesystem::path& corpus, std::size_t n_pages)
+	{
+		largest_pages largest(n_pages);
+		if (std::filesystem::is_regular_file(corpus))
+		{
+			dictionary_file file;
+			file.open_mapped(corpus.string(), false);
+			const auto encoding = def_encoding::from_id(file.def_encoding());
+			file.for_each_def([&](std::span<const std::byte> def, std::span<const std::string_view> words)
+				{ largest.offer(words.front(), def, encoding); });
+			return largest.take();
+		}
+		for (const auto& entry : std::filesystem::directory_iterator(corpus))
+		{
+			const auto& path = entry.path();
+			if (!entry.is_regular_file() || (path.extension() != ".json" && path.extension() != ".cbor"))
+				{ continue; }
+			std::ifstream fin(path, std::ios::binary);
+			std::string contents((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+			if (!fin && !fin.eof())
+				{ throw std::runtime_error("Unable to read " + path.string()); }
+			std::vector<std::uint8_t> cbor;
+			if (path.extension() == ".json")
+				{ jsoncons::cbor::encode_cbor(jsoncons::json::parse(contents), cbor); }
+			else
+				{ cbor.assign(contents.begin(), contents.end()); }
+			largest.offer(path.stem().string(), std::as_bytes(std::span(cbor)), def_encoding::encoding::cbor);
+		}
+		return largest.take();
+	}
+
+	// draw all of `display` into `surface`, as when it is exposed
+	void draw(Linked_Text_Display& display, Fl_Image_Surface& surface)
+	{
+		Fl_Surface_Device::push_current(&surface);
+		display.damage(FL_DAMAGE_ALL);
+		surface.draw(&display);
+		Fl_Surface_Device::pop_current();
+	}
+
+	void run(const std::vector<page>& pages, bool lazy_wrap)
+	{
+		// set up like FLTK_UI, but never shown
+		Fl_Double_Window window(display_w + 30, display_h + 60);
+		Linked_Text_Display display(15, 45, display_w, display_h);
+		window.end();
+		Fl_Text_Buffer text_buf, style_buf;
+		text_buf.canUndo(0);
+		style_buf.canUndo(0);
+		display.wrap_mode(Fl_Text_Display::WRAP_AT_BOUNDS, 0);
+		display.buffer(text_buf);
+		display.highlight_data(&style_buf, styles.data(), styles.size(), 0, [](int, void*) {}, nullptr);
+		display.lazy_wrap(lazy_wrap);
+		Fl_Image_Surface surface(display_w, display_h), resized_surface(resized_w, resized_h);
+
+		samples parse_samples, fill_samples, draw_samples, scroll_samples, resize_samples, resize_draw_samples, recount_samples;
+		std::string expanded_styles;
+		for (std::size_t pass = 0; pass < num_passes; pass++)
+		{
+			for (const auto& p : pages)
+			{
+				std::optional<rendered_def> rendered;
+				measure(parse_samples, [&]() { rendered = parse_and_render(p.def, p.encoding); });
+				const auto& text = rendered->text;
+				const int n = static_cast<int>(text.size());
+				expanded_styles.resize(text.size());
+				expand_styles(rendered->style, 0, expanded_styles.data());
+
+				// as a definition is shown, after the previous one is cleared
+				text_buf.text("");
+				style_buf.text("");
+				measure(fill_samples, [&]()
+				{
+					text_buf.append(text.data(), n);
+					style_buf.append(expanded_styles.data(), n);
+				});
+				measure(draw_samples, [&]() { draw(display, surface); });
+
+				const int num_lines = display.count_lines(0, n, true);
+				for (std::size_t i = 1; i <= scroll_stops; i++)
+				{
+					measure(scroll_samples, [&]()
+					{
+						display.scroll(static_cast<int>(num_lines * i / scroll_stops), 0);
+						draw(display, surface);
+					});
+				}
+				display.scroll(0, 0);
+
+				for (const auto [w, h, s] : { std::tuple(resized_w, resized_h, &resized_surface), std::tuple(display_w, display_h, &surface) })
+				{
+					measure(resize_samples, [&]() { display.resize(display.x(), display.y(), w, h); });
+					measure(resize_draw_samples, [&]() { draw(display, *s); });
+				}
+				if (lazy_wrap)
+				{
+					// there is no event loop to recount when idle
+					measure(recount_samples, [&]() { display.lazy_wrap(false); });
+					display.lazy_wrap(true);
+				}
+
+				for (auto* s : { &parse_samples, &fill_samples, &draw_samples, &resize_samples, &resize_draw_samples, &recount_samples })
+					{ s->chars += (s == &resize_samples || s == &resize_draw_samples ? 2 : 1) * text.size(); }
+				scroll_samples.chars += scroll_stops * text.size();
+			}
+		}
+		display.buffer(nullptr);
+
+		report(lazy_wrap, "parse_render", pages.size(), parse_samples);
+		report(lazy_wrap, "fill", pages.size(), fill_samples);
+		report(lazy_wrap, "first_draw", pages.size(), draw_samples);
+		report(lazy_wrap, "scroll", pages.size(), scroll_samples);
+		report(lazy_wrap, "resize", pages.size(), resize_samples);
+		report(lazy_wrap, "resize_draw", pages.size(), resize_draw_samples);
+		report(lazy_wrap, "recount", pages.size(), recount_samples);
+	}
+}
+
+// links aren't followed
+void search_word(std::string_view) {}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		std::cerr << "usage: bench_display <file.sdict | corpus_dir> [n_pages]" << std::endl;
+		return 1;
+	}
+	const std::size_t n_pages = (argc > 2 ? std::max<std::size_t>(std::stoull(argv[2]), 1) : 20);
+
+	try
+	{
+		const auto pages = load_pages(argv[1], n_pages);
+		if (pages.empty())
+		{
+			std::cerr << "no definitions in " << argv[1] << std::endl;
+			return 1;
+		}
+		fl_open_display();
+		run(pages, false);
+		run(pages, true);
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+}
@@ -0,0 +1,325 @@
+// replays captured Merriam-Webster API responses through the parsing and rendering paths of search_word
+// usage: bench_parse <corpus_dir> [chunk_sizes...] (default 512 4096 65536)
+// corpus_dir holds responses as *.json (raw API response) or *.cbor (as stored in the offline dictionary)
+// every response goes through both json_coro_cursor, fed in chunks of each chunk size (like an HTTP response),
+// cursor_coro_wrapper<cbor_bytes_cursor>, and cbor_parse::parse (like an offline lookup).
+// begin_parse and rendering with parse_def_text are measured separately, and each result is printed as a line of JSON, e.g.
+// {"bench":"json","phase":"begin_parse","chunk_size":4096,"words":812,"words_per_sec":20512.3,"allocs_per_word":402.1,"bytes_per_word":30822.5,"p50_ns":41210,"p99_ns":190022}
+// "lookup" follows an offline lookup phase by phase: dictionary_file::find_view, cbor_parse::parse, parse_def_text,
+// the rest of rendering, and caching the rendered def (for history) in render_cache.
+// allocations are only reported if built with BENCH_COUNT_ALLOCS (see alloc_counter.h)
+// if built with CO_TRACE, time spent in each coroutine is written to bench_parse.folded (for flamegraph.pl),
+// and summarized on stderr. tracing slows down parsing, so timings of such builds aren't comparable to normal ones
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <jsoncons/json.hpp>
+#include <jsoncons_ext/cbor/cbor.hpp>
+
+#include "alloc_counter.h"
+#include "cbor_parse.h"
+#include "co_util.h"
+#include "json_coro_cursor.h"
+#include "dict_parse.h"
+#include "render_cache.h"
+#include "render_entries.h"
+#include "sdict_file.h"
+
+namespace
+{
+	// every response is replayed this many times
+	constexpr std::size_t num_passes = 5;
+	struct response
+	{
+		std::string json;
+		std::vector<std::uint8_t> cbor;
+	};
+
+	// per response measurements of one phase
+	struct samples
+	{
+		std::vector<std::chrono::nanoseconds> latencies;
+		alloc_counter::counts allocs;
+	};
+
+	// transcode like save_words, so the result has the same layout (e.g. indefinite length containers) as offline defs
+	std::vector<std::uint8_t> to_cbor(std::string_view json)
+	{
+		std::vector<std::uint8_t> cbor;
+		jsoncons::json_string_cursor cursor(json);
+		jsoncons::cbor::cbor_bytes_encoder encoder(cbor);
+		using jsoncons::staj_event_type;
+		for (; !cursor.done(); cursor.next())
+		{
+			const auto& event = cursor.current();
+			switch (event.event_type())
+			{
+				case staj_event_type::begin_array: encoder.begin_array(); break;
+				case staj_event_type::end_array: encoder.end_array(); break;
+				case staj_event_type::begin_object: encoder.begin_object(); break;
+				case staj_event_type::end_object: encoder.end_object(); break;
+				case staj_event_type::key: encoder.key(event.get<jsoncons::string_view>()); break;
+				case staj_event_type::string_value: encoder.string_value(event.get<jsoncons::string_view>()); break;
+				case staj_event_type::null_value: encoder.null_value(); break;
+				case staj_event_type::bool_value: encoder.bool_value(event.get<bool>()); break;
+				case staj_event_type::int64_value: encoder.int64_value(event.get<int64_t>()); break;
+				case staj_event_type::uint64_value: encoder.uint64_value(event.get<uint64_t>()); break;
+				case staj_event_type::double_value: encoder.double_value(event.get<double>()); break;
+				default: break;
+			}
+		}
+		encoder.flush();
+		return cbor;
+	}
+
+	std::vector<response> load_corpus(const std::filesystem::path& dir)
+	{
+		std::vector<response> corpus;
+		for (const auto& entry : std::filesystem::directory_iterator(dir))
+		{
+			const auto& path = entry.path();
+			if (!entry.is_regular_file() || (path.extension() != ".json" && path.extension() != ".cbor"))
+				{ continue; }
+			std::ifstream fin(path, std::ios::binary);
+			std::string contents((std::istreambuf_iterator<char>(fin)), std::istreambuf_iterator<char>());
+			if (!fin && !fin.eof())
+				{ throw std::runtime_error("Unable to read " + path.string()); }
+
+			response res;
+			if (path.extension() == ".json")
+			{
+				res.cbor = to_cbor(contents);
+				res.json = std::move(contents);
+			}
+			else
+			{
+				res.cbor.assign(contents.begin(), contents.end());
+				res.json = jsoncons::cbor::decode_cbor<jsoncons::json>(res.cbor).to_string();
+			}
+			corpus.push_back(std::move(res));
+		}
+		return corpus;
+	}
+
+	// measure `f` once, adding its latency and allocations to `s`
+	// @param new_sample  whether this is a separate sample, otherwise it is added to the last sample of `s`
+	template<typename F>
+	void measure(samples& s, F&& f, bool new_sample = true)
+	{
+		const auto allocs_start = alloc_counter::now();
+		const auto start = std::chrono::steady_clock::now();
+		f();
+		const auto elapsed = std::chrono::steady_clock::now() - start;
+		s.allocs += alloc_counter::now() - allocs_start;
+		if (new_sample || s.latencies.empty())
+			{ s.latencies.push_back(elapsed); }
+		else
+			{ s.latencies.back() += elapsed; }
+	}
+
+	// remove the latency and allocations of the last sample of `part` from the last sample of `s`, which includes it
+	void exclude(samples& s, const samples& part, const alloc_counter::counts& part_allocs)
+	{
+		s.latencies.back() -= part.latencies.back();
+		s.allocs -= part_allocs;
+	}
+
+	void report(std::string_view bench, std::string_view phase, std::size_t chunk_size, samples& s)
+	{
+		if (s.latencies.empty())
+			{ return; }
+		std::ranges::sort(s.latencies);
+		std::chrono::nanoseconds total{};
+		for (const auto l : s.latencies)
+			{ total += l; }
+		const auto n = s.latencies.size();
+		const auto percentile = [&](std::size_t p) { return s.latencies[std::min(n - 1, n * p / 100)].count(); };
+		// allocations are only known if they are counted
+		const std::string allocs = (alloc_counter::enabled ? std::format(R"(,"allocs_per_word":{:.1f},"bytes_per_word":{:.1f})",
+			static_cast<double>(s.allocs.allocs) / static_cast<double>(n), static_cast<double>(s.allocs.bytes) / static_cast<double>(n)) : "");
+		std::cout << std::format(R"({{"bench":"{}","phase":"{}","chunk_size":{},"words":{},"words_per_sec":{:.1f}{},"p50_ns":{},"p99_ns":{}}})",
+			bench, phase, chunk_size, n, static_cast<double>(n) * 1e9 / static_cast<double>(std::max<std::int64_t>(total.count(), 1)),
+			allocs, percentile(50), percentile(99)) << std::endl;
+	}
+
+	void run_json(const std::vector<response>& corpus, std::size_t chunk_size)
+	{
+		samples parse_samples, render_samples;
+		for (std::size_t pass = 0; pass < num_passes; pass++)
+		{
+			for (const auto& res : corpus)
+			{
+				std::vector<word_info> data;
+				measure(parse_samples, [&]()
+				{
+					json_coro_cursor cursor;
+					task<void> parse_task = CO_TRACED("begin_parse", begin_parse(cursor, data));
+					for (std::size_t i = 0; i < res.json.size(); i += chunk_size)
+						{ parse_task.add_data(std::string_view(res.json).substr(i, chunk_size)); }
+				});
+				rendered_def rendered;
+				measure(render_samples, [&]() { render_entries(std::span(std::as_const(data)), {}, rendered); });
+			}
+		}
+		report("json", "begin_parse", chunk_size, parse_samples);
+		report("json", "parse_def_text", chunk_size, render_samples);
+	}
+
+	void run_cbor(const std::vector<response>& corpus)
+	{
+		samples parse_samples, render_samples;
+		for (std::size_t pass = 0; pass < num_passes; pass++)
+		{
+			for (const auto& res : corpus)
+			{
+				std::vector<word_info> data;
+				measure(parse_samples, [&]()
+				{
+					auto cursor = cursor_coro_wrapper<jsoncons::cbor::cbor_bytes_cursor>(std::span(res.cbor));
+					task<void> parse_task = CO_TRACED("begin_parse", begin_parse(cursor, data));
+					parse_task.rethrow_if_failed();
+					if (!parse_task.coro_handle.done())
+						{ throw std::runtime_error("CBOR parsing did not finish"); }
+				});
+				rendered_def rendered;
+				measure(render_samples, [&]() { render_entries(std::span(std::as_const(data)), {}, rendered); });
+			}
+		}
+		report("cbor", "begin_parse", 0, parse_samples);
+		report("cbor", "parse_def_text", 0, render_samples);
+	}
+
+	// an offline lookup in search_word, through each phase up to caching the rendered def for history
+	// the corpus is stored in a temporary sdict file, which is read through the mapping like the offline dictionary
+	void run_lookup(const std::vector<response>& corpus)
+	{
+		constexpr std::string_view filename = "bench_parse.sdict";
+		if (std::filesystem::exists(filename))
+			{ std::filesystem::remove(filename); }
+		{
+			dictionary_file file(filename);
+			for (const auto [i, res] : std::views::enumerate(corpus))
+				{ file.add_word<false, true>(std::to_string(i), std::as_bytes(std::span(res.cbor))); }
+			file.flush();
+		}
+		dictionary_file dict;
+		dict.open_mapped(filename);
+		render_cache cache;
+
+		samples find_samples, parse_samples, text_samples, render_samples, cache_samples;
+		for (std::size_t pass = 0; pass < num_passes; pass++)
+		{
+			for (std::size_t i = 0; i < corpus.size(); i++)
+			{
+				const auto word = std::to_string(i);
+				// copied, since find_view() may return a buffer which is reused by the next lookup.
+				// the copy and entries are allocated from an arena, as in background_lookup::offline_def
+				std::unique_ptr<std::pmr::monotonic_buffer_resource> arena;
+				std::optional<std::pmr::vector<std::byte>> def;
+				measure(find_samples, [&]()
+				{
+					const auto view = dict.find_view(word);
+					arena = std::make_unique<std::pmr::monotonic_buffer_resource>(def_arena::initial_size(view->size()));
+					def.emplace(view->begin(), view->end(), arena.get());
+				});
+				std::pmr::vector<def_arena::word_info> data(arena.get());
+				measure(parse_samples, [&]() { cbor_parse::parse(std::span<const std::byte>(def.value()), data); });
+
+				// parse_def_text is measured within rendering, and excluded from it
+				rendered_def rendered;
+				text_samples.latencies.emplace_back();
+				const auto text_allocs_start = text_samples.allocs;
+				measure(render_samples, [&]()
+				{
+					render_entries(std::span(std::as_const(data)), {}, rendered, false, [&text_samples](const auto& parse_text)
+						{ measure(text_samples, parse_text, false); });
+				});
+				exclude(render_samples, text_samples, text_samples.allocs - text_allocs_start);
+
+				measure(cache_samples, [&]() { cache.add(word, std::make_shared<const rendered_def>(std::move(rendered)), false); });
+			}
+		}
+		report("lookup", "find", 0, find_samples);
+		report("lookup", "parse", 0, parse_samples);
+		report("lookup", "parse_def_text", 0, text_samples);
+		report("lookup", "render", 0, render_samples);
+		report("lookup", "render_cache", 0, cache_samples);
+
+		dict.close();
+		std::filesystem::remove(filename);
+	}
+
+	void run_cbor_direct(const std::vector<response>& corpus)
+	{
+		samples parse_samples, render_samples;
+		for (std::size_t pass = 0; pass < num_passes; pass++)
+		{
+			for (const auto& res : corpus)
+			{
+				// strings point into res.cbor, as in search_word
+				std::vector<def_view::word_info> data;
+				measure(parse_samples, [&]() { cbor_parse::parse(std::as_bytes(std::span(res.cbor)), data); });
+				rendered_def rendered;
+				measure(render_samples, [&]() { render_entries(std::span(std::as_const(data)), {}, rendered); });
+			}
+		}
+		report("cbor_direct", "parse", 0, parse_samples);
+		report("cbor_direct", "parse_def_text", 0, render_samples);
+	}
+}
+
+int main(int argc, char** argv)
+{
+	if (argc < 2)
+	{
+		std::cerr << "usage: bench_parse <corpus_dir> [chunk_sizes...]" << std::endl;
+		return 1;
+	}
+	std::vector<std::size_t> chunk_sizes;
+	for (int i = 2; i < argc; i++)
+		{ chunk_sizes.push_back(std::max<std::size_t>(std::stoull(argv[i]), 1)); }
+	if (chunk_sizes.empty())
+		{ chunk_sizes = { 512, 4096, 65536 }; }
+
+	try
+	{
+		const auto corpus = load_corpus(argv[1]);
+		if (corpus.empty())
+		{
+			std::cerr << "no *.json or *.cbor files in " << argv[1] << std::endl;
+			return 1;
+		}
+		for (const auto chunk_size : chunk_sizes)
+			{ run_json(corpus, chunk_size); }
+		run_cbor(corpus);
+		run_cbor_direct(corpus);
+		run_lookup(corpus);
+#ifdef CO_TRACE
+		std::ofstream fout("bench_parse.folded");
+		detail::co_trace::dump_folded(fout);
+		detail::co_trace::dump_summary(std::cerr);
+#endif
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+}
@@ -0,0 +1,255 @@
+// microbenchmarks for dictionary_file over synthetic dictionaries
+// usage: bench_sdict [n_words...] (default 10000 100000 1000000)
+// each result is printed as a line of JSON, e.g.
+// {"bench":"find_hit","words":10000,"ops":100000,"ns_per_op":151.2}
+// allocations per op are also reported if built with BENCH_COUNT_ALLOCS (see alloc_counter.h)
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+#include "alloc_counter.h"
+#include "sdict_file.h"
+
+namespace
+{
+	constexpr std::string_view filename = "bench.sdict";
+	// copy of `filename` without its extensions, so its defs aren't marked as verified (see unverified_copy())
+	constexpr std::string_view unverified_filename = "bench_unverified.sdict";
+	constexpr std::size_t num_lookups = 100000;
+	// words added one at a time with add_word() and flush()
+	constexpr std::size_t num_single_adds = 256;
+	// fraction of defs which repeat an earlier def (e.g. cross-reference only entries), for deduplication
+	constexpr double dup_fraction = 0.1;
+	constexpr std::size_t gen_batch_size = 4096;
+
+	std::mt19937_64 rng(42);
+
+	// lowercase word, length roughly normally distributed around 8
+	std::string random_word()
+	{
+		std::normal_distribution<double> len_dist(8, 3);
+		std::uniform_int_distribution<int> char_dist('a', 'z');
+		const auto len = static_cast<std::size_t>(std::clamp(std::lround(len_dist(rng)), 1l, 24l));
+		std::string word(len, '\0');
+		for (auto& c : word)
+			{ c = static_cast<char>(char_dist(rng)); }
+		return word;
+	}
+
+	// def sizes are log-normally distributed (median 400 bytes), like CBOR encoded API responses
+	std::vector<std::byte> random_def()
+	{
+		std::lognormal_distribution<double> size_dist(std::log(400.0), 1.0);
+		std::uniform_int_distribution<int> byte_dist(0, 255);
+		const auto size = static_cast<std::size_t>(std::clamp(size_dist(rng), 16.0, 256.0 * 1024));
+		std::vector<std::byte> def(size);
+		for (auto& b : def)
+			{ b = static_cast<std::byte>(byte_dist(rng)); }
+		return def;
+	}
+
+	// @return unique random words
+	std::vector<std::string> random_words(std::size_t n, const std::unordered_set<std::string>& exclude = {})
+	{
+		std::unordered_set<std::string> seen;
+		std::vector<std::string> words;
+		words.reserve(n);
+		while (words.size() < n)
+		{
+			auto word = random_word();
+			if (!exclude.contains(word) && seen.insert(word).second)
+				{ words.push_back(std::move(word)); }
+		}
+		return words;
+	}
+
+	struct measurement
+	{
+		std::chrono::nanoseconds elapsed;
+		alloc_counter::counts allocs;
+	};
+
+	void report(std::string_view bench, std::size_t n_words, std::size_t ops, const measurement& m, std::string_view extra = "")
+	{
+		const double n = static_cast<double>(std::max<std::size_t>(ops, 1));
+		// allocations are only known if they are counted
+		const std::string allocs = (alloc_counter::enabled ? std::format(R"(,"allocs_per_op":{:.1f},"bytes_per_op":{:.1f})",
+			static_cast<double>(m.allocs.allocs) / n, static_cast<double>(m.allocs.bytes) / n) : "");
+		std::cout << std::format(R"({{"bench":"{}","words":{},"ops":{},"ns_per_op":{:.1f}{}{}}})", bench, n_words, ops,
+			static_cast<double>(m.elapsed.count()) / n, allocs, extra) << std::endl;
+	}
+
+	template<typename F>
+	measurement time(F&& f)
+	{
+		const auto allocs_start = alloc_counter::now();
+		const auto start = std::chrono::steady_clock::now();
+		f();
+		const auto elapsed = std::chrono::steady_clock::now() - start;
+		return { elapsed, alloc_counter::now() - allocs_start };
+	}
+
+	// create `filename` with `words`, and report build time
+	void build(const std::vector<std::string>& words, bool deduplicate)
+	{
+		if (std::filesystem::exists(filename))
+			{ std::filesystem::remove(filename); }
+		std::mt19937_64 def_rng(7);
+		std::bernoulli_distribution dup_dist(dup_fraction);
+		// recent defs, which are repeated with probability dup_fraction
+		std::vector<std::vector<std::byte>> recent_defs;
+		const auto elapsed = time([&]()
+		{
+			dictionary_file file(filename, true, deduplicate, false);
+			std::vector<std::pair<std::string_view, std::vector<std::byte>>> batch;
+			for (std::size_t i = 0; i < words.size(); i += gen_batch_size)
+			{
+				batch.clear();
+				for (std::size_t j = i; j < std::min(i + gen_batch_size, words.size()); j++)
+				{
+					if (!recent_defs.empty() && dup_dist(def_rng))
+						{ batch.emplace_back(words[j], recent_defs[def_rng() % recent_defs.size()]); }
+					else
+					{
+						batch.emplace_back(words[j], random_def());
+						if (recent_defs.size() < 256)
+							{ recent_defs.push_back(batch.back().second); }
+						else
+							{ recent_defs[def_rng() % recent_defs.size()] = batch.back().second; }
+					}
+				}
+				file.add_words<false, true>(batch);
+			}
+			file.flush();
+		});
+		report(deduplicate ? "build_dedup" : "build", words.size(), words.size(), elapsed,
+			std::format(R"(,"file_size":{})", std::filesystem::file_size(filename)));
+	}
+
+	// copy `filename` to `unverified_filename`, dropping its extension table like a file from before the metadata checksum extension.
+	// defs of files written by dictionary_file are marked as verified, and so only verified on open without the mark
+	void unverified_copy()
+	{
+		std::filesystem::copy_file(filename, unverified_filename, std::filesystem::copy_options::overwrite_existing);
+		std::fstream f{std::string(unverified_filename), std::ios::in | std::ios::out | std::ios::binary};
+		f.seekp(23, std::ios::beg); // ExtInd
+		const char zero[4]{};
+		f.write(zero, sizeof(zero));
+		if (!f)
+			{ throw std::runtime_error("Could not write " + std::string(unverified_filename)); }
+	}
+
+	void run(std::size_t n_words)
+	{
+		const auto words = random_words(n_words);
+		build(words, false);
+		build(words, true);
+
+		unverified_copy();
+		for (const bool check_defs : { false, true })
+		{
+			// check_defs is skipped for files whose defs are marked as verified, as written by build(), so the copy is verified instead
+			const std::string_view open_filename = (check_defs ? unverified_filename : filename);
+			const auto extra = std::format(R"(,"check_defs":{})", check_defs);
+			report("open", n_words, 1, time([&]() { dictionary_file file(open_filename, false, false, check_defs); }), extra);
+			report("open_dedup", n_words, 1, time([&]() { dictionary_file file(open_filename, false, true, check_defs); }), extra);
+			report("open_mapped", n_words, 1, time([&]() { dictionary_file file; file.open_mapped(open_filename, check_defs); }), extra);
+		}
+		std::filesystem::remove(unverified_filename);
+
+		std::vector<std::string_view> hits;
+		hits.reserve(num_lookups);
+		for (std::size_t i = 0; i < num_lookups; i++)
+			{ hits.push_back(words[rng() % words.size()]); }
+		const std::unordered_set<std::string> word_set(words.begin(), words.end());
+		const auto misses = random_words(num_lookups, word_set);
+
+		// sum of def sizes, so lookups can't be optimized out
+		std::size_t total_size = 0;
+		{
+			const dictionary_file file(filename, false, false, false);
+			report("find_hit", n_words, hits.size(), time([&]()
+			{
+				for (const auto word : hits)
+					{ total_size += file.find(word)->size(); }
+			}));
+			report("find_miss", n_words, misses.size(), time([&]()
+			{
+				for (const auto& word : misses)
+					{ total_size += file.find(word).has_value(); }
+			}));
+			report("contains_miss", n_words, misses.size(), time([&]()
+			{
+				for (const auto& word : misses)
+					{ total_size += file.contains(word); }
+			}));
+		}
+		{
+			dictionary_file file;
+			file.open_mapped(filename, false);
+			report("find_view_hit", n_words, hits.size(), time([&]()
+			{
+				for (const auto word : hits)
+					{ total_size += file.find_view(word)->size(); }
+			}));
+			report("find_view_miss", n_words, misses.size(), time([&]()
+			{
+				for (const auto& word : misses)
+					{ total_size += file.find_view(word).has_value(); }
+			}));
+		}
+
+		{
+			dictionary_file file(filename, false, true, false);
+			const auto new_words = random_words(num_single_adds, word_set);
+			std::vector<std::vector<std::byte>> new_defs;
+			for (std::size_t i = 0; i < new_words.size(); i++)
+				{ new_defs.push_back(random_def()); }
+			// new words are written in place while they fit, then as word segments
+			report("add_word_flush", n_words, new_words.size(), time([&]()
+			{
+				for (std::size_t i = 0; i < new_words.size(); i++)
+					{ file.add_word(new_words[i], new_defs[i]); }
+			}));
+			report("rewrite", n_words, 1, time([&]() { file.compact(); }));
+		}
+
+		std::filesystem::remove(filename);
+		if (total_size == 0)
+			{ std::cerr << "no defs found" << std::endl; }
+	}
+}
+
+int main(int argc, char** argv)
+{
+	std::vector<std::size_t> sizes;
+	for (int i = 1; i < argc; i++)
+		{ sizes.push_back(std::stoull(argv[i])); }
+	if (sizes.empty())
+		{ sizes = { 10000, 100000, 1000000 }; }
+
+	try
+	{
+		for (const auto n : sizes)
+			{ run(n); }
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+}
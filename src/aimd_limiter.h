@@ -0,0 +1,136 @@
+#ifndef AIMD_LIMITER_H
+#define AIMD_LIMITER_H
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <stdexcept>
+
+// limits the number of concurrent requests, adapting the limit to how the server responds (like TCP congestion control).
+// the limit increases by about 1 for each limit requests which succeed quickly (additive increase),
+// and halves when a request is throttled or latency grows well beyond the lowest seen (multiplicative decrease)
+class aimd_limiter
+{
+public:
+	using clock = std::chrono::steady_clock;
+
+private:
+	mutable std::mutex m;
+	std::condition_variable cv;
+	double current_limit;
+	const double min_limit, max_limit;
+	std::size_t active = 0;
+
+	// lowest latency seen, taken as the latency of an unloaded server
+	clock::duration min_latency = clock::duration::max();
+	// exponentially weighted moving average of latency
+	double avg_latency = 0;
+	clock::time_point last_decrease{};
+
+	// latency is too high once it is this many times min_latency
+	constexpr static double latency_tolerance = 2.0;
+	constexpr static double latency_weight = 0.1;
+
+	void decrease(clock::time_point now)
+	{
+		// requests which fail together (within about one round trip) only count once, like TCP
+		if (min_latency != clock::duration::max() && now - last_decrease < min_latency)
+			{ return; }
+		last_decrease = now;
+		// latency from before the decrease shouldn't cause another
+		avg_latency = 0;
+		current_limit = std::max(current_limit / 2, min_limit);
+	}
+
+public:
+	// @param initial  limit to start with
+	// @param min, max  range of the limit
+	// @throws std::invalid_argument  if initial is not within [min, max], or min is less than 1
+	aimd_limiter(std::size_t initial, std::size_t min, std::size_t max) :
+		current_limit(static_cast<double>(initial)), min_limit(static_cast<double>(min)), max_limit(static_cast<double>(max))
+	{
+		if (min < 1 || initial < min || initial > max)
+			{ throw std::invalid_argument("Limit must be within [min, max], and min must be at least 1"); }
+	}
+
+	aimd_limiter(const aimd_limiter&) = delete;
+	aimd_limiter& operator=(const aimd_limiter&) = delete;
+
+	// wait until another request may be started
+	// Complexity: O(1)
+	void acquire()
+	{
+		std::unique_lock lock(m);
+		cv.wait(lock, [this]() { return static_cast<double>(active) < current_limit; });
+		active++;
+	}
+
+	// start a request if the limit allows it, without waiting
+	// Complexity: O(1)
+	// @return whether the request may be started, in which case it must be finished with release() or cancel()
+	bool try_acquire()
+	{
+		std::lock_guard lock(m);
+		if (static_cast<double>(active) >= current_limit)
+			{ return false; }
+		active++;
+		return true;
+	}
+
+	// finish a request which was started with acquire(), but didn't complete (e.g. it will be sent again), without changing the limit
+	// Complexity: O(1)
+	void cancel()
+	{
+		{
+			std::lock_guard lock(m);
+			active--;
+		}
+		cv.notify_one();
+	}
+
+	// finish a request which was started with acquire()
+	// Complexity: O(1)
+	// @param latency  time taken by the request
+	// @param throttled  whether the request failed in a way which suggests the server is overloaded (e.g. 429 or 5xx)
+	void release(clock::duration latency, bool throttled)
+	{
+		{
+			std::lock_guard lock(m);
+			active--;
+			const auto now = clock::now();
+			if (throttled)
+				{ decrease(now); }
+			else
+			{
+				min_latency = std::min(min_latency, latency);
+				const double l = std::chrono::duration<double>(latency).count();
+				avg_latency = (avg_latency == 0 ? l : avg_latency + latency_weight * (l - avg_latency));
+				if (avg_latency > latency_tolerance * std::chrono::duration<double>(min_latency).count())
+					{ decrease(now); }
+				else
+					{ current_limit = std::min(current_limit + 1 / current_limit, max_limit); }
+			}
+		}
+		cv.notify_all();
+	}
+
+	// Complexity: O(1)
+	// @return number of requests started and not yet finished
+	std::size_t active_count() const
+	{
+		std::lock_guard lock(m);
+		return active;
+	}
+
+	// Complexity: O(1)
+	// @return the current limit, rounded down
+	std::size_t limit() const
+	{
+		std::lock_guard lock(m);
+		return static_cast<std::size_t>(current_limit);
+	}
+};
+
+#endif
@@ -0,0 +1,205 @@
+#ifndef ASYNC_READER_H
+#define ASYNC_READER_H
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <mutex>
+#include <optional>
+#include <ranges>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include "sdict_file.h"
+
+// asynchronous definition reads from a dictionary_file, through a pool of threads calling find() concurrently
+// (positioned reads, or page faults on the mapping), so many reads can be in flight at once.
+// reads are submitted with submit(), and complete out of order into a completion queue drained with pop() / try_pop()
+// no non-const member function of the file may be called while reads are in flight
+class async_reader
+{
+public:
+	struct completion
+	{
+		// value passed to submit()
+		std::uint64_t user_data;
+		std::string word;
+		// empty if the word was not found or there was an error
+		std::optional<std::vector<char>> def;
+		// set if find() threw
+		std::exception_ptr error;
+	};
+
+	// number of worker threads (i.e. maximum reads in flight) if not specified
+	constexpr static std::size_t default_queue_depth = 16;
+
+private:
+	struct request
+	{
+		std::uint64_t user_data;
+		std::string word;
+		bool check_def;
+	};
+
+	const dictionary_file& file;
+
+	std::mutex mutex;
+	// notified when a request is queued or on shutdown
+	std::condition_variable request_cv;
+	// notified when a completion is queued, or queued requests are cancelled
+	std::condition_variable completion_cv;
+	std::deque<request> requests;
+	std::deque<completion> completions;
+	// number of requests which have been submitted but have not completed
+	std::size_t num_in_flight = 0;
+	bool stopping = false;
+
+	std::vector<std::jthread> workers;
+
+	void worker()
+	{
+		while (true)
+		{
+			request req;
+			{
+				std::unique_lock lock(mutex);
+				request_cv.wait(lock, [this]() { return stopping || !requests.empty(); });
+				if (stopping)
+					{ return; }
+				req = std::move(requests.front());
+				requests.pop_front();
+			}
+
+			completion res{ req.user_data, std::move(req.word), {}, {} };
+			try
+				{ res.def = file.find(res.word, req.check_def); }
+			catch (...)
+				{ res.error = std::current_exception(); }
+
+			{
+				std::lock_guard lock(mutex);
+				completions.push_back(std::move(res));
+			}
+			completion_cv.notify_one();
+		}
+	}
+
+public:
+	// @param file_  file to read from, which must outlive this object
+	// @param queue_depth  number of worker threads
+	explicit async_reader(const dictionary_file& file_, std::size_t queue_depth = default_queue_depth) : file(file_)
+	{
+		queue_depth = std::max<std::size_t>(queue_depth, 1);
+		workers.reserve(queue_depth);
+		for (std::size_t i = 0; i < queue_depth; i++)
+			{ workers.emplace_back([this]() { worker(); }); }
+	}
+
+	async_reader(const async_reader&) = delete;
+	async_reader& operator=(const async_reader&) = delete;
+
+	// reads which have not started are dropped, and reads in progress are waited for
+	~async_reader()
+	{
+		{
+			std::lock_guard lock(mutex);
+			stopping = true;
+		}
+		request_cv.notify_all();
+		workers.clear();
+	}
+
+	// queue a read of the definition of `word` (see dictionary_file::find())
+	// Complexity: O(1)
+	// File Access: No (Read on a worker thread)
+	// @param user_data  value returned in the completion, e.g. to identify the request
+	void submit(std::string word, std::uint64_t user_data = 0, bool check_def = false)
+	{
+		{
+			std::lock_guard lock(mutex);
+			requests.emplace_back(user_data, std::move(word), check_def);
+			num_in_flight++;
+		}
+		request_cv.notify_one();
+	}
+
+	// queue reads of all words in `words`, with user_data set to their index in `words`
+	// Complexity: O(n_words)
+	// File Access: No (Read on worker threads)
+	// @param words  range of words (convertible to std::string_view)
+	template<std::ranges::input_range R>
+	void submit_all(R&& words, bool check_def = false)
+	{
+		{
+			std::lock_guard lock(mutex);
+			std::uint64_t ind = 0;
+			for (auto&& word : words)
+			{
+				requests.emplace_back(ind++, std::string(std::string_view(word)), check_def);
+				num_in_flight++;
+			}
+		}
+		request_cv.notify_all();
+	}
+
+	// drop reads which have not started yet. they will not produce completions
+	// Complexity: O(n_queued)
+	// @return number of dropped reads
+	std::size_t cancel_queued()
+	{
+		std::size_t num_dropped;
+		{
+			std::lock_guard lock(mutex);
+			num_dropped = requests.size();
+			num_in_flight -= num_dropped;
+			requests.clear();
+		}
+		// wake pop() if nothing is left in flight
+		completion_cv.notify_all();
+		return num_dropped;
+	}
+
+	// Complexity: O(1)
+	// @return next completion, or empty if none is available right now
+	std::optional<completion> try_pop()
+	{
+		std::lock_guard lock(mutex);
+		if (completions.empty())
+			{ return {}; }
+		completion res = std::move(completions.front());
+		completions.pop_front();
+		num_in_flight--;
+		return res;
+	}
+
+	// wait for the next completion
+	// Complexity: O(1), plus time blocked
+	// @return next completion, or empty if there are no reads in flight
+	std::optional<completion> pop()
+	{
+		std::unique_lock lock(mutex);
+		completion_cv.wait(lock, [this]() { return !completions.empty() || num_in_flight == 0; });
+		if (completions.empty())
+			{ return {}; }
+		completion res = std::move(completions.front());
+		completions.pop_front();
+		num_in_flight--;
+		return res;
+	}
+
+	// Complexity: O(1)
+	// @return number of submitted reads whose completion has not been popped
+	std::size_t in_flight()
+	{
+		std::lock_guard lock(mutex);
+		return num_in_flight;
+	}
+};
+
+#endif
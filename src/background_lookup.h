@@ -0,0 +1,718 @@
+#ifndef BACKGROUND_LOOKUP_H
+#define BACKGROUND_LOOKUP_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <fmt/ranges.h>
+
+#include "co_util.h"
+#include "dict_def.h"
+#include "dict_parse.h"
+#include "json_coro_cursor.h"
+#include "render_cache.h"
+
+// lookups on a background thread, so that the UI thread never waits for file i/o, the network or parsing.
+// a word is first looked up offline, and otherwise fetched online. online entries are handed over as soon as they have been parsed,
+// while the rest of the response is still downloading, so that they can be rendered during the transfer.
+// only the latest lookup is processed: starting a lookup supersedes the previous one, which stops being fetched and parsed.
+// words can also be prefetched at low priority: one at a time, only while there is no lookup, and within a byte budget.
+// a lookup of the word which is being prefetched takes over the prefetch instead of starting again.
+// other sources (e.g. other references) can be looked up along with every lookup and prefetch, each on its own thread.
+// their results are sent with the last update, and a source which misses its deadline is given up on.
+// complete definitions (offline ones and prefetches) can also be rendered on the lookup thread, so that the UI thread only swaps them in.
+// words found offline can be revalidated after being shown: fetched again when there is nothing else to do, and sent again if they changed
+class background_lookup
+{
+public:
+	// offline definition, parsed on the lookup thread.
+	// the copy of the definition and its entries are allocated from an arena of their own, which is usually allocated once,
+	// instead of allocating for every entry. it is freed along with them, once the definition has been shown (or superseded)
+	struct offline_def
+	{
+		// declared first, so that it outlives what is allocated from it
+		std::unique_ptr<std::pmr::monotonic_buffer_resource> arena;
+		// copy of the stored definition, which entries point into
+		std::pmr::vector<std::byte> def;
+		std::pmr::vector<def_arena::word_info> entries;
+
+		// copy `def_`, without parsing it
+		explicit offline_def(std::span<const std::byte> def_) :
+			arena(std::make_unique<std::pmr::monotonic_buffer_resource>(def_arena::initial_size(def_.size()))),
+			def(def_.begin(), def_.end(), arena.get()), entries(arena.get()) {}
+		offline_def(offline_def&&) noexcept = default;
+		// vectors can't take over the buffers of ones from another arena, so `other` is moved in whole
+		offline_def& operator=(offline_def&& other) noexcept
+		{
+			if (this != &other)
+			{
+				std::destroy_at(this);
+				std::construct_at(this, std::move(other));
+			}
+			return *this;
+		}
+	};
+
+	// definition of a word from another source (see source)
+	struct source_result
+	{
+		// index of the source, as passed to the constructor
+		std::size_t source;
+		// entries fetched online, or empty if the word wasn't found
+		std::vector<word_info> entries;
+		// set instead of entries if the word was found offline
+		std::optional<offline_def> offline;
+		// set if the lookup failed or missed the deadline
+		std::string error;
+	};
+
+	// progress of a lookup, returned by poll()
+	struct update
+	{
+		// value returned by start()
+		std::uint64_t id;
+		// online entries which have been completed since the last update
+		std::vector<word_info> entries;
+		// set instead of entries if the word was found offline, in which case finished is also set
+		std::optional<offline_def> offline;
+		// whether this is the last update of the lookup
+		bool finished = false;
+		// set if the lookup failed, in which case finished is also set
+		std::string error;
+		// set for (successful) prefetches, which are not part of any lookup. finished is also set
+		std::string prefetch_word;
+		// results of the other sources, in order, if finished is set
+		std::vector<source_result> sources;
+		// the whole definition, with the results of sources, rendered on the lookup thread (see render_function).
+		// set for offline definitions and prefetches which didn't fail, if there is a render function
+		std::shared_ptr<const rendered_def> rendered;
+		// set for definitions which changed when they were revalidated (see revalidate()), which are not part of any lookup.
+		// finished and offline are also set, and sources are empty
+		std::string revalidated_word;
+	};
+
+	// looks up a word offline. called on the lookup thread
+	// @throws std::runtime_error  on error, which fails the lookup
+	// @return definition, or empty to fetch the word online instead
+	using find_function = std::function<std::optional<offline_def>(std::string_view word)>;
+
+	// receives the response body in chunks. returns false to stop the transfer
+	using receiver = std::function<bool(const char* data, std::size_t data_len)>;
+	// fetches the definition of a word, passing the response body to the receiver. called on the lookup thread
+	// @return error message, or empty on success
+	using fetch_function = std::function<std::string(std::string_view word, const receiver&)>;
+
+	// renders the definition of a finished update, along with its sources, e.g. as shown by the UI. called on the lookup thread
+	// @param word  looked up word, which is also prefetch_word for prefetches
+	using render_function = std::function<rendered_def(const update& u, std::string_view word)>;
+
+	// fetches the definition of a word found offline again, and stores it if it changed, so that it is found offline from then on.
+	// called on the lookup thread
+	// @param stopped  returns whether to stop fetching, once a lookup has been started
+	// @return whether the definition changed and was stored, or empty if it was stopped
+	using revalidate_function = std::function<std::optional<bool>(std::string_view word, const std::function<bool()>& stopped)>;
+
+	// another source which every word is also looked up in. its functions are called on a thread of its own,
+	// and may be called concurrently (by a lookup which missed its deadline and the next one)
+	struct source
+	{
+		// e.g. the name of the reference, for showing results
+		std::string name;
+		// either may be empty, as for the main source
+		find_function find;
+		fetch_function fetch;
+		// from the start of the lookup. a slow source delays finishing the lookup by at most this, and not its other updates
+		std::chrono::milliseconds deadline;
+	};
+
+	// how often waiting for sources checks whether the lookup has been superseded
+	constexpr static auto source_poll_interval = std::chrono::milliseconds(10);
+
+	// how long the lookup thread waits while idle before calling keep_warm again
+	constexpr static auto keep_warm_interval = std::chrono::seconds(30);
+	// keep_warm is no longer called once there hasn't been a lookup for this long
+	constexpr static auto keep_warm_duration = std::chrono::minutes(10);
+
+private:
+	// either may be empty, to only look up offline or online
+	find_function find;
+	fetch_function fetch;
+	// called on the lookup thread whenever an update is queued
+	std::function<void()> notify;
+	// called on the lookup thread at startup and periodically while idle, e.g. to keep a connection open. may be empty
+	std::function<void()> keep_warm;
+	// may be empty, to leave rendering to the UI thread
+	render_function render;
+	// may be empty, if words are never revalidated
+	revalidate_function revalidator;
+
+	std::mutex mutex;
+	// notified when a lookup is started or on shutdown
+	std::condition_variable request_cv;
+	// word of the lookup which hasn't been started by the lookup thread
+	std::optional<std::string> next_word;
+	// words to prefetch, in order
+	std::deque<std::string> prefetch_words;
+	// bytes which may still be fetched online for prefetch_words
+	std::size_t prefetch_budget = 0;
+	// incremented whenever prefetch_words is replaced. prefetches of previous generations are stopped
+	std::atomic<std::uint64_t> prefetch_generation = 0;
+	// word which is being prefetched by the lookup thread
+	std::optional<std::string> prefetching;
+	// id of the lookup which took over the prefetch in progress, or 0 if none
+	std::atomic<std::uint64_t> prefetch_lookup_id = 0;
+	// words to revalidate once there are no lookups or prefetches, in order
+	std::deque<std::string> revalidate_words;
+	std::deque<update> updates;
+	// id of the latest lookup. all others are superseded
+	std::atomic<std::uint64_t> latest_id = 0;
+	std::atomic<bool> stopping = false;
+
+	std::vector<source> sources;
+	// lookup of a word in one source, on its own thread, which outlives the lookup if it misses the deadline
+	struct source_lookup
+	{
+		std::mutex mutex;
+		std::condition_variable done_cv;
+		std::optional<source_result> result;
+		// set once the result is no longer wanted, which stops fetching at the next chunk
+		std::atomic<bool> abandoned = false;
+		// set once the thread is about to return
+		std::atomic<bool> finished = false;
+	};
+	// lookups of a word in every source
+	struct source_lookups
+	{
+		std::chrono::steady_clock::time_point start;
+		std::vector<std::shared_ptr<source_lookup>> lookups;
+	};
+	// threads of source lookups which may still be running. only used by the lookup thread (and the destructor)
+	std::vector<std::pair<std::shared_ptr<source_lookup>, std::jthread>> source_threads;
+
+	std::jthread thread;
+
+	bool superseded(std::uint64_t id) const noexcept
+	{
+		return stopping.load(std::memory_order_relaxed) || latest_id.load(std::memory_order_relaxed) != id;
+	}
+
+	// a prefetch is still wanted as long as the lookup that took it over is
+	bool prefetch_superseded(std::uint64_t id, std::uint64_t generation) const noexcept
+	{
+		if (const auto lookup_id = prefetch_lookup_id.load(std::memory_order_relaxed); lookup_id != 0)
+			{ return superseded(lookup_id); }
+		return superseded(id) || prefetch_generation.load(std::memory_order_relaxed) != generation;
+	}
+
+	void send(update u)
+	{
+		{
+			std::lock_guard lock(mutex);
+			updates.push_back(std::move(u));
+		}
+		notify();
+	}
+
+	// send a finished update, rendered first unless it failed
+	// @param word  looked up word
+	void send_rendered(update u, std::string_view word)
+	{
+		if (render && u.error.empty())
+			{ u.rendered = std::make_shared<const rendered_def>(render(u, word)); }
+		send(std::move(u));
+	}
+
+	// send entries [num_sent, end) of `data`
+	// @param source_results  set if finished
+	void send_entries(std::uint64_t id, std::vector<word_info>& data, std::size_t& num_sent, std::size_t end, bool finished,
+		std::vector<source_result> source_results = {})
+	{
+		update u{ id, {}, {}, finished, {}, {}, std::move(source_results) };
+		u.entries.assign(std::make_move_iterator(data.begin() + num_sent), std::make_move_iterator(data.begin() + end));
+		num_sent = end;
+		send(std::move(u));
+	}
+
+	// pass a chunk of the response body to begin_parse
+	// @throws std::runtime_error  on parse error, or if parsing has completed before the end of the body
+	static void add_chunk(task<void>& parse_task, const char* chunk, std::size_t chunk_len)
+	{
+		try
+			{ parse_task.add_data({ chunk, chunk_len }); }
+		catch (const std::exception& e)
+		{
+			// TODO: replace with std::format once range formatter is more mature
+			throw std::runtime_error(fmt::format("JSON parse error: {}\nOccured in section:\n{:s}", e.what(), std::string_view(chunk, chunk_len) | std::views::chunk(128) | std::views::join_with('\n')));
+		}
+		if (parse_task.coro_handle.done())
+		{
+			throw std::runtime_error(fmt::format("JSON parsing ended prematurely.\nOccured in section:\n{:s}", std::string_view(chunk, chunk_len) | std::views::chunk(128) | std::views::join_with('\n')));
+		}
+	}
+
+	// look up `word` in source `i`, on its own thread
+	void run_source(source_lookup& lookup, std::size_t i, const std::string& word) const
+	{
+		const source& s = sources[i];
+		source_result res{ i, {}, {}, {} };
+		try
+		{
+			if (s.find)
+				{ res.offline = s.find(word); }
+			if (!res.offline && s.fetch)
+			{
+				json_coro_cursor cursor;
+				task<void> parse_task = begin_parse(cursor, res.entries);
+				res.error = s.fetch(word, [&](const char* chunk, std::size_t chunk_len)
+				{
+					if (lookup.abandoned.load(std::memory_order_relaxed))
+						{ return false; }
+					add_chunk(parse_task, chunk, chunk_len);
+					return true;
+				});
+			}
+		}
+		catch (const std::exception& e)
+			{ res.error = e.what(); }
+		if (!res.error.empty())
+			{ res.entries.clear(); }
+		{
+			std::lock_guard lock(lookup.mutex);
+			lookup.result = std::move(res);
+		}
+		lookup.done_cv.notify_all();
+		lookup.finished = true;
+	}
+
+	// start looking up `word` in every source, each on its own thread. only called on the lookup thread
+	// Complexity: O(n_sources + n_source_threads)
+	source_lookups start_sources(const std::string& word)
+	{
+		// finished threads are joined right away
+		std::erase_if(source_threads, [](const auto& p) { return p.first->finished.load(); });
+		source_lookups res{ std::chrono::steady_clock::now(), {} };
+		for (std::size_t i = 0; i < sources.size(); i++)
+		{
+			auto lookup = std::make_shared<source_lookup>();
+			source_threads.emplace_back(lookup, std::jthread([this, lookup, i, word]() { run_source(*lookup, i, word); }));
+			res.lookups.push_back(std::move(lookup));
+		}
+		return res;
+	}
+
+	// stop the lookups of `looked_up` which are still running
+	static void abandon_sources(const source_lookups& looked_up)
+	{
+		for (const auto& lookup : looked_up.lookups)
+			{ lookup->abandoned = true; }
+	}
+
+	// wait for the results of `looked_up`, until each source's deadline. sources which miss it are given up on
+	// @param stopped  returns whether the results are no longer wanted, in which case all lookups are abandoned
+	// @return results of every source, in order (those which missed their deadline have an error)
+	template<typename Stopped>
+	std::vector<source_result> collect_sources(const source_lookups& looked_up, Stopped stopped)
+	{
+		std::vector<source_result> res;
+		res.reserve(looked_up.lookups.size());
+		for (std::size_t i = 0; i < looked_up.lookups.size(); i++)
+		{
+			auto& lookup = *looked_up.lookups[i];
+			const auto deadline = looked_up.start + sources[i].deadline;
+			std::unique_lock lock(lookup.mutex);
+			while (!lookup.result && std::chrono::steady_clock::now() < deadline && !stopped())
+			{
+				// starting another lookup doesn't notify done_cv, so check for it periodically
+				lookup.done_cv.wait_until(lock, std::min(deadline, std::chrono::steady_clock::now() + source_poll_interval),
+					[&lookup]() { return lookup.result.has_value(); });
+			}
+			if (lookup.result)
+				{ res.push_back(std::move(lookup.result.value())); }
+			else
+			{
+				lookup.abandoned = true;
+				res.push_back(source_result{ i, {}, {}, "Did not respond in time" });
+			}
+		}
+		if (stopped())
+			{ abandon_sources(looked_up); }
+		return res;
+	}
+
+	// @return whether the lookup is finished
+	bool run_offline(std::uint64_t id, std::string_view word, const source_lookups& looked_up)
+	{
+		std::optional<offline_def> res;
+		std::string error;
+		try
+			{ res = find(word); }
+		catch (const std::exception& e)
+			{ error = e.what(); }
+		if (superseded(id))
+			{ return true; }
+		if (!res && error.empty() && fetch)
+			{ return false; }
+		auto source_results = collect_sources(looked_up, [this, id]() { return superseded(id); });
+		if (superseded(id))
+			{ return true; }
+		send_rendered(update{ id, {}, std::move(res), true, std::move(error), {}, std::move(source_results) }, word);
+		return true;
+	}
+
+	void run_online(std::uint64_t id, std::string_view word, const source_lookups& looked_up)
+	{
+		json_coro_cursor cursor;
+		// entries before num_sent have been moved out, and are never touched again by parsing
+		std::vector<word_info> data;
+		std::size_t num_sent = 0;
+		std::string error;
+		try
+		{
+			task<void> parse_task = begin_parse(cursor, data);
+			error = fetch(word, [&](const char* chunk, std::size_t chunk_len)
+			{
+				if (superseded(id))
+					{ return false; }
+				add_chunk(parse_task, chunk, chunk_len);
+				// the last entry may still be being parsed
+				if (data.size() > num_sent + 1)
+					{ send_entries(id, data, num_sent, data.size() - 1, false); }
+				return true;
+			});
+		}
+		catch (const std::exception& e)
+			{ error = e.what(); }
+
+		if (superseded(id))
+			{ abandon_sources(looked_up); return; }
+		auto source_results = collect_sources(looked_up, [this, id]() { return superseded(id); });
+		if (superseded(id))
+			{ return; }
+		if (error.empty())
+			{ send_entries(id, data, num_sent, data.size(), true, std::move(source_results)); }
+		else
+			{ send(update{ id, {}, {}, true, std::move(error), {}, std::move(source_results) }); }
+	}
+
+	// @param looked_up  lookups of `word` in the sources, which have been started
+	void run(std::uint64_t id, std::string_view word, const source_lookups& looked_up)
+	{
+		if (find && run_offline(id, word, looked_up))
+			{ return; }
+		if (fetch)
+			{ run_online(id, word, looked_up); }
+		else
+		{
+			auto source_results = collect_sources(looked_up, [this, id]() { return superseded(id); });
+			if (!superseded(id))
+				{ send(update{ id, {}, {}, true, {}, {}, std::move(source_results) }); }
+		}
+	}
+
+	// look up `word` in full, without sending anything unless it succeeds.
+	// it stops once a lookup is started or the prefetched words are replaced,
+	// unless the lookup is of the same word (see start()), in which case it is sent as that lookup instead
+	// @param budget  bytes which may be fetched online, which is reduced by the bytes fetched (not counting other sources)
+	void run_prefetch(std::uint64_t id, std::uint64_t generation, const std::string& word, std::size_t& budget)
+	{
+		// sources are prefetched too, so that a prefetched definition is complete
+		const auto looked_up = start_sources(word);
+		std::optional<offline_def> offline;
+		// entries before num_sent have been sent to the lookup which took over
+		std::vector<word_info> data;
+		std::size_t num_sent = 0;
+		std::string error;
+		bool found = false;
+		try
+		{
+			if (find)
+				{ offline = find(word); }
+			found = offline.has_value();
+			if (!found && fetch && (budget > 0 || prefetch_lookup_id != 0))
+			{
+				json_coro_cursor cursor;
+				task<void> parse_task = begin_parse(cursor, data);
+				error = fetch(word, [&](const char* chunk, std::size_t chunk_len)
+				{
+					if (prefetch_superseded(id, generation))
+						{ return false; }
+					const auto lookup_id = prefetch_lookup_id.load();
+					// the budget only applies while this is still a prefetch
+					if (lookup_id == 0 && chunk_len > budget)
+						{ budget = 0; return false; }
+					budget -= std::min(chunk_len, budget);
+					add_chunk(parse_task, chunk, chunk_len);
+					if (lookup_id != 0 && data.size() > num_sent + 1)
+						{ send_entries(lookup_id, data, num_sent, data.size() - 1, false); }
+					return true;
+				});
+				found = error.empty();
+			}
+		}
+		catch (const std::exception& e)
+			{ error = e.what(); }
+
+		std::uint64_t lookup_id;
+		{
+			std::lock_guard lock(mutex);
+			lookup_id = prefetch_lookup_id.exchange(0);
+			prefetching.reset();
+		}
+		if (lookup_id != 0)
+		{
+			// it may have been stopped (e.g. by the budget) before being taken over
+			if (!found && num_sent == 0)
+				{ run(lookup_id, word, looked_up); return; }
+			auto source_results = collect_sources(looked_up, [this, lookup_id]() { return superseded(lookup_id); });
+			if (superseded(lookup_id))
+				{ return; }
+			if (offline || !error.empty())
+				{ send_rendered(update{ lookup_id, {}, std::move(offline), true, std::move(error), {}, std::move(source_results) }, word); }
+			else
+				{ send_entries(lookup_id, data, num_sent, data.size(), true, std::move(source_results)); }
+			return;
+		}
+		// prefetches fail silently. the word is looked up again if it is searched
+		if (!found || prefetch_superseded(id, generation))
+			{ abandon_sources(looked_up); return; }
+		auto source_results = collect_sources(looked_up, [this, id, generation]() { return prefetch_superseded(id, generation); });
+		if (prefetch_superseded(id, generation))
+			{ return; }
+		send_rendered(update{ id, std::move(data), std::move(offline), true, {}, word, std::move(source_results) }, word);
+	}
+
+	// revalidate `word`, and send it again if it changed. it is stopped by lookups, and then revalidated again later
+	// @param id  latest_id when it was started
+	void run_revalidate(std::uint64_t id, const std::string& word)
+	{
+		std::optional<bool> changed;
+		try
+			{ changed = revalidator(word, [this, id]() { return superseded(id); }); }
+		catch (const std::exception&)
+			{ return; }
+		if (!changed)
+		{
+			std::lock_guard lock(mutex);
+			if (!stopping)
+				{ revalidate_words.push_front(word); }
+			return;
+		}
+		if (!changed.value())
+			{ return; }
+		// found offline again, now with the new definition
+		std::optional<offline_def> res;
+		try
+			{ res = find(word); }
+		catch (const std::exception&)
+			{ return; }
+		if (!res)
+			{ return; }
+		update u{ 0, {}, std::move(res), true, {}, {}, {} };
+		u.revalidated_word = word;
+		send_rendered(std::move(u), word);
+	}
+
+	void worker()
+	{
+		if (keep_warm)
+			{ keep_warm(); }
+		auto last_lookup = std::chrono::steady_clock::now();
+		while (true)
+		{
+			std::uint64_t id, generation;
+			std::string word;
+			bool is_prefetch, is_revalidate;
+			std::size_t budget;
+			{
+				std::unique_lock lock(mutex);
+				const auto ready = [this]() { return stopping || next_word || !prefetch_words.empty() || !revalidate_words.empty(); };
+				if (keep_warm && std::chrono::steady_clock::now() - last_lookup < keep_warm_duration)
+				{
+					if (!request_cv.wait_for(lock, keep_warm_interval, ready))
+					{
+						lock.unlock();
+						keep_warm();
+						continue;
+					}
+				}
+				else
+					{ request_cv.wait(lock, ready); }
+				if (stopping)
+					{ return; }
+				id = latest_id;
+				generation = prefetch_generation;
+				budget = prefetch_budget;
+				// lookups always take priority over prefetches, which take priority over revalidating
+				is_prefetch = (!next_word && !prefetch_words.empty());
+				is_revalidate = (!next_word && prefetch_words.empty());
+				if (is_prefetch)
+				{
+					word = std::move(prefetch_words.front());
+					prefetch_words.pop_front();
+					prefetching = word;
+				}
+				else if (is_revalidate)
+				{
+					word = std::move(revalidate_words.front());
+					revalidate_words.pop_front();
+				}
+				else
+				{
+					word = std::move(next_word.value());
+					next_word.reset();
+				}
+			}
+			if (is_prefetch)
+			{
+				run_prefetch(id, generation, word, budget);
+				std::lock_guard lock(mutex);
+				if (prefetch_generation == generation)
+					{ prefetch_budget = budget; }
+			}
+			else if (is_revalidate)
+				{ run_revalidate(id, word); }
+			else
+			{
+				run(id, word, start_sources(word));
+				last_lookup = std::chrono::steady_clock::now();
+			}
+		}
+	}
+
+public:
+	// @param find_  function to look up definitions offline with, or empty
+	// @param fetch_  function to fetch definitions online with, or empty. if both are empty, lookups finish without entries
+	// @param notify_  function called on the lookup thread whenever there are updates to poll(), e.g. to wake the UI thread
+	// @param keep_warm_  function called on the lookup thread when it starts, and every keep_warm_interval while idle
+	//                    for up to keep_warm_duration after the last lookup
+	// @param sources_  other sources to look up every word in (see source), whose results are sent with the last update
+	// @param render_  function to render complete definitions with on the lookup thread (see update::rendered), or empty
+	// @param revalidate_  function to revalidate words with (see revalidate()), or empty. requires find_
+	background_lookup(find_function find_, fetch_function fetch_, std::function<void()> notify_, std::function<void()> keep_warm_ = {},
+		std::vector<source> sources_ = {}, render_function render_ = {}, revalidate_function revalidate_ = {}) :
+		find(std::move(find_)), fetch(std::move(fetch_)), notify(std::move(notify_)), keep_warm(std::move(keep_warm_)),
+		render(std::move(render_)), revalidator(std::move(revalidate_)), sources(std::move(sources_)), thread([this]() { worker(); }) {}
+
+	background_lookup(const background_lookup&) = delete;
+	background_lookup& operator=(const background_lookup&) = delete;
+
+	// the lookup in progress (and the lookups of sources) are stopped at their next chunk, and waited for
+	~background_lookup()
+	{
+		{
+			std::lock_guard lock(mutex);
+			stopping = true;
+		}
+		request_cv.notify_all();
+		thread.join();
+		for (auto& [lookup, source_thread] : source_threads)
+			{ lookup->abandoned = true; }
+		source_threads.clear();
+	}
+
+	// look up `word`, superseding any previous lookup. pending prefetches are dropped,
+	// and the prefetch in progress is stopped, or continues as this lookup if it is of the same word
+	// Complexity: O(n_prefetch_words)
+	// @return id of the lookup, as set in its updates
+	std::uint64_t start(std::string word)
+	{
+		std::uint64_t id;
+		{
+			std::lock_guard lock(mutex);
+			id = ++latest_id;
+			prefetch_words.clear();
+			if (prefetching == word)
+			{
+				next_word.reset();
+				prefetch_lookup_id = id;
+				return id;
+			}
+			next_word = std::move(word);
+			prefetch_lookup_id = 0;
+			prefetch_generation++;
+		}
+		request_cv.notify_one();
+		return id;
+	}
+
+	// stop the current lookup and prefetches. it will not produce any more updates
+	// Complexity: O(n_prefetch_words)
+	void cancel()
+	{
+		std::lock_guard lock(mutex);
+		latest_id++;
+		next_word.reset();
+		prefetch_words.clear();
+		prefetch_lookup_id = 0;
+		prefetch_generation++;
+	}
+
+	// prefetch `words` in order when there is no lookup, replacing (and stopping) previous prefetches.
+	// each is sent as a finished update with prefetch_word set, if it is found
+	// Complexity: O(n_words)
+	// @param max_bytes  maximum number of bytes to fetch online for all of `words`.
+	//     a response which would exceed it is stopped, and no further words are fetched online
+	void prefetch(std::vector<std::string> words, std::size_t max_bytes)
+	{
+		{
+			std::lock_guard lock(mutex);
+			prefetch_words.assign(std::make_move_iterator(words.begin()), std::make_move_iterator(words.end()));
+			prefetch_budget = max_bytes;
+			prefetch_generation++;
+		}
+		request_cv.notify_one();
+	}
+
+	// revalidate `word` (which was found offline) once there are no lookups or prefetches, with the revalidate function.
+	// if its definition changed, it is looked up and rendered again, and sent as a finished update with revalidated_word set.
+	// nothing is done if there is no revalidate function
+	// Complexity: O(1)
+	void revalidate(std::string word)
+	{
+		if (!revalidator || !find)
+			{ return; }
+		{
+			std::lock_guard lock(mutex);
+			revalidate_words.push_back(std::move(word));
+		}
+		request_cv.notify_one();
+	}
+
+	// Complexity: O(n_updates)
+	// @return updates of the latest lookup, prefetches and revalidated words which haven't been returned yet, in order
+	std::vector<update> poll()
+	{
+		std::vector<update> res;
+		std::lock_guard lock(mutex);
+		for (auto& u : updates)
+		{
+			// prefetched and revalidated defs are still valid after being superseded
+			if (u.id == latest_id || !u.prefetch_word.empty() || !u.revalidated_word.empty())
+				{ res.push_back(std::move(u)); }
+		}
+		updates.clear();
+		return res;
+	}
+};
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef BLOOM_H
+#define BLOOM_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <utility>
+
+#include "hash.h"
+
+// bloom filter bit operations, shared by the sdict bloom filter extension and dictionary_set
+// a word sets bits (a + i * b) % n_bits for i in [0, num_hashes), where a and b are the lower and upper 32 bits of its XXH64.
+// bit i is bit (i % 8) of byte (i / 8)
+namespace bloom
+{
+	// @return a and b for `word`
+	inline std::pair<std::uint64_t, std::uint64_t> hashes(std::string_view word) noexcept
+	{
+		const auto hash = xxh64(std::as_bytes(std::span(word)));
+		return { hash & 0xFFFFFFFF, hash >> 32 };
+	}
+
+	// optimal number of hash functions is bits_per_word * ln(2)
+	constexpr std::uint32_t num_hashes(std::uint32_t bits_per_word) noexcept
+		{ return std::clamp<std::uint32_t>(static_cast<std::uint32_t>(bits_per_word * 0.693 + 0.5), 1, 16); }
+
+	// Complexity: O(num_hashes)
+	// @param bits  filter bits, must not be empty
+	// @return false if `word` is definitely not in the filter
+	inline bool may_contain(std::span<const std::byte> bits, std::uint32_t num_hashes, std::string_view word) noexcept
+	{
+		const std::uint64_t num_bits = bits.size() * 8;
+		const auto [a, b] = hashes(word);
+		for (std::uint64_t i = 0; i < num_hashes; i++)
+		{
+			const auto bit = (a + i * b) % num_bits;
+			if ((bits[bit / 8] & std::byte(1 << (bit % 8))) == std::byte(0))
+				{ return false; }
+		}
+		return true;
+	}
+
+	// Complexity: O(num_hashes)
+	// @param bits  filter bits, must not be empty
+	inline void insert(std::span<std::byte> bits, std::uint32_t num_hashes, std::string_view word) noexcept
+	{
+		const std::uint64_t num_bits = bits.size() * 8;
+		const auto [a, b] = hashes(word);
+		for (std::uint64_t i = 0; i < num_hashes; i++)
+		{
+			const auto bit = (a + i * b) % num_bits;
+			bits[bit / 8] |= std::byte(1 << (bit % 8));
+		}
+	}
+}
+
+#endif
@@ -0,0 +1,473 @@
+#ifndef CBOR_PARSE_H
+#define CBOR_PARSE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "dict_def.h"
+
+// direct decoder from CBOR definitions (as stored in the offline dictionary) to word_info, without coroutines or
+// jsoncons events. produces the same result as begin_parse with a cbor_bytes_cursor.
+// unused values are skipped from their headers: strings are skipped without being read,
+// but containers are walked since CBOR only stores their element count
+namespace cbor_parse
+{
+	namespace detail
+	{
+		enum class major_type : std::uint8_t
+		{
+			unsigned_int, negative_int, byte_string, text_string, array, map, tag, simple
+		};
+
+		// maximum depth of nested containers, to bound recursion on corrupted data
+		constexpr std::size_t max_depth = 256;
+
+		// elements of an array or entries of a map, after its header
+		struct container
+		{
+			std::uint64_t remaining;
+			bool indefinite;
+			// entries of a map are a key and value
+			bool is_map;
+		};
+
+		class reader
+		{
+		private:
+			std::span<const std::byte> data;
+			std::size_t pos = 0;
+
+			[[noreturn]] static void fail(const char* msg)
+				{ throw std::runtime_error(std::string(msg) + ". File may be corrupted"); }
+
+			std::uint8_t peek_byte() const
+			{
+				if (pos >= data.size())
+					{ fail("Unexpected end of CBOR data"); }
+				return std::to_integer<std::uint8_t>(data[pos]);
+			}
+
+			void skip_tags()
+			{
+				while (static_cast<major_type>(peek_byte() >> 5) == major_type::tag)
+					{ read_header(); }
+			}
+
+			// read the header of the item at pos
+			// @return {major type, argument}. argument is max for indefinite length, and the additional info for simple values
+			std::pair<major_type, std::uint64_t> read_header()
+			{
+				const std::uint8_t initial = peek_byte();
+				pos++;
+				const auto type = static_cast<major_type>(initial >> 5);
+				const std::uint8_t info = initial & 0x1F;
+				if (info < 24)
+					{ return { type, info }; }
+				if (info == 31)
+				{
+					if (type == major_type::unsigned_int || type == major_type::negative_int || type == major_type::tag)
+						{ fail("Invalid CBOR header"); }
+					return { type, type == major_type::simple ? info : std::numeric_limits<std::uint64_t>::max() };
+				}
+				if (info > 27)
+					{ fail("Invalid CBOR header"); }
+				const std::size_t n_bytes = std::size_t(1) << (info - 24);
+				if (data.size() - pos < n_bytes)
+					{ fail("Unexpected end of CBOR data"); }
+				std::uint64_t arg = 0;
+				for (std::size_t i = 0; i < n_bytes; i++)
+					{ arg = (arg << 8) | std::to_integer<std::uint64_t>(data[pos + i]); }
+				pos += n_bytes;
+				// floats are not needed, so their value is dropped
+				return { type, type == major_type::simple ? info : arg };
+			}
+
+			void skip_bytes(std::uint64_t n)
+			{
+				if (data.size() - pos < n)
+					{ fail("Unexpected end of CBOR data"); }
+				pos += n;
+			}
+
+			void skip(std::size_t depth)
+			{
+				if (depth > max_depth)
+					{ fail("CBOR data is nested too deeply"); }
+				skip_tags();
+				const auto [type, arg] = read_header();
+				switch (type)
+				{
+				case major_type::byte_string: [[fallthrough]];
+				case major_type::text_string:
+					if (arg != std::numeric_limits<std::uint64_t>::max())
+						{ skip_bytes(arg); }
+					else
+					{
+						// chunks of definite length strings
+						while (!at_break())
+						{
+							const auto [chunk_type, chunk_len] = read_header();
+							if (chunk_type != type || chunk_len == std::numeric_limits<std::uint64_t>::max())
+								{ fail("Invalid CBOR string chunk"); }
+							skip_bytes(chunk_len);
+						}
+						pos++;
+					}
+					break;
+				case major_type::array: [[fallthrough]];
+				case major_type::map:
+					{
+						container c = { arg, arg == std::numeric_limits<std::uint64_t>::max(), type == major_type::map };
+						while (next(c))
+						{
+							skip(depth + 1);
+							if (c.is_map)
+								{ skip(depth + 1); }
+						}
+					}
+					break;
+				case major_type::simple:
+					if (arg == 31)
+						{ fail("Unexpected CBOR break"); }
+					break;
+				default:
+					break;
+				}
+			}
+
+		public:
+			explicit reader(std::span<const std::byte> data_) : data(data_) {}
+
+			// @return whether the next byte is a break (end of indefinite length container)
+			bool at_break() const { return pos < data.size() && std::to_integer<std::uint8_t>(data[pos]) == 0xFF; }
+
+			// @return type of the next item, after tags
+			major_type peek_type()
+			{
+				skip_tags();
+				return static_cast<major_type>(peek_byte() >> 5);
+			}
+
+			// @return whether the next item is true or false
+			bool peek_bool()
+			{
+				if (peek_type() != major_type::simple)
+					{ return false; }
+				const std::uint8_t info = peek_byte() & 0x1F;
+				return info == 20 || info == 21;
+			}
+
+			// expects peek_bool()
+			bool read_bool() { return read_header().second == 21; }
+
+			// expects peek_type() to be text_string
+			// @return view of the string, valid as long as the data
+			std::string_view read_text()
+			{
+				const auto [type, len] = read_header();
+				if (len == std::numeric_limits<std::uint64_t>::max())
+					{ fail("Indefinite length CBOR strings are not supported"); }
+				const std::size_t start = pos;
+				skip_bytes(len);
+				return std::string_view(reinterpret_cast<const char*>(data.data() + start), len);
+			}
+
+			// expects peek_type() to be array or map
+			container read_container()
+			{
+				const auto [type, count] = read_header();
+				return { count, count == std::numeric_limits<std::uint64_t>::max(), type == major_type::map };
+			}
+
+			// advance to the next element (or map entry) of `c`. consumes the break of an indefinite length container
+			// @return false if there are no more elements
+			bool next(container& c)
+			{
+				if (c.indefinite)
+				{
+					if (!at_break())
+						{ return true; }
+					pos++;
+					c.indefinite = false;
+					c.remaining = 0;
+					return false;
+				}
+				if (c.remaining == 0)
+					{ return false; }
+				c.remaining--;
+				return true;
+			}
+
+			// skip the next item, including all of its contents
+			void skip() { skip(0); }
+
+			// skip the remaining elements (or entries) of `c`
+			void skip_rest(container& c)
+			{
+				while (next(c))
+				{
+					skip();
+					if (c.is_map)
+						{ skip(); }
+				}
+			}
+
+			// call `f` with the key of each remaining entry of map `c`. `f` must consume the value.
+			// entries with non string keys are skipped
+			template<typename F>
+			void for_each_entry(container& c, F&& f)
+			{
+				while (next(c))
+				{
+					if (peek_type() != major_type::text_string)
+						{ skip(); skip(); continue; }
+					f(read_text());
+				}
+			}
+		};
+
+		// parse a `dt` array, setting def_text to the first "text" element
+		// expects r to be at the array
+		template<typename String>
+		void parse_dt(reader& r, String& def_text)
+		{
+			auto dt = r.read_container();
+			while (r.next(dt))
+			{
+				if (r.peek_type() != major_type::array)
+					{ r.skip(); continue; }
+				auto sub = r.read_container();
+				if (r.next(sub))
+				{
+					if (r.peek_type() != major_type::text_string)
+						{ r.skip(); }
+					else if (r.read_text() == "text")
+					{
+						if (r.next(sub))
+						{
+							if (r.peek_type() != major_type::text_string)
+								{ throw std::runtime_error("Expected string after \"text\". File may be corrupted"); }
+							def_text = r.read_text();
+						}
+						r.skip_rest(sub);
+						r.skip_rest(dt);
+						return;
+					}
+				}
+				r.skip_rest(sub);
+			}
+		}
+
+		// expects r to be at the sdsense object
+		template<typename WordInfo>
+		void parse_sdsense(reader& r, WordInfo& data)
+		{
+			using types = typename WordInfo::def_types;
+			auto& this_sense = std::get<typename types::sense_data>(data.defs.back()).sdsense;
+			this_sense = typename types::div_sense_data();
+			auto c = r.read_container();
+			r.for_each_entry(c, [&](std::string_view key)
+			{
+				if (key == "sd" && r.peek_type() == major_type::text_string)
+					{ this_sense.value().sense_div = r.read_text(); }
+				else if (key == "sn" && r.peek_type() == major_type::text_string)
+					{ this_sense.value().number = r.read_text(); }
+				else if (key == "dt" && r.peek_type() == major_type::array)
+					{ parse_dt(r, this_sense.value().def_text); }
+				else
+					{ r.skip(); }
+			});
+		}
+
+		// parse a `sense` or `sen` object
+		// expects r to be at the object
+		template<bool is_trunc = false, typename WordInfo>
+		void parse_sense(reader& r, WordInfo& data)
+		{
+			using types = typename WordInfo::def_types;
+			using sense_type = std::conditional_t<is_trunc, typename types::trunc_sense_data, typename types::sense_data>;
+			data.defs.push_back(sense_type());
+			auto c = r.read_container();
+			r.for_each_entry(c, [&](std::string_view key)
+			{
+				if (key == "sn" && r.peek_type() == major_type::text_string)
+					{ std::get<sense_type>(data.defs.back()).number = r.read_text(); }
+				else if (!is_trunc && key == "dt" && r.peek_type() == major_type::array)
+					{ parse_dt(r, std::get<typename types::sense_data>(data.defs.back()).def_text); }
+				else if (!is_trunc && key == "sdsense" && r.peek_type() == major_type::map)
+					{ parse_sdsense(r, data); }
+				else
+					{ r.skip(); }
+			});
+		}
+
+		// parse the sense of a `bs` object, which is its first entry
+		// expects r to be at the object
+		template<typename WordInfo>
+		void parse_bs(reader& r, WordInfo& data)
+		{
+			auto c = r.read_container();
+			if (r.next(c))
+			{
+				r.skip(); // "sense" key
+				if (r.peek_type() == major_type::map)
+					{ parse_sense(r, data); }
+				else
+					{ r.skip(); }
+			}
+			r.skip_rest(c);
+		}
+
+		// call parse_sense, parse_bs etc. depending on the key (first element) of each sub-array of an array
+		// expects r to be at the array. sub-arrays without a known key are skipped
+		// @param in_pseq  whether this is a pseq array, which only contains `sense` and `bs`
+		template<typename WordInfo>
+		void parse_sseq_element(reader& r, WordInfo& data, bool in_pseq)
+		{
+			auto c = r.read_container();
+			while (r.next(c))
+			{
+				if (r.peek_type() != major_type::array)
+					{ r.skip(); continue; }
+				auto sub = r.read_container();
+				if (r.next(sub))
+				{
+					if (r.peek_type() != major_type::text_string)
+						{ r.skip(); }
+					else if (const auto key = r.read_text(); r.next(sub))
+					{
+						const auto type = r.peek_type();
+						if (key == "sense" && type == major_type::map)
+							{ parse_sense(r, data); }
+						else if (key == "sen" && !in_pseq && type == major_type::map)
+							{ parse_sense<true>(r, data); }
+						else if (key == "pseq" && !in_pseq && type == major_type::array)
+							{ parse_sseq_element(r, data, true); }
+						else if (key == "bs" && type == major_type::map)
+							{ parse_bs(r, data); }
+						else
+							{ r.skip(); }
+					}
+				}
+				r.skip_rest(sub);
+			}
+		}
+
+		// expects r to be at the sseq array
+		template<typename WordInfo>
+		void parse_sseq(reader& r, WordInfo& data)
+		{
+			auto c = r.read_container();
+			while (r.next(c))
+			{
+				if (r.peek_type() == major_type::array)
+					{ parse_sseq_element(r, data, false); }
+				else
+					{ r.skip(); }
+			}
+		}
+
+		// expects r to be at the def array
+		template<typename WordInfo>
+		void parse_def(reader& r, WordInfo& data)
+		{
+			auto c = r.read_container();
+			while (r.next(c))
+			{
+				if (r.peek_type() != major_type::map)
+					{ r.skip(); continue; }
+				auto single_def = r.read_container();
+				r.for_each_entry(single_def, [&](std::string_view key)
+				{
+					if (key == "sseq" && r.peek_type() == major_type::array)
+						{ parse_sseq(r, data); }
+					else
+						{ r.skip(); }
+				});
+			}
+		}
+
+		// expects r to be at the meta object
+		template<typename WordInfo>
+		void parse_meta(reader& r, WordInfo& data)
+		{
+			auto c = r.read_container();
+			r.for_each_entry(c, [&](std::string_view key)
+			{
+				if (key == "id" && r.peek_type() == major_type::text_string)
+					{ data.id = r.read_text(); }
+				else if (key == "stems" && r.peek_type() == major_type::array)
+				{
+					auto stems = r.read_container();
+					while (r.next(stems))
+					{
+						if (r.peek_type() != major_type::text_string)
+							{ throw std::runtime_error("Expected string in \"stems\". File may be corrupted"); }
+						data.stems.emplace_back(r.read_text());
+					}
+				}
+				else if (key == "offensive" && r.peek_bool())
+					{ data.offensive = r.read_bool(); }
+				else
+					{ r.skip(); }
+			});
+		}
+	}
+
+	// parse a CBOR encoded API response into `data`
+	// with def_view::word_info, strings point into `def`, and are only valid as long as it is.
+	// the lists of each entry use the allocator of `data`, so with def_arena::word_info, everything is allocated from its resource
+	// Complexity: O(def_size)
+	// @tparam WordInfo  word_info, def_view::word_info or def_arena::word_info
+	// @throws std::runtime_error  if the definition is not a list of entries, or is not valid CBOR
+	template<typename WordInfo, typename Allocator>
+	void parse(std::span<const std::byte> def, std::vector<WordInfo, Allocator>& data)
+	{
+		using detail::major_type;
+		detail::reader r(def);
+		if (r.peek_type() != major_type::array)
+			{ throw std::runtime_error("Definition does not begin with an array"); }
+		auto root = r.read_container();
+		if (!r.next(root))
+			{ throw std::runtime_error("Expected word definition object"); }
+		switch (r.peek_type())
+		{
+		case major_type::map:
+			break;
+		case major_type::text_string:
+			// TODO: "no word found" condition
+			throw std::runtime_error("No word found. Possible alternatives: ");
+		default:
+			throw std::runtime_error("Expected word definition object");
+		}
+
+		do
+		{
+			if (r.peek_type() != major_type::map)
+				{ r.skip(); continue; }
+			// moving the lists keeps their allocator
+			data.push_back(WordInfo{ {}, decltype(WordInfo::stems)(data.get_allocator()), false, decltype(WordInfo::defs)(data.get_allocator()) });
+			auto entry = r.read_container();
+			r.for_each_entry(entry, [&](std::string_view key)
+			{
+				if (key == "meta" && r.peek_type() == major_type::map)
+					{ detail::parse_meta(r, data.back()); }
+				else if (key == "def" && r.peek_type() == major_type::array)
+					{ detail::parse_def(r, data.back()); }
+				else
+					{ r.skip(); }
+			});
+		} while (r.next(root));
+	}
+}
+
+#endif
@@ -0,0 +1,214 @@
+#ifndef CO_TRACE_H
+#define CO_TRACE_H
+
+// opt-in tracing of tasks from co_util.h, enabled by defining CO_TRACE (cmake option CO_TRACE)
+// coroutines are recorded as a call tree by name (the function passed to CO_CALL / CO_WHILE),
+// with the number of calls, resumes (through task::add_data()) and self time of each node.
+// trees are per thread, and merged into a global tree when threads exit or dump_folded() is called.
+// a normal profiler shows parsing as nested resume() frames, which this attributes to the parsing functions instead
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <ranges>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace detail::co_trace
+{
+	// name of coroutines which were not created through CO_TRACED (e.g. directly calling a task function)
+	constexpr std::string_view unnamed = "(task)";
+
+	struct node
+	{
+		std::string_view name;
+		std::uint32_t depth = 0;
+		std::uint64_t calls = 0, resumes = 0;
+		std::chrono::nanoseconds self{};
+		std::vector<std::uint32_t> children;
+	};
+
+	// call tree, where nodes[0] is the root (not a coroutine)
+	struct tree
+	{
+		std::vector<node> nodes = std::vector<node>(1);
+
+		// Complexity: O(n_children)
+		// @return index of the child of `parent` named `name`, which is added if it doesn't exist
+		std::uint32_t child(std::uint32_t parent, std::string_view name)
+		{
+			for (const auto ind : nodes[parent].children)
+			{
+				if (nodes[ind].name == name)
+					{ return ind; }
+			}
+			const auto ind = static_cast<std::uint32_t>(nodes.size());
+			nodes.emplace_back(name, nodes[parent].depth + 1);
+			nodes[parent].children.push_back(ind);
+			return ind;
+		}
+
+		// add the counts of node `from_ind` of `from` (and its descendants) to node `to_ind`
+		void merge(const tree& from, std::uint32_t from_ind = 0, std::uint32_t to_ind = 0)
+		{
+			nodes[to_ind].calls += from.nodes[from_ind].calls;
+			nodes[to_ind].resumes += from.nodes[from_ind].resumes;
+			nodes[to_ind].self += from.nodes[from_ind].self;
+			for (const auto from_child : from.nodes[from_ind].children)
+				{ merge(from, from_child, child(to_ind, from.nodes[from_child].name)); }
+		}
+	};
+
+	struct global_tree
+	{
+		std::mutex mutex;
+		tree merged;
+	};
+	inline global_tree global;
+
+	class thread_tree
+	{
+	private:
+		struct active
+		{
+			std::uint32_t ind;
+			std::chrono::steady_clock::time_point start;
+			// time spent in coroutines resumed by this one, which is not self time
+			std::chrono::nanoseconds children{};
+		};
+
+	public:
+		tree t;
+		// coroutines which are currently running on this thread, innermost last
+		std::vector<active> stack;
+		// name for the next promise which is constructed, set by CO_TRACED
+		std::string_view pending_name = unnamed;
+
+		thread_tree() = default;
+		thread_tree(const thread_tree&) = delete;
+		thread_tree& operator=(const thread_tree&) = delete;
+
+		~thread_tree()
+			{ flush(); }
+
+		void enter(std::string_view name, bool resume)
+		{
+			const auto ind = t.child(stack.empty() ? 0 : stack.back().ind, name);
+			(resume ? t.nodes[ind].resumes : t.nodes[ind].calls)++;
+			stack.emplace_back(ind, std::chrono::steady_clock::now());
+		}
+
+		void exit()
+		{
+			const auto cur = stack.back();
+			stack.pop_back();
+			const std::chrono::nanoseconds elapsed = std::chrono::steady_clock::now() - cur.start;
+			t.nodes[cur.ind].self += elapsed - cur.children;
+			if (!stack.empty())
+				{ stack.back().children += elapsed; }
+		}
+
+		// merge into the global tree, unless coroutines are running (since their nodes are referred to by index)
+		void flush()
+		{
+			if (!stack.empty() || t.nodes.size() == 1)
+				{ return; }
+			std::lock_guard lock(global.mutex);
+			global.merged.merge(t);
+			t = {};
+		}
+	};
+	inline thread_local thread_tree this_thread;
+
+	// @return name set by CO_TRACED (and resets it), for the promise being constructed
+	inline std::string_view take_name() noexcept
+		{ return std::exchange(this_thread.pending_name, unnamed); }
+
+	// records the time until destruction as time spent in a coroutine
+	class scope
+	{
+	public:
+		// the first run of a coroutine (until it first suspends), which is named `name`
+		explicit scope(std::string_view name)
+		{
+			this_thread.pending_name = name;
+			this_thread.enter(name, false);
+		}
+		// a resume of a coroutine named `name`
+		scope(std::string_view name, bool resume)
+			{ this_thread.enter(name, resume); }
+		scope(const scope&) = delete;
+		scope& operator=(const scope&) = delete;
+		~scope()
+			{ this_thread.exit(); }
+	};
+
+	// write the global tree (including the calling thread's) as folded stacks, which flamegraph.pl and speedscope accept
+	// each line is `root;...;leaf <self time in ns>`
+	inline void dump_folded(std::ostream& out)
+	{
+		this_thread.flush();
+		std::lock_guard lock(global.mutex);
+		const auto& nodes = global.merged.nodes;
+		std::string path;
+		const auto write = [&out, &nodes, &path](this auto self, std::uint32_t ind) -> void
+		{
+			const auto path_len = path.size();
+			if (ind != 0)
+			{
+				if (!path.empty())
+					{ path += ';'; }
+				path += nodes[ind].name;
+				if (nodes[ind].self.count() > 0)
+					{ out << path << ' ' << nodes[ind].self.count() << '\n'; }
+			}
+			for (const auto child : nodes[ind].children)
+				{ self(child); }
+			path.resize(path_len);
+		};
+		write(0);
+		out.flush();
+	}
+
+	// write totals of each name, summed over every place it is called from, by decreasing self time
+	inline void dump_summary(std::ostream& out)
+	{
+		this_thread.flush();
+		struct totals
+		{
+			std::uint64_t calls = 0, resumes = 0;
+			std::uint32_t max_depth = 0;
+			std::chrono::nanoseconds self{};
+		};
+		std::map<std::string_view, totals> by_name;
+		{
+			std::lock_guard lock(global.mutex);
+			for (const auto& n : global.merged.nodes | std::views::drop(1))
+			{
+				auto& t = by_name[n.name];
+				t.calls += n.calls;
+				t.resumes += n.resumes;
+				t.max_depth = std::max(t.max_depth, n.depth);
+				t.self += n.self;
+			}
+		}
+		std::vector<std::pair<std::string_view, totals>> sorted(by_name.begin(), by_name.end());
+		std::ranges::sort(sorted, std::ranges::greater(), [](const auto& p) { return p.second.self; });
+		out << std::format("{:<40} {:>12} {:>12} {:>9} {:>12}\n", "coroutine", "calls", "resumes", "max depth", "self ms");
+		for (const auto& [name, t] : sorted)
+		{
+			out << std::format("{:<40} {:>12} {:>12} {:>9} {:>12.3f}\n",
+				name, t.calls, t.resumes, t.max_depth, std::chrono::duration<double, std::milli>(t.self).count());
+		}
+		out.flush();
+	}
+}
+
+#endif
@@ -1,10 +1,73 @@
 #ifndef CO_UTIL_H
 #define CO_UTIL_H
 
+#include <algorithm>
+#include <array>
 #include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <new>
 #include <string_view>
 #include <utility>
 
+#ifdef CO_TRACE
+#include "co_trace.h"
+#endif
+
+namespace detail
+{
+	// thread local free lists of coroutine frames, by size class
+	// tasks from CO_CALL are nested and destroyed in reverse order, so only about as many frames
+	// as the maximum nesting depth are ever cached, and steady state parsing does not allocate frames
+	class frame_pool
+	{
+	private:
+		// frames larger than granularity * num_classes are not pooled
+		constexpr static std::size_t granularity = 64, num_classes = 32;
+
+		struct free_block
+		{
+			free_block* next;
+		};
+		std::array<free_block*, num_classes> free_lists{};
+
+	public:
+		frame_pool() = default;
+		frame_pool(const frame_pool&) = delete;
+		frame_pool& operator=(const frame_pool&) = delete;
+
+		~frame_pool()
+		{
+			for (auto block : free_lists)
+			{
+				while (block)
+					{ ::operator delete(std::exchange(block, block->next)); }
+			}
+		}
+
+		void* allocate(std::size_t size)
+		{
+			const std::size_t ind = (std::max<std::size_t>(size, 1) - 1) / granularity;
+			if (ind >= num_classes)
+				{ return ::operator new(size); }
+			if (free_lists[ind])
+				{ return std::exchange(free_lists[ind], free_lists[ind]->next); }
+			return ::operator new((ind + 1) * granularity);
+		}
+
+		// @param size  size passed to allocate()
+		void deallocate(void* p, std::size_t size) noexcept
+		{
+			const std::size_t ind = (std::max<std::size_t>(size, 1) - 1) / granularity;
+			if (ind >= num_classes)
+				{ ::operator delete(p); return; }
+			free_lists[ind] = ::new (p) free_block{ free_lists[ind] };
+		}
+	};
+
+	inline thread_local frame_pool co_frame_pool;
+}
+
 template<typename T>
 struct promise_type;
 
@@ -30,8 +93,21 @@ struct task
 		coro_handle.promise().data_in = msg;
 		if (!coro_handle.done())
 		{
+#ifdef CO_TRACE
+			detail::co_trace::scope trace(coro_handle.promise().trace_name, true);
+#endif
 			coro_handle.resume();
 		}
+		rethrow_if_failed();
+	}
+
+	// rethrow the exception the coroutine ended with, if any
+	// needed after creating a task which may finish without suspending (e.g. parsing complete data),
+	// since exceptions are not propagated from the initial call
+	constexpr void rethrow_if_failed() const
+	{
+		if (coro_handle.promise().exception)
+			{ std::rethrow_exception(coro_handle.promise().exception); }
 	}
 };
 
@@ -39,7 +115,19 @@ template<typename Derived, typename T>
 struct basic_promise_type
 {
 	std::string_view data_in;
-	void unhandled_exception() { throw; }
+#ifdef CO_TRACE
+	// set by CO_TRACED when the coroutine is called through it
+	std::string_view trace_name = detail::co_trace::take_name();
+#endif
+
+	// frames are nested many levels deep (so allocated and freed many times per parse), and are pooled instead
+	static void* operator new(std::size_t size) { return detail::co_frame_pool.allocate(size); }
+	static void operator delete(void* p, std::size_t size) noexcept { detail::co_frame_pool.deallocate(p, size); }
+
+	// the exception is rethrown from task::add_data() or task::rethrow_if_failed() instead of here, since
+	// rethrowing before the first suspension makes some compilers free the frame, which the task frees again
+	std::exception_ptr exception;
+	void unhandled_exception() noexcept { exception = std::current_exception(); }
 	constexpr task<T> get_return_object() { return task<T>(static_cast<Derived*>(this)); }
 	constexpr std::suspend_never initial_suspend() noexcept { return {}; }
 	constexpr std::suspend_always final_suspend() noexcept { return {}; }
@@ -103,12 +191,21 @@ public:
 #define CONCAT_(lhs, rhs) lhs##rhs
 #define CONCAT(lhs, rhs) CONCAT_(lhs, rhs)
 
+// evaluate `call` (which creates a task), naming the task `name` if CO_TRACE is defined (see co_trace.h)
+// tasks which are not created through this are traced as "(task)"
+#ifdef CO_TRACE
+#define CO_TRACED(name, call) (detail::co_trace::scope(name), call)
+#else
+#define CO_TRACED(name, call) (call)
+#endif
+
 // call `func` with params
 // return type can be accessed with rha_wrapper::operator>>
 #define CO_CALL(func, ...) \
 decltype(func(__VA_ARGS__).coro_handle.promise().data_out) CONCAT(detail_t_ret_, __LINE__); \
-{ auto t = func(__VA_ARGS__); \
+{ auto t = CO_TRACED(#func, func(__VA_ARGS__)); \
 while (!t.coro_handle.done()) { co_await t; } \
+t.rethrow_if_failed(); \
 CONCAT(detail_t_ret_, __LINE__) = t.coro_handle.promise().data_out; } \
 rha_wrapper(std::move(CONCAT(detail_t_ret_, __LINE__)))
 
@@ -128,8 +225,9 @@ rha_wrapper(std::move(CONCAT(detail_t_ret_, __LINE__)))
 #define CO_WHILE(func, ...) \
 while (true) { \
 decltype(func(__VA_ARGS__).coro_handle.promise().data_out) CONCAT(detail_t_ret_, __LINE__); \
-{ auto t = func(__VA_ARGS__); \
+{ auto t = CO_TRACED(#func, func(__VA_ARGS__)); \
 while (!t.coro_handle.done()) { co_await t; } \
+t.rethrow_if_failed(); \
 CONCAT(detail_t_ret_, __LINE__) = t.coro_handle.promise().data_out; } \
 if (!CONCAT(detail_t_ret_, __LINE__)) { break; }
 
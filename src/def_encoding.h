@@ -0,0 +1,104 @@
+#ifndef DEF_ENCODING_H
+#define DEF_ENCODING_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "cbor_parse.h"
+#include "dict_def.h"
+#include "flat_def.h"
+
+// encodings of the defs stored in a dictionary file, beneath any compression by the file itself (see dictionary_file::def_codec).
+// each file records the encoding of all of its defs (see dictionary_file::def_encoding()), and files which don't are CBOR,
+// so that defs can be stored in another encoding without changing the file format
+namespace def_encoding
+{
+	enum class encoding : std::uint32_t
+	{
+		// API responses transcoded to CBOR (see transcode.h), parsed by cbor_parse
+		cbor = 0,
+		// only the fields which the parsers read, as serialized flat_defs (see flat_defs::serialize()), parsed by flat_defs::parse().
+		// there are no field names to match, and records are fixed size
+		flat = 1
+	};
+
+	constexpr std::array all = { encoding::cbor, encoding::flat };
+
+	constexpr std::string_view name(encoding e)
+	{
+		switch (e)
+		{
+		case encoding::cbor: return "cbor";
+		case encoding::flat: return "flat";
+		}
+		return "";
+	}
+
+	// Complexity: O(1)
+	// @return the encoding called `s` (see name()), or empty if there is none
+	constexpr std::optional<encoding> from_name(std::string_view s)
+	{
+		for (const auto e : all)
+		{
+			if (name(e) == s)
+				{ return e; }
+		}
+		return {};
+	}
+
+	// Complexity: O(1)
+	// @param id  encoding of a file (see dictionary_file::def_encoding())
+	// @throws std::runtime_error  if `id` isn't a known encoding, e.g. of a file written by a newer version
+	constexpr encoding from_id(std::uint32_t id)
+	{
+		for (const auto e : all)
+		{
+			if (static_cast<std::uint32_t>(e) == id)
+				{ return e; }
+		}
+		throw std::runtime_error("Unknown definition encoding " + std::to_string(id));
+	}
+
+	// parse a def encoded with `e` into `data`. same as cbor_parse::parse for CBOR defs
+	// Complexity: O(def_size)
+	// @tparam WordInfo  word_info, def_view::word_info or def_arena::word_info
+	// @throws std::runtime_error  if the definition can't be parsed
+	template<typename WordInfo, typename Allocator>
+	void parse(encoding e, std::span<const std::byte> def, std::vector<WordInfo, Allocator>& data)
+	{
+		switch (e)
+		{
+		case encoding::cbor:
+			cbor_parse::parse(def, data);
+			break;
+		case encoding::flat:
+			flat_defs::parse(def, data);
+			break;
+		}
+	}
+
+	// encode a CBOR def with `e`. other encodings only keep what the parsers read, so defs can't be converted back to CBOR
+	// Complexity: O(def_size)
+	// @param buf  buffer for the encoded def
+	// @return encoded def, either `cbor` itself or a view of `buf`
+	// @throws std::runtime_error  if `cbor` can't be parsed
+	inline std::span<const std::byte> encode(encoding e, std::span<const std::byte> cbor, std::vector<std::byte>& buf)
+	{
+		if (e == encoding::cbor)
+			{ return cbor; }
+		std::vector<def_view::word_info> entries;
+		cbor_parse::parse(cbor, entries);
+		buf.clear();
+		flat_defs::from(std::span<const def_view::word_info>(entries)).serialize(buf);
+		return buf;
+	}
+}
+
+#endif
@@ -0,0 +1,156 @@
+#ifndef DEF_TABLE_H
+#define DEF_TABLE_H
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <vector>
+
+// flat open addressing hash table from (def size, def hash) to def indices, used for deduplication
+// each key stores its first def index inline. defs with equal size and hash but different contents
+// (i.e. hash collisions) are chained through a separate overflow list, so there are no per-entry allocations
+class def_table
+{
+private:
+	struct slot
+	{
+		std::uint64_t hash;
+		std::uint64_t def_ind;
+		// 0 if slot is empty (defs are never empty)
+		std::uint32_t size = 0;
+		// index + 1 of next def index in `overflow`, 0 if none
+		std::uint32_t next = 0;
+	};
+	struct overflow_entry
+	{
+		std::uint64_t def_ind;
+		std::uint32_t next = 0;
+	};
+
+	// size is always 0 or a power of 2
+	std::vector<slot> slots;
+	std::vector<overflow_entry> overflow;
+	std::size_t num_keys = 0;
+
+	static std::size_t slot_hash(std::uint32_t size, std::uint64_t hash) noexcept
+	{
+		// def hashes are already well mixed, only size needs to be mixed in
+		return static_cast<std::size_t>(hash ^ (size * 0x9E3779B97F4A7C15ull));
+	}
+
+	// expects slots to have at least one empty slot
+	// @return slot for the key, which is empty if the key is not present
+	std::size_t probe(std::uint32_t size, std::uint64_t hash) const noexcept
+	{
+		const std::size_t mask = slots.size() - 1;
+		std::size_t i = slot_hash(size, hash) & mask;
+		while (slots[i].size != 0 && (slots[i].size != size || slots[i].hash != hash))
+			{ i = (i + 1) & mask; }
+		return i;
+	}
+
+	// Complexity: O(N)
+	void rehash(std::size_t new_slot_count)
+	{
+		std::vector<slot> old_slots(new_slot_count);
+		old_slots.swap(slots);
+		for (const auto& s : old_slots)
+		{
+			if (s.size != 0)
+				{ slots[probe(s.size, s.hash)] = s; }
+		}
+	}
+
+public:
+	// Complexity: O(N)
+	void clear() noexcept
+	{
+		slots.clear();
+		overflow.clear();
+		num_keys = 0;
+	}
+
+	// reserve space for `n` distinct keys
+	// Complexity: O(N)
+	void reserve(std::size_t n)
+	{
+		// keep load factor at most 1/2
+		const std::size_t needed = std::bit_ceil(n * 2);
+		if (needed > slots.size())
+			{ rehash(needed); }
+	}
+
+	bool empty() const noexcept { return num_keys == 0; }
+
+	// insert `def_ind` for the key, if it is not already present.
+	// existing def indices for the key are kept, and are visited first by find_if()
+	// Complexity: O(1) average (O(number of def indices for this key) if the key exists)
+	void insert(std::uint32_t size, std::uint64_t hash, std::uint64_t def_ind)
+	{
+		if ((num_keys + 1) * 2 > slots.size())
+			{ rehash(std::max<std::size_t>(16, slots.size() * 2)); }
+		auto& s = slots[probe(size, hash)];
+		if (s.size == 0)
+		{
+			s = { hash, def_ind, size, 0 };
+			num_keys++;
+			return;
+		}
+		if (s.def_ind == def_ind)
+			{ return; }
+		// index + 1 of last entry in `overflow`, 0 if the chain only contains the inline entry
+		std::uint32_t last = 0;
+		for (std::uint32_t next = s.next; next != 0; next = overflow[next - 1].next)
+		{
+			if (overflow[next - 1].def_ind == def_ind)
+				{ return; }
+			last = next;
+		}
+		overflow.push_back({ def_ind, 0 });
+		(last == 0 ? s.next : overflow[last - 1].next) = static_cast<std::uint32_t>(overflow.size());
+	}
+
+	// Complexity: O(1) average, plus calls to `pred`
+	// @param pred  predicate taking a def index
+	// @return first def index (in insertion order) with the given key that satisfies `pred`
+	template<typename F>
+	std::optional<std::uint64_t> find_if(std::uint32_t size, std::uint64_t hash, F&& pred) const
+	{
+		if (slots.empty())
+			{ return {}; }
+		const auto& s = slots[probe(size, hash)];
+		if (s.size == 0)
+			{ return {}; }
+		if (pred(s.def_ind))
+			{ return s.def_ind; }
+		for (std::uint32_t next = s.next; next != 0; next = overflow[next - 1].next)
+		{
+			if (pred(overflow[next - 1].def_ind))
+				{ return overflow[next - 1].def_ind; }
+		}
+		return {};
+	}
+
+	// Complexity: O(1) average
+	bool contains(std::uint32_t size, std::uint64_t hash, std::uint64_t def_ind) const
+		{ return find_if(size, hash, [def_ind](std::uint64_t ind) { return ind == def_ind; }).has_value(); }
+
+	// Complexity: O(N)
+	// @param f  function taking def size, def hash, and def index, called for every def index
+	template<typename F>
+	void for_each(F&& f) const
+	{
+		for (const auto& s : slots)
+		{
+			if (s.size == 0)
+				{ continue; }
+			f(s.size, s.hash, s.def_ind);
+			for (std::uint32_t next = s.next; next != 0; next = overflow[next - 1].next)
+				{ f(s.size, s.hash, overflow[next - 1].def_ind); }
+		}
+	}
+};
+
+#endif
@@ -1,47 +1,161 @@
 #ifndef DICT_DEF_H
 #define DICT_DEF_H
 
+#include <cstddef>
+#include <memory_resource>
 #include <optional>
 #include <string>
+#include <string_view>
 #include <variant>
 #include <vector>
 
-struct basic_sense_data
+// definition types, with strings of type String and lists of type Vector
+template<typename String, template<typename> typename Vector = std::vector>
+struct dict_defs
 {
-	std::optional<std::string> etymology;
-	std::optional<std::vector<std::string>> inflections;
-	std::optional<std::vector<std::string>> labels;
-	std::optional<std::vector<std::string>> pronunciations;
-	std::optional<bool> transitive_verb;
-	std::optional<std::vector<std::string>> subj_status;
-	std::optional<std::string> number;
-	// variants
-};
+	using string_type = String;
 
-struct basic_def_sense_data : basic_sense_data
-{
-	std::string def_text;	
+	struct basic_sense_data
+	{
+		std::optional<String> etymology;
+		std::optional<Vector<String>> inflections;
+		std::optional<Vector<String>> labels;
+		std::optional<Vector<String>> pronunciations;
+		std::optional<bool> transitive_verb;
+		std::optional<Vector<String>> subj_status;
+		std::optional<String> number;
+		// variants
+	};
+
+	struct basic_def_sense_data : basic_sense_data
+	{
+		String def_text;
+	};
+
+	using trunc_sense_data = basic_sense_data;
+
+	struct div_sense_data : basic_def_sense_data
+	{
+		String sense_div;
+	};
+
+	struct sense_data : basic_def_sense_data
+	{
+		std::optional<div_sense_data> sdsense;
+	};
+
+	struct word_info
+	{
+		// the other types of this family, e.g. word_info::def_types::sense_data
+		using def_types = dict_defs;
+
+		String id;
+		Vector<String> stems;
+		bool offensive;
+
+		Vector<std::variant<sense_data, trunc_sense_data>> defs;
+	};
 };
 
-using trunc_sense_data = basic_sense_data;
+using basic_sense_data = dict_defs<std::string>::basic_sense_data;
+using basic_def_sense_data = dict_defs<std::string>::basic_def_sense_data;
+using trunc_sense_data = dict_defs<std::string>::trunc_sense_data;
+using div_sense_data = dict_defs<std::string>::div_sense_data;
+using sense_data = dict_defs<std::string>::sense_data;
+using word_info = dict_defs<std::string>::word_info;
 
-struct div_sense_data : basic_def_sense_data
+// definition types whose strings point into the source buffer (e.g. a def from dictionary_file::find_view()),
+// and are only valid as long as it is. for defs which are rendered immediately and then discarded
+namespace def_view
 {
-	std::string sense_div;
-};
+	using basic_sense_data = dict_defs<std::string_view>::basic_sense_data;
+	using basic_def_sense_data = dict_defs<std::string_view>::basic_def_sense_data;
+	using trunc_sense_data = dict_defs<std::string_view>::trunc_sense_data;
+	using div_sense_data = dict_defs<std::string_view>::div_sense_data;
+	using sense_data = dict_defs<std::string_view>::sense_data;
+	using word_info = dict_defs<std::string_view>::word_info;
+}
 
-struct sense_data : basic_def_sense_data
+// def_view types whose lists are allocated from a memory resource, such as the arena of a lookup (see background_lookup::offline_def),
+// so that parsing a def doesn't allocate for every entry. cbor_parse::parse gives every entry the allocator of the vector it is parsed into
+namespace def_arena
 {
-	std::optional<div_sense_data> sdsense;
-};
+	using basic_sense_data = dict_defs<std::string_view, std::pmr::vector>::basic_sense_data;
+	using basic_def_sense_data = dict_defs<std::string_view, std::pmr::vector>::basic_def_sense_data;
+	using trunc_sense_data = dict_defs<std::string_view, std::pmr::vector>::trunc_sense_data;
+	using div_sense_data = dict_defs<std::string_view, std::pmr::vector>::div_sense_data;
+	using sense_data = dict_defs<std::string_view, std::pmr::vector>::sense_data;
+	using word_info = dict_defs<std::string_view, std::pmr::vector>::word_info;
+
+	// a sense takes several times the memory of its CBOR encoding (and vectors leave their old buffers behind as they grow)
+	constexpr std::size_t bytes_per_def_byte = 8;
+	constexpr std::size_t extra_bytes = 4096;
+
+	// @return initial size of an arena which most defs of `def_size` bytes (and a copy of them) are parsed into without it growing
+	constexpr std::size_t initial_size(std::size_t def_size) { return def_size * bytes_per_def_byte + extra_bytes; }
+}
 
-struct word_info
+namespace detail
 {
-	std::string id;
-	std::vector<std::string> stems;
-	bool offensive;
-	
-	std::vector<std::variant<sense_data, trunc_sense_data>> defs;
-};
+	inline std::optional<std::string> materialize(const std::optional<std::string_view>& s)
+		{ return s ? std::optional<std::string>(s.value()) : std::nullopt; }
+
+	inline std::optional<std::vector<std::string>> materialize(const std::optional<std::vector<std::string_view>>& v)
+	{
+		if (!v)
+			{ return {}; }
+		return std::vector<std::string>(v->begin(), v->end());
+	}
+
+	inline void materialize(const def_view::basic_sense_data& in, basic_sense_data& out)
+	{
+		out.etymology = materialize(in.etymology);
+		out.inflections = materialize(in.inflections);
+		out.labels = materialize(in.labels);
+		out.pronunciations = materialize(in.pronunciations);
+		out.transitive_verb = in.transitive_verb;
+		out.subj_status = materialize(in.subj_status);
+		out.number = materialize(in.number);
+	}
+
+	inline void materialize(const def_view::basic_def_sense_data& in, basic_def_sense_data& out)
+	{
+		materialize(static_cast<const def_view::basic_sense_data&>(in), out);
+		out.def_text = in.def_text;
+	}
+}
+
+// copy `w` into owning strings, e.g. to keep it after its source buffer is gone
+// Complexity: O(total string length)
+inline word_info materialize(const def_view::word_info& w)
+{
+	word_info res;
+	res.id = w.id;
+	res.stems.assign(w.stems.begin(), w.stems.end());
+	res.offensive = w.offensive;
+	res.defs.reserve(w.defs.size());
+	for (const auto& sense : w.defs)
+	{
+		if (const auto full = std::get_if<def_view::sense_data>(&sense))
+		{
+			sense_data out;
+			detail::materialize(*full, out);
+			if (full->sdsense)
+			{
+				out.sdsense.emplace();
+				detail::materialize(full->sdsense.value(), out.sdsense.value());
+				out.sdsense->sense_div = full->sdsense->sense_div;
+			}
+			res.defs.push_back(std::move(out));
+		}
+		else
+		{
+			trunc_sense_data out;
+			detail::materialize(std::get<def_view::trunc_sense_data>(sense), out);
+			res.defs.push_back(std::move(out));
+		}
+	}
+	return res;
+}
 
 #endif
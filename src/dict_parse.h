@@ -18,10 +18,9 @@ task<void> parse_meta(coro_cursor auto& cursor, word_info& data)
 	using json_type = jsoncons::staj_event_type;
 	CO_CALL(cursor.next_); // consume begin object
 	
-	const json_obj_callbacks<3> meta_callbacks =
-    { {
-        { "id", json_type::string_value, [&cursor, &data]() -> task<void> { data.id = cursor.current().get<std::string>(); CO_CALL(cursor.next_); } },
-        { "stems", json_type::begin_array, [&cursor, &data]() -> task<void>
+	const json_obj_callbacks meta_callbacks(
+        obj_callback<"id", json_type::string_value>([&cursor, &data]() -> task<void> { data.id = cursor.current().get<std::string_view>(); CO_CALL(cursor.next_); }),
+        obj_callback<"stems", json_type::begin_array>([&cursor, &data]() -> task<void>
 			{
 				CO_CALL(cursor.next_); // skip begin array
 				for (; !cursor.done();)
@@ -29,13 +28,13 @@ task<void> parse_meta(coro_cursor auto& cursor, word_info& data)
 					const auto& cur_event = cursor.current();
 					if (cur_event.event_type() == json_type::end_array)
 						{ CO_CALL(cursor.next_); co_return; }
-					data.stems.push_back(cur_event.get<std::string>());
+					data.stems.emplace_back(cur_event.get<std::string_view>());
 					
 					CO_CALL(cursor.next_);
 				}
-			} },
-        { "offensive", json_type::bool_value, [&cursor, &data]() -> task<void> { data.offensive = cursor.current().get<bool>(); CO_CALL(cursor.next_); } }
-    } };
+			}),
+        obj_callback<"offensive", json_type::bool_value>([&cursor, &data]() -> task<void> { data.offensive = cursor.current().get<bool>(); CO_CALL(cursor.next_); })
+    );
 	
 	CO_WHILE(recursive_skip_until_obj, cursor, meta_callbacks) /* { */ }
 }
@@ -48,31 +47,30 @@ task<void> parse_sdsense(coro_cursor auto& cursor, word_info& data)
 	this_sense = div_sense_data(); // only full `sense` contains sdsense
 	
 	// TODO: merge this with parse_sense to avoid duplication ?
-	const json_obj_callbacks<3> sense_callbacks =
-	{ {
-		{ "sd", json_type::string_value, [&this_sense, &cursor]() -> task<void>
+	const json_obj_callbacks sense_callbacks(
+		obj_callback<"sd", json_type::string_value>([&this_sense, &cursor]() -> task<void>
 			{
-				this_sense.value().sense_div = cursor.current().get<std::string>();
+				this_sense.value().sense_div = cursor.current().get<std::string_view>();
 				CO_CALL(cursor.next_);
-			} },
-		{ "sn", json_type::string_value, [&this_sense, &cursor]() -> task<void>
+			}),
+		obj_callback<"sn", json_type::string_value>([&this_sense, &cursor]() -> task<void>
 			{
-				this_sense.value().number = cursor.current().get<std::string>();
+				this_sense.value().number = cursor.current().get<std::string_view>();
 				CO_CALL(cursor.next_);
-			} },
-		{ "dt", json_type::begin_array, [&this_sense, &cursor]() -> task<void>
+			}),
+		obj_callback<"dt", json_type::begin_array>([&this_sense, &cursor]() -> task<void>
 			{
 				CO_CALL(cursor.next_); // consume begin array
 				bool val;
 				CO_CALL(recursive_skip_until_key_arr, cursor, "text") >> val;
 				if (val)
 				{
-					this_sense.value().def_text = cursor.current().get<std::string>();
+					this_sense.value().def_text = cursor.current().get<std::string_view>();
 					CO_CALL(recursive_skip, cursor); // exit "text" array
 					CO_CALL(recursive_skip, cursor); // exit dt array
 				}
-			} },
-	} };
+			})
+	);
 	
 	CO_WHILE(recursive_skip_until_obj, cursor, sense_callbacks) /* { */ }
 }
@@ -89,44 +87,38 @@ task<void> parse_sense(coro_cursor auto& cursor, word_info& data)
 	using sense_type = std::conditional_t<is_trunc, trunc_sense_data, sense_data>;
 	data.defs.push_back(sense_type()); // new (truncated) sense
 	
-	json_obj_callbacks<1> basic_sense_callbacks =
-	{ {
-		{ "sn", json_type::string_value, [&cursor, &data]() -> task<void>
-			{
-				std::get<sense_type>(data.defs.back()).number = cursor.current().get<std::string>();
-				CO_CALL(cursor.next_);
-			} }
-	} };
+	// shared by full and truncated senses
+	const auto number_callback = obj_callback<"sn", json_type::string_value>([&cursor, &data]() -> task<void>
+		{
+			std::get<sense_type>(data.defs.back()).number = cursor.current().get<std::string_view>();
+			CO_CALL(cursor.next_);
+		});
 	
 	if constexpr (!is_trunc)
 	{
-		constexpr std::size_t sense_only_callbacks_size = 2, size2 = basic_sense_callbacks.size();
-		
-		json_obj_callbacks<sense_only_callbacks_size + size2> sense_callbacks =
-		{ {
-			{ "dt", json_type::begin_array, [&cursor, &data]() -> task<void>
+		const json_obj_callbacks sense_callbacks(
+			obj_callback<"dt", json_type::begin_array>([&cursor, &data]() -> task<void>
 				{
 					CO_CALL(cursor.next_); // consume begin array
 					bool val;
 					CO_CALL(recursive_skip_until_key_arr, cursor, "text") >> val;
 					if (val)
 					{
-						std::get<sense_data>(data.defs.back()).def_text = cursor.current().get<std::string>();
+						std::get<sense_data>(data.defs.back()).def_text = cursor.current().get<std::string_view>();
 						CO_CALL(recursive_skip, cursor); // exit "text" array
 						CO_CALL(recursive_skip, cursor); // exit dt array
 					}
-				} },
-			{ "sdsense", json_type::begin_object, CO_BIND_VOID(parse_sdsense, cursor, data) }
-		} };
-		
-		std::move(basic_sense_callbacks.begin(), basic_sense_callbacks.end(),
-			sense_callbacks.begin() + sense_only_callbacks_size);
+				}),
+			obj_callback<"sdsense", json_type::begin_object>(CO_BIND_VOID(parse_sdsense, cursor, data)),
+			number_callback
+		);
 		
 		CO_WHILE(recursive_skip_until_obj, cursor, sense_callbacks) /* { */ }
 	}
 	else
 	{
-		CO_WHILE(recursive_skip_until_obj, cursor, basic_sense_callbacks) /* { */ }
+		const json_obj_callbacks sense_callbacks(number_callback);
+		CO_WHILE(recursive_skip_until_obj, cursor, sense_callbacks) /* { */ }
 	}
 }
 
@@ -143,15 +135,14 @@ task<void> parse_pseq(coro_cursor auto& cursor, word_info& data)
 {
 	CO_CALL(cursor.next_); // consume begin array
 	
-	const json_key_arr_callbacks<2> pseq_callbacks =
-	{ {
-		{ "sense", [&cursor, &data]() -> task<void>
+	const json_key_arr_callbacks pseq_callbacks(
+		key_arr_callback<"sense">([&cursor, &data]() -> task<void>
 			{
 				CO_CALL(parse_sense, cursor, data);
 				CO_CALL(recursive_skip, cursor); // consume sub-array
-			} },
-		{ "bs", CO_BIND_VOID(parse_bs, cursor, data) }
-	} };
+			}),
+		key_arr_callback<"bs">(CO_BIND_VOID(parse_bs, cursor, data))
+	);
 	
 	CO_WHILE(recursive_skip_until_key_arr, cursor, pseq_callbacks) /* { */ }
 	
@@ -166,21 +157,20 @@ task<void> parse_sseq_element(coro_cursor auto& cursor, word_info& data)
 {
 	CO_CALL(cursor.next_); // consume begin array
 	
-	const json_key_arr_callbacks<4> sseq_callbacks =
-	{ {
-		{ "sense", [&cursor, &data]() -> task<void>
+	const json_key_arr_callbacks sseq_callbacks(
+		key_arr_callback<"sense">([&cursor, &data]() -> task<void>
 			{
 				CO_CALL(parse_sense, cursor, data);
 				CO_CALL(recursive_skip, cursor); // consume sub-array
-			} },
-		{ "sen", [&cursor, &data]() -> task<void>
+			}),
+		key_arr_callback<"sen">([&cursor, &data]() -> task<void>
 			{
 				CO_CALL(parse_sense<true>, cursor, data);
 				CO_CALL(recursive_skip, cursor); // consume sub-array
-			} },
-		{ "pseq", CO_BIND_VOID(parse_pseq, cursor, data) },
-		{ "bs", CO_BIND_VOID(parse_bs, cursor, data) }
-	} };
+			}),
+		key_arr_callback<"pseq">(CO_BIND_VOID(parse_pseq, cursor, data)),
+		key_arr_callback<"bs">(CO_BIND_VOID(parse_bs, cursor, data))
+	);
 	
 	CO_WHILE(recursive_skip_until_key_arr, cursor, sseq_callbacks) /* { */ }
 }
@@ -208,10 +198,9 @@ task<void> parse_single_def(coro_cursor auto& cursor, word_info& data)
 	using json_type = jsoncons::staj_event_type;
 	CO_CALL(cursor.next_); // consume begin object
 	
-	const json_obj_callbacks<1> def_callbacks =
-	{ {
-		{ "sseq", json_type::begin_array, CO_BIND_VOID(parse_sseq, cursor, data) }
-	} };
+	const json_obj_callbacks def_callbacks(
+		obj_callback<"sseq", json_type::begin_array>(CO_BIND_VOID(parse_sseq, cursor, data))
+	);
 	
 	CO_WHILE(recursive_skip_until_obj, cursor, def_callbacks) /* { */ }
 }
@@ -225,10 +214,9 @@ task<void> parse_def(coro_cursor auto& cursor, word_info& data)
 	CO_CALL(cursor.next_); // consume begin array
 	
 	// parse array
-	const json_arr_callbacks<1> def_callbacks =
-	{ {
-		{ json_type::begin_object, CO_BIND_VOID(parse_single_def, cursor, data) }
-	} };
+	const json_arr_callbacks def_callbacks(
+		arr_callback<json_type::begin_object>(CO_BIND_VOID(parse_single_def, cursor, data))
+	);
 	
 	CO_WHILE(recursive_skip_until_arr, cursor, def_callbacks) /* { */ }
 }
@@ -260,11 +248,10 @@ task<void> begin_parse(coro_cursor auto& cursor, std::vector<word_info>& data)
 		data.emplace_back();
 		CO_CALL(cursor.next_); // consume begin object
 
-		const json_obj_callbacks<2> root_callbacks =
-		{ {
-			{ "meta", json_type::begin_object, CO_BIND_VOID(parse_meta, cursor, data.back()) },
-			{ "def", json_type::begin_array, CO_BIND_VOID(parse_def, cursor, data.back()) }
-		} };
+		const json_obj_callbacks root_callbacks(
+			obj_callback<"meta", json_type::begin_object>(CO_BIND_VOID(parse_meta, cursor, data.back())),
+			obj_callback<"def", json_type::begin_array>(CO_BIND_VOID(parse_def, cursor, data.back()))
+		);
 		
 		CO_WHILE(recursive_skip_until_obj, cursor, root_callbacks) /* { */ }
 	}
@@ -0,0 +1,521 @@
+// headless lookups in an offline dictionary, for scripts and pipelines. definitions are parsed and rendered as in search_word
+// usage: dictionary_cli [options] [word...]
+//   -d <file.sdict>         dictionary to look up (default: data.sdict)
+//   -f <format>             plain (default), ansi (styled with escape codes) or json (one object per line)
+//   -j <n>                  number of threads (default: number of hardware threads)
+//   --stats                 print throughput to stderr
+//   --serve <port>          serve definitions over http instead (see serve()), with -j threads
+//   --host <address>        address to listen on with --serve (default: 127.0.0.1)
+//   --cache-mb <n>          memory for parsed definitions with --serve, in MiB (default: 64, 0 disables)
+//   --search <terms>        print the words whose definitions contain all of `terms` instead, one per line
+//                           (needs a full-text index, see sdict_tool --build-text-index)
+// words are read from stdin (one per line) if none are given. "word:n" only shows the entry with that id.
+// definitions are written in the order of the words, and words which aren't found are reported to stderr
+// (or as {"word":...,"error":...} in json). returns 1 if any word wasn't found
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <httplib.h>
+#include <jsoncons/json.hpp>
+#include <jsoncons_ext/cbor/cbor.hpp>
+
+#include "def_encoding.h"
+#include "dict_def.h"
+#include "flat_def.h"
+#include "lru_cache.h"
+#include "render_entries.h"
+#include "sdict_file.h"
+#include "styles.h"
+
+namespace
+{
+	// words read from stdin are looked up this many at a time, so that output starts before stdin ends
+	constexpr std::size_t batch_size = 4096;
+	// words handed out to a worker at a time
+	constexpr std::size_t chunk_size = 16;
+
+	enum class output_format { plain, ansi, json };
+
+	struct options
+	{
+		std::string filename = "data.sdict";
+		output_format format = output_format::plain;
+		std::size_t num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+		bool stats = false;
+		int port = -1;
+		std::string host = "127.0.0.1";
+		std::size_t cache_mb = 64;
+		std::optional<std::string> search;
+		std::vector<std::string> words;
+	};
+
+	// state of one worker, reused across definitions so that they don't allocate once warmed up
+	struct worker_state
+	{
+		std::vector<word_info> data;
+		// views of cached parsed definitions (see serve())
+		std::vector<def_view::word_info> view_data;
+		rendered_def rendered;
+		std::size_t def_bytes = 0;
+	};
+
+	// @return escape code which switches to `style` (from get_style)
+	std::string_view ansi_style(char style)
+	{
+		// indexed by style, less 'A' (see the style table in ui.h)
+		constexpr std::string_view codes[] =
+		{
+			"\x1b[0m", "\x1b[0;1m", "\x1b[0;3m", "\x1b[0;1;3m", "\x1b[0;2m", "\x1b[0;1;2m", "\x1b[0;3;2m", "\x1b[0;1;3;2m",
+			"\x1b[0;4;34m", "\x1b[0;1;4;34m", "\x1b[0;3;4;34m", "\x1b[0;1;3;4;34m", "\x1b[0;2;4;34m",
+			"\x1b[0;1;4m"
+		};
+		const auto ind = static_cast<std::size_t>(style - 'A');
+		return (ind < std::size(codes) ? codes[ind] : codes[0]);
+	}
+
+	void append_json_string(std::string& out, std::string_view s)
+	{
+		out += '"';
+		for (const char c : s)
+		{
+			switch (c)
+			{
+			case '"': out += "\\\""; break;
+			case '\\': out += "\\\\"; break;
+			case '\n': out += "\\n"; break;
+			case '\t': out += "\\t"; break;
+			case '\r': out += "\\r"; break;
+			default:
+				if (static_cast<unsigned char>(c) < 0x20)
+					{ out += std::format("\\u{:04x}", static_cast<unsigned char>(c)); }
+				else
+					{ out += c; }
+			}
+		}
+		out += '"';
+	}
+
+	// write the rendered definition in state to `out`
+	void write_def(std::string_view word, const worker_state& state, output_format format, std::string& out)
+	{
+		const std::string_view text(state.rendered.text.data(), state.rendered.text.size());
+		switch (format)
+		{
+		case output_format::plain:
+			out += text;
+			break;
+		case output_format::ansi:
+			for (const auto& run : state.rendered.style)
+			{
+				out += ansi_style(run.style);
+				out += text.substr(run.start, run.length);
+			}
+			out += ansi_style(get_style());
+			break;
+		case output_format::json:
+			out += "{\"word\":";
+			append_json_string(out, word);
+			out += ",\"text\":";
+			append_json_string(out, text);
+			out += ",\"links\":[";
+			for (const auto& [i, link] : state.rendered.def_links | std::views::enumerate)
+			{
+				if (i != 0)
+					{ out += ','; }
+				append_json_string(out, link.second);
+			}
+			out += "]}\n";
+			break;
+		}
+	}
+
+	// @return message for a word which isn't in `file`, including suggestions
+	std::string not_found_message(const dictionary_file& file, std::string_view word)
+	{
+		std::string message = "Not found";
+		const auto suggestions = file.suggest(word);
+		for (const auto& [i, suggestion] : suggestions | std::views::enumerate)
+			{ message.append(i == 0 ? ". Did you mean: " : ", ").append(suggestion); }
+		return message;
+	}
+
+	// parse the definition `def` (in encoding `e`, see def_encoding.h) into state.data
+	// the definition is complete, so it is decoded directly instead of through begin_parse, which only needs to suspend for streamed responses
+	// @throws std::runtime_error  if it couldn't be parsed
+	void parse_def(std::span<const std::byte> def, def_encoding::encoding e, worker_state& state)
+	{
+		state.def_bytes += def.size();
+		state.data.clear();
+		def_encoding::parse(e, def, state.data);
+	}
+
+	// render the parsed `entries` of `word`, writing them to `out`
+	// @throws std::runtime_error  if there is no entry with the id in `word`
+	template<typename WordInfo>
+	void render_parsed(std::span<const WordInfo> entries, std::string_view word, output_format format, worker_state& state, std::string& out)
+	{
+		state.rendered.clear();
+		render_entries(entries, word, state.rendered, true);
+		if (state.rendered.text.empty())
+			{ throw std::runtime_error("No entry with this id"); }
+		write_def(word, state, format, out);
+	}
+
+	// parse and render the definition `def` of `word`, writing it to `out`
+	// @throws std::runtime_error  if it couldn't be parsed, or there is no entry with the id in `word`
+	void render_def(std::span<const std::byte> def, def_encoding::encoding e, std::string_view word, output_format format, worker_state& state, std::string& out)
+	{
+		parse_def(def, e, state);
+		render_parsed(std::span<const word_info>(state.data), word, format, state, out);
+	}
+
+	void append_json_error(std::string& out, std::string_view word, std::string_view error)
+	{
+		out += "{\"word\":";
+		append_json_string(out, word);
+		out += ",\"error\":";
+		append_json_string(out, error);
+		out += "}\n";
+	}
+
+	// look up, parse and render `word`, writing it to `out`
+	// @return false if it wasn't found (or couldn't be parsed), in which case the error is written to `out` for json
+	//     and to `error` otherwise
+	bool process(const dictionary_file& file, std::string_view word, output_format format, worker_state& state, std::string& out, std::string& error)
+	{
+		try
+		{
+			const auto word_colon = word.rfind(':');
+			const auto def = file.find_view(word.substr(0, word_colon));
+			if (!def)
+				{ throw std::runtime_error(not_found_message(file, word.substr(0, word_colon))); }
+			render_def(def.value(), def_encoding::from_id(file.def_encoding()), word, format, state, out);
+			return true;
+		}
+		catch (const std::exception& e)
+		{
+			if (format == output_format::json)
+				{ append_json_error(out, word, e.what()); }
+			else
+				{ error = std::format("{}: {}", word, e.what()); }
+			return false;
+		}
+	}
+
+	// look up `words` on num_threads threads, and write them to stdout in order
+	// @return number of words which weren't found
+	std::size_t process_batch(const dictionary_file& file, std::span<const std::string> words, const options& opts, std::vector<worker_state>& states)
+	{
+		std::vector<std::string> outputs(words.size()), errors(words.size());
+		std::atomic<std::size_t> next = 0, num_failed = 0;
+		const auto work = [&](worker_state& state)
+		{
+			for (std::size_t begin; (begin = next.fetch_add(chunk_size, std::memory_order_relaxed)) < words.size();)
+			{
+				for (std::size_t i = begin; i < std::min(begin + chunk_size, words.size()); i++)
+				{
+					if (!process(file, words[i], opts.format, state, outputs[i], errors[i]))
+						{ num_failed.fetch_add(1, std::memory_order_relaxed); }
+				}
+			}
+		};
+		const std::size_t num_threads = std::min(states.size(), (words.size() + chunk_size - 1) / chunk_size);
+		if (num_threads <= 1)
+			{ work(states[0]); }
+		else
+		{
+			std::vector<std::jthread> workers;
+			for (std::size_t i = 0; i < num_threads; i++)
+				{ workers.emplace_back(work, std::ref(states[i])); }
+		}
+
+		for (std::size_t i = 0; i < words.size(); i++)
+		{
+			if (!errors[i].empty())
+				{ std::cerr << errors[i] << '\n'; }
+			std::cout << outputs[i];
+		}
+		std::cout.flush();
+		return num_failed;
+	}
+
+	// @return whether `etag` is one of the tags in the If-None-Match header value `header`
+	bool etag_matches(std::string_view header, std::string_view etag)
+	{
+		for (const auto part : header | std::views::split(','))
+		{
+			std::string_view tag(part.begin(), part.end());
+			tag.remove_prefix(std::min(tag.find_first_not_of(" \t"), tag.size()));
+			tag.remove_suffix(tag.size() - std::min(tag.find_last_not_of(" \t") + 1, tag.size()));
+			// weak comparison, as If-None-Match uses
+			if (tag.starts_with("W/"))
+				{ tag.remove_prefix(2); }
+			if (tag == "*" || tag == etag)
+				{ return true; }
+		}
+		return false;
+	}
+
+	// serve definitions over http until the process is killed
+	// GET /define/<word>[?format=text|ansi|json]: text (default) and ansi are rendered like the cli output,
+	// json is the stored word_info as compact json. "word:n" only returns the entry with that id, as with the cli.
+	// requests are handled by a pool of num_threads threads, each with its own worker_state, and connections are kept alive.
+	// the etag is the stored hash of the definition, so clients revalidating an unchanged definition get 304 Not Modified
+	// without it being parsed or rendered. parsed definitions are kept (as flat_defs, keyed by the same hash) up to cache_mb,
+	// so popular words are only rendered
+	// @return false if the server couldn't listen on host:port
+	bool serve(const dictionary_file& file, const options& opts)
+	{
+		sharded_lru_cache<std::uint64_t, flat_defs> parsed(opts.cache_mb * 1024 * 1024);
+		httplib::Server server;
+		server.new_task_queue = [num_threads = opts.num_threads] { return new httplib::ThreadPool(num_threads); };
+		server.set_keep_alive_max_count(1000);
+		server.Get(R"(/define/(.+))", [&file, &parsed](const httplib::Request& req, httplib::Response& res)
+		{
+			thread_local worker_state state;
+			const std::string word = req.matches[1].str();
+			const std::string format_name = (req.has_param("format") ? req.get_param_value("format") : "text");
+			const bool json = (format_name == "json");
+			if (format_name != "text" && format_name != "ansi" && !json)
+			{
+				res.status = httplib::StatusCode::BadRequest_400;
+				res.set_content(std::format("Unknown format {}\n", format_name), "text/plain; charset=utf-8");
+				return;
+			}
+			const auto content_type = (json ? "application/json" : "text/plain; charset=utf-8");
+			const auto set_error = [&](int status, std::string_view error)
+			{
+				std::string body;
+				if (json)
+					{ append_json_error(body, word, error); }
+				else
+					{ body = std::format("{}: {}\n", word, error); }
+				res.status = status;
+				res.set_content(std::move(body), content_type);
+			};
+
+			try
+			{
+				const auto word_colon = word.rfind(':');
+				const auto found = file.find_view_and_hash(word.substr(0, word_colon));
+				if (!found)
+				{
+					set_error(httplib::StatusCode::NotFound_404, not_found_message(file, word.substr(0, word_colon)));
+					return;
+				}
+				const auto [def, hash] = found.value();
+				// each format is a different representation, so it has a different etag
+				const std::string etag = (word_colon == std::string_view::npos ?
+					std::format("\"{:016x}-{}\"", hash, format_name) :
+					std::format("\"{:016x}-{}-{}\"", hash, format_name, word.substr(word_colon + 1)));
+				res.set_header("ETag", etag);
+				res.set_header("Cache-Control", "no-cache");
+				if (req.has_header("If-None-Match") && etag_matches(req.get_header_value("If-None-Match"), etag))
+				{
+					res.status = httplib::StatusCode::NotModified_304;
+					return;
+				}
+
+				std::string body;
+				if (json)
+				{
+					if (file.def_encoding() != static_cast<std::uint32_t>(def_encoding::encoding::cbor))
+						{ throw std::runtime_error("Definitions are only kept as JSON in CBOR encoded files"); }
+					auto entries = jsoncons::cbor::decode_cbor<jsoncons::json>(def);
+					if (word_colon != std::string_view::npos && entries.is_array())
+					{
+						jsoncons::json filtered(jsoncons::json_array_arg);
+						for (const auto& entry : entries.array_range())
+						{
+							if (entry.contains("meta") && entry.at("meta").contains("id") && entry.at("meta").at("id").as_string_view() == word)
+								{ filtered.push_back(entry); }
+						}
+						if (filtered.empty())
+							{ throw std::runtime_error("No entry with this id"); }
+						entries = std::move(filtered);
+					}
+					entries.dump(body);
+					body += '\n';
+				}
+				else
+				{
+					auto flat = parsed.find(hash);
+					if (!flat)
+					{
+						parse_def(def, def_encoding::from_id(file.def_encoding()), state);
+						flat = std::make_shared<const flat_defs>(flat_defs::from(std::span<const word_info>(state.data)));
+						parsed.insert(hash, flat, sizeof(flat_defs) + flat->memory_size());
+					}
+					flat->to_view(state.view_data);
+					render_parsed(std::span<const def_view::word_info>(state.view_data), word,
+						(format_name == "ansi" ? output_format::ansi : output_format::plain), state, body);
+				}
+				res.set_content(std::move(body), content_type);
+			}
+			catch (const std::exception& e)
+			{
+				res.headers.erase("ETag");
+				set_error(httplib::StatusCode::InternalServerError_500, e.what());
+			}
+		});
+		std::cerr << std::format("Listening on http://{}:{}", opts.host, opts.port) << std::endl;
+		return server.listen(opts.host, opts.port);
+	}
+
+	options parse_args(int argc, char** argv)
+	{
+		options opts;
+		for (int i = 1; i < argc; i++)
+		{
+			const std::string_view arg = argv[i];
+			const auto next_arg = [&]() -> std::string_view
+			{
+				if (i + 1 >= argc)
+					{ throw std::invalid_argument(std::format("Missing value for {}", arg)); }
+				return argv[++i];
+			};
+			if (arg == "-d")
+				{ opts.filename = next_arg(); }
+			else if (arg == "-f")
+			{
+				const auto format = next_arg();
+				if (format == "plain")
+					{ opts.format = output_format::plain; }
+				else if (format == "ansi")
+					{ opts.format = output_format::ansi; }
+				else if (format == "json")
+					{ opts.format = output_format::json; }
+				else
+					{ throw std::invalid_argument(std::format("Unknown format {}", format)); }
+			}
+			else if (arg == "-j")
+				{ opts.num_threads = std::max<std::size_t>(std::stoull(std::string(next_arg())), 1); }
+			else if (arg == "--stats")
+				{ opts.stats = true; }
+			else if (arg == "--serve")
+				{ opts.port = std::stoi(std::string(next_arg())); }
+			else if (arg == "--host")
+				{ opts.host = next_arg(); }
+			else if (arg == "--cache-mb")
+				{ opts.cache_mb = std::stoull(std::string(next_arg())); }
+			else if (arg == "--search")
+				{ opts.search = next_arg(); }
+			else if (arg.starts_with("-"))
+				{ throw std::invalid_argument(std::format("Unexpected argument {}", arg)); }
+			else
+				{ opts.words.emplace_back(arg); }
+		}
+		if (opts.port != -1 && !opts.words.empty())
+			{ throw std::invalid_argument("Words can't be given with --serve"); }
+		if (opts.search && (opts.port != -1 || !opts.words.empty()))
+			{ throw std::invalid_argument("Words and --serve can't be given with --search"); }
+		return opts;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	options opts;
+	try
+		{ opts = parse_args(argc, argv); }
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << "\nusage: dictionary_cli [-d <file.sdict>] [-f plain|ansi|json] [-j <n>] [--stats] [word...]\n"
+			"       dictionary_cli [-d <file.sdict>] [-j <n>] --serve <port> [--host <address>] [--cache-mb <n>]\n"
+			"       dictionary_cli [-d <file.sdict>] --search <terms>" << std::endl;
+		return 1;
+	}
+
+	try
+	{
+		dictionary_file file;
+		// lookups only read, so the file is mapped and shared by the workers
+		file.open_mapped(opts.filename, false);
+		if (opts.search)
+		{
+			const auto found = file.find_text(opts.search.value());
+			for (const auto word : found)
+				{ std::cout << word << '\n'; }
+			std::cout.flush();
+			return found.empty() ? 1 : 0;
+		}
+		if (opts.port != -1)
+		{
+			if (!serve(file, opts))
+			{
+				std::cerr << std::format("Couldn't listen on {}:{}", opts.host, opts.port) << std::endl;
+				return 1;
+			}
+			return 0;
+		}
+		std::ios::sync_with_stdio(false);
+
+		std::vector<worker_state> states(opts.num_threads);
+		std::size_t num_words = 0, num_failed = 0;
+		const auto start = std::chrono::steady_clock::now();
+		if (!opts.words.empty())
+		{
+			num_words = opts.words.size();
+			num_failed = process_batch(file, opts.words, opts, states);
+		}
+		else
+		{
+			std::vector<std::string> batch;
+			std::string line;
+			while (true)
+			{
+				const bool more = static_cast<bool>(std::getline(std::cin, line));
+				if (more)
+				{
+					if (line.ends_with('\r'))
+						{ line.pop_back(); }
+					if (!line.empty())
+						{ batch.push_back(std::move(line)); }
+				}
+				if (batch.size() >= batch_size || (!more && !batch.empty()))
+				{
+					num_words += batch.size();
+					num_failed += process_batch(file, batch, opts, states);
+					batch.clear();
+				}
+				if (!more)
+					{ break; }
+			}
+		}
+
+		if (opts.stats)
+		{
+			const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			std::size_t def_bytes = 0;
+			for (const auto& state : states)
+				{ def_bytes += state.def_bytes; }
+			const double seconds = std::max(elapsed.count(), 1e-9);
+			std::cerr << std::format(R"({{"words":{},"failed":{},"threads":{},"seconds":{:.2f},"words_per_sec":{:.1f},"def_mb_per_sec":{:.1f}}})",
+				num_words, num_failed, opts.num_threads, seconds, static_cast<double>(num_words) / seconds,
+				static_cast<double>(def_bytes) / seconds / (1024 * 1024)) << std::endl;
+		}
+		return num_failed == 0 ? 0 : 1;
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+}
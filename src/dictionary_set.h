@@ -0,0 +1,200 @@
+#ifndef DICTIONARY_SET_H
+#define DICTIONARY_SET_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+#include "bloom.h"
+#include "sdict_file.h"
+
+// ordered set of dictionary files (layers) which are searched as one dictionary
+// layer 0 has the highest precedence: if a word is in several layers, its def is taken from the lowest index.
+// this allows a small writable overlay on top of large read only files, or a dictionary sharded across files
+// an optional combined bloom filter over all layers rejects most absent words without probing every layer
+class dictionary_set
+{
+private:
+	// unique_ptr, since dictionary_file is not movable
+	std::vector<std::unique_ptr<dictionary_file>> layers;
+
+	// combined filter bits, empty if there is none
+	std::vector<std::byte> filter;
+	std::uint32_t filter_num_hashes = 0;
+
+public:
+	dictionary_set() {}
+
+	// open `filenames` read only (see dictionary_file::open_mapped()) in parallel, replacing all existing layers
+	// filenames[0] has the highest precedence. the combined filter is cleared
+	// Complexity: O(max layer open complexity) with enough threads
+	// File Access: Map, for every file
+	// @param check_defs  whether to verify definition hashes (see dictionary_file::open_mapped())
+	// @throws std::runtime_error  on file i/o or parsing error of any file (the error of the first such file is thrown)
+	void open_mapped(std::span<const std::string> filenames, bool check_defs = true)
+	{
+		std::vector<std::unique_ptr<dictionary_file>> new_layers(filenames.size());
+		std::vector<std::exception_ptr> errors(filenames.size());
+		{
+			std::vector<std::jthread> workers;
+			workers.reserve(filenames.size());
+			for (std::size_t i = 0; i < filenames.size(); i++)
+			{
+				workers.emplace_back([&, i]()
+				{
+					try
+					{
+						auto layer = std::make_unique<dictionary_file>();
+						layer->open_mapped(filenames[i], check_defs);
+						new_layers[i] = std::move(layer);
+					}
+					catch (...)
+						{ errors[i] = std::current_exception(); }
+				});
+			}
+		}
+		for (const auto& e : errors)
+		{
+			if (e)
+				{ std::rethrow_exception(e); }
+		}
+		layers = std::move(new_layers);
+		filter.clear();
+	}
+
+	// open `filename` writable (see dictionary_file::open(string_view)) as the new highest precedence layer.
+	// words added through add_word() go to this layer, shadowing the same words in lower layers
+	// Complexity: that of dictionary_file::open(string_view), plus O(n_layers)
+	// File Access: that of dictionary_file::open(string_view)
+	// @throws std::runtime_error  on file i/o or parsing error
+	// @return the new layer
+	dictionary_file& add_overlay(std::string_view filename, bool create_if_not_exists = true, bool deduplicate = true, bool check_defs = true)
+	{
+		auto layer = std::make_unique<dictionary_file>(filename, create_if_not_exists, deduplicate, check_defs);
+		layers.insert(layers.begin(), std::move(layer));
+		// words of the new layer are not in the filter
+		filter.clear();
+		return *layers.front();
+	}
+
+	// Complexity: O(1)
+	std::size_t num_layers() const noexcept { return layers.size(); }
+
+	// layers may be modified directly, but words added this way are not in the combined filter until build_filter() is called
+	// Complexity: O(1)
+	dictionary_file& layer(std::size_t i) { return *layers.at(i); }
+	const dictionary_file& layer(std::size_t i) const { return *layers.at(i); }
+
+	// build the combined filter over the (flushed) words of all layers
+	// Complexity: O(total_words)
+	// File Access: No
+	// @param bits_per_word  filter bits per word. 10 gives about 1% false positives
+	// @throws std::logic_error  if bits_per_word is not in [1, 64]
+	void build_filter(std::uint32_t bits_per_word = 10)
+	{
+		if (bits_per_word == 0 || bits_per_word > 64)
+			{ throw std::logic_error("Bloom filter bits per word must be between 1 and 64"); }
+		std::uint64_t total_words = 0;
+		for (const auto& l : layers)
+			{ total_words += l->num_words(); }
+		// multiple of 64 bits, at least 64
+		const std::uint64_t num_bits = (std::max<std::uint64_t>(total_words * bits_per_word, 1) + 63) / 64 * 64;
+		filter.assign(num_bits / 8, std::byte(0));
+		filter_num_hashes = bloom::num_hashes(bits_per_word);
+		for (const auto& l : layers)
+		{
+			for (const auto word : l->prefix_range(""))
+				{ bloom::insert(filter, filter_num_hashes, word); }
+		}
+	}
+
+	// Complexity: O(1) if there is a combined filter, otherwise O(n_layers) times that of dictionary_file::maybe_contains()
+	// File Access: No
+	// @return false if `word` is definitely not in any layer
+	bool maybe_contains(std::string_view word) const
+	{
+		if (!filter.empty())
+			{ return bloom::may_contain(filter, filter_num_hashes, word); }
+		for (const auto& l : layers)
+		{
+			if (l->maybe_contains(word))
+				{ return true; }
+		}
+		return false;
+	}
+
+	// absent words are usually rejected by the combined filter, or by the bloom filter of each layer
+	// Complexity: O(n_layers * log(n_words)) worst case
+	// File Access: No
+	// @return index of the highest precedence layer containing `word`
+	std::optional<std::size_t> find_layer(std::string_view word) const
+	{
+		if (!filter.empty() && !bloom::may_contain(filter, filter_num_hashes, word))
+			{ return {}; }
+		for (std::size_t i = 0; i < layers.size(); i++)
+		{
+			if (layers[i]->contains(word))
+				{ return i; }
+		}
+		return {};
+	}
+
+	// Complexity: that of find_layer()
+	// File Access: No
+	bool contains(std::string_view word) const { return find_layer(word).has_value(); }
+
+	// see dictionary_file::find(). safe to call concurrently under the same conditions
+	// Complexity: that of find_layer(), plus O(def_size)
+	// File Access: Read, def_size + 12 bytes (No if the layer is mapped)
+	// @throws std::runtime_error  on file i/o or decoding error
+	std::optional<std::vector<char>> find(std::string_view word, bool check_def = false) const
+	{
+		const auto i = find_layer(word);
+		if (!i)
+			{ return {}; }
+		return layers[i.value()]->find(word, check_def);
+	}
+
+	// see dictionary_file::find_view()
+	// Complexity: that of find_layer() (plus O(def_size) if check_def or compressed)
+	// File Access: No
+	// @throws std::runtime_error  on corrupted definition
+	// @throws std::logic_error  if the layer containing `word` is not mapped
+	std::optional<std::span<const std::byte>> find_view(std::string_view word, bool check_def = false) const
+	{
+		const auto i = find_layer(word);
+		if (!i)
+			{ return {}; }
+		return layers[i.value()]->find_view(word, check_def);
+	}
+
+	// add a word to the highest precedence layer (see add_overlay()), and to the combined filter.
+	// only fails if the word already exists in that layer, since it shadows lower layers
+	// Complexity: that of dictionary_file::add_word()
+	// File Access: that of dictionary_file::add_word()
+	// @throws std::runtime_error  on file i/o or parsing error
+	// @throws std::logic_error  if there are no layers, or layer 0 is mapped read only
+	// @return whether the word/def was successfully inserted
+	bool add_word(std::string_view word, std::span<const std::byte> def)
+	{
+		if (layers.empty())
+			{ throw std::logic_error("No layers. Call add_overlay(string_view) first"); }
+		if (!layers.front()->add_word(word, def))
+			{ return false; }
+		if (!filter.empty())
+			{ bloom::insert(filter, filter_num_hashes, word); }
+		return true;
+	}
+	bool add_word(std::string_view word, std::span<const char> def) { return add_word(word, std::as_bytes(def)); }
+};
+
+#endif
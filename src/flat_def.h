@@ -0,0 +1,583 @@
+#ifndef FLAT_DEF_H
+#define FLAT_DEF_H
+
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+
+#include "dict_def.h"
+
+// compact representation of parsed entries (of one def, see dict_def.h): all strings are in one pool,
+// and entries and senses are fixed-size records which refer to strings and lists of strings by index ranges.
+// word_info spreads each sense over many small allocations (mostly empty optional vectors),
+// while this is a handful of flat vectors, so it is cheaper to keep in caches, copy and serialize
+struct flat_defs
+{
+	constexpr static std::uint32_t absent = -1;
+
+	// range of `pool`. offset is `absent` for an empty optional
+	struct str_ref
+	{
+		std::uint32_t offset = absent, size = 0;
+	};
+	// range of `lists`. first is `absent` for an empty optional
+	struct list_ref
+	{
+		std::uint32_t first = absent, count = 0;
+	};
+
+	enum class sense_kind : std::uint8_t
+	{
+		full = 0,
+		trunc = 1,
+		div = 2
+	};
+	struct sense_record
+	{
+		str_ref etymology, number, def_text, sense_div;
+		list_ref inflections, labels, pronunciations, subj_status;
+		// index of the sdsense in `sub_senses` (for full senses), or `absent`
+		std::uint32_t sdsense = absent;
+		sense_kind kind = sense_kind::full;
+		// 0 if absent, otherwise 1 + value
+		std::uint8_t transitive_verb = 0;
+	};
+	struct entry_record
+	{
+		str_ref id;
+		list_ref stems;
+		// range of `senses`
+		std::uint32_t first_sense = 0, num_senses = 0;
+		bool offensive = false;
+	};
+
+	std::string pool;
+	std::vector<str_ref> lists;
+	// senses of all entries, in order
+	std::vector<sense_record> senses;
+	// sdsenses (div senses) of `senses`
+	std::vector<sense_record> sub_senses;
+	std::vector<entry_record> entries;
+
+private:
+	str_ref add_str(std::string_view s)
+	{
+		const str_ref res{ static_cast<std::uint32_t>(pool.size()), static_cast<std::uint32_t>(s.size()) };
+		pool += s;
+		return res;
+	}
+	template<typename String>
+	str_ref add_str(const std::optional<String>& s)
+		{ return s ? add_str(std::string_view(s.value())) : str_ref{}; }
+
+	template<typename String>
+	list_ref add_list(const std::vector<String>& v)
+	{
+		const list_ref res{ static_cast<std::uint32_t>(lists.size()), static_cast<std::uint32_t>(v.size()) };
+		for (const auto& s : v)
+			{ lists.push_back(add_str(std::string_view(s))); }
+		return res;
+	}
+	template<typename String>
+	list_ref add_list(const std::optional<std::vector<String>>& v)
+		{ return v ? add_list(v.value()) : list_ref{}; }
+
+	template<typename Sense>
+	sense_record make_sense(const Sense& val)
+	{
+		sense_record rec;
+		rec.etymology = add_str(val.etymology);
+		rec.number = add_str(val.number);
+		rec.inflections = add_list(val.inflections);
+		rec.labels = add_list(val.labels);
+		rec.pronunciations = add_list(val.pronunciations);
+		rec.subj_status = add_list(val.subj_status);
+		rec.transitive_verb = static_cast<std::uint8_t>(val.transitive_verb ? 1 + val.transitive_verb.value() : 0);
+		return rec;
+	}
+
+	std::vector<std::string_view> list_views(list_ref ref) const
+	{
+		std::vector<std::string_view> res;
+		res.reserve(ref.count);
+		for (const auto s : list(ref))
+			{ res.push_back(str(s)); }
+		return res;
+	}
+
+	void fill_view(const sense_record& rec, def_view::basic_sense_data& out) const
+	{
+		out.etymology = opt_str(rec.etymology);
+		out.number = opt_str(rec.number);
+		out.inflections = opt_list(rec.inflections);
+		out.labels = opt_list(rec.labels);
+		out.pronunciations = opt_list(rec.pronunciations);
+		out.subj_status = opt_list(rec.subj_status);
+		out.transitive_verb = (rec.transitive_verb == 0 ? std::nullopt : std::optional<bool>(rec.transitive_verb == 2));
+	}
+
+public:
+	// add `w` (a word_info of any string type) after the existing entries
+	// Complexity: O(n_senses + total string length)
+	template<typename WordInfo>
+	void append(const WordInfo& w)
+	{
+		using types = typename WordInfo::def_types;
+		entry_record entry;
+		entry.id = add_str(std::string_view(w.id));
+		entry.stems = add_list(w.stems);
+		entry.offensive = w.offensive;
+		entry.first_sense = static_cast<std::uint32_t>(senses.size());
+		entry.num_senses = static_cast<std::uint32_t>(w.defs.size());
+		for (const auto& sense : w.defs)
+		{
+			if (const auto full = std::get_if<typename types::sense_data>(&sense))
+			{
+				auto rec = make_sense(*full);
+				rec.def_text = add_str(std::string_view(full->def_text));
+				if (full->sdsense)
+				{
+					auto sub = make_sense(full->sdsense.value());
+					sub.kind = sense_kind::div;
+					sub.def_text = add_str(std::string_view(full->sdsense->def_text));
+					sub.sense_div = add_str(std::string_view(full->sdsense->sense_div));
+					rec.sdsense = static_cast<std::uint32_t>(sub_senses.size());
+					sub_senses.push_back(sub);
+				}
+				senses.push_back(rec);
+			}
+			else
+			{
+				auto rec = make_sense(std::get<typename types::trunc_sense_data>(sense));
+				rec.kind = sense_kind::trunc;
+				senses.push_back(rec);
+			}
+		}
+		entries.push_back(entry);
+	}
+
+	// Complexity: O(n_entries * n_senses + total string length)
+	template<typename WordInfo>
+	static flat_defs from(std::span<const WordInfo> entries)
+	{
+		flat_defs res;
+		for (const auto& w : entries)
+			{ res.append(w); }
+		return res;
+	}
+
+	void clear() noexcept
+	{
+		pool.clear();
+		lists.clear();
+		senses.clear();
+		sub_senses.clear();
+		entries.clear();
+	}
+
+	std::string_view str(str_ref ref) const
+		{ return ref.offset == absent ? std::string_view() : std::string_view(pool).substr(ref.offset, ref.size); }
+	std::optional<std::string_view> opt_str(str_ref ref) const
+		{ return ref.offset == absent ? std::nullopt : std::optional<std::string_view>(str(ref)); }
+	std::span<const str_ref> list(list_ref ref) const
+		{ return ref.first == absent ? std::span<const str_ref>() : std::span(lists).subspan(ref.first, ref.count); }
+	std::optional<std::vector<std::string_view>> opt_list(list_ref ref) const
+		{ return ref.first == absent ? std::nullopt : std::optional(list_views(ref)); }
+
+	// views of the entries in the usual (word_info) form, e.g. for rendering. they point into `pool`, so are valid as long as it is
+	// Complexity: O(n_entries * n_senses + n_list_strings)
+	// @param out  reused across calls, so that its senses don't need to be reallocated
+	void to_view(std::vector<def_view::word_info>& out) const
+	{
+		out.resize(entries.size());
+		for (std::size_t i = 0; i < entries.size(); i++)
+		{
+			const auto& entry = entries[i];
+			auto& w = out[i];
+			w.id = str(entry.id);
+			w.stems = list_views(entry.stems);
+			w.offensive = entry.offensive;
+			w.defs.clear();
+			for (const auto& rec : std::span(senses).subspan(entry.first_sense, entry.num_senses))
+			{
+				if (rec.kind == sense_kind::trunc)
+				{
+					def_view::trunc_sense_data val;
+					fill_view(rec, val);
+					w.defs.emplace_back(std::move(val));
+					continue;
+				}
+				def_view::sense_data val;
+				fill_view(rec, val);
+				val.def_text = str(rec.def_text);
+				if (rec.sdsense != absent)
+				{
+					const auto& sub = sub_senses[rec.sdsense];
+					auto& div = val.sdsense.emplace();
+					fill_view(sub, div);
+					div.def_text = str(sub.def_text);
+					div.sense_div = str(sub.sense_div);
+				}
+				w.defs.emplace_back(std::move(val));
+			}
+		}
+	}
+
+	// @return approximate memory used, not including sizeof(flat_defs)
+	std::size_t memory_size() const noexcept
+	{
+		return pool.capacity() + lists.capacity() * sizeof(str_ref) + (senses.capacity() + sub_senses.capacity()) * sizeof(sense_record)
+			+ entries.capacity() * sizeof(entry_record);
+	}
+
+private:
+	static void append_uint32_LE(std::uint32_t num, std::vector<std::byte>& out)
+	{
+		for (std::size_t i = 0; i < 4; i++)
+			{ out.push_back(static_cast<std::byte>((num >> (i * 8)) & 0xFF)); }
+	}
+	// @return false if `in` has less than 4 bytes
+	static bool read_uint32_LE(std::span<const std::byte>& in, std::uint32_t& num)
+	{
+		if (in.size() < 4)
+			{ return false; }
+		num = 0;
+		for (std::size_t i = 0; i < 4; i++)
+			{ num |= std::to_integer<std::uint32_t>(in[i]) << (i * 8); }
+		in = in.subspan(4);
+		return true;
+	}
+
+	constexpr static std::size_t sense_record_fields = 17;
+	// sizes of the parts of serialize()d flat_defs
+	constexpr static std::size_t header_size = 5 * 4;
+	constexpr static std::size_t list_string_size = 8;
+	constexpr static std::size_t sense_size = sense_record_fields * 4 + 2;
+	constexpr static std::size_t entry_size = 6 * 4 + 1;
+
+	static void append_sense(const sense_record& rec, std::vector<std::byte>& out)
+	{
+		for (const auto ref : { rec.etymology, rec.number, rec.def_text, rec.sense_div })
+		{
+			append_uint32_LE(ref.offset, out);
+			append_uint32_LE(ref.size, out);
+		}
+		for (const auto ref : { rec.inflections, rec.labels, rec.pronunciations, rec.subj_status })
+		{
+			append_uint32_LE(ref.first, out);
+			append_uint32_LE(ref.count, out);
+		}
+		append_uint32_LE(rec.sdsense, out);
+		out.push_back(static_cast<std::byte>(rec.kind));
+		out.push_back(static_cast<std::byte>(rec.transitive_verb));
+	}
+
+	// check that the ranges of `ref` are within the pool or lists
+	bool valid(str_ref ref) const noexcept
+		{ return ref.offset == absent ? ref.size == 0 : (ref.offset <= pool.size() && ref.size <= pool.size() - ref.offset); }
+	bool valid(list_ref ref) const noexcept
+		{ return ref.first == absent ? ref.count == 0 : (ref.first <= lists.size() && ref.count <= lists.size() - ref.first); }
+	bool valid(const sense_record& rec, bool sub) const noexcept
+	{
+		return valid(rec.etymology) && valid(rec.number) && valid(rec.def_text) && valid(rec.sense_div)
+			&& valid(rec.inflections) && valid(rec.labels) && valid(rec.pronunciations) && valid(rec.subj_status)
+			&& rec.transitive_verb <= 2 && (sub ? rec.kind == sense_kind::div : rec.kind != sense_kind::div)
+			&& (rec.sdsense == absent || (!sub && rec.kind == sense_kind::full && rec.sdsense < sub_senses.size()));
+	}
+
+public:
+	// append a serialized copy to `out`, which deserialize() reads back
+	// it contains unsigned 32-bit (4-byte LE) counts of pool bytes, list strings, senses, sub senses and entries, followed by
+	// the pool, list strings (offset and size), senses and sub senses (offset and size of etymology, number, def_text and sense_div,
+	// first and count of inflections, labels, pronunciations and subj_status, sdsense, and 1 byte each of kind and transitive_verb)
+	// and entries (offset and size of id, first and count of stems, first_sense, num_senses, and 1 byte of offensive), all 32-bit LE
+	// Complexity: O(size)
+	void serialize(std::vector<std::byte>& out) const
+	{
+		for (const auto count : { pool.size(), lists.size(), senses.size(), sub_senses.size(), entries.size() })
+			{ append_uint32_LE(static_cast<std::uint32_t>(count), out); }
+		const auto pool_bytes = std::as_bytes(std::span(pool));
+		out.insert(out.end(), pool_bytes.begin(), pool_bytes.end());
+		for (const auto ref : lists)
+		{
+			append_uint32_LE(ref.offset, out);
+			append_uint32_LE(ref.size, out);
+		}
+		for (const auto& rec : senses)
+			{ append_sense(rec, out); }
+		for (const auto& rec : sub_senses)
+			{ append_sense(rec, out); }
+		for (const auto& entry : entries)
+		{
+			append_uint32_LE(entry.id.offset, out);
+			append_uint32_LE(entry.id.size, out);
+			append_uint32_LE(entry.stems.first, out);
+			append_uint32_LE(entry.stems.count, out);
+			append_uint32_LE(entry.first_sense, out);
+			append_uint32_LE(entry.num_senses, out);
+			out.push_back(static_cast<std::byte>(entry.offensive));
+		}
+	}
+
+	// Complexity: O(size)
+	// @return the flat_defs serialized in `in` (see serialize()), or empty if it is malformed
+	static std::optional<flat_defs> deserialize(std::span<const std::byte> in)
+	{
+		std::uint32_t pool_size, n_lists, n_senses, n_sub_senses, n_entries;
+		if (!read_uint32_LE(in, pool_size) || !read_uint32_LE(in, n_lists) || !read_uint32_LE(in, n_senses)
+			|| !read_uint32_LE(in, n_sub_senses) || !read_uint32_LE(in, n_entries))
+			{ return {}; }
+		if (in.size() != pool_size + std::uint64_t(n_lists) * list_string_size + (std::uint64_t(n_senses) + n_sub_senses) * sense_size
+			+ std::uint64_t(n_entries) * entry_size)
+			{ return {}; }
+
+		flat_defs res;
+		res.pool.assign(reinterpret_cast<const char*>(in.data()), pool_size);
+		in = in.subspan(pool_size);
+		res.lists.resize(n_lists);
+		for (auto& ref : res.lists)
+			{ read_uint32_LE(in, ref.offset); read_uint32_LE(in, ref.size); }
+		const auto read_sense = [&in](sense_record& rec)
+		{
+			for (auto* ref : { &rec.etymology, &rec.number, &rec.def_text, &rec.sense_div })
+				{ read_uint32_LE(in, ref->offset); read_uint32_LE(in, ref->size); }
+			for (auto* ref : { &rec.inflections, &rec.labels, &rec.pronunciations, &rec.subj_status })
+				{ read_uint32_LE(in, ref->first); read_uint32_LE(in, ref->count); }
+			read_uint32_LE(in, rec.sdsense);
+			rec.kind = static_cast<sense_kind>(in[0]);
+			rec.transitive_verb = std::to_integer<std::uint8_t>(in[1]);
+			in = in.subspan(2);
+		};
+		res.senses.resize(n_senses);
+		for (auto& rec : res.senses)
+			{ read_sense(rec); }
+		res.sub_senses.resize(n_sub_senses);
+		for (auto& rec : res.sub_senses)
+			{ read_sense(rec); }
+		res.entries.resize(n_entries);
+		for (auto& entry : res.entries)
+		{
+			read_uint32_LE(in, entry.id.offset);
+			read_uint32_LE(in, entry.id.size);
+			read_uint32_LE(in, entry.stems.first);
+			read_uint32_LE(in, entry.stems.count);
+			read_uint32_LE(in, entry.first_sense);
+			read_uint32_LE(in, entry.num_senses);
+			entry.offensive = (in[0] != std::byte(0));
+			in = in.subspan(1);
+		}
+
+		for (const auto ref : res.lists)
+		{
+			if (ref.offset == absent || !res.valid(ref))
+				{ return {}; }
+		}
+		for (const auto& rec : res.senses)
+		{
+			if (!res.valid(rec, false))
+				{ return {}; }
+		}
+		for (const auto& rec : res.sub_senses)
+		{
+			if (!res.valid(rec, true))
+				{ return {}; }
+		}
+		for (const auto& entry : res.entries)
+		{
+			if (entry.id.offset == absent || !res.valid(entry.id) || !res.valid(entry.stems) || entry.stems.first == absent
+				|| entry.first_sense > n_senses || entry.num_senses > n_senses - entry.first_sense)
+				{ return {}; }
+		}
+		return res;
+	}
+
+private:
+	// reads the records of serialize()d flat_defs where they are, checking every reference as it is read
+	class serialized_reader
+	{
+	private:
+		std::span<const std::byte> in;
+
+	public:
+		std::string_view pool;
+		std::uint32_t n_lists = 0, n_senses = 0, n_sub_senses = 0, n_entries = 0;
+		// offsets of the records in `in`
+		std::size_t lists_off = 0, senses_off = 0, sub_senses_off = 0, entries_off = 0;
+
+		// @throws std::runtime_error  if the counts don't match the size of `in_`
+		explicit serialized_reader(std::span<const std::byte> in_) : in(in_)
+		{
+			std::uint32_t pool_size;
+			if (!read_uint32_LE(in_, pool_size) || !read_uint32_LE(in_, n_lists) || !read_uint32_LE(in_, n_senses)
+				|| !read_uint32_LE(in_, n_sub_senses) || !read_uint32_LE(in_, n_entries))
+				{ fail(); }
+			if (in_.size() != pool_size + std::uint64_t(n_lists) * list_string_size + (std::uint64_t(n_senses) + n_sub_senses) * sense_size
+				+ std::uint64_t(n_entries) * entry_size)
+				{ fail(); }
+			pool = std::string_view(reinterpret_cast<const char*>(in_.data()), pool_size);
+			lists_off = header_size + pool_size;
+			senses_off = lists_off + std::size_t(n_lists) * list_string_size;
+			sub_senses_off = senses_off + std::size_t(n_senses) * sense_size;
+			entries_off = sub_senses_off + std::size_t(n_sub_senses) * sense_size;
+		}
+
+		[[noreturn]] static void fail()
+			{ throw std::runtime_error("Malformed flat definition. File may be corrupted"); }
+
+		std::uint8_t byte(std::size_t off) const
+			{ return std::to_integer<std::uint8_t>(in[off]); }
+		std::uint32_t uint32(std::size_t off) const
+		{
+			auto rest = in.subspan(off);
+			std::uint32_t num = 0;
+			read_uint32_LE(rest, num);
+			return num;
+		}
+
+		// @return the string of the str_ref at `off`, or empty if it is absent
+		std::optional<std::string_view> opt_str(std::size_t off) const
+		{
+			const std::uint32_t offset = uint32(off), size = uint32(off + 4);
+			if (offset == absent)
+			{
+				if (size != 0)
+					{ fail(); }
+				return {};
+			}
+			if (offset > pool.size() || size > pool.size() - offset)
+				{ fail(); }
+			return pool.substr(offset, size);
+		}
+		std::string_view str(std::size_t off) const
+			{ return opt_str(off).value_or(std::string_view()); }
+
+		// append the strings of the list_ref at `off` to `out`
+		// @return false if it is absent
+		template<typename Vector>
+		bool read_list(std::size_t off, Vector& out) const
+		{
+			const std::uint32_t first = uint32(off), count = uint32(off + 4);
+			if (first == absent)
+			{
+				if (count != 0)
+					{ fail(); }
+				return false;
+			}
+			if (first > n_lists || count > n_lists - first)
+				{ fail(); }
+			out.reserve(count);
+			for (std::uint32_t i = first; i < first + count; i++)
+			{
+				const auto s = opt_str(lists_off + std::size_t(i) * list_string_size);
+				if (!s)
+					{ fail(); }
+				out.emplace_back(s.value());
+			}
+			return true;
+		}
+
+		// fill the fields of `out` from the sense record at `off`
+		// @param alloc  allocator of the lists
+		template<typename Sense, typename Allocator>
+		void read_sense(std::size_t off, Sense& out, const Allocator& alloc) const
+		{
+			using String = typename decltype(out.etymology)::value_type;
+			const auto read_opt_list = [this, &alloc](std::size_t list_off, auto& list)
+			{
+				list.emplace(alloc);
+				if (!read_list(list_off, list.value()))
+					{ list.reset(); }
+			};
+			if (const auto etymology = opt_str(off))
+				{ out.etymology = String(etymology.value()); }
+			if (const auto number = opt_str(off + 8))
+				{ out.number = String(number.value()); }
+			read_opt_list(off + 32, out.inflections);
+			read_opt_list(off + 40, out.labels);
+			read_opt_list(off + 48, out.pronunciations);
+			read_opt_list(off + 56, out.subj_status);
+			const auto transitive_verb = byte(off + 69);
+			if (transitive_verb > 2)
+				{ fail(); }
+			if (transitive_verb != 0)
+				{ out.transitive_verb = (transitive_verb == 2); }
+		}
+
+		// expects the sense record at `off` to be a full or div sense
+		template<typename Sense, typename Allocator>
+		void read_def_sense(std::size_t off, Sense& out, const Allocator& alloc) const
+		{
+			read_sense(off, out, alloc);
+			out.def_text = str(off + 16);
+		}
+	};
+
+public:
+	// parse flat_defs serialized by serialize() into `data`, reading records where they are instead of deserializing them first.
+	// gives the same entries as to_view() of the deserialized flat_defs. with def_view::word_info, strings point into `in`,
+	// and are only valid as long as it is. the lists of each entry use the allocator of `data` (as with cbor_parse::parse)
+	// Complexity: O(size)
+	// @tparam WordInfo  word_info, def_view::word_info or def_arena::word_info
+	// @throws std::runtime_error  if `in` is malformed
+	template<typename WordInfo, typename Allocator>
+	static void parse(std::span<const std::byte> in, std::vector<WordInfo, Allocator>& data)
+	{
+		using types = typename WordInfo::def_types;
+		using String = typename types::string_type;
+		const serialized_reader r(in);
+		const auto alloc = data.get_allocator();
+		data.reserve(data.size() + r.n_entries);
+		for (std::uint32_t i = 0; i < r.n_entries; i++)
+		{
+			const std::size_t off = r.entries_off + std::size_t(i) * entry_size;
+			// moving the lists keeps their allocator
+			data.push_back(WordInfo{ {}, decltype(WordInfo::stems)(alloc), false, decltype(WordInfo::defs)(alloc) });
+			auto& w = data.back();
+			const auto id = r.opt_str(off);
+			if (!id || !r.read_list(off + 8, w.stems))
+				{ serialized_reader::fail(); }
+			w.id = String(id.value());
+			w.offensive = (r.byte(off + 24) != 0);
+			const std::uint32_t first_sense = r.uint32(off + 16), num_senses = r.uint32(off + 20);
+			if (first_sense > r.n_senses || num_senses > r.n_senses - first_sense)
+				{ serialized_reader::fail(); }
+			w.defs.reserve(num_senses);
+			for (std::uint32_t j = first_sense; j < first_sense + num_senses; j++)
+			{
+				const std::size_t sense_off = r.senses_off + std::size_t(j) * sense_size;
+				const auto kind = static_cast<sense_kind>(r.byte(sense_off + 68));
+				const std::uint32_t sdsense = r.uint32(sense_off + 64);
+				if (kind == sense_kind::trunc && sdsense == absent)
+				{
+					typename types::trunc_sense_data val;
+					r.read_sense(sense_off, val, alloc);
+					w.defs.emplace_back(std::move(val));
+					continue;
+				}
+				if (kind != sense_kind::full)
+					{ serialized_reader::fail(); }
+				typename types::sense_data val;
+				r.read_def_sense(sense_off, val, alloc);
+				if (sdsense != absent)
+				{
+					const std::size_t sub_off = r.sub_senses_off + std::size_t(sdsense) * sense_size;
+					if (sdsense >= r.n_sub_senses || static_cast<sense_kind>(r.byte(sub_off + 68)) != sense_kind::div)
+						{ serialized_reader::fail(); }
+					auto& div = val.sdsense.emplace();
+					r.read_def_sense(sub_off, div, alloc);
+					div.sense_div = String(r.str(sub_off + 24));
+				}
+				w.defs.emplace_back(std::move(val));
+			}
+		}
+	}
+};
+
+#endif
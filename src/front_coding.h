@@ -0,0 +1,84 @@
+#ifndef FRONT_CODING_H
+#define FRONT_CODING_H
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "text_index.h"
+
+// helpers for front coded (prefix compressed) lists of sorted words, as used by the words section of dictionary_file
+// words are coded in blocks of block_size. the first word of a block is stored whole, so a block can be decoded
+// on its own (blocks are restart points), and every other word only stores what follows the prefix it shares with the previous word.
+// each word is the LEB128 varint length of the shared prefix (omitted for the first word of a block),
+// the varint length of the rest, and the rest (same varints as text_index)
+namespace front_coding
+{
+	constexpr std::size_t block_size = 16;
+
+	// append a block of `words` (at most block_size, sorted) to `out`
+	// Complexity: O(total_len)
+	// @param words  range of std::string_view
+	template<typename R>
+	void append_block(R&& words, std::vector<std::byte>& out)
+	{
+		std::string_view prev;
+		bool first = true;
+		for (const std::string_view word : words)
+		{
+			std::size_t shared = 0;
+			if (!first)
+			{
+				while (shared < prev.size() && shared < word.size() && prev[shared] == word[shared])
+					{ shared++; }
+				text_index::append_varint(static_cast<std::uint32_t>(shared), out);
+			}
+			text_index::append_varint(static_cast<std::uint32_t>(word.size() - shared), out);
+			const auto rest = std::as_bytes(std::span(word.substr(shared)));
+			out.insert(out.end(), rest.begin(), rest.end());
+			prev = word;
+			first = false;
+		}
+	}
+
+	// decodes the words of a block in order
+	class block_reader
+	{
+	private:
+		std::span<const std::byte> in;
+		std::string word;
+		bool first = true;
+
+	public:
+		// @param block  bytes starting at the block. may extend past it, since blocks don't store their size
+		explicit block_reader(std::span<const std::byte> block) noexcept : in(block) {}
+
+		// Complexity: O(word_len)
+		// @return the next word, valid until the next call, or empty if `block` ends within it or it is malformed
+		std::optional<std::string_view> next()
+		{
+			std::uint32_t shared = 0;
+			if (!first)
+			{
+				const auto shared_len = text_index::read_varint(in);
+				if (!shared_len || shared_len.value() > word.size())
+					{ return {}; }
+				shared = shared_len.value();
+			}
+			const auto rest_len = text_index::read_varint(in);
+			if (!rest_len || rest_len.value() > in.size())
+				{ return {}; }
+			word.resize(shared);
+			word.append(reinterpret_cast<const char*>(in.data()), rest_len.value());
+			in = in.subspan(rest_len.value());
+			first = false;
+			return std::string_view(word);
+		}
+	};
+}
+
+#endif
@@ -0,0 +1,78 @@
+#ifndef FUZZY_H
+#define FUZZY_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// helpers for the symmetric delete (SymSpell) fuzzy index of dictionary_file
+// a word within edit distance d of a query shares at least one variant with it, where up to d characters are deleted from each.
+// distances are in bytes, so a multibyte UTF-8 character counts as several edits
+namespace fuzzy
+{
+	namespace detail
+	{
+		template<typename F>
+		void for_each_delete(std::string& cur, std::size_t start, std::uint32_t deletes_left, F& f)
+		{
+			f(std::string_view(cur));
+			if (deletes_left == 0)
+				{ return; }
+			// only delete at or after `start`, so each set of deleted positions is visited once
+			for (std::size_t i = start; i < cur.size(); i++)
+			{
+				const char c = cur[i];
+				cur.erase(i, 1);
+				for_each_delete(cur, i, deletes_left - 1, f);
+				cur.insert(i, 1, c);
+			}
+		}
+	}
+
+	// call `f` with every variant of `word` with at most `max_deletes` characters deleted, including `word` itself.
+	// the same variant may be visited more than once if `word` has repeated characters
+	// Complexity: O(word_len^(max_deletes + 1))
+	// @param f  function taking a std::string_view, which is only valid during the call
+	template<typename F>
+	void for_each_delete(std::string_view word, std::uint32_t max_deletes, F&& f)
+	{
+		std::string cur(word);
+		detail::for_each_delete(cur, 0, max_deletes, f);
+	}
+
+	// optimal string alignment distance (Levenshtein distance with adjacent transpositions)
+	// Complexity: O(a_len * b_len)
+	// @param limit  distances above `limit` are reported as limit + 1
+	inline std::uint32_t edit_distance(std::string_view a, std::string_view b, std::uint32_t limit)
+	{
+		if (std::max(a.size(), b.size()) - std::min(a.size(), b.size()) > limit)
+			{ return limit + 1; }
+		// rows for i - 2, i - 1, i
+		std::vector<std::uint32_t> prev2(b.size() + 1), prev(b.size() + 1), cur(b.size() + 1);
+		for (std::size_t j = 0; j <= b.size(); j++)
+			{ prev[j] = static_cast<std::uint32_t>(j); }
+		for (std::size_t i = 1; i <= a.size(); i++)
+		{
+			cur[0] = static_cast<std::uint32_t>(i);
+			std::uint32_t row_min = cur[0];
+			for (std::size_t j = 1; j <= b.size(); j++)
+			{
+				const std::uint32_t cost = (a[i - 1] == b[j - 1] ? 0 : 1);
+				cur[j] = std::min({ prev[j] + 1, cur[j - 1] + 1, prev[j - 1] + cost });
+				if (i > 1 && j > 1 && a[i - 1] == b[j - 2] && a[i - 2] == b[j - 1])
+					{ cur[j] = std::min(cur[j], prev2[j - 2] + 1); }
+				row_min = std::min(row_min, cur[j]);
+			}
+			if (row_min > limit)
+				{ return limit + 1; }
+			std::swap(prev2, prev);
+			std::swap(prev, cur);
+		}
+		return std::min(prev[b.size()], limit + 1);
+	}
+}
+
+#endif
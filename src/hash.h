@@ -0,0 +1,139 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+// XXH64 (https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md)
+// processes 32 bytes per iteration in 4 independent lanes, which is much faster than byte-at-a-time hashes
+class xxh64_hasher
+{
+private:
+	constexpr static std::uint64_t prime1 = 0x9E3779B185EBCA87;
+	constexpr static std::uint64_t prime2 = 0xC2B2AE3D27D4EB4F;
+	constexpr static std::uint64_t prime3 = 0x165667B19E3779F9;
+	constexpr static std::uint64_t prime4 = 0x85EBCA77C2B2AE63;
+	constexpr static std::uint64_t prime5 = 0x27D4EB2F165667C5;
+	constexpr static std::size_t stripe_size = 32;
+
+	std::uint64_t seed;
+	std::array<std::uint64_t, 4> acc;
+	// partial stripe from previous update()
+	std::array<std::byte, stripe_size> buf;
+	std::size_t buf_len = 0;
+	std::uint64_t total_len = 0;
+
+	// expects `in` to contain at least N bytes
+	template<std::size_t N>
+	constexpr static std::uint64_t read_LE(std::span<const std::byte> in)
+	{
+		std::uint64_t val = 0;
+		for (std::size_t i = 0; i < N; i++)
+			{ val |= std::to_integer<std::uint64_t>(in[i]) << (i * 8); }
+		return val;
+	}
+
+	constexpr static std::uint64_t round(std::uint64_t a, std::uint64_t lane)
+	{
+		a += lane * prime2;
+		a = std::rotl(a, 31);
+		return a * prime1;
+	}
+
+	constexpr static std::uint64_t merge_round(std::uint64_t a, std::uint64_t lane)
+	{
+		a ^= round(0, lane);
+		return a * prime1 + prime4;
+	}
+
+	// expects `stripe` to contain stripe_size bytes
+	constexpr void consume_stripe(std::span<const std::byte> stripe)
+	{
+		for (std::size_t i = 0; i < 4; i++)
+			{ acc[i] = round(acc[i], read_LE<8>(stripe.subspan(i * 8))); }
+	}
+
+public:
+	constexpr explicit xxh64_hasher(std::uint64_t seed_ = 0) :
+		seed(seed_), acc{ seed_ + prime1 + prime2, seed_ + prime2, seed_, seed_ - prime1 }, buf{} {}
+
+	// Complexity: O(data.size())
+	constexpr void update(std::span<const std::byte> data)
+	{
+		total_len += data.size();
+		if (buf_len != 0)
+		{
+			const std::size_t n = std::min(stripe_size - buf_len, data.size());
+			std::copy_n(data.begin(), n, buf.begin() + buf_len);
+			buf_len += n;
+			data = data.subspan(n);
+			if (buf_len < stripe_size)
+				{ return; }
+			consume_stripe(buf);
+			buf_len = 0;
+		}
+		while (data.size() >= stripe_size)
+		{
+			consume_stripe(data.first(stripe_size));
+			data = data.subspan(stripe_size);
+		}
+		std::copy(data.begin(), data.end(), buf.begin());
+		buf_len = data.size();
+	}
+
+	// Complexity: O(1)
+	// @return hash of all data passed to update() so far
+	constexpr std::uint64_t digest() const
+	{
+		std::uint64_t h;
+		if (total_len >= stripe_size)
+		{
+			h = std::rotl(acc[0], 1) + std::rotl(acc[1], 7) + std::rotl(acc[2], 12) + std::rotl(acc[3], 18);
+			for (const auto a : acc)
+				{ h = merge_round(h, a); }
+		}
+		else
+			{ h = seed + prime5; }
+		h += total_len;
+
+		std::span<const std::byte> rest(buf.data(), buf_len);
+		while (rest.size() >= 8)
+		{
+			h ^= round(0, read_LE<8>(rest));
+			h = std::rotl(h, 27) * prime1 + prime4;
+			rest = rest.subspan(8);
+		}
+		if (rest.size() >= 4)
+		{
+			h ^= read_LE<4>(rest) * prime1;
+			h = std::rotl(h, 23) * prime2 + prime3;
+			rest = rest.subspan(4);
+		}
+		for (const auto b : rest)
+		{
+			h ^= std::to_integer<std::uint64_t>(b) * prime5;
+			h = std::rotl(h, 11) * prime1;
+		}
+
+		h ^= h >> 33;
+		h *= prime2;
+		h ^= h >> 29;
+		h *= prime3;
+		h ^= h >> 32;
+		return h;
+	}
+};
+
+// Complexity: O(data.size())
+constexpr std::uint64_t xxh64(std::span<const std::byte> data, std::uint64_t seed = 0)
+{
+	xxh64_hasher hasher(seed);
+	hasher.update(data);
+	return hasher.digest();
+}
+
+#endif
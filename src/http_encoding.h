@@ -0,0 +1,30 @@
+#ifndef HTTP_ENCODING_H
+#define HTTP_ENCODING_H
+
+#include <string>
+
+#include <httplib.h>
+
+// value of the Accept-Encoding header for the encodings httplib can decompress (USE_ZLIB and USE_BROTLI in CMakeLists.txt)
+// compressed responses are decompressed by httplib as they are received, so content receivers still get plain JSON
+// @return encodings, or empty if none are supported
+inline std::string accept_encoding()
+{
+	std::string encodings;
+#ifdef CPPHTTPLIB_BROTLI_SUPPORT
+	encodings += "br";
+#endif
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+	encodings += (encodings.empty() ? "gzip, deflate" : ", gzip, deflate");
+#endif
+	return encodings;
+}
+
+// request compressed responses from `client`, if any encoding is supported
+inline void enable_compression(httplib::ClientImpl& client)
+{
+	if (const auto encodings = accept_encoding(); !encodings.empty())
+		{ client.set_default_headers({ { "Accept-Encoding", encodings } }); }
+}
+
+#endif
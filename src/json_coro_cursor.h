@@ -14,6 +14,9 @@
 #include "co_util.h"
 
 #include <concepts>
+#include <functional>
+#include <string>
+#include <string_view>
 
 template<typename T>
 concept coro_cursor =
@@ -35,6 +38,7 @@ requires(const T cursor)
 	{ cursor.done() } -> std::same_as<bool>;
 	{ cursor.current() } -> std::same_as<const jsoncons::basic_staj_event<typename T::char_type>&>;
 	{ cursor.context() } -> std::same_as<const jsoncons::ser_context&>;
+	{ cursor.last_key() } -> std::same_as<std::basic_string_view<typename T::char_type>>;
 };
 
 namespace jsoncons
@@ -42,6 +46,9 @@ namespace jsoncons
 	// modified json cursor using coroutines
 	// will only parse and create events when updated
 	// via task::add_data
+	// the parser points string events into the chunk being parsed when the string is wholly within it (and unescaped),
+	// and only copies strings which are split between chunks into its own buffer. either is only valid until the next event,
+	// so keys are kept for longer by last_key(), which also only copies them when needed
 	template<typename CharT, typename Allocator = std::allocator<CharT>>
 	class basic_json_coro_cursor : public basic_staj_cursor<CharT>, private virtual ser_context
 	{
@@ -53,6 +60,12 @@ namespace jsoncons
 		basic_json_parser<CharT, Allocator> parser_;
 		basic_staj_visitor<CharT> cursor_visitor_;
 		bool done_;
+		// chunk being parsed, which is released once the next is received
+		std::string_view chunk_;
+		// see last_key()
+		std::basic_string_view<CharT> key_;
+		// copy of key_, if it isn't in chunk_
+		std::basic_string<CharT> key_buffer_;
 		
 		// Noncopyable and nonmoveable
 		basic_json_coro_cursor(const basic_json_coro_cursor&) = delete;
@@ -63,6 +76,25 @@ namespace jsoncons
 			return true;
 		}
 
+		// @return whether `s` is a view into chunk_
+		bool in_chunk(std::basic_string_view<CharT> s) const
+		{
+			const std::less_equal<const CharT*> le;
+			return !s.empty() && le(chunk_.data(), s.data()) && le(s.data() + s.size(), chunk_.data() + chunk_.size());
+		}
+
+		// keep the key of a new key event, without copying it if it's in the chunk
+		void on_event()
+		{
+			if (done() || cursor_visitor_.event().event_type() != staj_event_type::key)
+				{ return; }
+			const auto key = cursor_visitor_.event().template get<std::basic_string_view<CharT>>();
+			if (in_chunk(key))
+				{ key_ = key; }
+			else
+				{ key_ = key_buffer_.assign(key); }
+		}
+
 	public:
 		basic_json_coro_cursor(const basic_json_decode_options<CharT>& options = basic_json_decode_options<CharT>(),
 			std::function<bool(json_errc, const ser_context&)> err_handler = default_json_parsing(),
@@ -82,6 +114,8 @@ namespace jsoncons
 			parser_.reset();
 			cursor_visitor_.reset();
 			done_ = false;
+			chunk_ = {};
+			key_ = {};
 		}
 		
 		bool done() const override
@@ -148,6 +182,15 @@ public:
 		{
 			return *this;
 		}
+
+		// key of the last key event, which is valid until the next key event, unlike the event's own.
+		// while the key is within the chunk it was parsed from, it is a view into it, and it is only copied if the chunk
+		// is released first, or if the parser buffered it
+		// Complexity: O(1)
+		std::basic_string_view<CharT> last_key() const
+		{
+			return key_;
+		}
 		
 		std::size_t line() const override
 		{
@@ -174,11 +217,14 @@ public:
 			{
 				JSONCONS_THROW(ser_error(ec,parser_.line(),parser_.column()));
 			}
+			on_event();
 		}
 
 		task<void> read_next(std::error_code& ec)
 		{
 			CO_CALL(read_next, cursor_visitor_, ec);
+			if (!ec)
+				{ on_event(); }
 		}
 
 		task<void> read_next(basic_json_visitor<CharT>& visitor, std::error_code& ec)
@@ -188,7 +234,11 @@ public:
 			{
 				if (parser_.source_exhausted())
 				{
+					// the key may still be in use, e.g. if its value is split between chunks
+					if (in_chunk(key_))
+						{ key_ = key_buffer_.assign(key_); }
 					auto s = co_await std::string_view{};
+					chunk_ = s;
 					parser_.update(s.data(),s.size());
 					if (ec) co_return;
 				}
@@ -208,6 +258,8 @@ using json_coro_cursor = jsoncons::basic_json_coro_cursor<char>;
 
 // wraps a regular cursor in a coroutine-friendly interface
 // THE CURSOR WILL NOT BE SUSPENDABLE/RESUMABLE
+// parsing through it still creates a coroutine frame per call, so complete CBOR definitions are better decoded
+// with cbor_parse::parse, which gives the same result synchronously
 // cursor can be constructed in-place; constructor args for this class
 // are forwarded directly to cursor constructor
 template<typename CursorT>
@@ -218,6 +270,14 @@ public:
 
 private:
 	CursorT cursor;
+	// copy of the last key, since the wrapped cursor's may be overwritten by the next string
+	std::basic_string<char_type> key;
+
+	void on_event()
+	{
+		if (!cursor.done() && cursor.current().event_type() == jsoncons::staj_event_type::key)
+			{ key.assign(cursor.current().template get<std::basic_string_view<char_type>>()); }
+	}
 
 public:
 	template<typename... Args>
@@ -229,9 +289,10 @@ public:
 	const jsoncons::basic_staj_event<char_type>& current() const override { return cursor.current(); }
 	task<void> read_to_(jsoncons::basic_json_visitor<char_type>& vis) { cursor.read_to(vis); co_return; }
 	task<void> read_to_(jsoncons::basic_json_visitor<char_type>& vis, std::error_code& ec) { cursor.read_to(vis, ec); co_return; }
-	task<void> next_() { cursor.next(); co_return; }
-	task<void> next_(std::error_code& ec) { cursor.next(ec); co_return; }
+	task<void> next_() { cursor.next(); on_event(); co_return; }
+	task<void> next_(std::error_code& ec) { cursor.next(ec); if (!ec) { on_event(); } co_return; }
 	const jsoncons::ser_context& context() const override { return cursor.context(); }
+	std::basic_string_view<char_type> last_key() const { return key; }
 	friend jsoncons::basic_staj_filter_view<char_type> operator|(cursor_coro_wrapper& cursor,
 		std::function<bool(const jsoncons::basic_staj_event<char_type>&, const jsoncons::ser_context&)> pred)
 		{ return operator|(cursor.cursor, pred); }
@@ -1,16 +1,20 @@
 #ifndef JSON_UTIL_H
 #define JSON_UTIL_H
 
+#include <algorithm>
 #include <array>
 #include <concepts>
+#include <cstddef>
 #include <cstdint>
-#include <functional>
+#include <optional>
 #include <string_view>
+#include <tuple>
 #include <utility>
 #include <jsoncons/json.hpp>
 
 #include "co_util.h"
 #include "json_coro_cursor.h"
+#include "string_literal.h"
 
 template<typename T>
 concept JsonObjectCondition = requires(T f, jsoncons::staj_event e, std::string_view s)
@@ -28,18 +32,180 @@ concept JsonKeyArrayCondition = requires(T f, std::string_view s)
 	{ f(s) } -> std::same_as<task<bool>>;
 };
 
-// array type that contains key and type information for json object callbacks
-template<std::size_t size>
-using json_obj_callbacks = std::array<std::tuple<std::string_view, jsoncons::staj_event_type, std::function<task<void>()>>, size>;
+namespace detail
+{
+	template<string_literal_wrapper key_, jsoncons::staj_event_type event_type_, typename F>
+	struct json_obj_callback
+	{
+		constexpr static std::string_view key = key_.view();
+		constexpr static jsoncons::staj_event_type event_type = event_type_;
+		F callback;
+	};
+
+	template<jsoncons::staj_event_type event_type_, typename F>
+	struct json_arr_callback
+	{
+		constexpr static jsoncons::staj_event_type event_type = event_type_;
+		F callback;
+	};
+
+	template<string_literal_wrapper key_, typename F>
+	struct json_key_arr_callback
+	{
+		constexpr static std::string_view key = key_.view();
+		F callback;
+	};
+
+	// table of callbacks, each stored with its own type (no type erasure)
+	// Entries must have a `callback` member, which returns task<void> when called
+	template<typename... Entries>
+	class json_callbacks
+	{
+	private:
+		std::tuple<Entries...> entries;
+
+	protected:
+		// @return task of callback `ind`, where `ind` is less than sizeof...(Entries)
+		template<std::size_t I = 0>
+		task<void> call(std::size_t ind) const
+		{
+			// return directly, since task can't be moved
+			if constexpr (I + 1 == sizeof...(Entries))
+				{ return std::get<I>(entries).callback(); }
+			else
+			{
+				if (ind == I)
+					{ return std::get<I>(entries).callback(); }
+				return call<I + 1>(ind);
+			}
+		}
+
+	public:
+		static_assert(sizeof...(Entries) > 0, "Callback table must not be empty");
+
+		constexpr explicit json_callbacks(Entries... entries_) : entries(std::move(entries_)...) {}
+	};
+}
+
+// callback for a key with a value of type `event_type`, in an object. see json_obj_callbacks
+template<string_literal_wrapper key, jsoncons::staj_event_type event_type, typename F>
+constexpr auto obj_callback(F callback) { return detail::json_obj_callback<key, event_type, F>{ std::move(callback) }; }
+
+// callback for an element of type `event_type`, in an array. see json_arr_callbacks
+template<jsoncons::staj_event_type event_type, typename F>
+constexpr auto arr_callback(F callback) { return detail::json_arr_callback<event_type, F>{ std::move(callback) }; }
+
+// callback for a sub-array beginning with string `key`, in an array. see json_key_arr_callbacks
+template<string_literal_wrapper key, typename F>
+constexpr auto key_arr_callback(F callback) { return detail::json_key_arr_callback<key, F>{ std::move(callback) }; }
+
+// key and type information for json object callbacks, from obj_callback()
+// keys are sorted at compile time, so each key is matched with a binary search
+template<typename... Entries>
+class json_obj_callbacks : public detail::json_callbacks<Entries...>
+{
+private:
+	using json_type = jsoncons::staj_event_type;
+
+	// {key, event type, index in Entries}, sorted
+	constexpr static auto table = []()
+	{
+		std::array<std::tuple<std::string_view, json_type, std::size_t>, sizeof...(Entries)> t;
+		std::size_t i = 0;
+		((t[i] = { Entries::key, Entries::event_type, i }, i++), ...);
+		std::ranges::sort(t);
+		return t;
+	}();
+	static_assert(std::ranges::adjacent_find(table, {}, [](const auto& e) { return std::pair(std::get<0>(e), std::get<1>(e)); }) == table.end(),
+		"Each key and event type must be unique");
+
+public:
+	using detail::json_callbacks<Entries...>::json_callbacks;
+	using detail::json_callbacks<Entries...>::call;
+
+	// Complexity: O(log(size))
+	// @return index of the callback for `key` and `event_type`, or empty if there is none
+	constexpr static std::optional<std::size_t> find(std::string_view key, json_type event_type)
+	{
+		const auto it = std::ranges::lower_bound(table, std::pair(key, event_type), {}, [](const auto& e) { return std::pair(std::get<0>(e), std::get<1>(e)); });
+		if (it == table.end() || std::get<0>(*it) != key || std::get<1>(*it) != event_type)
+			{ return {}; }
+		return std::get<2>(*it);
+	}
+};
 
-// array type that contains type information for json array callbacks
-template<std::size_t size>
-using json_arr_callbacks = std::array<std::tuple<jsoncons::staj_event_type, std::function<task<void>()>>, size>;
+// type information for json array callbacks, from arr_callback()
+template<typename... Entries>
+class json_arr_callbacks : public detail::json_callbacks<Entries...>
+{
+private:
+	using json_type = jsoncons::staj_event_type;
+
+	static_assert([]()
+		{
+			const std::array<json_type, sizeof...(Entries)> types = { Entries::event_type... };
+			for (std::size_t i = 0; i < types.size(); i++)
+			{
+				if (std::ranges::find(types.begin() + i + 1, types.end(), types[i]) != types.end())
+					{ return false; }
+			}
+			return true;
+		}(), "Each event type must be unique");
+
+public:
+	using detail::json_callbacks<Entries...>::json_callbacks;
+	using detail::json_callbacks<Entries...>::call;
+
+	// Complexity: O(size), with constant event types
+	// @return index of the callback for `event_type`, or empty if there is none
+	constexpr static std::optional<std::size_t> find(json_type event_type)
+	{
+		std::optional<std::size_t> res;
+		std::size_t i = 0;
+		((event_type == Entries::event_type ? (res = i, true) : (i++, false)) || ...);
+		return res;
+	}
+};
+
+// key information for json array callbacks where every element is a sub-array beginning with a string key,
+// from key_arr_callback(). keys are sorted at compile time, so each key is matched with a binary search
+template<typename... Entries>
+class json_key_arr_callbacks : public detail::json_callbacks<Entries...>
+{
+private:
+	// {key, index in Entries}, sorted
+	constexpr static auto table = []()
+	{
+		std::array<std::pair<std::string_view, std::size_t>, sizeof...(Entries)> t;
+		std::size_t i = 0;
+		((t[i] = { Entries::key, i }, i++), ...);
+		std::ranges::sort(t);
+		return t;
+	}();
+	static_assert(std::ranges::adjacent_find(table, {}, &std::pair<std::string_view, std::size_t>::first) == table.end(),
+		"Each key must be unique");
+
+public:
+	using detail::json_callbacks<Entries...>::json_callbacks;
+	using detail::json_callbacks<Entries...>::call;
+
+	// Complexity: O(log(size))
+	// @return index of the callback for `key`, or empty if there is none
+	constexpr static std::optional<std::size_t> find(std::string_view key)
+	{
+		const auto it = std::ranges::lower_bound(table, key, {}, &std::pair<std::string_view, std::size_t>::first);
+		if (it == table.end() || it->first != key)
+			{ return {}; }
+		return it->second;
+	}
+};
 
-// array type that contains key information for json array callbacks
-// where every element is a sub-array beginning with a string key
-template<std::size_t size>
-using json_key_arr_callbacks = std::array<std::tuple<std::string_view, std::function<task<void>()>>, size>;
+template<typename... Entries>
+json_obj_callbacks(Entries...) -> json_obj_callbacks<Entries...>;
+template<typename... Entries>
+json_arr_callbacks(Entries...) -> json_arr_callbacks<Entries...>;
+template<typename... Entries>
+json_key_arr_callbacks(Entries...) -> json_key_arr_callbacks<Entries...>;
 
 // skip events until current object/array is consumed
 // expects cursor to have consumed the begin obj/arr
@@ -80,7 +246,8 @@ task<void> recursive_skip(coro_cursor auto& cursor)
 // @return false if entire object is consumed, true if condition is met
 task<bool> recursive_skip_until_obj(coro_cursor auto& cursor, JsonObjectCondition auto condition)
 {
-	std::string last_key;
+	// whether the last event on this level was a key, whose value is the current event
+	bool after_key = false;
 	int num_levels = 0;
 	for (; !cursor.done();)
 	{
@@ -92,11 +259,12 @@ task<bool> recursive_skip_until_obj(coro_cursor auto& cursor, JsonObjectConditio
 		{
 			if (cur_event.event_type() == json_type::key)
 			{
-				// last_key needs to be a copy here as cur_event could change (which would change the contents of a string_view)
-				last_key = cur_event.get<std::string>();
+				// the event's key may not outlive it, so it is read from the cursor when its value is reached
+				after_key = true;
 			}
 			else
 			{
+				const std::string_view last_key = (after_key ? cursor.last_key() : std::string_view());
 				bool val;
 				CO_CALL(condition, cur_event, last_key) >> val;
 				if (val)
@@ -105,7 +273,7 @@ task<bool> recursive_skip_until_obj(coro_cursor auto& cursor, JsonObjectConditio
 				}
 				else
 				{
-					last_key = {};
+					after_key = false;
 				}
 			}
 		}
@@ -141,24 +309,20 @@ task<bool> recursive_skip_until_obj(coro_cursor auto& cursor, std::string_view k
 }
 
 // skip events until any one of many desired fields is found on the current level, or entire json object is consumed
-// @param callbacks  array of {key, event type, callback}; callback is called when key and event type matches.
-//                   each key and event type should be unique, and the callback should consume the value fully
+// @param callbacks  table of obj_callback(); callback is called when key and event type matches.
+//                   the callback should consume the value fully
 // see `condition` overload
-template<std::size_t size>
-task<bool> recursive_skip_until_obj(coro_cursor auto& cursor, const json_obj_callbacks<size>& callbacks)
+template<typename... Entries>
+task<bool> recursive_skip_until_obj(coro_cursor auto& cursor, const json_obj_callbacks<Entries...>& callbacks)
 {
 	bool val;
 	CO_CALL(recursive_skip_until_obj, cursor, [&callbacks](const auto& cur_event, std::string_view last_key) -> task<bool>
 		{
-			for (const auto& [key, event_type, callback] : callbacks)
-			{
-				if (cur_event.event_type() == event_type && last_key == key)
-				{
-					CO_CALL(callback);
-					co_return true;
-				}
-			}
-			co_return false;
+			const auto ind = callbacks.find(last_key, cur_event.event_type());
+			if (!ind)
+				{ co_return false; }
+			CO_CALL(callbacks.call, ind.value());
+			co_return true;
 		}) >> val;
 	co_return val;
 }
@@ -219,24 +383,20 @@ task<bool> recursive_skip_until_arr(coro_cursor auto& cursor, jsoncons::staj_eve
 }
 
 // skip events until one of many desired types is found on the current level, or entire json array is consumed
-// @param callbacks  array of {event type, callback}; callback is called when event type matches.
-//                   each event type should be unique, and the callback should consume the element fully
+// @param callbacks  table of arr_callback(); callback is called when event type matches.
+//                   the callback should consume the element fully
 // see `condition` overload
-template<std::size_t size>
-task<bool> recursive_skip_until_arr(coro_cursor auto& cursor, const json_arr_callbacks<size>& callbacks)
+template<typename... Entries>
+task<bool> recursive_skip_until_arr(coro_cursor auto& cursor, const json_arr_callbacks<Entries...>& callbacks)
 {
 	bool val;
 	CO_CALL(recursive_skip_until_arr, cursor, [&callbacks](const auto& cur_event) -> task<bool>
 		{
-			for (const auto& [event_type, callback] : callbacks)
-			{
-				if (cur_event.event_type() == event_type)
-				{
-					CO_CALL(callback);
-					co_return true;
-				}
-			}
-			co_return false;
+			const auto ind = callbacks.find(cur_event.event_type());
+			if (!ind)
+				{ co_return false; }
+			CO_CALL(callbacks.call, ind.value());
+			co_return true;
 		}) >> val;
 	co_return val;
 }
@@ -288,26 +448,22 @@ task<bool> recursive_skip_until_key_arr(coro_cursor auto& cursor, std::string_vi
 }
 
 // skip events until one of many desired "keys" is found on the current level, or entire json array is consumed
-// @param callbacks  array of {key, callback}; callback is called when key matches first element of a sub-array.
-//                   each key should be unique, and the callback should consume the sub-array
+// @param callbacks  table of key_arr_callback(); callback is called when key matches first element of a sub-array.
+//                   the callback should consume the sub-array
 // see `condition` overload
-template<std::size_t size>
-task<bool> recursive_skip_until_key_arr(coro_cursor auto& cursor, const json_key_arr_callbacks<size>& callbacks)
+template<typename... Entries>
+task<bool> recursive_skip_until_key_arr(coro_cursor auto& cursor, const json_key_arr_callbacks<Entries...>& callbacks)
 {
 	// placing this within CO_CALL below causes
 	// compiler confusion with __LINE__
 	const auto callback = [&callbacks, &cursor](std::string_view cur_key) -> task<bool>
 	{
-		for (const auto& [key, callback] : callbacks)
-		{
-			if (key == cur_key)
-			{
-				CO_CALL(cursor.next_); // consume key string (don't consume after condition)
-				CO_CALL(callback);
-				co_return true;
-			}
-		}
-		co_return false;
+		const auto ind = callbacks.find(cur_key);
+		if (!ind)
+			{ co_return false; }
+		CO_CALL(cursor.next_); // consume key string (don't consume after condition)
+		CO_CALL(callbacks.call, ind.value());
+		co_return true;
 	};
 
 	bool val;
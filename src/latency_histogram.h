@@ -0,0 +1,89 @@
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+
+// histogram of durations with power of 2 buckets (in microseconds), which can be added to from multiple threads
+class latency_histogram
+{
+public:
+	// bucket i counts durations of less than 2^i us (except the last, which counts the rest)
+	constexpr static std::size_t num_buckets = 28;
+
+private:
+	std::array<std::atomic<std::uint64_t>, num_buckets> buckets{};
+	std::atomic<std::uint64_t> total_count = 0;
+	std::atomic<std::uint64_t> total_us = 0;
+
+public:
+	// Complexity: O(1)
+	void add(std::chrono::steady_clock::duration d) noexcept
+	{
+		const auto us = static_cast<std::uint64_t>(std::max<std::int64_t>(std::chrono::duration_cast<std::chrono::microseconds>(d).count(), 0));
+		const std::size_t bucket = std::min<std::size_t>(std::bit_width(us), num_buckets - 1);
+		buckets[bucket].fetch_add(1, std::memory_order_relaxed);
+		total_count.fetch_add(1, std::memory_order_relaxed);
+		total_us.fetch_add(us, std::memory_order_relaxed);
+	}
+
+	std::uint64_t count() const noexcept
+		{ return total_count.load(std::memory_order_relaxed); }
+
+	// @return sum of all durations
+	std::chrono::microseconds sum() const noexcept
+		{ return std::chrono::microseconds(total_us.load(std::memory_order_relaxed)); }
+
+	// @return mean duration, or 0 if empty
+	std::chrono::microseconds mean() const noexcept
+	{
+		const auto n = count();
+		return (n == 0 ? std::chrono::microseconds(0) : sum() / static_cast<std::chrono::microseconds::rep>(n));
+	}
+
+	// Complexity: O(num_buckets)
+	// @param q  in [0, 1]
+	// @return an upper bound of the q-quantile (the upper bound of the bucket containing it), or 0 if empty
+	std::chrono::microseconds quantile(double q) const noexcept
+	{
+		const auto n = count();
+		if (n == 0)
+			{ return std::chrono::microseconds(0); }
+		const auto target = static_cast<std::uint64_t>(q * static_cast<double>(n - 1)) + 1;
+		std::uint64_t cumulative = 0;
+		for (std::size_t i = 0; i < num_buckets; i++)
+		{
+			cumulative += buckets[i].load(std::memory_order_relaxed);
+			if (cumulative >= target)
+				{ return std::chrono::microseconds(std::uint64_t(1) << i); }
+		}
+		return std::chrono::microseconds(std::uint64_t(1) << (num_buckets - 1));
+	}
+
+	// write the histogram in the Prometheus text format, in seconds. the # TYPE line is not written
+	// @param name  metric name
+	// @param labels  labels other than le, e.g. `worker="0"`, or empty
+	void write_prometheus(std::ostream& out, std::string_view name, std::string_view labels) const
+	{
+		const std::string_view sep = (labels.empty() ? "" : ",");
+		std::uint64_t cumulative = 0;
+		for (std::size_t i = 0; i + 1 < num_buckets; i++)
+		{
+			cumulative += buckets[i].load(std::memory_order_relaxed);
+			out << name << "_bucket{" << labels << sep << "le=\"" << static_cast<double>(std::uint64_t(1) << i) / 1e6 << "\"} " << cumulative << '\n';
+		}
+		// counts are read separately, so +Inf and _count may be slightly inconsistent with the buckets while being added to
+		out << name << "_bucket{" << labels << sep << "le=\"+Inf\"} " << count() << '\n';
+		out << name << "_sum" << (labels.empty() ? "" : "{") << labels << (labels.empty() ? "" : "}") << ' ' << static_cast<double>(sum().count()) / 1e6 << '\n';
+		out << name << "_count" << (labels.empty() ? "" : "{") << labels << (labels.empty() ? "" : "}") << ' ' << count() << '\n';
+	}
+};
+
+#endif
@@ -0,0 +1,287 @@
+#ifndef LINKED_TEXT_DISPLAY_H
+#define LINKED_TEXT_DISPLAY_H
+
+#include <algorithm>
+#include <cstddef>
+#include <iterator>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <FL/Fl.H>
+#include <FL/Fl_Text_Buffer.H>
+#include <FL/Fl_Text_Display.H>
+
+#include "links.h"
+
+extern void search_word(std::string_view word);
+
+// text display which follows the links of the shown definition (`links`) when they are clicked.
+// when wrapping long text, its lines are recounted in the background after the width changes (see lazy_wrap())
+class Linked_Text_Display : public Fl_Text_Display
+{
+private:
+	// buffers shorter than this are rewrapped when resized as fltk does, since counting their lines is fast enough
+	static constexpr int lazy_wrap_min_chars = 1 << 16;
+	// characters counted per idle call while recounting, after which the block is extended to the end of its line
+	static constexpr int recount_block_chars = 1 << 14;
+
+	// the buffer counted so far while recounting, in blocks which each end after a newline (or at the end of the buffer)
+	struct recounted_block
+	{
+		int end;
+		// lines up to the end of the block, from the start of the buffer
+		int lines;
+	};
+
+	std::size_t link_ind = -1;
+	// index of the link found by the last search_links, checked before searching since the mouse usually stays on a link
+	std::size_t last_hit = -1;
+	bool lazy_wrap_on = true;
+	// whether mNBufferLines and mTopLineNum are estimates, which are being recounted
+	bool recounting = false;
+	std::vector<recounted_block> recounted;
+
+	// links are added in order of position, so they are sorted by bounds. a link's high is one past its text,
+	// so adjacent links can both contain the position between them, in which case the earlier one is found
+	// Complexity: O(1) if pos is within the last hit, otherwise O(log(n_links))
+	// @return index of the link containing pos, or -1 if none
+	std::size_t search_links(const int pos)
+	{
+		const auto contains = [pos](std::size_t i) { return pos >= links[i].first.low && pos <= links[i].first.high; };
+		std::size_t i = last_hit;
+		if (i >= links.size() || !contains(i))
+		{
+			// first link which starts after pos, so the one before is the last which may contain it
+			const auto it = std::ranges::upper_bound(links, pos, {}, [](const auto& p) { return p.first.low; });
+			if (it == links.begin())
+				{ return -1; }
+			i = static_cast<std::size_t>(std::prev(it) - links.begin());
+			if (!contains(i))
+				{ return -1; }
+		}
+		while (i > 0 && contains(i - 1))
+			{ i--; }
+		last_hit = i;
+		return i;
+	}
+
+	// count the lines of the next block of the buffer
+	// Complexity: O(recount_block_chars + length of the line the block ends in)
+	// @return whether the whole buffer has been counted
+	bool recount_block()
+	{
+		const int start = (recounted.empty() ? 0 : recounted.back().end);
+		const int length = buffer()->length();
+		if (start >= length)
+			{ return true; }
+		int end = std::min(length, start + recount_block_chars);
+		// a block must end at the start of a line for the next to be counted on its own
+		if (end < length)
+			{ end = std::min(length, buffer()->line_end(end) + 1); }
+		const int lines = (recounted.empty() ? 0 : recounted.back().lines) + count_lines(start, end, true);
+		recounted.push_back({ end, lines });
+		return end == length;
+	}
+
+	void start_recount()
+	{
+		recounting = true;
+		recounted.clear();
+		if (!Fl::has_idle(recount_idle, this))
+			{ Fl::add_idle(recount_idle, this); }
+	}
+
+	void stop_recount()
+	{
+		recounting = false;
+		recounted.clear();
+		Fl::remove_idle(recount_idle, this);
+	}
+
+	// count the rest of the buffer, and replace the estimated line counts
+	// Complexity: that of counting (wrapped) lines of the buffer not yet recounted
+	void finish_recount()
+	{
+		while (!recount_block()) {}
+		mNBufferLines = (recounted.empty() ? 0 : recounted.back().lines);
+		// the top line is within the first block which ends after it
+		const auto it = std::ranges::upper_bound(recounted, mFirstChar, {}, &recounted_block::end);
+		const auto [block_start, lines_before] = (it == recounted.begin() ? recounted_block{ 0, 0 } : *std::prev(it));
+		mTopLineNum = lines_before + count_lines(block_start, mFirstChar, true) + 1;
+		stop_recount();
+		update_v_scrollbar();
+	}
+
+	static void recount_idle(void* data)
+	{
+		auto& self = *static_cast<Linked_Text_Display*>(data);
+		if (self.recount_block())
+			{ self.finish_recount(); }
+	}
+
+	// fltk counts the lines of modified text itself, and adds them to the estimate, so only blocks after `pos` are recounted
+	static void recount_modified(int pos, int n_inserted, int n_deleted, int, const char*, void* data)
+	{
+		auto& self = *static_cast<Linked_Text_Display*>(data);
+		if (!self.recounting || (n_inserted == 0 && n_deleted == 0))
+			{ return; }
+		std::erase_if(self.recounted, [pos](const recounted_block& b) { return b.end > pos; });
+		// fltk calls the callbacks added last first, so the display's has already adjusted the counts
+		if (self.buffer()->length() == 0)
+		{
+			self.mNBufferLines = 0;
+			self.mTopLineNum = 1;
+		}
+	}
+
+protected:
+	using Fl_Text_Display::mMaxsize;
+	using Fl_Text_Display::mContinuousWrap;
+	using Fl_Text_Display::mWrapMarginPix;
+	using Fl_Text_Display::mNBufferLines;
+	using Fl_Text_Display::mTopLineNum;
+	using Fl_Text_Display::mFirstChar;
+	using Fl_Text_Display::mNVisibleLines;
+	using Fl_Text_Display::text_area;
+
+public:
+	using Fl_Text_Display::Fl_Text_Display;
+	using Fl_Text_Display::buffer;
+
+	~Linked_Text_Display() override
+	{
+		Fl::remove_idle(recount_idle, this);
+		if (buffer())
+			{ buffer()->remove_modify_callback(recount_modified, this); }
+	}
+
+	// same as Fl_Text_Display::buffer, and follows modifications of `buf` while lines are recounted
+	void buffer(Fl_Text_Buffer* buf)
+	{
+		stop_recount();
+		if (buffer())
+			{ buffer()->remove_modify_callback(recount_modified, this); }
+		// added before the display's callback, so that it's called after it
+		if (buf)
+			{ buf->add_modify_callback(recount_modified, this); }
+		Fl_Text_Display::buffer(buf);
+	}
+
+	void buffer(Fl_Text_Buffer& buf)
+		{ buffer(&buf); }
+
+	// whether the wrapped lines of long buffers are recounted in the background (when idle) after the width changes, which is the default.
+	// fltk recounts every line when resized, several times, which makes resizing slow on long pages. instead, only the shown lines
+	// are rewrapped, the line counts are estimated from those before, and recounted a block at a time. until they are,
+	// the scrollbar is approximate, but scrolling and the shown text are as usual.
+	// turning it off finishes recounting
+	void lazy_wrap(bool on)
+	{
+		if (!on && recounting)
+			{ finish_recount(); }
+		lazy_wrap_on = on;
+	}
+
+	bool lazy_wrap() const
+		{ return lazy_wrap_on; }
+
+	void resize(int X, int Y, int W, int H) override
+	{
+		const int text_w = text_area.w;
+		if (!lazy_wrap_on || !mContinuousWrap || mWrapMarginPix != 0 || W == w() || text_w <= 0 || linenumber_width() != 0
+			|| !buffer() || buffer()->length() < lazy_wrap_min_chars)
+			{ Fl_Text_Display::resize(X, Y, W, H); return; }
+
+		// the lines wrapped at the new width are estimated to scale with it, which keeps the scroll position
+		const int new_text_w = std::max(1, text_w + W - w());
+		const auto scale = [text_w, new_text_w](int lines) { return static_cast<int>(static_cast<long long>(lines) * text_w / new_text_w); };
+		mNBufferLines = std::max(1, scale(mNBufferLines));
+		mTopLineNum = std::min(mNBufferLines, scale(mTopLineNum - 1) + 1);
+		// fltk only recounts when the width changes, and otherwise wraps the shown lines at the new width
+		Fl_Widget::resize(X, Y, W, H);
+		Fl_Text_Display::resize(X, Y, W, H);
+		// the top line may now start within a wrapped line
+		mFirstChar = line_start(mFirstChar);
+		calc_line_starts(0, mNVisibleLines);
+		calc_last_char();
+		update_v_scrollbar();
+		start_recount();
+	}
+
+	// scroll so that the line starting at `pos` is at the top
+	// Complexity: O(1) without wrapping, otherwise that of counting (wrapped) lines up to pos (and the rest of the buffer, if being recounted)
+	// @param line  number of newlines before pos, or -1 to count them
+	void scroll_to_line(int pos, int line)
+	{
+		// scrolling is relative to the top line, which must be exact
+		if (recounting)
+			{ finish_recount(); }
+		// lines are counted as shown when wrapping, which depends on the width, so they can't be counted in advance
+		if (mContinuousWrap || line == -1)
+			{ line = count_lines(0, pos, true); }
+		scroll(line + 1, 0);
+	}
+
+	int handle(int event) override
+	{
+		if (mMaxsize == 0) // causes xy_to_position to div by 0
+			{ return Fl_Text_Display::handle(event); }
+
+		switch (event)
+		{
+		case FL_ENTER: [[fallthrough]];
+		case FL_MOVE: // TODO: is xy_to_position too expensive for move and drag events?
+			{
+				const int pos = xy_to_position(Fl::event_x(), Fl::event_y());
+				if (search_links(pos) != -1)
+					{ window()->cursor(FL_CURSOR_HAND); return 1; }
+				// else: fallthrouh to fltk
+			}
+			break;
+			
+		case FL_PUSH:
+			{
+				const int pos = xy_to_position(Fl::event_x(), Fl::event_y());
+				const auto cur_ind = search_links(pos);
+				if (cur_ind != -1)
+				{
+					link_ind = cur_ind;
+					// we do want a "fallthrough" to fltk behavior since otherwise trying to select
+					// from a link will not work properly
+				}
+			}
+			break;
+		case FL_DRAG:
+			if (link_ind != -1)
+			{
+				// make sure cursor is still on the same link
+				const int pos = xy_to_position(Fl::event_x(), Fl::event_y());
+				const auto [low, high] = links[link_ind].first;
+				if (pos < low || pos > high)
+					{ link_ind = -1; window()->cursor(FL_CURSOR_INSERT); } // fallthrough to fltk behavior; this is now a selection
+				else
+					{ return 1; } // still within the word, still a link click and not a selection
+			}
+		case FL_RELEASE:
+			if (link_ind != -1)
+			{
+				// links will be cleared in search_word so we must
+				// extend the lifetime of the word to avoid illegal access
+				std::string word = std::move(links[link_ind].second);
+				search_word(word);
+				link_ind = -1;
+				return 1;
+			}
+			break;
+		}
+		const int ret = Fl_Text_Display::handle(event);
+		// on FL_PUSH, fltk will change the cursor, which is not always what we want
+		// not ideal... but we don't want to turn into an insert cursor on clicking a link
+		if (event == FL_PUSH && link_ind != -1)
+			{ window()->cursor(FL_CURSOR_HAND); }
+		return ret;
+	}
+};
+
+#endif
@@ -0,0 +1,156 @@
+#ifndef LIVE_DICTIONARY_H
+#define LIVE_DICTIONARY_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stop_token>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <thread>
+#include <utility>
+
+#include "sdict_file.h"
+
+// read only dictionary file which is reopened when the file on disk changes, without blocking lookups.
+// lookups take a snapshot(), which stays valid (with its mapping of the old file) until the last holder drops it,
+// while the new version is opened in the background and swapped in for later snapshots.
+// updates must replace the file (e.g. by std::filesystem::rename, as save_words and rewrite_file do) rather than write over it,
+// since old snapshots keep mapping the old file.
+// changes are detected by polling the size and modification time of the file, so they are picked up within the poll interval
+class live_dictionary
+{
+public:
+	using snapshot_ptr = std::shared_ptr<const dictionary_file>;
+
+private:
+	struct file_stamp
+	{
+		std::uintmax_t size = 0;
+		std::filesystem::file_time_type write_time{};
+		bool operator==(const file_stamp&) const = default;
+	};
+
+	std::string filename;
+	bool check_defs = true;
+	bool lean = false;
+	// guards cur only. snapshots are copied out under it, so it is held briefly
+	mutable std::mutex cur_mutex;
+	snapshot_ptr cur;
+	// stamp of the file cur was opened from. only used by whichever thread reopens
+	file_stamp cur_stamp;
+	std::mutex reload_mutex;
+
+	std::condition_variable_any watch_cv;
+	std::mutex watch_mutex;
+	std::jthread watcher;
+
+	// @return stamp of the file, or empty if it can't be read (e.g. while it is being replaced)
+	std::optional<file_stamp> read_stamp() const
+	{
+		std::error_code ec;
+		file_stamp res;
+		res.size = std::filesystem::file_size(filename, ec);
+		if (ec)
+			{ return {}; }
+		res.write_time = std::filesystem::last_write_time(filename, ec);
+		if (ec)
+			{ return {}; }
+		return res;
+	}
+
+public:
+	live_dictionary() {}
+	live_dictionary(const live_dictionary&) = delete;
+	live_dictionary& operator=(const live_dictionary&) = delete;
+	~live_dictionary() { stop_watching(); }
+
+	// map `filename_` read only (see dictionary_file::open_mapped()) as the current snapshot
+	// Complexity: that of dictionary_file::open_mapped()
+	// File Access: Map
+	// @param lean_  whether to map it (and later versions) in lean mode
+	// @throws std::runtime_error  on file i/o or parsing error, in which case the current snapshot is kept
+	void open_mapped(std::string_view filename_, bool check_defs_ = true, bool lean_ = false)
+	{
+		std::lock_guard reload_lock(reload_mutex);
+		filename = filename_;
+		check_defs = check_defs_;
+		lean = lean_;
+		// read before opening, so a change made while opening is picked up by the next reload
+		const auto stamp = read_stamp();
+		auto file = std::make_shared<dictionary_file>();
+		file->open_mapped(filename, check_defs, lean);
+		cur_stamp = stamp.value_or(file_stamp{});
+		std::lock_guard lock(cur_mutex);
+		cur = std::move(file);
+	}
+
+	// the current version of the file. lookups through it are unaffected by later reloads
+	// Complexity: O(1)
+	// @return null if no file has been opened
+	snapshot_ptr snapshot() const
+	{
+		std::lock_guard lock(cur_mutex);
+		return cur;
+	}
+
+	// reopen the file if its size or modification time changed since it was last opened, and swap it in as the current snapshot.
+	// if the new version can't be opened, the current snapshot is kept, and that version isn't retried
+	// Complexity: O(1) if unchanged, otherwise that of dictionary_file::open_mapped()
+	// File Access: Map, if changed
+	// @return whether a new version was swapped in
+	bool reload_if_changed() noexcept
+	{
+		std::lock_guard reload_lock(reload_mutex);
+		if (filename.empty())
+			{ return false; }
+		const auto stamp = read_stamp();
+		if (!stamp || *stamp == cur_stamp)
+			{ return false; }
+		cur_stamp = *stamp;
+		try
+		{
+			auto file = std::make_shared<dictionary_file>();
+			file->open_mapped(filename, check_defs, lean);
+			std::lock_guard lock(cur_mutex);
+			// the old version is closed once its last snapshot is dropped
+			cur = std::move(file);
+			return true;
+		}
+		catch (const std::exception&)
+			{ return false; }
+	}
+
+	// check for changes every `interval` on a background thread (see reload_if_changed()), replacing any existing watcher
+	// @param on_reload  called on the watcher thread after a new version is swapped in
+	void watch(std::chrono::milliseconds interval, std::function<void()> on_reload = {})
+	{
+		stop_watching();
+		watcher = std::jthread([this, interval, on_reload = std::move(on_reload)](std::stop_token stop)
+		{
+			std::unique_lock lock(watch_mutex);
+			while (!watch_cv.wait_for(lock, stop, interval, [&stop]() { return stop.stop_requested(); }))
+			{
+				if (reload_if_changed() && on_reload)
+					{ on_reload(); }
+			}
+		});
+	}
+
+	// stop the watcher thread, if any, waiting for a reload in progress to finish
+	void stop_watching()
+	{
+		if (!watcher.joinable())
+			{ return; }
+		watcher.request_stop();
+		watcher.join();
+	}
+};
+
+#endif
@@ -0,0 +1,139 @@
+#ifndef LRU_CACHE_H
+#define LRU_CACHE_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// size bounded cache, least recently used first out, which may be used from multiple threads at once.
+// keys are split over shards by hash, each with its own lock and an equal part of the capacity,
+// so concurrent lookups of different keys rarely contend. values are shared, so they stay valid after eviction
+template<typename Key, typename Value, typename Hash = std::hash<Key>>
+class sharded_lru_cache
+{
+public:
+	using value_ptr = std::shared_ptr<const Value>;
+	constexpr static std::size_t default_num_shards = 16;
+
+private:
+	struct entry
+	{
+		Key key;
+		value_ptr value;
+		std::size_t size;
+	};
+	struct shard
+	{
+		std::mutex mutex;
+		// most recently used first
+		std::list<entry> lru;
+		std::unordered_map<Key, typename std::list<entry>::iterator, Hash> index;
+		std::size_t used = 0;
+	};
+	std::vector<std::unique_ptr<shard>> shards;
+	std::size_t shard_capacity;
+	std::atomic<std::uint64_t> num_hits = 0, num_misses = 0;
+
+	shard& shard_of(const Key& key) const { return *shards[Hash{}(key) % shards.size()]; }
+
+	// drop least recently used entries of `s` until it is within capacity
+	// expects s.mutex to be locked
+	void evict(shard& s)
+	{
+		while (s.used > shard_capacity && !s.lru.empty())
+		{
+			s.used -= s.lru.back().size;
+			s.index.erase(s.lru.back().key);
+			s.lru.pop_back();
+		}
+	}
+
+public:
+	// @param capacity  approximate total size of values (as given to insert()) to keep
+	explicit sharded_lru_cache(std::size_t capacity, std::size_t num_shards = default_num_shards) :
+		shard_capacity(capacity / std::max<std::size_t>(num_shards, 1))
+	{
+		for (std::size_t i = 0; i < std::max<std::size_t>(num_shards, 1); i++)
+			{ shards.push_back(std::make_unique<shard>()); }
+	}
+
+	sharded_lru_cache(const sharded_lru_cache&) = delete;
+	sharded_lru_cache& operator=(const sharded_lru_cache&) = delete;
+
+	// Complexity: O(1) average
+	// @return value of `key`, or null if it isn't cached. counts as a use of the entry
+	value_ptr find(const Key& key)
+	{
+		auto& s = shard_of(key);
+		std::lock_guard lock(s.mutex);
+		const auto it = s.index.find(key);
+		if (it == s.index.end())
+		{
+			num_misses.fetch_add(1, std::memory_order_relaxed);
+			return {};
+		}
+		num_hits.fetch_add(1, std::memory_order_relaxed);
+		s.lru.splice(s.lru.begin(), s.lru, it->second);
+		return it->second->value;
+	}
+
+	// add `value` as the most recently used entry, replacing any entry for `key`. values larger than a shard's capacity aren't cached
+	// Complexity: O(1) average, plus O(n_evicted)
+	// @param size  approximate memory used by `value`
+	void insert(const Key& key, value_ptr value, std::size_t size)
+	{
+		auto& s = shard_of(key);
+		std::lock_guard lock(s.mutex);
+		if (const auto it = s.index.find(key); it != s.index.end())
+		{
+			s.used -= it->second->size;
+			s.lru.erase(it->second);
+			s.index.erase(it);
+		}
+		if (size > shard_capacity)
+			{ return; }
+		s.lru.emplace_front(key, std::move(value), size);
+		s.index.emplace(key, s.lru.begin());
+		s.used += size;
+		evict(s);
+	}
+
+	// Complexity: O(n_entries)
+	void clear()
+	{
+		for (auto& s : shards)
+		{
+			std::lock_guard lock(s->mutex);
+			s->index.clear();
+			s->lru.clear();
+			s->used = 0;
+		}
+	}
+
+	// Complexity: O(n_shards)
+	// @return approximate total size of cached values
+	std::size_t size() const
+	{
+		std::size_t res = 0;
+		for (const auto& s : shards)
+		{
+			std::lock_guard lock(s->mutex);
+			res += s->used;
+		}
+		return res;
+	}
+
+	// number of find() calls which found, or didn't find, the key
+	std::uint64_t hits() const noexcept { return num_hits.load(std::memory_order_relaxed); }
+	std::uint64_t misses() const noexcept { return num_misses.load(std::memory_order_relaxed); }
+};
+
+#endif
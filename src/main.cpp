@@ -1,55 +1,274 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
 #include <cstdlib>
 #include <fstream>
+#include <functional>
+#include <latch>
 #include <memory>
+#include <memory_resource>
+#include <mutex>
+#include <new>
+#include <optional>
+#include <span>
+#include <sstream>
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <thread>
 #include <type_traits>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <variant>
 #include <vector>
 
+#ifdef SDICT_USE_ZSTD
+#include <zstd.h>
+#endif
+
 #define CPPHTTPLIB_OPENSSL_SUPPORT
 #include <httplib.h>
 #define FMT_HEADER_ONLY
 #define FMT_UNICODE false
 #include <fmt/ranges.h>
-#include <jsoncons_ext/cbor/cbor.hpp>
 #include <FL/fl_ask.H>
 
 #include "ui.h"
 #include "styles.h"
 #include "json_coro_cursor.h"
 #include "dict_parse.h"
+#include "cbor_parse.h"
+#include "def_encoding.h"
 #include "text_parse.h"
 #include "links.h"
+#include "render_cache.h"
+#include "render_entries.h"
+#include "http_encoding.h"
+#include "transcode.h"
+#include "background_lookup.h"
 #include "util.h"
 #include "sdict_file.h"
+#include "live_dictionary.h"
+#include "usage_log.h"
 
 FLTK_UI ui;
 std::string api_key;
+// only used by the background_lookup thread once it is started
 httplib::SSLClient http_client("www.dictionaryapi.com");
 std::string last_word = "";
-dictionary_file dict_file;
+// data.sdict, reloaded when it is replaced on disk (see main). lookups take a snapshot, so a reload doesn't affect them
+live_dictionary dict_file;
+// how often data.sdict is checked for changes
+constexpr std::chrono::seconds dict_reload_interval(5);
+// store successfully fetched online defs in online.sdict, so that later lookups (in this and later sessions) are served offline
+constexpr bool save_online_defs = true;
+// writable dictionary of fetched online defs, looked up after dict_file (or before it, if revalidate_offline_defs). empty if disabled.
+// only used by the background_lookup thread once it is started
+std::optional<dictionary_file> online_defs;
+// show offline defs right away, but fetch them again in the background (once per session), and store them in online_defs if they changed,
+// refreshing them if they are still shown (see revalidate_offline). online_defs is then looked up first, so that it overrides dict_file.
+// only done if online defs are saved, and there are no sources (whose results would be missing from the refreshed def, see rerender_def)
+constexpr bool revalidate_offline_defs = true;
+// Merriam-Webster reference of the main definition, in the API path
+constexpr std::string_view main_reference = "collegiate";
+
+// another Merriam-Webster reference (e.g. the thesaurus), which every word is also looked up in, shown after the main definition.
+// listed in sources.txt, one per line, as "<reference> <api key> [deadline in ms]" (see load_sources).
+// each has its own connection, offline dictionary and saved online defs, and is looked up in parallel with the main definition
+struct reference_source
+{
+	// as in the API path, e.g. "thesaurus"
+	std::string reference;
+	std::string api_key;
+	// see background_lookup::source
+	std::chrono::milliseconds deadline;
+	httplib::SSLClient client{ "www.dictionaryapi.com" };
+	// <reference>.sdict, opened by the loader thread (see main) if it exists
+	std::optional<dictionary_file> offline;
+	// fetched defs, as online_defs, stored in online_<reference>.sdict.
+	// locked with online_defs_mutex, since lookups of a source may overlap (see background_lookup::source)
+	std::optional<dictionary_file> online_defs;
+	std::mutex online_defs_mutex;
+};
+// deadline of sources which don't set one
+constexpr std::chrono::milliseconds default_source_deadline(1500);
+// unique_ptr, since reference_source is not movable
+std::vector<std::unique_ptr<reference_source>> sources;
+
+render_cache def_cache;
+// all lookups go through this, once started in main()
+std::optional<background_lookup> lookup;
 bool online_mode = true, offline_mode = true; // TODO: indicators for whether each of these are available; maybe indicator for whether search is online or not
-// TODO: offline search completion?
+// counted down once dict_file has been opened on the loader thread (see main), after which offline_mode is final
+std::latch dict_opened(1);
+// set if dict_file couldn't be opened
+std::string dict_error_msg;
+
+// words looked up, saved on exit. the most used are warmed up at startup (see warm_up)
+usage_log usage;
+// number of the most used words which are warmed up
+constexpr std::size_t num_warm_up_words = 64;
+// the most used words of the last runs, read before dict_file is opened
+std::vector<std::string> warm_up_words;
+// words which have been revalidated (or are waiting to be) in this session, which aren't revalidated again
+std::unordered_set<std::string> revalidated_words;
+
+// @return whether dict_file can be used, without waiting for it to be opened
+bool offline_ready()
+	{ return dict_opened.try_wait() && offline_mode; }
 
 // TODO: save/restore scroll location and selections?
-struct cached_def
+// rendered def in navigation history. entries of cached_defs for the same word share one page
+struct history_page
 {
-	struct buf_data
-	{
-		// fltk uses malloc/free so we need custom deleter
-		std::unique_ptr<char, decltype([](char* p) { std::free(p); })> buf;
-		int length, gap_start, gap_end;
-	};
 	std::string word;
-	buf_data def_text, def_style;
-	decltype(links) def_links;
+	// null once packed or evicted (see trim_history). may be shared with def_cache
+	std::shared_ptr<const rendered_def> rendered;
+	// whether rendered has all entries of the def (it doesn't if the lookup was cancelled)
+	bool complete = true;
+#ifdef SDICT_USE_ZSTD
+	// once packed, rendered with its text zstd compressed into packed_text (which was text_length bytes)
+	rendered_def packed;
+	std::vector<char> packed_text;
+	std::size_t text_length = 0;
+	bool is_packed = false;
+#endif
+
+	// @return approximate memory used by this page only, i.e. not by a def it shares with def_cache or the shown def
+	std::size_t memory_size() const
+	{
+		std::size_t size = sizeof(history_page) + word.size();
+		if (rendered && rendered.use_count() == 1)
+			{ size += sizeof(rendered_def) + rendered_def_size(*rendered); }
+#ifdef SDICT_USE_ZSTD
+		size += rendered_def_size(packed) + packed_text.size();
+#endif
+		return size;
+	}
 };
 
-// TODO: deduplicate?
-std::vector<cached_def> cached_defs;
+std::vector<std::shared_ptr<history_page>> cached_defs;
 std::size_t cur_cached_ind; // index of last used cached def, or size of cached_defs if none
+// pages of cached_defs by word, to deduplicate them. expired pages are removed by trim_history
+std::unordered_map<std::string, std::weak_ptr<history_page>> history_pages;
+// the shown def, which is cached as a page of cached_defs when it is replaced. null while it is still being rendered
+std::shared_ptr<const rendered_def> shown_def;
+bool shown_def_complete = true;
+// approximate memory used by pages of cached_defs (not counting defs shared with def_cache) before they are evicted, furthest from cur_cached_ind first
+constexpr std::size_t history_memory_budget = 4 * 1024 * 1024;
+// pages at most this far from cur_cached_ind are kept as is, so that going back or forward to them doesn't decompress
+constexpr std::size_t history_live_distance = 2;
+#ifdef SDICT_USE_ZSTD
+// fast, since packing is done on the UI thread
+constexpr int history_compression_level = 3;
+#endif
+
+// render `word` again, without the lookup thread, for an evicted history page
+// @return rendered def, or null if it is in neither def_cache nor the offline dictionary
+std::shared_ptr<const rendered_def> rerender_def(std::string_view word);
+
+// compress the text of a page if supported and it isn't shared, releasing rendered
+// Complexity: O(text_length)
+void pack_page(history_page& page)
+{
+#ifdef SDICT_USE_ZSTD
+	if (!page.rendered || page.rendered.use_count() > 1)
+		{ return; }
+	const auto& text = page.rendered->text;
+	std::vector<char> packed_text(ZSTD_compressBound(text.size()));
+	const auto compressed_len = ZSTD_compress(packed_text.data(), packed_text.size(), text.data(), text.size(), history_compression_level);
+	if (ZSTD_isError(compressed_len) || compressed_len >= text.size())
+		{ return; }
+	packed_text.resize(compressed_len);
+	packed_text.shrink_to_fit();
+	page.packed_text = std::move(packed_text);
+	page.text_length = text.size();
+	page.packed = { {}, page.rendered->style, page.rendered->def_links, page.rendered->target_word };
+	page.is_packed = true;
+	page.rendered.reset();
+#else
+	static_cast<void>(page);
+#endif
+}
+
+// drop everything but the word of a page, which can be rendered again by rerender_def
+void evict_page(history_page& page)
+{
+	page.rendered.reset();
+#ifdef SDICT_USE_ZSTD
+	page.packed = {};
+	page.packed_text = {};
+	page.is_packed = false;
+#endif
+}
+
+// make rendered of a packed or evicted page available again
+// Complexity: O(text_length) if packed, that of rerender_def() if evicted
+// @return false if the text couldn't be decompressed, or the def couldn't be rendered
+bool unpack_page(history_page& page)
+{
+	if (page.rendered)
+		{ return true; }
+#ifdef SDICT_USE_ZSTD
+	if (page.is_packed)
+	{
+		auto rendered = std::make_shared<rendered_def>(std::move(page.packed));
+		rendered->text.resize(page.text_length);
+		if (ZSTD_decompress(rendered->text.data(), rendered->text.size(), page.packed_text.data(), page.packed_text.size()) != page.text_length)
+			{ return false; }
+		page.rendered = std::move(rendered);
+		page.packed = {};
+		page.packed_text = {};
+		page.is_packed = false;
+		return true;
+	}
+#endif
+	page.rendered = rerender_def(page.word);
+	page.complete = true;
+	return page.rendered != nullptr;
+}
+
+// pack pages which aren't near cur_cached_ind, and evict pages (furthest first) until cached_defs is within
+// history_memory_budget. only pages which rerender_def can render again are evicted. the shown page is never changed
+// Complexity: O(n_cached * log(n_cached) + packed_size)
+void trim_history()
+{
+	std::erase_if(history_pages, [](const auto& p) { return p.second.expired(); });
+
+	// a page is as near as its nearest entry
+	std::unordered_map<history_page*, std::size_t> distances;
+	for (std::size_t i = 0; i < cached_defs.size(); i++)
+	{
+		const std::size_t distance = (i > cur_cached_ind ? i - cur_cached_ind : cur_cached_ind - i);
+		const auto [it, inserted] = distances.emplace(cached_defs[i].get(), distance);
+		if (!inserted)
+			{ it->second = std::min(it->second, distance); }
+	}
+	std::vector<std::pair<std::size_t, history_page*>> pages;
+	pages.reserve(distances.size());
+	std::size_t total = 0;
+	for (const auto& [page, distance] : distances)
+	{
+		if (distance > history_live_distance)
+			{ pack_page(*page); }
+		total += page->memory_size();
+		pages.emplace_back(distance, page);
+	}
+
+	std::ranges::sort(pages, std::ranges::greater());
+	const auto offline = (offline_ready() && sources.empty() ? dict_file.snapshot() : nullptr);
+	for (const auto& [distance, page] : pages)
+	{
+		if (total <= history_memory_budget)
+			{ break; }
+		if (distance == 0 || !(def_cache.contains(page->word) || (offline && offline->contains(page->word))))
+			{ continue; }
+		total -= page->memory_size();
+		evict_page(*page);
+		total += page->memory_size();
+	}
+}
 
 // make forward/back buttons active/inactive based on cur_cached_ind and cached_defs.size()
 void update_nav_buttons()
@@ -66,17 +285,31 @@ void update_nav_buttons()
 		{ ui.button_forward.activate(); }
 }
 
-// clears last_word, links, and optionally text/style buffers, and caches the current
-// definition in cached_defs
-// NB: if do_reset is false, text_buf.mBuf and style_buf.mBuf MUST be changed immediately after,
-// or the buffers (whose addresses are cached) may be freed, leading to dangling cached buffers
-// @tparam do_reset  whether to reset text_buffers and style_buffers to a new empty buffer
+// @return page of cached_defs for the shown def, reusing the page for last_word if there is one
+std::shared_ptr<history_page> shown_page()
+{
+	auto& weak = history_pages[last_word];
+	auto page = weak.lock();
+	if (!page)
+	{
+		page = std::make_shared<history_page>(last_word, shown_def, shown_def_complete);
+		weak = page;
+	}
+	else if (shown_def_complete && (!page->complete || !page->rendered))
+	{
+		// the shown def is more complete (or not packed), so use it for every entry of this word
+		evict_page(*page);
+		page->rendered = shown_def;
+		page->complete = true;
+	}
+	return page;
+}
+
+// clears last_word, links, and text/style buffers, and optionally caches the current definition in cached_defs
 // @tparam do_cache  whether to cache to cached_defs
-template<bool do_reset = true, bool do_cache = true>
+template<bool do_cache = true>
 void clear_and_cache()
 {
-	static_assert(do_reset || do_cache, "must either reset or cache (or both)");
-
 	Fl_Text_Buffer& text_buf = ui.text_buf;
 	Fl_Text_Buffer& style_buf = ui.style_buf;
 
@@ -91,41 +324,137 @@ void clear_and_cache()
 	int& text_buf_mPreferredGapSize = text_buf.*get(Fl_Text_Buffer_m<"mPreferredGapSize", int>());
 	int& style_buf_mPreferredGapSize = style_buf.*get(Fl_Text_Buffer_m<"mPreferredGapSize", int>());
 
-	// copy old data (buffers are NOT copied, just the pointer address)
-	cached_def::buf_data text_buf_data = { decltype(cached_def::buf_data::buf)(text_buf_mBuf), text_buf_mLength, text_buf_mGapStart, text_buf_mGapEnd };
-	cached_def::buf_data style_buf_data = { decltype(cached_def::buf_data::buf)(style_buf_mBuf), style_buf_mLength, style_buf_mGapStart, style_buf_mGapEnd };
+	// fltk uses malloc/free so we need custom deleter
+	using buf_ptr = std::unique_ptr<char, decltype([](char* p) { std::free(p); })>;
+	// the old buffers are freed once the new ones have been set (and callbacks have been called)
+	const buf_ptr old_text_buf(text_buf_mBuf), old_style_buf(style_buf_mBuf);
+	const int old_text_length = text_buf_mLength, old_style_length = style_buf_mLength;
 
-	if constexpr (do_reset)
-	{
-		(text_buf.*get(Fl_Text_Buffer_m<"call_predelete_callbacks", void(int, int) const>()))(0, text_buf_data.length);
-		(style_buf.*get(Fl_Text_Buffer_m<"call_predelete_callbacks", void(int, int) const>()))(0, style_buf_data.length);
+	(text_buf.*get(Fl_Text_Buffer_m<"call_predelete_callbacks", void(int, int) const>()))(0, old_text_length);
+	(style_buf.*get(Fl_Text_Buffer_m<"call_predelete_callbacks", void(int, int) const>()))(0, old_style_length);
 
-		// allocate new empty (but with gap) buffer and set members accordingly
-		text_buf_mBuf = static_cast<char*>(std::malloc(text_buf_mPreferredGapSize));
-		style_buf_mBuf = static_cast<char*>(std::malloc(style_buf_mPreferredGapSize));
-		text_buf_mLength = 0;
-		style_buf_mLength = 0;
-		text_buf_mGapStart = 0;
-		style_buf_mGapStart = 0;
-		text_buf_mGapEnd = text_buf_mPreferredGapSize;
-		style_buf_mGapEnd = style_buf_mPreferredGapSize;
+	// allocate new empty (but with gap) buffer and set members accordingly
+	text_buf_mBuf = static_cast<char*>(std::malloc(text_buf_mPreferredGapSize));
+	style_buf_mBuf = static_cast<char*>(std::malloc(style_buf_mPreferredGapSize));
+	text_buf_mLength = 0;
+	style_buf_mLength = 0;
+	text_buf_mGapStart = 0;
+	style_buf_mGapStart = 0;
+	text_buf_mGapEnd = text_buf_mPreferredGapSize;
+	style_buf_mGapEnd = style_buf_mPreferredGapSize;
 
-		(text_buf.*get(Fl_Text_Buffer_m<"update_selections", void(int, int, int)>()))(0, text_buf_data.length, 0);
-		(style_buf.*get(Fl_Text_Buffer_m<"update_selections", void(int, int, int)>()))(0, style_buf_data.length, 0);
+	(text_buf.*get(Fl_Text_Buffer_m<"update_selections", void(int, int, int)>()))(0, old_text_length, 0);
+	(style_buf.*get(Fl_Text_Buffer_m<"update_selections", void(int, int, int)>()))(0, old_style_length, 0);
 
-		// TODO: do we need to remove the gap for this?
-		(text_buf.*get(Fl_Text_Buffer_m<"call_modify_callbacks", void(int, int, int, int, const char*) const>()))(0, text_buf_data.length, 0, 0, text_buf_data.buf.get());
-		(style_buf.*get(Fl_Text_Buffer_m<"call_modify_callbacks", void(int, int, int, int, const char*) const>()))(0, style_buf_data.length, 0, 0, style_buf_data.buf.get());
-	}
+	// TODO: do we need to remove the gap for this?
+	(text_buf.*get(Fl_Text_Buffer_m<"call_modify_callbacks", void(int, int, int, int, const char*) const>()))(0, old_text_length, 0, 0, old_text_buf.get());
+	(style_buf.*get(Fl_Text_Buffer_m<"call_modify_callbacks", void(int, int, int, int, const char*) const>()))(0, old_style_length, 0, 0, old_style_buf.get());
 
+	// the text is shared with the cached page, so only a pointer is cached
 	if constexpr (do_cache)
 	{
-		if (cur_cached_ind != cached_defs.size())
-			{ cached_defs.resize(cur_cached_ind + 1); }
-		cached_defs.emplace_back(std::move(last_word), std::move(text_buf_data), std::move(style_buf_data), std::move(links));
+		if (shown_def)
+		{
+			if (cur_cached_ind != cached_defs.size())
+				{ cached_defs.resize(cur_cached_ind + 1); }
+			cached_defs.push_back(shown_page());
+			cur_cached_ind = cached_defs.size();
+			update_nav_buttons();
+		}
+	}
+	last_word.clear();
+	links.clear();
+	shown_def.reset();
+}
+
+// append `n` characters to `buf`, which are written by `write(char* out)` directly into its gap (growing it once if needed),
+// and call the modify callbacks once. this avoids the copy (and, for styles, the expanded temporary) of Fl_Text_Buffer::append
+// Complexity: O(n) (amortized)
+template<typename Write>
+void append_in_place(Fl_Text_Buffer& buf, int n, Write write)
+{
+	char*& mBuf = buf.*get(Fl_Text_Buffer_m<"mBuf", char*>());
+	int& mLength = buf.*get(Fl_Text_Buffer_m<"mLength", int>());
+	int& mGapStart = buf.*get(Fl_Text_Buffer_m<"mGapStart", int>());
+	int& mGapEnd = buf.*get(Fl_Text_Buffer_m<"mGapEnd", int>());
+	const int mPreferredGapSize = buf.*get(Fl_Text_Buffer_m<"mPreferredGapSize", int>());
+
+	if (n <= 0)
+		{ return; }
+	// the shown text is only ever appended to, so the gap is at the end unless fltk moved it
+	if (mGapStart != mLength)
+	{
+		std::vector<char> temp(n);
+		write(temp.data());
+		buf.append(temp.data(), n);
+		return;
+	}
+	if (mGapEnd - mGapStart < n)
+	{
+		// nothing is after the gap, so the buffer can be grown in place. fltk frees it with free()
+		const int size = mLength + n + mPreferredGapSize;
+		char* const grown = static_cast<char*>(std::realloc(mBuf, size));
+		if (!grown)
+			{ throw std::bad_alloc(); }
+		mBuf = grown;
+		mGapEnd = size;
+	}
+	write(mBuf + mGapStart);
+	const int pos = mLength;
+	mGapStart += n;
+	mLength += n;
+	(buf.*get(Fl_Text_Buffer_m<"update_selections", void(int, int, int)>()))(pos, 0, n);
+	(buf.*get(Fl_Text_Buffer_m<"call_modify_callbacks", void(int, int, int, int, const char*) const>()))(pos, 0, n, 0, nullptr);
+}
+
+// scroll the target word of the shown `rendered` to the top, and select it
+void show_target(const rendered_def& rendered)
+{
+	const auto [first, second] = rendered.target_word;
+	ui.text_display.scroll_to_line(static_cast<int>(first), static_cast<int>(rendered.entry_line(first)));
+	ui.text_buf.select(static_cast<int>(first), static_cast<int>(second) - 1);
+}
+
+// append characters of `rendered` from `from` onwards, and their styles, to ui.text_buf and ui.style_buf
+// Complexity: O(log(n_runs) + appended length)
+void append_shown(const rendered_def& rendered, std::size_t from)
+{
+	const int n = static_cast<int>(rendered.text.size() - from);
+	append_in_place(ui.text_buf, n, [&rendered, from](char* out) { std::ranges::copy(std::span(rendered.text).subspan(from), out); });
+	append_in_place(ui.style_buf, n, [&rendered, from](char* out) { expand_styles(rendered.style, from, out); });
+}
+
+// replace the shown definition with `rendered`, caching it in cached_defs unless it was restored from there.
+// cur_cached_ind is set to the size of cached_defs, and should be set afterwards if `rendered` is from there
+void replace_shown(std::string_view word, const rendered_def& rendered)
+{
+	if (!last_word.empty() && cur_cached_ind == cached_defs.size())
+		{ clear_and_cache(); }
+	else
+	{
+		clear_and_cache<false>();
 		cur_cached_ind = cached_defs.size();
 		update_nav_buttons();
 	}
+	last_word = word;
+	links = rendered.def_links;
+
+	append_shown(rendered, 0);
+
+	if (rendered.target_word.first != -1)
+		{ show_target(rendered); }
+	else
+		{ ui.text_display.scroll(0, 0); }
+}
+
+// cache the current definition and replace it with `rendered`
+// @param shared  `rendered`, if it is shared (e.g. with def_cache). otherwise shown_def must be set once it is finished
+void show_rendered(std::string_view word, const rendered_def& rendered, std::shared_ptr<const rendered_def> shared = nullptr)
+{
+	replace_shown(word, rendered);
+	shown_def = std::move(shared);
+	shown_def_complete = true;
+	trim_history();
 }
 
 void restore_from_cache(std::size_t ind)
@@ -135,228 +464,685 @@ void restore_from_cache(std::size_t ind)
 		fl_alert("Trying to restore from invalid cache index %uz (cache size %uz)", ind, cached_defs.size());
 		return;
 	}
+	// kept alive, since the page may be evicted while the shown def is cached
+	const auto page = cached_defs[ind];
+	if (!unpack_page(*page))
+	{
+		// it can't be shown, so drop it from the history
+		fl_alert("Unable to restore \"%s\" from history", page->word.c_str());
+		cur_cached_ind -= std::ranges::count(cached_defs.begin(), cached_defs.begin() + std::min(cur_cached_ind, cached_defs.size()), page);
+		std::erase(cached_defs, page);
+		update_nav_buttons();
+		return;
+	}
+	const auto rendered = page->rendered;
 
-	Fl_Text_Buffer& text_buf = ui.text_buf;
-	Fl_Text_Buffer& style_buf = ui.style_buf;
+	replace_shown(page->word, *rendered);
+	shown_def = rendered;
+	shown_def_complete = page->complete;
+	cur_cached_ind = ind;
+	update_nav_buttons();
+	trim_history();
+}
 
-	char*& text_buf_mBuf = text_buf.*get(Fl_Text_Buffer_m<"mBuf", char*>());
-	char*& style_buf_mBuf = style_buf.*get(Fl_Text_Buffer_m<"mBuf", char*>());
-	int& text_buf_mLength = text_buf.*get(Fl_Text_Buffer_m<"mLength", int>());
-	int& style_buf_mLength = style_buf.*get(Fl_Text_Buffer_m<"mLength", int>());
-	int& text_buf_mGapStart = text_buf.*get(Fl_Text_Buffer_m<"mGapStart", int>());
-	int& style_buf_mGapStart = style_buf.*get(Fl_Text_Buffer_m<"mGapStart", int>());
-	int& text_buf_mGapEnd = text_buf.*get(Fl_Text_Buffer_m<"mGapEnd", int>());
-	int& style_buf_mGapEnd = style_buf.*get(Fl_Text_Buffer_m<"mGapEnd", int>());
-	
-	if (cur_cached_ind == cached_defs.size())
-		{ clear_and_cache<false, true>(); }
+std::shared_ptr<const rendered_def> rerender_def(std::string_view word)
+{
+	if (auto rendered = def_cache.find(word))
+		{ return rendered; }
+	// online_defs is only used by the lookup thread, so online defs which aren't in def_cache can't be rendered here.
+	// neither can other sources, which are only looked up by the lookup thread
+	if (!offline_ready() || !sources.empty())
+		{ return {}; }
+	try
+	{
+		// kept until the def is parsed, since the def may be a view of its mapping
+		const auto offline = dict_file.snapshot();
+		const auto def = offline->find_view(word);
+		if (!def)
+			{ return {}; }
+		// only needed until rendered, so allocated from an arena like the entries of lookups (see background_lookup::offline_def)
+		std::pmr::monotonic_buffer_resource arena(def_arena::initial_size(def->size()));
+		std::pmr::vector<def_arena::word_info> entries(&arena);
+		def_encoding::parse(def_encoding::from_id(offline->def_encoding()), def.value(), entries);
+		auto rendered = std::make_shared<rendered_def>();
+		render_entries(std::span<const def_arena::word_info>(entries), word, *rendered);
+		return rendered;
+	}
+	catch (const std::exception&)
+		{ return {}; }
+}
+
+// render the result of another source under a heading with its reference, appending to `out`.
+// nothing is rendered if the word wasn't found
+void render_source(const background_lookup::source_result& result, std::string_view word, rendered_def& out)
+{
+	const std::size_t num_entries = (result.offline ? result.offline->entries.size() : result.entries.size());
+	if (num_entries == 0 && result.error.empty())
+		{ return; }
+	const auto add = [&out](std::string_view text, char style)
+	{
+		out.text.append_range(text);
+		append_style(out.style, text.size(), style);
+	};
+	add(std::format("[{}]\n", sources[result.source]->reference), get_style(style::title));
+	if (!result.error.empty())
+		{ add(std::format("{}\n\n", result.error), get_style(style_italic)); }
+	else if (result.offline)
+		{ render_entries(std::span<const def_arena::word_info>(result.offline->entries), word, out); }
+	else
+		{ render_entries(std::span<const word_info>(result.entries), word, out); }
+}
+
+// @return whether none of `results` failed (or missed its deadline), so that a page with them can be cached
+bool sources_complete(std::span<const background_lookup::source_result> results)
+	{ return std::ranges::all_of(results, [](const auto& r) { return r.error.empty(); }); }
+// @return whether all of `results` were found offline, so that a page with them can be stored in def_cache's file
+bool sources_offline(std::span<const background_lookup::source_result> results)
+	{ return std::ranges::all_of(results, [](const auto& r) { return r.offline.has_value(); }); }
+
+// render the whole definition of a finished update, with the results of sources which found the word (or failed).
+// called on the lookup thread, so that offline hits and prefetches are shown without rendering on the UI thread
+rendered_def render_lookup(const background_lookup::update& u, std::string_view word)
+{
+	rendered_def res;
+	if (u.offline)
+		{ render_entries(std::span<const def_arena::word_info>(u.offline->entries), word, res); }
 	else
+		{ render_entries(std::span<const word_info>(u.entries), word, res); }
+	for (const auto& result : u.sources)
+		{ render_source(result, word, res); }
+	return res;
+}
+
+// definition which is shown, but whose later entries are still being rendered on idle (see search_word)
+struct pending_render
+{
+	std::string word;
+	// entries, unless found offline
+	std::vector<word_info> data;
+	// set instead of data if found offline. its arena is freed with the pending render, once it has been shown
+	std::optional<background_lookup::offline_def> offline;
+	// index of the next entry to render
+	std::size_t next_entry = 0;
+	// everything rendered so far, which is also shown once `shown` is set
+	rendered_def rendered;
+	// whether entries are still being received from the lookup thread (see lookup_results_ready)
+	bool streaming = false;
+	bool shown = true;
+	// whether all entries were received, so the result can be cached
+	bool complete = true;
+	// results of other sources which found the word (or failed), each rendered as one entry after those of the main definition
+	std::vector<background_lookup::source_result> source_results;
+
+	std::size_t num_main_entries() const { return offline ? offline->entries.size() : data.size(); }
+	std::size_t num_entries() const { return num_main_entries() + source_results.size(); }
+
+	// render the next entry into `rendered`
+	void render_next()
 	{
-		// bufs would have been released when restored, we need to cache them again
-		cached_defs[cur_cached_ind].def_text.buf.reset(text_buf_mBuf);
-		cached_defs[cur_cached_ind].def_style.buf.reset(style_buf_mBuf);
+		if (next_entry >= num_main_entries())
+			{ render_source(source_results[next_entry - num_main_entries()], word, rendered); }
+		else if (offline)
+			{ render_entries(std::span<const def_arena::word_info>(offline->entries).subspan(next_entry, 1), word, rendered); }
+		else
+			{ render_entries(std::span<const word_info>(data).subspan(next_entry, 1), word, rendered); }
+		next_entry++;
 	}
+};
+std::optional<pending_render> pending;
 
-	char* old_text_buf = text_buf_mBuf;
-	char* old_style_buf = style_buf_mBuf;
-	int old_text_length = text_buf_mLength;
-	int old_style_length = style_buf_mLength;
+// number of link targets of the shown definition to prefetch (see prefetch_links)
+constexpr std::size_t num_prefetch_links = 8;
+// maximum bytes fetched online when prefetching the links of a definition
+constexpr std::size_t prefetch_bytes = 256 * 1024;
 
-	(text_buf.*get(Fl_Text_Buffer_m<"call_predelete_callbacks", void(int, int) const>()))(0, old_text_length);
-	(style_buf.*get(Fl_Text_Buffer_m<"call_predelete_callbacks", void(int, int) const>()))(0, old_style_length);
+// prefetch the first link targets of the shown definition which aren't cached, replacing the prefetches of the previous one.
+// they are rendered into def_cache as they arrive (in lookup_results_ready), so that clicking them is instant
+// Complexity: O(n_links * num_prefetch_links)
+void prefetch_links(const decltype(links)& def_links)
+{
+	std::vector<std::string> words;
+	for (const auto& [bounds, target] : def_links)
+	{
+		if (words.size() >= num_prefetch_links)
+			{ break; }
+		if (std::ranges::find(words, target) == words.end() && !def_cache.contains(target))
+			{ words.push_back(target); }
+	}
+	lookup->prefetch(std::move(words), prefetch_bytes);
+}
 
-	cached_def& cached = cached_defs[ind];
-	text_buf_mBuf = cached.def_text.buf.release();
-	style_buf_mBuf = cached.def_style.buf.release();
-	text_buf_mLength = cached.def_text.length;
-	style_buf_mLength = cached.def_style.length;
-	text_buf_mGapStart = cached.def_text.gap_start;
-	style_buf_mGapStart = cached.def_style.gap_start;
-	text_buf_mGapEnd = cached.def_text.gap_end;
-	style_buf_mGapEnd = cached.def_style.gap_end;
-	links = cached.def_links;
+// revalidate `word` on the lookup thread once it is idle, if it hasn't been in this session (see revalidate_offline_defs).
+// called when a def which may be offline is shown. whether it is (and isn't in online_defs) is checked by revalidate_offline
+void revalidate_shown(std::string_view word)
+{
+	if (!revalidate_offline_defs || !save_online_defs || !online_mode || !sources.empty())
+		{ return; }
+	if (revalidated_words.emplace(word).second)
+		{ lookup->revalidate(std::string(word)); }
+}
 
-	(text_buf.*get(Fl_Text_Buffer_m<"update_selections", void(int, int, int)>()))(0, old_text_length, 0);
-	(style_buf.*get(Fl_Text_Buffer_m<"update_selections", void(int, int, int)>()))(0, old_style_length, 0);
+// replace the stale def of `word` with `rendered`, which changed when it was revalidated, in def_cache and the history,
+// and show it if it is still shown (unless it was restored from the history, or is being replaced)
+void refresh_revalidated(const std::string& word, std::shared_ptr<const rendered_def> rendered)
+{
+	def_cache.invalidate(word);
+	def_cache.add(word, rendered);
+	if (const auto it = history_pages.find(word); it != history_pages.end())
+	{
+		if (const auto page = it->second.lock())
+		{
+			evict_page(*page);
+			page->rendered = rendered;
+			page->complete = true;
+		}
+	}
+	if (last_word == word && !pending && cur_cached_ind == cached_defs.size())
+	{
+		// cleared so that the stale def isn't added to the history
+		last_word.clear();
+		show_rendered(word, *rendered, rendered);
+	}
+}
 
-	(text_buf.*get(Fl_Text_Buffer_m<"call_modify_callbacks", void(int, int, int, int, const char*) const>()))(0, old_text_length, 0, 0, old_text_buf);
-	(style_buf.*get(Fl_Text_Buffer_m<"call_modify_callbacks", void(int, int, int, int, const char*) const>()))(0, old_style_length, 0, 0, old_style_buf);
+// render the next pending entry and append it to the shown definition
+// @return false if the pending render is finished (and has been cleared)
+bool render_pending_entry()
+{
+	if (!pending)
+		{ return false; }
+	if (pending->next_entry < pending->num_entries())
+	{
+		auto& rendered = pending->rendered;
+		const std::size_t text_start = rendered.text.size(), links_start = rendered.def_links.size();
+		pending->render_next();
 
-	cur_cached_ind = ind;
-	last_word = cached.word;
-	update_nav_buttons();
+		append_shown(rendered, text_start);
+		links.insert(links.end(), rendered.def_links.begin() + links_start, rendered.def_links.end());
+
+		if (rendered.target_word.first != -1 && rendered.target_word.first >= text_start)
+			{ show_target(rendered); }
+		if (pending->next_entry < pending->num_entries())
+			{ return true; }
+	}
+	// more entries may still arrive, and rendering is resumed by lookup_results_ready
+	if (pending->streaming)
+		{ return false; }
+
+	// shared by def_cache and navigation history. online defs are only written to the cache file on exit
+	auto rendered = std::make_shared<const rendered_def>(std::move(pending->rendered));
+	if (pending->complete)
+	{
+		def_cache.add(pending->word, rendered, pending->offline.has_value() && sources_offline(pending->source_results));
+		prefetch_links(rendered->def_links);
+	}
+	if (pending->shown)
+	{
+		shown_def = std::move(rendered);
+		shown_def_complete = pending->complete;
+	}
+	pending.reset();
+	return false;
 }
 
-void search_word(std::string_view word)
+void render_pending_idle(void*)
 {
-	const auto word_colon = word.rfind(':');
-	std::vector<word_info> data;
+	if (!render_pending_entry())
+		{ Fl::remove_idle(render_pending_idle); }
+}
 
+// render all pending entries now, e.g. before the shown definition is cached or replaced.
+// a lookup still in progress is cancelled, and only what has been received is kept
+void finish_pending_render()
+{
+	Fl::remove_idle(render_pending_idle);
+	if (pending && pending->streaming)
 	{
-		std::string_view word_only = word;
-		if (word_colon != std::string_view::npos)
-			{ word_only = word.substr(0, word_colon); }
+		lookup->cancel();
+		pending->streaming = false;
+		pending->complete = false;
+		if (!pending->shown)
+			{ pending.reset(); }
+	}
+	while (render_pending_entry()) {}
+}
 
-		std::optional<std::vector<char>> dict_res;
-		if (offline_mode)
+// Fl::awake handler for lookup updates, which adds received entries to `pending` and renders them
+void lookup_results_ready(void*)
+{
+	for (auto& u : lookup->poll())
+	{
+		if (!u.revalidated_word.empty())
 		{
-			try
-				{ dict_res = dict_file.find(word); }
-			catch (const std::exception& e)
-				{ fl_alert("%s", e.what()); return; }
+			if (u.rendered)
+				{ refresh_revalidated(u.revalidated_word, std::move(u.rendered)); }
+			continue;
 		}
-
-		try
+		if (!u.prefetch_word.empty())
 		{
-			const auto parse_data = [](auto& parse_task, const char* data, std::size_t data_len)
-			{
-				try
-					{ parse_task.add_data({ data, data_len }); }
-				catch (const std::exception& e)
-				{
-					// TODO: replace with std::format once range formatter is more mature
-					throw std::runtime_error(fmt::format("JSON parse error: {}\nOccured in section:\n{:s}", e.what(), std::string_view(data, data_len) | std::views::chunk(128) | std::views::join_with('\n')));
-				}
-				if (parse_task.coro_handle.done())
-				{
-					throw std::runtime_error(fmt::format("JSON parsing ended prematurely.\nOccured in section:\n{:s}", std::string_view(data, data_len) | std::views::chunk(128) | std::views::join_with('\n')));
-				}
-			};
-
-
-			if (dict_res)
-			{
-				auto cursor = cursor_coro_wrapper<jsoncons::cbor::cbor_bytes_cursor>(dict_res.value());
-				try
-				{
-					task<void> parse_task = begin_parse(cursor, data);
-					if (!parse_task.coro_handle.done())
-						{ throw std::runtime_error("CBOR parsing did not finish"); }
-				}
-				catch (const std::exception& e)
-					{ throw std::runtime_error(std::format("CBOR parse error: {}", e.what())); }
-			}
-			else if (online_mode)
-			{
-				json_coro_cursor cursor;
-				task<void> parse_task = begin_parse(cursor, data);
-
-				static constexpr auto url_encode = [](std::string_view in)
-				{
-					std::string s;
-					for (char c : in)
-					{
-						if (('A' <= c && c <= 'Z') ||
-							('a' <= c && c <= 'z') ||
-							('0' <= c && c <= '9') ||
-							c == '-' || c == '.' || c == '_' || c == '~')
-							{ s += c; }
-						else
-							{ s += std::format("%{:X}", c); }
-					}
-					return s;
-				};
-				auto res = http_client.Get(httplib::append_query_params("/api/v3/references/collegiate/json/" + url_encode(word_only), { { "key", api_key } }),
-					[&parse_data, &parse_task](const char* cur_data, std::size_t data_len) { parse_data(parse_task, cur_data, data_len); return true; });
-				if (!res)
-				{
-					throw std::runtime_error("HTTP Error: " + httplib::to_string(res.error()));
-				}
-				if (res->status != 200)
-				{
-					throw std::runtime_error(std::format("Unexpected HTTP Status {}", res->status));
-				}
-			}
-			else
+			// a source failed, so it is looked up again if it is searched
+			if (!sources_complete(u.sources))
+				{ continue; }
+			// rendered on the lookup thread
+			def_cache.add(u.prefetch_word, std::move(u.rendered), u.offline.has_value() && sources_offline(u.sources));
+			continue;
+		}
+		if (!pending || !pending->streaming)
+			{ continue; }
+		if (u.rendered)
+		{
+			// the whole definition was rendered on the lookup thread (offline hits are sent in one update), so it is only swapped in
+			const bool complete = sources_complete(u.sources);
+			show_rendered(pending->word, *u.rendered, u.rendered);
+			shown_def_complete = complete;
+			if (complete)
 			{
-				throw std::runtime_error(std::format("Unable to find \"{}\" in offline dictionary", word));
+				def_cache.add(pending->word, u.rendered, u.offline.has_value() && sources_offline(u.sources));
+				prefetch_links(u.rendered->def_links);
 			}
+			if (u.offline)
+				{ revalidate_shown(pending->word); }
+			pending.reset();
+			continue;
+		}
+		// moving keeps the views pointing into the same buffer
+		if (u.offline)
+			{ pending->offline = std::move(u.offline); }
+		pending->data.append_range(u.entries | std::views::as_rvalue);
+		if (u.finished)
+		{
+			pending->streaming = false;
+			// sources which didn't find the word aren't shown
+			std::erase_if(u.sources, [](const auto& r) { return r.error.empty() && r.entries.empty() && !r.offline; });
+			if (!sources_complete(u.sources))
+				{ pending->complete = false; }
+			pending->source_results = std::move(u.sources);
+		}
+
+		if (!u.error.empty())
+		{
+			fl_alert("%s", u.error.c_str());
+			pending->complete = false;
+			// keep the shown definition if nothing of this one has been shown, unless another source found it
+			if (!pending->shown && std::ranges::all_of(pending->source_results, [](const auto& r) { return !r.error.empty(); }))
+				{ pending.reset(); continue; }
 		}
-		catch (const std::runtime_error& e)
+		if (!pending->shown)
 		{
-			fl_alert("%s", e.what());
-			return;
+			if (pending->num_entries() == 0 && !u.finished)
+				{ continue; }
+			if (pending->num_entries() > 0)
+				{ pending->render_next(); }
+			show_rendered(pending->word, pending->rendered);
+			pending->shown = true;
 		}
+		if (!Fl::has_idle(render_pending_idle))
+			{ Fl::add_idle(render_pending_idle); }
 	}
+}
 
-	if (!last_word.empty() && cur_cached_ind == cached_defs.size())
-		{ clear_and_cache(); }
+// strip the entry number of links such as "word:2"
+std::string_view without_entry_num(std::string_view word)
+{
+	const auto word_colon = word.rfind(':');
+	if (word_colon != std::string_view::npos)
+		{ word = word.substr(0, word_colon); }
+	return word;
+}
+
+// parse the stored definition of `def` into its entries.
+// offline defs are complete in memory, so don't need a streaming parser
+// @param encoding  def encoding of the file it is from (see dictionary_file::def_encoding())
+// @throws std::runtime_error  on parse error
+void parse_offline_def(background_lookup::offline_def& def, std::uint32_t encoding)
+{
+	try
+		{ def_encoding::parse(def_encoding::from_id(encoding), std::span<const std::byte>(def.def), def.entries); }
+	catch (const std::exception& e)
+		{ throw std::runtime_error(std::format("Definition parse error: {}", e.what())); }
+}
+
+// look up `word` in the offline dictionary, or in online_defs (for background_lookup)
+// @throws std::runtime_error  if the definition can't be read or parsed, or if it isn't found and there is no online mode
+// @return definition, or empty to fetch it online
+std::optional<background_lookup::offline_def> find_offline(std::string_view word)
+{
+	// lookups started while the dictionary is being opened wait for it
+	dict_opened.wait();
+	std::optional<background_lookup::offline_def> res;
+	// kept until the def is copied, so a reload during the lookup doesn't unmap it
+	const auto offline = (offline_mode ? dict_file.snapshot() : nullptr);
+	const auto find_stored = [word]() { return (online_defs ? online_defs->find(without_entry_num(word)) : std::nullopt); };
+	// defs which changed when they were revalidated are in online_defs, so it is looked up first
+	auto stored = (revalidate_offline_defs ? find_stored() : std::nullopt);
+	// find_view() may return a buffer which is reused by the next lookup on this thread, so keep a copy
+	const auto def = (!stored && offline ? offline->find_view(word) : std::nullopt);
+	if (!stored && !def && !revalidate_offline_defs)
+		{ stored = find_stored(); }
+	std::uint32_t encoding = 0;
+	if (stored)
+	{
+		res.emplace(std::as_bytes(std::span(stored.value())));
+		encoding = online_defs->def_encoding();
+	}
+	else if (def)
+	{
+		res.emplace(def.value());
+		encoding = offline->def_encoding();
+	}
+	else if (online_mode)
+		{ return {}; }
 	else
 	{
-		clear_and_cache<true, false>();
-		cur_cached_ind = cached_defs.size();
-		update_nav_buttons();
+		const auto suggestions = (offline ? offline->suggest(without_entry_num(word)) : std::vector<std::string_view>());
+		if (suggestions.empty())
+			{ throw std::runtime_error(std::format("Unable to find \"{}\" in offline dictionary", word)); }
+		throw std::runtime_error(fmt::format("Unable to find \"{}\" in offline dictionary. Did you mean: {}?", word, fmt::join(suggestions, ", ")));
 	}
-	last_word = word;
 
-	// we keep a separate buffer instead of using ui.text_buf and ui.style_buf
-	// to prevent calling modify callbacks excessively. This results in a
-	// speedup for larger definitions despite additional copy
-	// (which might be optimized out anyway)
-	std::vector<char> text_buf, style_buf;
-	std::pair<std::size_t, std::size_t> target_word = { -1, -1 };
+	parse_offline_def(res.value(), encoding);
+	return res;
+}
+
+// look up `word` in the offline dictionary of `source`, or in its saved online defs (for background_lookup::source)
+// @throws std::runtime_error  if the definition can't be read or parsed
+// @return definition, or empty to fetch it online
+std::optional<background_lookup::offline_def> find_source_offline(reference_source& source, std::string_view word)
+{
+	// the offline dictionaries of sources are opened along with dict_file
+	dict_opened.wait();
+	std::optional<background_lookup::offline_def> res;
+	std::uint32_t encoding = 0;
+	if (const auto def = (source.offline ? source.offline->find_view(word) : std::nullopt))
+	{
+		res.emplace(def.value());
+		encoding = source.offline->def_encoding();
+	}
+	else
+	{
+		std::lock_guard lock(source.online_defs_mutex);
+		const auto stored = (source.online_defs ? source.online_defs->find(without_entry_num(word)) : std::nullopt);
+		if (!stored)
+			{ return {}; }
+		res.emplace(std::as_bytes(std::span(stored.value())));
+		encoding = source.online_defs->def_encoding();
+	}
+	parse_offline_def(res.value(), encoding);
+	return res;
+}
+
+// transcode a fetched def and add it to `defs` (online_defs, or that of a source), in its def encoding. errors disable `defs`
+// Complexity: O(json_len), plus that of dictionary_file::add_word()
+// File Access: that of dictionary_file::add_word()
+void save_online_def(std::optional<dictionary_file>& defs, std::string_view word, std::string_view json) noexcept
+{
+	try
+	{
+		const auto cbor = transcode_def(json, true, [](std::string_view) {});
+		std::vector<std::byte> buf;
+		defs->add_word(word, def_encoding::encode(def_encoding::from_id(defs->def_encoding()), std::as_bytes(std::span(cbor)), buf));
+	}
+	catch (const std::exception&)
+		{ defs.reset(); }
+}
 
-	const auto add = [&text_buf, &style_buf](std::string_view text, char style = get_style())
+// fetch `word` from `reference` of the API with `client`, passing the response body to `receiver`
+// @param key  API key for `reference`
+// @param defs  where the def is saved once it has been fetched, if set (see save_online_def)
+// @param defs_mutex  locked while using `defs`, or null if it is only used by this thread
+// @return error message, or empty on success
+std::string fetch_reference(httplib::SSLClient& client, std::string_view reference, std::string_view key, std::string_view word,
+	const background_lookup::receiver& receiver, std::optional<dictionary_file>& defs, std::mutex* defs_mutex = nullptr)
+{
+	static constexpr auto url_encode = [](std::string_view in)
 	{
-		text_buf.append_range(text);
-		style_buf.append_range(std::views::repeat(style, text.size()));
+		std::string s;
+		for (char c : in)
+		{
+			if (('A' <= c && c <= 'Z') ||
+				('a' <= c && c <= 'z') ||
+				('0' <= c && c <= '9') ||
+				c == '-' || c == '.' || c == '_' || c == '~')
+				{ s += c; }
+			else
+				{ s += std::format("%{:X}", c); }
+		}
+		return s;
 	};
+	// locks defs_mutex, if any
+	const auto lock_defs = [defs_mutex]() { return (defs_mutex ? std::unique_lock(*defs_mutex) : std::unique_lock<std::mutex>()); };
+	word = without_entry_num(word);
+	bool save;
+	{
+		const auto lock = lock_defs();
+		save = defs.has_value();
+	}
+	// whole body, kept if it is to be saved
+	std::string body;
+	auto res = client.Get(httplib::append_query_params(std::format("/api/v3/references/{}/json/{}", reference, url_encode(word)), { { "key", std::string(key) } }),
+		[&receiver, &body, save](const char* data, std::size_t data_len)
+		{
+			if (!receiver(data, data_len))
+				{ return false; }
+			if (save)
+				{ body.append(data, data_len); }
+			return true;
+		});
+	if (!res)
+		{ return "HTTP Error: " + httplib::to_string(res.error()); }
+	if (res->status != 200)
+		{ return std::format("Unexpected HTTP Status {}", res->status); }
+	// the body has been parsed successfully, since the receiver throws otherwise
+	if (save)
+	{
+		const auto lock = lock_defs();
+		if (defs)
+			{ save_online_def(defs, word, body); }
+	}
+	return {};
+}
 
-	for (const auto& w : data)
+// fetch `word` from the main reference, passing the response body to `receiver` (for background_lookup)
+// @return error message, or empty on success
+std::string fetch_online(std::string_view word, const background_lookup::receiver& receiver)
+{
+	return fetch_reference(http_client, main_reference, api_key, word, receiver, online_defs);
+}
+
+// fetch `word` again, and store it in online_defs if it differs from its def in dict_file (for background_lookup::revalidate).
+// defs are compared byte for byte rather than by the hash stored with each def, which is of its encoding in the file (which may be compressed).
+// words which aren't in dict_file, or are already in online_defs (which can't replace defs), aren't fetched
+// @return whether the def changed and was stored, or empty if stopped
+std::optional<bool> revalidate_offline(std::string_view word, const std::function<bool()>& stopped)
+{
+	dict_opened.wait();
+	word = without_entry_num(word);
+	const auto offline = (offline_mode ? dict_file.snapshot() : nullptr);
+	if (!offline || !online_defs || online_defs->contains(word) || !offline->contains(word))
+		{ return false; }
+	std::string body;
+	bool was_stopped = false;
+	// nothing is saved by fetch_reference, since it is only stored if it changed
+	std::optional<dictionary_file> no_defs;
+	const auto error = fetch_reference(http_client, main_reference, api_key, word, [&](const char* data, std::size_t data_len)
 	{
-		const std::size_t start_len = text_buf.size();
+		was_stopped = stopped();
+		if (!was_stopped)
+			{ body.append(data, data_len); }
+		return !was_stopped;
+	}, no_defs);
+	if (was_stopped)
+		{ return {}; }
+	if (!error.empty())
+		{ return false; }
 
-		add(w.id, get_style(style::title));
-		add("\n");
+	std::vector<std::uint8_t> cbor;
+	std::vector<std::byte> buf;
+	try
+	{
+		cbor = transcode_def(body, true, [](std::string_view) {});
+		const auto def = std::as_bytes(std::span(cbor));
+		// compared in the encoding of dict_file
+		const auto stored = offline->find_view(word);
+		if (stored && std::ranges::equal(stored.value(), def_encoding::encode(def_encoding::from_id(offline->def_encoding()), def, buf)))
+			{ return false; }
+		// e.g. a list of suggestions if the word was removed, which shouldn't replace its def
+		std::pmr::monotonic_buffer_resource arena(def_arena::initial_size(def.size()));
+		std::pmr::vector<def_arena::word_info> entries(&arena);
+		cbor_parse::parse(def, entries);
+	}
+	catch (const std::exception&)
+		{ return false; }
+	try
+	{
+		const auto def = def_encoding::encode(def_encoding::from_id(online_defs->def_encoding()), std::as_bytes(std::span(cbor)), buf);
+		return online_defs->add_word(word, def);
+	}
+	catch (const std::exception&)
+	{
+		online_defs.reset();
+		return false;
+	}
+}
 
-		if (word_colon != std::string_view::npos && word == w.id)
-			{ target_word = { start_len, text_buf.size() }; }
+// (re)connect to the API if the connections (including those of sources) have been closed,
+// so that the next lookup doesn't wait for the TLS handshake
+void keep_online_warm()
+{
+	// only the connection is wanted, so use a cheap request whose response is discarded
+	if (online_mode)
+		{ http_client.Head("/"); }
+	for (const auto& source : sources)
+		{ source->client.Head("/"); }
+}
 
-		for (const auto& sense : w.defs)
+// read the other references to look up from sources.txt (see reference_source), if it exists.
+// their offline dictionaries are opened later, by the loader thread
+void load_sources()
+{
+	std::ifstream fin("sources.txt");
+	std::string line;
+	while (std::getline(fin, line))
+	{
+		std::istringstream line_in(line);
+		auto source = std::make_unique<reference_source>();
+		// skips blank lines
+		if (!(line_in >> source->reference >> source->api_key))
+			{ continue; }
+		long long deadline_ms;
+		source->deadline = (line_in >> deadline_ms ? std::chrono::milliseconds(deadline_ms) : default_source_deadline);
+
+		auto& client = source->client;
+		client.set_connection_timeout(0, 500'000); // 500 ms
+		// the lookup is given up on after the deadline anyway
+		client.set_read_timeout(source->deadline);
+		client.set_write_timeout(2); // 2 s
+		client.set_url_encode(false);
+		client.set_keep_alive(true);
+		enable_compression(client);
+		if (save_online_defs)
 		{
-			const auto add_sense = [&text_buf, &add](this auto self, const auto& val)
-			{
-				if (val.number)
-				{
-					add(val.number.value(), get_style(style_bold));
-					add(" ");
-				}
-				if constexpr (std::is_base_of_v<basic_def_sense_data, std::remove_reference_t<decltype(val)>>)
-				{
-					if constexpr (std::is_same_v<div_sense_data, std::remove_cvref_t<decltype(val)>>)
-					{
-						add(val.sense_div, get_style(style_italic));
-					}
-					parse_def_text(val.def_text, add, [&text_buf]() -> int { return text_buf.size(); });
-					add("\n");
-					if constexpr (std::is_same_v<sense_data, std::remove_cvref_t<decltype(val)>>)
-					{
-						if (val.sdsense)
-						{
-							self(val.sdsense.value());
-						}
-					}
-				}
-				else
-					{ add("\n"); }
-			};
-			std::visit(add_sense, sense);
+			try
+				{ source->online_defs.emplace(std::format("online_{}.sdict", source->reference), true, false, false); }
+			catch (const std::exception&) {}
 		}
-		add("\n");
+		sources.push_back(std::move(source));
 	}
+}
+
+// words of the offline dictionary starting with what has been typed into the search bar, shown in ui.suggestions
+struct search_completion
+{
+	// version of the dictionary the words are from, kept so that they stay valid. null while nothing is suggested
+	live_dictionary::snapshot_ptr offline;
+	std::string prefix;
+	// indices of the words starting with prefix (see dictionary_file::prefix_bounds())
+	std::pair<std::size_t, std::size_t> bounds;
+};
+search_completion completion;
+// number of suggestions shown
+constexpr std::size_t num_suggestions = 8;
+// number of the first suggestions which are prefetched, once typing pauses
+constexpr std::size_t num_prefetch_suggestions = 3;
+// how long typing must pause before suggestions are prefetched, so that online lookups aren't made for every keystroke
+constexpr double suggestion_prefetch_delay = 0.3;
+
+// prefetch the first suggestions (or what has been typed if there are none, e.g. in online-only mode), so that searching one is instant.
+// called once typing pauses (see update_suggestions)
+void prefetch_suggestions(void*)
+{
+	std::vector<std::string> words;
+	for (std::size_t i = completion.bounds.first; i < completion.bounds.second && words.size() < num_prefetch_suggestions; i++)
+		{ words.emplace_back(completion.offline->word_at(i)); }
+	if (words.empty())
+		{ words.emplace_back(ui.search_bar.value()); }
+	std::erase_if(words, [](const auto& word) { return word.empty() || def_cache.contains(word); });
+	if (!words.empty())
+		{ lookup->prefetch(std::move(words), prefetch_bytes); }
+}
 
-	ui.text_buf.append(text_buf.data(), text_buf.size());
-	ui.style_buf.append(style_buf.data(), style_buf.size());
+void hide_suggestions()
+{
+	Fl::remove_timeout(prefetch_suggestions);
+	ui.suggestions.hide();
+	ui.suggestions.clear();
+	completion = {};
+}
 
-	if (target_word.first != -1)
+// show the words starting with `prefix` in ui.suggestions. when `prefix` extends the previous one (i.e. while typing),
+// they are searched for among the previous suggestions only, so this takes well under a frame even for large dictionaries
+// Complexity: O(log(n_words) * prefix_len + num_suggestions)
+void update_suggestions(std::string_view prefix)
+{
+	Fl::remove_timeout(prefetch_suggestions);
+	if (prefix.empty())
+		{ hide_suggestions(); return; }
+	Fl::add_timeout(suggestion_prefetch_delay, prefetch_suggestions);
+	auto offline = (offline_ready() ? dict_file.snapshot() : nullptr);
+	if (!offline)
 	{
-		const int lines = ui.text_buf.count_lines(0, target_word.first);
-		// TODO: scroll is not correct
-		ui.text_display.scroll(lines + 1, 0);
-		ui.text_buf.select(target_word.first, target_word.second - 1);
+		ui.suggestions.hide();
+		completion = {};
+		return;
 	}
+
+	const bool narrows = (offline == completion.offline && prefix.starts_with(completion.prefix));
+	completion.bounds = offline->prefix_bounds(prefix, narrows ? completion.bounds : std::pair<std::size_t, std::size_t>(0, -1));
+	completion.offline = std::move(offline);
+	completion.prefix = prefix;
+
+	ui.suggestions.clear();
+	for (std::size_t i = completion.bounds.first; i < std::min(completion.bounds.second, completion.bounds.first + num_suggestions); i++)
+		{ ui.suggestions.add(std::string(completion.offline->word_at(i)).c_str()); }
+	if (ui.suggestions.size() > 0)
+		{ ui.suggestions.show(); }
 	else
-		{ ui.text_display.scroll(0, 0); }
+		{ ui.suggestions.hide(); }
+}
+
+void search_word(std::string_view word)
+{
+	finish_pending_render();
+	hide_suggestions();
+	usage.record(word);
+
+	// skip parsing and rendering entirely if this word has been rendered before
+	if (const auto rendered = def_cache.find(word))
+	{
+		show_rendered(word, *rendered, rendered);
+		prefetch_links(rendered->def_links);
+		revalidate_shown(word);
+		return;
+	}
+
+	// looked up and parsed on the lookup thread (superseding any lookup in progress), and shown by lookup_results_ready.
+	// offline defs are rendered there too. of online ones, the first entry is shown once it arrives,
+	// and the rest are rendered on idle, since many words have dozens of entries
+	lookup->start(std::string(word));
+	pending.emplace();
+	pending->word = word;
+	pending->streaming = true;
+	pending->shown = false;
 }
 
 void search_word(Fl_Widget*)
@@ -365,17 +1151,93 @@ void search_word(Fl_Widget*)
 	search_word(word);
 }
 
+// callback of ui.search_bar, which searches on enter and updates the suggestions as it is typed into
+void search_input(Fl_Widget* w)
+{
+	if (Fl::callback_reason() == FL_REASON_CHANGED)
+		{ update_suggestions(ui.search_bar.value()); }
+	else
+		{ search_word(w); }
+}
+
+// callback of ui.suggestions, which searches the clicked suggestion
+void pick_suggestion(Fl_Widget*)
+{
+	const int line = ui.suggestions.value();
+	if (line == 0)
+		{ return; }
+	const std::string word = ui.suggestions.text(line);
+	ui.search_bar.value(word.c_str());
+	search_word(word);
+}
+
 void nav_back(Fl_Widget*)
 {
+	// the shown definition is cached by restore_from_cache(), so it must be complete
+	finish_pending_render();
 	if (cur_cached_ind == 0)
 		{ return; }
 	restore_from_cache(cur_cached_ind - 1);
+	prefetch_links(links);
 }
 void nav_forward(Fl_Widget*)
 {
+	finish_pending_render();
 	if (cur_cached_ind + 1 >= cached_defs.size())
 		{ return; }
 	restore_from_cache(cur_cached_ind + 1);
+	prefetch_links(links);
+}
+
+// render the most used words which aren't in def_cache on the lookup thread, so that the first lookups after startup
+// are as fast as later ones. their pages have already been read ahead by the loader thread.
+// nothing is done once a word has been searched, since prefetching would replace the prefetches of its links
+void warm_up()
+{
+	if (!last_word.empty() || pending)
+		{ return; }
+	std::vector<std::string> words;
+	for (const auto& word : warm_up_words)
+	{
+		if (!def_cache.contains(word))
+			{ words.push_back(word); }
+	}
+	// offline only, since nothing may be fetched online
+	lookup->prefetch(std::move(words), 0);
+}
+
+// Fl::awake handler for when the loader thread has opened dict_file (or failed to), which reports unavailable modes
+void offline_dict_opened(void*)
+{
+	ui.window.label("Dictionary");
+	if (offline_mode)
+	{
+		def_cache.open("render_cache.sdict", "data.sdict");
+		warm_up();
+		if (!online_mode)
+			{ fl_alert("API key not found (place key in api_key.txt). Using offline-only mode"); }
+		return;
+	}
+	if (!online_mode)
+	{
+		fl_alert("%s", std::format("Unable to open offline dictionary data.sdict ({}) and API key not found (place key in api_key.txt). Quitting", dict_error_msg).c_str());
+		ui.window.hide();
+		return;
+	}
+	fl_alert("%s", std::format("Unable to open offline dictionary (data.sdict): {}. Using online-only mode", dict_error_msg).c_str());
+}
+
+// Fl::awake handler for when the watcher thread has swapped in a new version of data.sdict.
+// defs rendered from the old version are dropped from def_cache (in memory and the file), since it is stamped with the version it was made from
+void offline_dict_reloaded(void*)
+{
+	def_cache.open("render_cache.sdict", "data.sdict");
+	// the suggestions are of the old version, so they are found again in the new one
+	if (completion.offline)
+	{
+		completion.offline.reset();
+		update_suggestions(ui.search_bar.value());
+	}
 }
 
 int main()
@@ -384,41 +1246,94 @@ int main()
 	http_client.set_read_timeout(2);  // 2 s
 	http_client.set_write_timeout(2); // 2 s
 	http_client.set_url_encode(false);
+	// reuse the connection across lookups, which is kept open by keep_online_warm
+	http_client.set_keep_alive(true);
+	// responses are decompressed while streaming, before they are parsed
+	enable_compression(http_client);
 
 	Fl::get_system_colors();
 
-	std::string sdict_error_msg;
-	try
-	{
-		dict_file.open("data.sdict", false);
-	}
-	catch (const std::exception& e)
 	{
-		sdict_error_msg = e.what();
-		offline_mode = false;
+		std::ifstream fin("api_key.txt");
+		// reported once it is known whether the offline dictionary is available, see offline_dict_opened
+		if (!fin)
+			{ online_mode = false; }
+		else
+			{ fin >> api_key; }
 	}
 
+	load_sources();
+	usage.load("usage.txt");
+	warm_up_words = usage.top(num_warm_up_words);
+
+	// enables Fl::awake from other threads
+	Fl::lock();
+	// opening reads the whole index, so it is done in the background to show the window immediately.
+	// lookups (on the lookup thread) wait for it in find_offline. mapped, so defs aren't deduplicated,
+	// and in lean mode, so only a sample of the words stays in memory (words are only looked up and completed)
+	std::jthread dict_loader([]()
 	{
-		std::ifstream fin("api_key.txt");
-		if (!fin)
+		try
+		{
+			dict_file.open_mapped("data.sdict", true, true);
+			// the page cache is often cold after a reboot, so the defs of the most used words are read ahead in the background
+			dict_file.snapshot()->will_need(warm_up_words);
+			// lookups already in progress finish with the version they started with
+			dict_file.watch(dict_reload_interval, []() { Fl::awake(offline_dict_reloaded, nullptr); });
+		}
+		catch (const std::exception& e)
+		{
+			dict_error_msg = e.what();
+			offline_mode = false;
+		}
+		for (const auto& source : sources)
 		{
-			if (!offline_mode) // online and offline both unavailable
+			// optional, so failing to open it isn't reported
+			try
 			{
-				fl_alert(std::format("Unable to open offline dictionary data.sdict ({}) and API key not found (place key in api_key.txt). Quitting", sdict_error_msg).c_str());
-				return -1;
+				source->offline.emplace();
+				source->offline->open_mapped(std::format("{}.sdict", source->reference), true, true);
 			}
-			fl_alert("API key not found (place key in api_key.txt). Using offline-only mode");
-			online_mode = false;
+			catch (const std::exception&)
+				{ source->offline.reset(); }
 		}
-		else
-			{ fin >> api_key; }
-	}
+		dict_opened.count_down();
+		Fl::awake(offline_dict_opened, nullptr);
+	});
 
-	if (!offline_mode) // online-only mode
+	if (save_online_defs && online_mode)
+	{
+		// each def is unique, so don't deduplicate
+		try
+			{ online_defs.emplace("online.sdict", true, false, false); }
+		catch (const std::exception&) {}
+	}
+	// looked up in parallel with the main definition, each under its own deadline
+	std::vector<background_lookup::source> lookup_sources;
+	for (const auto& source : sources)
 	{
-		fl_alert(std::format("Unable to open offline dictionary (data.sdict): {}. Using online-only mode", sdict_error_msg).c_str());
+		lookup_sources.push_back({ source->reference,
+			[&source = *source](std::string_view word) { return find_source_offline(source, word); },
+			[&source = *source](std::string_view word, const background_lookup::receiver& receiver)
+				{ return fetch_reference(source.client, source.reference, source.api_key, word, receiver, source.online_defs, &source.online_defs_mutex); },
+			source->deadline });
 	}
+	// whether the offline dictionary is available isn't known yet, so offline lookups are always tried
+	lookup.emplace(background_lookup::find_function(find_offline),
+		online_mode ? background_lookup::fetch_function(fetch_online) : nullptr,
+		[]() { Fl::awake(lookup_results_ready, nullptr); }, (online_mode || !sources.empty()) ? keep_online_warm : nullptr,
+		std::move(lookup_sources), render_lookup, revalidate_offline);
 	
+	ui.window.label("Dictionary (loading offline dictionary...)");
 	ui.window.show();
 	Fl::run();
+	finish_pending_render();
+	lookup.reset();
+	dict_loader.join();
+	dict_file.stop_watching();
+	def_cache.save();
+	usage.save("usage.txt");
+	// online and offline both unavailable
+	if (!online_mode && !offline_mode)
+		{ return -1; }
 }
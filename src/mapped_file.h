@@ -0,0 +1,156 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// read-only memory mapping of an entire file
+// the mapping stays valid until close() is called or the object is destroyed,
+// even if the file is replaced on disk (e.g. through rename)
+class mapped_file
+{
+private:
+	const std::byte* ptr = nullptr;
+	std::size_t len = 0;
+
+public:
+	mapped_file() {}
+
+	// @throws std::runtime_error  if the file could not be opened or mapped
+	explicit mapped_file(const std::string& filename) { open(filename); }
+
+	mapped_file(const mapped_file&) = delete;
+	mapped_file& operator=(const mapped_file&) = delete;
+	mapped_file(mapped_file&& other) noexcept :
+		ptr(std::exchange(other.ptr, nullptr)), len(std::exchange(other.len, 0)) {}
+	mapped_file& operator=(mapped_file&& other) noexcept
+	{
+		if (this != &other)
+		{
+			close();
+			ptr = std::exchange(other.ptr, nullptr);
+			len = std::exchange(other.len, 0);
+		}
+		return *this;
+	}
+
+	~mapped_file() { close(); }
+
+	// map `filename`, closing any existing mapping first
+	// empty files are "mapped" as an empty span
+	// @throws std::runtime_error  if the file could not be opened or mapped
+	void open(const std::string& filename)
+	{
+		close();
+#ifdef _WIN32
+		HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+			nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (file == INVALID_HANDLE_VALUE)
+			{ throw std::runtime_error("Unable to open " + filename + " for mapping"); }
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(file, &size))
+			{ CloseHandle(file); throw std::runtime_error("Unable to get size of " + filename); }
+		if (size.QuadPart == 0)
+			{ CloseHandle(file); return; }
+		HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		CloseHandle(file);
+		if (mapping == nullptr)
+			{ throw std::runtime_error("Unable to map " + filename); }
+		void* p = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+		CloseHandle(mapping); // view keeps the mapping alive
+		if (p == nullptr)
+			{ throw std::runtime_error("Unable to map " + filename); }
+		ptr = static_cast<const std::byte*>(p);
+		len = static_cast<std::size_t>(size.QuadPart);
+#else
+		int fd = ::open(filename.c_str(), O_RDONLY);
+		if (fd == -1)
+			{ throw std::runtime_error("Unable to open " + filename + " for mapping"); }
+		struct stat st;
+		if (fstat(fd, &st) == -1)
+			{ ::close(fd); throw std::runtime_error("Unable to get size of " + filename); }
+		if (st.st_size == 0)
+			{ ::close(fd); return; }
+		void* p = mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+		::close(fd); // mapping keeps the file alive
+		if (p == MAP_FAILED)
+			{ throw std::runtime_error("Unable to map " + filename); }
+		ptr = static_cast<const std::byte*>(p);
+		len = static_cast<std::size_t>(st.st_size);
+#endif
+	}
+
+	void close() noexcept
+	{
+		if (ptr != nullptr)
+		{
+#ifdef _WIN32
+			UnmapViewOfFile(ptr);
+#else
+			munmap(const_cast<std::byte*>(ptr), len);
+#endif
+		}
+		ptr = nullptr;
+		len = 0;
+	}
+
+	enum class access_pattern
+	{
+		normal,
+		// pages are read ahead more aggressively, and may be dropped soon after being read
+		sequential
+	};
+
+	// hint how the mapping will be accessed. ignored where unsupported
+	void advise(access_pattern pattern) const noexcept
+	{
+#ifndef _WIN32
+		if (ptr != nullptr)
+			{ posix_madvise(const_cast<std::byte*>(ptr), len, (pattern == access_pattern::sequential ? POSIX_MADV_SEQUENTIAL : POSIX_MADV_NORMAL)); }
+#else
+		(void)pattern;
+#endif
+	}
+
+	// hint that bytes [offset, offset + length) of the mapping will be read soon, so that the OS starts reading them in
+	// without blocking (the range is widened to whole pages). ignored where unsupported
+	void will_need(std::size_t offset, std::size_t length) const noexcept
+	{
+#ifndef _WIN32
+		if (ptr == nullptr || offset >= len)
+			{ return; }
+		// the mapping itself is page aligned
+		const std::size_t page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+		const std::size_t first = offset / page_size * page_size;
+		posix_madvise(const_cast<std::byte*>(ptr) + first, std::min(offset + length, len) - first, POSIX_MADV_WILLNEED);
+#else
+		(void)offset;
+		(void)length;
+#endif
+	}
+
+	bool is_open() const noexcept { return ptr != nullptr; }
+	std::size_t size() const noexcept { return len; }
+	std::span<const std::byte> data() const noexcept { return { ptr, len }; }
+};
+
+#endif
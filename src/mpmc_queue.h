@@ -0,0 +1,169 @@
+#ifndef MPMC_QUEUE_H
+#define MPMC_QUEUE_H
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <memory>
+#include <optional>
+#include <semaphore>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+
+// bounded multi producer multi consumer queue.
+// elements are passed through a lock free ring buffer (each slot has a sequence number which tells
+// whether it is free or holds an element of the current lap), and full or empty queues are waited on with semaphores
+template<typename T>
+class mpmc_queue
+{
+private:
+	// not std::hardware_destructive_interference_size, which varies between compiler flags
+	constexpr static std::size_t cache_line_size = 64;
+
+	struct slot
+	{
+		std::atomic<std::size_t> sequence;
+		T value;
+	};
+
+	std::unique_ptr<slot[]> slots;
+	std::size_t mask;
+	// kept on separate cache lines so that producers and consumers don't contend
+	alignas(cache_line_size) std::atomic<std::size_t> push_pos = 0;
+	alignas(cache_line_size) std::atomic<std::size_t> pop_pos = 0;
+	alignas(cache_line_size) std::counting_semaphore<> free_slots;
+	std::counting_semaphore<> used_slots{ 0 };
+	std::atomic<bool> closed = false;
+
+	static std::size_t checked_capacity(std::size_t capacity)
+	{
+		if (!std::has_single_bit(capacity) || capacity > static_cast<std::size_t>(std::counting_semaphore<>::max()))
+			{ throw std::invalid_argument("Queue capacity must be a power of 2"); }
+		return capacity;
+	}
+
+	// @return false if there is no free slot
+	bool try_push_slot(T& value)
+	{
+		std::size_t pos = push_pos.load(std::memory_order_relaxed);
+		while (true)
+		{
+			slot& s = slots[pos & mask];
+			const std::size_t seq = s.sequence.load(std::memory_order_acquire);
+			const auto diff = static_cast<std::ptrdiff_t>(seq - pos);
+			if (diff == 0)
+			{
+				if (push_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					s.value = std::move(value);
+					s.sequence.store(pos + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (diff < 0)
+				{ return false; }
+			else
+				{ pos = push_pos.load(std::memory_order_relaxed); }
+		}
+	}
+
+	// @return false if there is no element whose push has completed at the front
+	bool try_pop_slot(T& value)
+	{
+		std::size_t pos = pop_pos.load(std::memory_order_relaxed);
+		while (true)
+		{
+			slot& s = slots[pos & mask];
+			const std::size_t seq = s.sequence.load(std::memory_order_acquire);
+			const auto diff = static_cast<std::ptrdiff_t>(seq - (pos + 1));
+			if (diff == 0)
+			{
+				if (pop_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+				{
+					value = std::move(s.value);
+					s.sequence.store(pos + mask + 1, std::memory_order_release);
+					return true;
+				}
+			}
+			else if (diff < 0)
+				{ return false; }
+			else
+				{ pos = pop_pos.load(std::memory_order_relaxed); }
+		}
+	}
+
+public:
+	// @param capacity  maximum number of elements in the queue. must be a power of 2
+	// @throws std::invalid_argument  if capacity is not a power of 2
+	explicit mpmc_queue(std::size_t capacity) :
+		slots(std::make_unique<slot[]>(checked_capacity(capacity))), mask(capacity - 1),
+		free_slots(static_cast<std::ptrdiff_t>(capacity))
+	{
+		for (std::size_t i = 0; i < capacity; i++)
+			{ slots[i].sequence.store(i, std::memory_order_relaxed); }
+	}
+
+	mpmc_queue(const mpmc_queue&) = delete;
+	mpmc_queue& operator=(const mpmc_queue&) = delete;
+
+	// add an element, waiting while the queue is full. must not be called after close()
+	// Complexity: O(1) (amortized, without contention)
+	void push(T value)
+	{
+		free_slots.acquire();
+		// a slot is free, but the pop which frees it may not have finished yet
+		while (!try_push_slot(value))
+			{ std::this_thread::yield(); }
+		used_slots.release();
+	}
+
+	// remove the oldest element, waiting while the queue is empty
+	// Complexity: O(1) (amortized, without contention)
+	// @return the element, or empty if the queue has been closed and all elements have been popped
+	std::optional<T> pop()
+	{
+		used_slots.acquire();
+		T value;
+		while (!try_pop_slot(value))
+		{
+			if (closed.load(std::memory_order_acquire))
+			{
+				// all pushes have completed once closed, so this sees every element left
+				if (try_pop_slot(value))
+					{ break; }
+				// pass on the wakeup from close() to the next waiting consumer
+				used_slots.release();
+				return {};
+			}
+			std::this_thread::yield();
+		}
+		free_slots.release();
+		return std::optional<T>(std::move(value));
+	}
+
+	// Complexity: O(1)
+	// @return number of elements in the queue, which may already be out of date if other threads are using it
+	std::size_t size() const noexcept
+	{
+		const std::size_t pop = pop_pos.load(std::memory_order_relaxed);
+		const std::size_t push = push_pos.load(std::memory_order_relaxed);
+		// pop_pos may have passed push_pos if it was read first
+		return static_cast<std::ptrdiff_t>(push - pop) < 0 ? 0 : std::min(push - pop, mask + 1);
+	}
+
+	// Complexity: O(1)
+	std::size_t capacity() const noexcept
+		{ return mask + 1; }
+
+	// mark that no more elements will be pushed, once all pushes have returned. waiting and later pops return empty once the queue is empty
+	// Complexity: O(1)
+	void close()
+	{
+		closed.store(true, std::memory_order_release);
+		used_slots.release();
+	}
+};
+
+#endif
@@ -0,0 +1,218 @@
+#ifndef PIPELINED_CONNECTION_H
+#define PIPELINED_CONNECTION_H
+
+#include <array>
+#include <charconv>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+
+#ifndef CPPHTTPLIB_OPENSSL_SUPPORT
+#error "pipelined_connection requires CPPHTTPLIB_OPENSSL_SUPPORT"
+#endif
+#include <httplib.h>
+
+#include "http_encoding.h"
+
+// HTTPS connection which sends GET requests without waiting for the responses to earlier ones (HTTP/1.1 pipelining),
+// so that one connection can have many requests in flight. responses are received in the order the requests were sent.
+// httplib::SSLClient waits for each response, so this uses httplib's socket, TLS and message parsing functions directly
+// (which are only public through httplib::detail in the vendored version)
+class pipelined_connection
+{
+private:
+	constexpr static time_t connection_timeout_sec = 10;
+	// a response may wait behind every other request in flight
+	constexpr static time_t read_timeout_sec = 60;
+	constexpr static time_t write_timeout_sec = 10;
+
+	struct ssl_ctx_deleter
+	{
+		void operator()(SSL_CTX* ctx) const noexcept { SSL_CTX_free(ctx); }
+	};
+
+	std::string host;
+	int port;
+	// request headers other than the request line, which are the same for every request
+	std::string request_headers;
+	std::unique_ptr<SSL_CTX, ssl_ctx_deleter> ctx;
+	// SSL_new isn't thread safe for the same context, but this is only used by httplib::detail::ssl_new
+	std::mutex ctx_mutex;
+	socket_t sock = INVALID_SOCKET;
+	SSL* ssl = nullptr;
+	std::optional<httplib::detail::SSLSocketStream> stream;
+
+	bool write_all(std::string_view s)
+	{
+		while (!s.empty())
+		{
+			const auto n = stream->write(s.data(), s.size());
+			if (n <= 0)
+				{ return false; }
+			s.remove_prefix(static_cast<std::size_t>(n));
+		}
+		return true;
+	}
+
+	// @param status  set to the status code
+	// @return false if the line is not an HTTP/1.x status line
+	static bool parse_status_line(std::string_view line, int& status)
+	{
+		// HTTP/1.1 200 OK
+		if (!line.starts_with("HTTP/1.") || line.size() < 12 || line[8] != ' ')
+			{ return false; }
+		return std::from_chars(line.data() + 9, line.data() + 12, status).ptr == line.data() + 12;
+	}
+
+public:
+	// the connection is opened by connect()
+	// @throws std::runtime_error  if the TLS context could not be created
+	pipelined_connection(std::string host_, int port_ = 443) :
+		host(std::move(host_)), port(port_), ctx(SSL_CTX_new(TLS_client_method()))
+	{
+		if (!ctx)
+			{ throw std::runtime_error("Failed to create TLS context"); }
+		// same certificates as httplib::SSLClient
+		bool loaded = false;
+#ifdef _WIN32
+		loaded = httplib::detail::load_system_certs_on_windows(SSL_CTX_get_cert_store(ctx.get()));
+#endif
+		if (!loaded)
+			{ SSL_CTX_set_default_verify_paths(ctx.get()); }
+
+		request_headers = "Host: " + host + "\r\n";
+		if (const auto encodings = accept_encoding(); !encodings.empty())
+			{ request_headers += "Accept-Encoding: " + encodings + "\r\n"; }
+		request_headers += "\r\n";
+	}
+
+	pipelined_connection(const pipelined_connection&) = delete;
+	pipelined_connection& operator=(const pipelined_connection&) = delete;
+
+	~pipelined_connection() { close(); }
+
+	// @return whether the connection is open. it is closed after an error, or a response which closes it
+	bool is_open() const noexcept
+		{ return stream.has_value(); }
+
+	// open the connection (closing it first if open), verifying the server's certificate
+	// @param error  set to the reason if the connection could not be opened
+	// @return whether the connection was opened
+	bool connect(httplib::Error& error)
+	{
+		close();
+		sock = httplib::detail::create_client_socket(host, std::string(), port, AF_UNSPEC, true, nullptr,
+			connection_timeout_sec, 0, read_timeout_sec, 0, write_timeout_sec, 0, std::string(), error);
+		if (sock == INVALID_SOCKET)
+			{ return false; }
+		ssl = httplib::detail::ssl_new(sock, ctx.get(), ctx_mutex,
+			[this](SSL* s) { return httplib::detail::ssl_connect_or_accept_nonblocking(sock, s, SSL_connect, connection_timeout_sec, 0); },
+			[this](SSL* s)
+			{
+				SSL_set_tlsext_host_name(s, host.c_str());
+				SSL_set1_host(s, host.c_str());
+				SSL_set_verify(s, SSL_VERIFY_PEER, nullptr);
+				return true;
+			});
+		if (!ssl)
+		{
+			error = httplib::Error::SSLConnection;
+			close();
+			return false;
+		}
+		stream.emplace(sock, ssl, read_timeout_sec, 0, write_timeout_sec, 0);
+		return true;
+	}
+
+	// close the connection. responses to requests which were sent are lost
+	void close()
+	{
+		stream.reset();
+		if (ssl)
+		{
+			httplib::detail::ssl_delete(ctx_mutex, ssl, true);
+			ssl = nullptr;
+		}
+		if (sock != INVALID_SOCKET)
+		{
+			httplib::detail::shutdown_socket(sock);
+			httplib::detail::close_socket(sock);
+			sock = INVALID_SOCKET;
+		}
+	}
+
+	// send a GET request, without waiting for its response
+	// the number of requests in flight should be kept small enough that they fit in the socket buffers,
+	// since the server may stop reading requests until its responses are received
+	// @param path  path and query, which must already be url encoded
+	// @return false if the request could not be sent, in which case the connection is closed
+	bool send(std::string_view path)
+	{
+		if (!is_open())
+			{ return false; }
+		std::string request;
+		request.reserve(path.size() + request_headers.size() + 16);
+		request.append("GET ").append(path).append(" HTTP/1.1\r\n").append(request_headers);
+		if (!write_all(request))
+		{
+			close();
+			return false;
+		}
+		return true;
+	}
+
+	// receive the response to the oldest request which has no response yet. the body is decompressed if needed
+	// @param res  set to the response
+	// @param on_body  if set, the body of a 200 response is passed to it in pieces as they are received, as std::string_view,
+	//     instead of being stored in res.body, so that it is never held whole. it must not throw, since the rest of the body
+	//     is still read so that later responses can be received
+	// @return false if no valid response was received, in which case the connection is closed
+	bool receive(httplib::Response& res, const std::function<void(std::string_view)>& on_body = {})
+	{
+		if (!is_open())
+			{ return false; }
+		res = httplib::Response();
+		std::array<char, 2048> buf;
+		httplib::detail::stream_line_reader line_reader(*stream, buf.data(), buf.size());
+		if (!line_reader.getline() || !parse_status_line(std::string_view(line_reader.ptr(), line_reader.size()), res.status) ||
+			!httplib::detail::read_headers(*stream, res.headers))
+		{
+			close();
+			return false;
+		}
+
+		// without a length, the body is read until the end of the stream
+		bool read_until_close = false;
+		// these never have a body, even without Content-Length
+		if (res.status != 204 && res.status != 304 && res.status >= 200)
+		{
+			read_until_close = (!res.has_header("Content-Length") && !httplib::detail::is_chunked_transfer_encoding(res.headers));
+			int status = res.status;
+			const bool stream_body = (on_body && res.status == 200);
+			const bool read_body = httplib::detail::read_content(*stream, res, CPPHTTPLIB_PAYLOAD_MAX_LENGTH, status, nullptr,
+				[&res, &on_body, stream_body](const char* data, std::size_t size, std::uint64_t, std::uint64_t)
+				{
+					if (stream_body)
+						{ on_body(std::string_view(data, size)); }
+					else
+						{ res.body.append(data, size); }
+					return true;
+				}, true);
+			if (!read_body)
+			{
+				close();
+				return false;
+			}
+		}
+
+		if (read_until_close || res.get_header_value("Connection") == "close")
+			{ close(); }
+		return true;
+	}
+};
+
+#endif
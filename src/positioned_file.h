@@ -0,0 +1,152 @@
+#ifndef POSITIONED_FILE_H
+#define POSITIONED_FILE_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// read-only file handle for positioned reads (pread on POSIX, ReadFile with an offset on Windows)
+// reads don't depend on a shared file position, so read() may be called from multiple threads at once
+class positioned_file
+{
+private:
+#ifdef _WIN32
+	HANDLE handle = INVALID_HANDLE_VALUE;
+#else
+	int fd = -1;
+#endif
+
+public:
+	positioned_file() {}
+
+	// @throws std::runtime_error  if the file could not be opened
+	explicit positioned_file(const std::string& filename) { open(filename); }
+
+	positioned_file(const positioned_file&) = delete;
+	positioned_file& operator=(const positioned_file&) = delete;
+#ifdef _WIN32
+	positioned_file(positioned_file&& other) noexcept : handle(std::exchange(other.handle, INVALID_HANDLE_VALUE)) {}
+#else
+	positioned_file(positioned_file&& other) noexcept : fd(std::exchange(other.fd, -1)) {}
+#endif
+	positioned_file& operator=(positioned_file&& other) noexcept
+	{
+		if (this != &other)
+		{
+			close();
+#ifdef _WIN32
+			handle = std::exchange(other.handle, INVALID_HANDLE_VALUE);
+#else
+			fd = std::exchange(other.fd, -1);
+#endif
+		}
+		return *this;
+	}
+
+	~positioned_file() { close(); }
+
+	// open `filename` for reading, closing any existing handle first
+	// @throws std::runtime_error  if the file could not be opened
+	void open(const std::string& filename)
+	{
+		close();
+#ifdef _WIN32
+		handle = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+			nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (handle == INVALID_HANDLE_VALUE)
+			{ throw std::runtime_error("Unable to open " + filename + " for reading"); }
+#else
+		fd = ::open(filename.c_str(), O_RDONLY);
+		if (fd == -1)
+			{ throw std::runtime_error("Unable to open " + filename + " for reading"); }
+#endif
+	}
+
+	void close() noexcept
+	{
+#ifdef _WIN32
+		if (handle != INVALID_HANDLE_VALUE)
+			{ CloseHandle(handle); }
+		handle = INVALID_HANDLE_VALUE;
+#else
+		if (fd != -1)
+			{ ::close(fd); }
+		fd = -1;
+#endif
+	}
+
+#ifdef _WIN32
+	bool is_open() const noexcept { return handle != INVALID_HANDLE_VALUE; }
+#else
+	bool is_open() const noexcept { return fd != -1; }
+#endif
+
+	// read exactly out.size() bytes starting at `offset`
+	// Complexity: O(out.size())
+	// File Access: Read, out.size() bytes
+	// @throws std::runtime_error  on i/o error or if the file ends before out.size() bytes are read
+	void read(std::uint64_t offset, std::span<std::byte> out) const
+	{
+		if (read_some(offset, out) != out.size())
+			{ throw std::runtime_error("Unexpected EOF"); }
+	}
+
+	// read up to out.size() bytes starting at `offset`, stopping early only at the end of the file
+	// Complexity: O(out.size())
+	// File Access: Read, up to out.size() bytes
+	// @throws std::runtime_error  on i/o error
+	// @return number of bytes read
+	std::size_t read_some(std::uint64_t offset, std::span<std::byte> out) const
+	{
+		const std::size_t size = out.size();
+		while (!out.empty())
+		{
+#ifdef _WIN32
+			OVERLAPPED ov{};
+			ov.Offset = static_cast<DWORD>(offset);
+			ov.OffsetHigh = static_cast<DWORD>(offset >> 32);
+			DWORD read_amt;
+			const DWORD to_read = static_cast<DWORD>(std::min<std::size_t>(out.size(), 1u << 30));
+			if (!ReadFile(handle, out.data(), to_read, &read_amt, &ov))
+			{
+				if (GetLastError() == ERROR_HANDLE_EOF)
+					{ break; }
+				throw std::runtime_error("File I/O error");
+			}
+#else
+			const ssize_t read_amt = ::pread(fd, out.data(), out.size(), static_cast<off_t>(offset));
+			if (read_amt == -1)
+			{
+				if (errno == EINTR)
+					{ continue; }
+				throw std::runtime_error("File I/O error");
+			}
+#endif
+			if (read_amt == 0)
+				{ break; }
+			offset += static_cast<std::size_t>(read_amt);
+			out = out.subspan(static_cast<std::size_t>(read_amt));
+		}
+		return size - out.size();
+	}
+};
+
+#endif
@@ -0,0 +1,440 @@
+#ifndef RENDER_CACHE_H
+#define RENDER_CACHE_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <optional>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "links.h"
+#include "styles.h"
+#include "sdict_file.h"
+
+// output of rendering a definition in search_word
+struct rendered_def
+{
+	std::vector<char> text;
+	// styles of text
+	std::vector<style_run> style;
+	decltype(links) def_links;
+	// range of text to select, or { -1, -1 } if none
+	std::pair<std::size_t, std::size_t> target_word = { -1, -1 };
+	struct entry_start
+	{
+		// of the entry's title in text
+		std::size_t offset;
+		// number of newlines before offset
+		std::size_t line;
+	};
+	// recorded while rendering, so that entries can be scrolled to without counting lines
+	std::vector<entry_start> entry_starts;
+
+	// empty it to render another definition, keeping the capacity of its buffers
+	// Complexity: O(n_links)
+	void clear()
+	{
+		text.clear();
+		style.clear();
+		def_links.clear();
+		target_word = { -1, -1 };
+		entry_starts.clear();
+	}
+
+	// Complexity: O(log(n_entries))
+	// @return line of the entry starting at `offset`, or -1 if no entry starts there
+	std::size_t entry_line(std::size_t offset) const
+	{
+		const auto it = std::ranges::lower_bound(entry_starts, offset, {}, &entry_start::offset);
+		return (it != entry_starts.end() && it->offset == offset ? it->line : -1);
+	}
+};
+
+// @return approximate memory used by `rendered`, not including sizeof(rendered_def)
+inline std::size_t rendered_def_size(const rendered_def& rendered)
+{
+	std::size_t size = rendered.text.size() + rendered.style.size() * sizeof(style_run) + rendered.entry_starts.size() * sizeof(rendered_def::entry_start);
+	for (const auto& [bounds, target] : rendered.def_links)
+		{ size += sizeof(bounds) + sizeof(target) + target.size(); }
+	return size;
+}
+
+// cache of rendered definitions keyed by the searched word, so that repeated lookups skip parsing and rendering.
+// recently used definitions are kept in memory up to a byte budget (least recently used first out),
+// and offline definitions are also stored in a separate sdict file, which is kept across sessions.
+// the file is cleared whenever format_version or the source dictionary file changes
+class render_cache
+{
+public:
+	// memory budget if not set with set_memory_budget()
+	constexpr static std::size_t default_memory_budget = 32 * 1024 * 1024;
+
+private:
+	// increment whenever rendering (or this format) changes
+	constexpr static std::uint32_t format_version = 3;
+	// not a valid search word, holds format_version and the size and modification time of the source file
+	constexpr static std::string_view stamp_word = "\x01render_cache";
+
+	// empty if the file cache is disabled
+	std::optional<dictionary_file> file;
+	// of the file, as passed to open(), and its stamp_word def, so that it can be cleared (see invalidate())
+	std::string filename;
+	std::vector<char> stamp;
+
+	struct memory_entry
+	{
+		std::string word;
+		std::shared_ptr<const rendered_def> rendered;
+		// approximate memory used, see entry_size()
+		std::size_t size;
+		// whether the entry is also in file
+		bool in_file;
+	};
+	// most recently used first
+	std::list<memory_entry> lru;
+	// keys point into words of lru
+	std::unordered_map<std::string_view, std::list<memory_entry>::iterator> lru_index;
+	std::size_t memory_used = 0, memory_budget = default_memory_budget;
+
+	static std::size_t entry_size(std::string_view word, const rendered_def& rendered)
+	{
+		return sizeof(memory_entry) + sizeof(rendered_def) + word.size() + rendered_def_size(rendered);
+	}
+
+	// drop least recently used entries until memory_used is within memory_budget
+	void evict()
+	{
+		while (memory_used > memory_budget && !lru.empty())
+		{
+			memory_used -= lru.back().size;
+			lru_index.erase(lru.back().word);
+			lru.pop_back();
+		}
+	}
+
+	// drop the entry for `word` from memory, if there is one
+	void erase(std::string_view word)
+	{
+		if (const auto it = lru_index.find(word); it != lru_index.end())
+		{
+			memory_used -= it->second->size;
+			lru.erase(it->second);
+			lru_index.erase(it);
+		}
+	}
+
+	// drop every entry from memory
+	void clear_memory() noexcept
+	{
+		lru_index.clear();
+		lru.clear();
+		memory_used = 0;
+	}
+
+	// add `rendered` as the most recently used entry
+	void insert(std::string_view word, std::shared_ptr<const rendered_def> rendered, bool in_file)
+	{
+		erase(word);
+		const auto size = entry_size(word, *rendered);
+		if (size > memory_budget)
+			{ return; }
+		lru.emplace_front(std::string(word), std::move(rendered), size, in_file);
+		lru_index.emplace(lru.front().word, lru.begin());
+		memory_used += size;
+		evict();
+	}
+
+	static void append_uint_LE(std::uint64_t num, std::size_t n_bytes, std::vector<std::byte>& out)
+	{
+		for (std::size_t i = 0; i < n_bytes; i++)
+			{ out.push_back(static_cast<std::byte>((num >> (i * 8)) & 0xFF)); }
+	}
+
+	// @return false if `in` has less than n_bytes bytes
+	static bool read_uint_LE(std::span<const std::byte>& in, std::size_t n_bytes, std::uint64_t& num)
+	{
+		if (in.size() < n_bytes)
+			{ return false; }
+		num = 0;
+		for (std::size_t i = 0; i < n_bytes; i++)
+			{ num |= std::to_integer<std::uint64_t>(in[i]) << (i * 8); }
+		in = in.subspan(n_bytes);
+		return true;
+	}
+
+	static std::vector<char> make_stamp(const std::string& source_filename)
+	{
+		std::vector<std::byte> stamp;
+		append_uint_LE(format_version, 4, stamp);
+		append_uint_LE(std::filesystem::file_size(source_filename), 8, stamp);
+		append_uint_LE(std::filesystem::last_write_time(source_filename).time_since_epoch().count(), 8, stamp);
+		const auto chars = reinterpret_cast<const char*>(stamp.data());
+		return std::vector<char>(chars, chars + stamp.size());
+	}
+
+	// @return rendered def for `word` stored in file, or empty if it is not there or can't be read
+	std::optional<rendered_def> read_file(std::string_view word) const noexcept
+	{
+		if (!file || word == stamp_word)
+			{ return {}; }
+		try
+		{
+			const auto stored = file->find(word);
+			if (!stored)
+				{ return {}; }
+			auto data = std::as_bytes(std::span(stored.value()));
+			rendered_def res;
+			std::uint64_t text_len, n_runs, target_first, target_second, n_links;
+			if (!read_uint_LE(data, 4, text_len) || data.size() < text_len)
+				{ return {}; }
+			const auto chars = reinterpret_cast<const char*>(data.data());
+			res.text.assign(chars, chars + text_len);
+			data = data.subspan(text_len);
+			if (!read_uint_LE(data, 4, n_runs) || data.size() < n_runs * 5)
+				{ return {}; }
+			res.style.reserve(n_runs);
+			for (std::uint64_t i = 0; i < n_runs; i++)
+			{
+				std::uint64_t length;
+				read_uint_LE(data, 4, length);
+				append_style(res.style, length, std::to_integer<char>(data[0]));
+				data = data.subspan(1);
+			}
+			if (styles_length(res.style) != text_len)
+				{ return {}; }
+			if (!read_uint_LE(data, 8, target_first) || !read_uint_LE(data, 8, target_second) || !read_uint_LE(data, 4, n_links))
+				{ return {}; }
+			res.target_word = { target_first, target_second };
+			for (std::uint64_t i = 0; i < n_links; i++)
+			{
+				std::uint64_t low, high, target_len;
+				if (!read_uint_LE(data, 4, low) || !read_uint_LE(data, 4, high) || !read_uint_LE(data, 4, target_len) || data.size() < target_len)
+					{ return {}; }
+				res.def_links.emplace_back(link_bounds{ static_cast<int>(low), static_cast<int>(high) },
+					std::string(reinterpret_cast<const char*>(data.data()), target_len));
+				data = data.subspan(target_len);
+			}
+			std::uint64_t n_entries;
+			if (!read_uint_LE(data, 4, n_entries) || data.size() < n_entries * 8)
+				{ return {}; }
+			res.entry_starts.reserve(n_entries);
+			for (std::uint64_t i = 0; i < n_entries; i++)
+			{
+				std::uint64_t offset, line;
+				read_uint_LE(data, 4, offset);
+				read_uint_LE(data, 4, line);
+				res.entry_starts.emplace_back(offset, line);
+			}
+			return res;
+		}
+		catch (const std::exception&)
+			{ return {}; }
+	}
+
+	// replace the file with an empty cache with `stamp`
+	// @throws std::runtime_error  on file i/o error
+	void create_file()
+	{
+		file.reset();
+		std::filesystem::remove(filename);
+		file.emplace(filename, true, false, false);
+		file->add_word(stamp_word, std::span(stamp));
+	}
+
+	// store `rendered` for `word` in file, if it isn't already there. errors disable the file cache
+	void write_file(std::string_view word, const rendered_def& rendered) noexcept
+	{
+		if (!file || word == stamp_word)
+			{ return; }
+		std::vector<std::byte> data;
+		append_uint_LE(rendered.text.size(), 4, data);
+		const auto text = std::as_bytes(std::span(rendered.text));
+		data.insert(data.end(), text.begin(), text.end());
+		append_uint_LE(rendered.style.size(), 4, data);
+		for (const auto& run : rendered.style)
+		{
+			append_uint_LE(run.length, 4, data);
+			data.push_back(static_cast<std::byte>(run.style));
+		}
+		append_uint_LE(rendered.target_word.first, 8, data);
+		append_uint_LE(rendered.target_word.second, 8, data);
+		append_uint_LE(rendered.def_links.size(), 4, data);
+		for (const auto& [bounds, target] : rendered.def_links)
+		{
+			append_uint_LE(static_cast<std::uint32_t>(bounds.low), 4, data);
+			append_uint_LE(static_cast<std::uint32_t>(bounds.high), 4, data);
+			append_uint_LE(target.size(), 4, data);
+			const auto target_bytes = std::as_bytes(std::span(target));
+			data.insert(data.end(), target_bytes.begin(), target_bytes.end());
+		}
+		append_uint_LE(rendered.entry_starts.size(), 4, data);
+		for (const auto& [offset, line] : rendered.entry_starts)
+		{
+			append_uint_LE(offset, 4, data);
+			append_uint_LE(line, 4, data);
+		}
+		try
+			{ file->add_word(word, std::span<const std::byte>(data)); }
+		catch (const std::exception&)
+			{ file.reset(); }
+	}
+
+public:
+	// open or create the cache file at `filename` for definitions from `source_filename`.
+	// an existing cache for a different format or source file is replaced, and defs in memory are dropped unless they are
+	// from the same source file (as stamped) as before, e.g. when it is reloaded. the file cache stays disabled on error
+	// Complexity: that of dictionary_file::open(string_view), plus O(n_cached) if defs in memory are dropped
+	// File Access: that of dictionary_file::open(string_view); Delete and Create if the cache is replaced
+	void open(const std::string& filename_, const std::string& source_filename) noexcept
+	{
+		file.reset();
+		try
+		{
+			filename = filename_;
+			auto new_stamp = make_stamp(source_filename);
+			if (new_stamp != stamp)
+				{ clear_memory(); }
+			stamp = std::move(new_stamp);
+			try
+			{
+				// each rendered def is unique, so don't deduplicate
+				file.emplace(filename, true, false, false);
+				if (file->find(stamp_word) == stamp)
+					{ return; }
+			}
+			catch (const std::runtime_error&) {}
+
+			create_file();
+		}
+		catch (const std::exception&)
+		{
+			clear_memory();
+			stamp.clear();
+			file.reset();
+		}
+	}
+
+	// @return whether the file cache is enabled
+	bool is_open() const noexcept { return file.has_value(); }
+
+	// set the approximate memory used by cached definitions, evicting them if needed. 0 disables the memory cache
+	// Complexity: O(n_evicted)
+	void set_memory_budget(std::size_t bytes) noexcept
+	{
+		memory_budget = bytes;
+		evict();
+	}
+
+	// Complexity: O(1) on memory hit, otherwise O(log(n_words) + rendered_size)
+	// File Access: No on memory hit, otherwise Read, rendered_size + 12 bytes
+	// @return rendered def for `word`, or null if it is not cached or the entry can't be read
+	std::shared_ptr<const rendered_def> find(std::string_view word) noexcept
+	{
+		try
+		{
+			if (const auto it = lru_index.find(word); it != lru_index.end())
+			{
+				lru.splice(lru.begin(), lru, it->second);
+				return lru.front().rendered;
+			}
+			auto stored = read_file(word);
+			if (!stored)
+				{ return {}; }
+			auto rendered = std::make_shared<const rendered_def>(std::move(stored.value()));
+			insert(word, rendered, true);
+			return rendered;
+		}
+		catch (const std::exception&)
+			{ return {}; }
+	}
+
+	// unlike find(), this doesn't read the def or count as a use
+	// Complexity: O(1) on memory hit, otherwise O(log(n_words))
+	// File Access: No
+	// @return whether there is a rendered def for `word`, in memory or in the file
+	bool contains(std::string_view word) const noexcept
+	{
+		if (lru_index.contains(word))
+			{ return true; }
+		try
+			{ return file && word != stamp_word && file->contains(word); }
+		catch (const std::exception&)
+			{ return false; }
+	}
+
+	// cache `rendered` for `word`, replacing any cached def in memory. errors disable the file cache
+	// Complexity: O(rendered_size), plus that of dictionary_file::add_word() if write_through
+	// File Access: that of dictionary_file::add_word(), with def_len rendered_size, if write_through
+	// @param write_through  whether to also store it in the file now. otherwise it is only stored by save()
+	void add(std::string_view word, const rendered_def& rendered, bool write_through = true) noexcept
+	{
+		try
+			{ add(word, std::make_shared<const rendered_def>(rendered), write_through); }
+		catch (const std::exception&) {}
+	}
+
+	// cache `rendered` for `word` without copying it, so that it can be shared with the caller (e.g. navigation history)
+	// Complexity: O(1), plus that of dictionary_file::add_word() if write_through
+	// File Access: that of dictionary_file::add_word(), with def_len rendered_size, if write_through
+	// @param rendered  must not be null
+	void add(std::string_view word, std::shared_ptr<const rendered_def> rendered, bool write_through = true) noexcept
+	{
+		if (word == stamp_word)
+			{ return; }
+		try
+		{
+			if (write_through)
+				{ write_file(word, *rendered); }
+			insert(word, std::move(rendered), write_through && file);
+		}
+		catch (const std::exception&) {}
+	}
+
+	// drop the cached def for `word`, e.g. because its definition has changed.
+	// words can't be removed from a dictionary_file, so if it is in the file, the file is cleared.
+	// defs in memory are kept, and stored in the new file by save(). errors disable the file cache
+	// Complexity: O(1), plus O(n_cached) and that of open() if `word` is in the file
+	// File Access: that of open() if `word` is in the file
+	void invalidate(std::string_view word) noexcept
+	{
+		try
+		{
+			erase(word);
+			if (!file || word == stamp_word || !file->contains(word))
+				{ return; }
+			for (auto& entry : lru)
+				{ entry.in_file = false; }
+			create_file();
+		}
+		catch (const std::exception&)
+			{ file.reset(); }
+	}
+
+	// store defs which are only in memory in the file, e.g. at shutdown
+	// Complexity: O(n_cached * rendered_size), plus that of dictionary_file::add_word() for each
+	// File Access: that of dictionary_file::add_word() for each def which is only in memory
+	void save() noexcept
+	{
+		for (auto& entry : lru)
+		{
+			if (!file)
+				{ return; }
+			if (!entry.in_file)
+			{
+				write_file(entry.word, *entry.rendered);
+				entry.in_file = true;
+			}
+		}
+	}
+};
+
+#endif
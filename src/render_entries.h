@@ -0,0 +1,118 @@
+#ifndef RENDER_ENTRIES_H
+#define RENDER_ENTRIES_H
+
+#include <algorithm>
+#include <cctype>
+#include <span>
+#include <string_view>
+#include <type_traits>
+#include <utility>
+#include <variant>
+#include <vector>
+
+#include "links.h"
+#include "render_cache.h"
+#include "styles.h"
+#include "text_parse.h"
+
+namespace detail
+{
+	// default `wrap_text` of render_entries
+	struct call_text_parser
+	{
+		void operator()(const auto& parse_text) const { parse_text(); }
+	};
+}
+
+// render `entries` (of word_info, def_view::word_info or def_arena::word_info) as shown in ui.text_display, appending to `out`.
+// doesn't touch the UI, so it is also called on the lookup thread (see render_lookup in main.cpp), and by the tools and benchmarks
+// Complexity: O(text_size)
+// @param word  searched word. if it contains a colon, the entry with this id is selected
+// @param only_target  whether to only render the entry with the id in `word`, if it contains a colon
+// @param wrap_text  called with a callable which parses the text of each sense (see parse_def_text), which it must call,
+//                   e.g. to measure it on its own
+template<typename WordInfo, typename WrapText = detail::call_text_parser>
+void render_entries(std::span<const WordInfo> entries, std::string_view word, rendered_def& out, bool only_target = false,
+	const WrapText& wrap_text = {})
+{
+	// rendering adds to `links`, which still belong to the shown definition
+	auto cur_links = std::exchange(links, std::move(out.def_links));
+
+	// we keep a separate buffer instead of using ui.text_buf and ui.style_buf
+	// to prevent calling modify callbacks excessively. This results in a
+	// speedup for larger definitions despite additional copy
+	// (which might be optimized out anyway)
+	std::vector<char>& text_buf = out.text;
+	std::vector<style_run>& style_buf = out.style;
+	auto& target_word = out.target_word;
+
+	// if caps is set, text is uppercased in place (see parse_def_text)
+	const auto add = [&text_buf, &style_buf](std::string_view text, char style = get_style(), bool caps = false)
+	{
+		const auto start = text_buf.size();
+		text_buf.append_range(text);
+		if (caps)
+		{
+			std::transform(text_buf.begin() + start, text_buf.end(), text_buf.begin() + start, [](unsigned char c)
+				{ return std::toupper(c); });
+		}
+		append_style(style_buf, text.size(), style);
+	};
+	// reused across renders, so rendering a def doesn't allocate scratch buffers. one per thread, like `links`
+	thread_local render_context ctx;
+
+	using types = typename WordInfo::def_types;
+	const bool has_colon = (word.rfind(':') != std::string_view::npos);
+	for (const auto& w : entries)
+	{
+		if (only_target && has_colon && word != w.id)
+			{ continue; }
+		const std::size_t start_len = text_buf.size();
+		// count lines since the last entry, so every line is only counted once even when entries are rendered one at a time
+		const auto [last_offset, last_line] = (out.entry_starts.empty() ? rendered_def::entry_start{ 0, 0 } : out.entry_starts.back());
+		out.entry_starts.emplace_back(start_len, last_line + std::ranges::count(text_buf.begin() + last_offset, text_buf.end(), '\n'));
+
+		add(w.id, get_style(style::title));
+		add("\n");
+
+		// other sources may have entries with the same id, which are after the main one
+		if (has_colon && word == w.id && target_word.first == -1)
+			{ target_word = { start_len, text_buf.size() }; }
+
+		for (const auto& sense : w.defs)
+		{
+			const auto add_sense = [&text_buf, &add, &wrap_text](this auto self, const auto& val)
+			{
+				if (val.number)
+				{
+					add(val.number.value(), get_style(style_bold));
+					add(" ");
+				}
+				if constexpr (std::is_base_of_v<typename types::basic_def_sense_data, std::remove_reference_t<decltype(val)>>)
+				{
+					if constexpr (std::is_same_v<typename types::div_sense_data, std::remove_cvref_t<decltype(val)>>)
+					{
+						add(val.sense_div, get_style(style_italic));
+					}
+					wrap_text([&]() { parse_def_text(val.def_text, add, [&text_buf]() -> int { return text_buf.size(); }, ctx); });
+					add("\n");
+					if constexpr (std::is_same_v<typename types::sense_data, std::remove_cvref_t<decltype(val)>>)
+					{
+						if (val.sdsense)
+						{
+							self(val.sdsense.value());
+						}
+					}
+				}
+				else
+					{ add("\n"); }
+			};
+			std::visit(add_sense, sense);
+		}
+		add("\n");
+	}
+
+	out.def_links = std::exchange(links, std::move(cur_links));
+}
+
+#endif
@@ -1,187 +1,586 @@
 #include "sdict_file.h"
 #include <atomic>
+#include <charconv>
+#include <chrono>
+#include <condition_variable>
+#include <csignal>
+#include <deque>
 #include <fstream>
 #include <filesystem>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <random>
 #include <thread>
+#include <unordered_set>
 #define CPPHTTPLIB_OPENSSL_SUPPORT
 #include <httplib.h>
-#include <jsoncons/json.hpp>
-#include <jsoncons/json_cursor.hpp>
-#include <jsoncons_ext/cbor/cbor.hpp>
+#include "aimd_limiter.h"
+#include "cbor_parse.h"
+#include "def_encoding.h"
+#include "latency_histogram.h"
+#include "mapped_file.h"
+#include "mpmc_queue.h"
+#include "pipelined_connection.h"
+#include "sdict_builder.h"
+#include "transcode.h"
 
-constexpr std::size_t num_http_workers = 16;
+// number of connections (each with an http worker thread)
+constexpr std::size_t num_http_workers = 8;
+// maximum number of requests in flight on each connection
+constexpr std::size_t pipeline_depth = 32;
+// how many requests are in flight at once (over all connections) is decided by limiter
+// initial and minimum number of requests in flight
+constexpr std::size_t initial_concurrency = 16, min_concurrency = 1;
+// retries of a request which failed in a way that may be temporary (connection error, 429 or 5xx)
+constexpr std::size_t max_retries = 6;
+// delay before the nth retry is random in [0, min(retry_base_delay * 2^n, retry_max_delay)]
+constexpr auto retry_base_delay = std::chrono::milliseconds(500);
+constexpr auto retry_max_delay = std::chrono::seconds(60);
 
-constexpr std::size_t word_buf_size = 64, def_buf_size = 8;
-std::array<std::pair<std::string, std::string>, def_buf_size> def_buf;
-std::atomic<std::size_t> def_buf_start = 0, def_buf_end = 0;
-std::array<std::string, word_buf_size> word_buf;
-std::atomic<std::size_t> word_buf_start = 0, word_buf_end = 0;
-std::mutex word_lock;
-std::atomic_flag word_finished, def_finished;
+// capacities of word_queue and def_queue (powers of 2)
+constexpr std::size_t word_queue_size = 64, def_queue_size = 8;
+// number of transcoded defs to add to the dictionary at once
+constexpr std::size_t add_batch_size = 256;
+// number of words after which the dictionary is flushed, so that a crash loses at most this many
+constexpr std::size_t checkpoint_interval = 4096;
+// only store the fields of each def which are parsed (see def_projection)
+constexpr bool project_defs = true;
+// words which could not be fetched or transcoded are written here at the end.
+// they aren't in the dictionary, so they are retried by `save_words --resume` (or `save_words --resume failed_words.txt` for only those)
+constexpr std::string_view failed_words_filename = "failed_words.txt";
+// words from file_read_worker to http workers. words are views of the mapped word list (which is open until all defs are added) from here on
+mpmc_queue<std::string_view> word_queue(word_queue_size);
+// def transcoded by an http worker as it was received
+struct transcoded_def
+{
+	std::string_view word;
+	std::vector<std::uint8_t> def;
+	// `meta.stems` of each entry
+	std::vector<std::string> stems;
+};
+// defs from http workers to main, which only adds them to the dictionary
+mpmc_queue<transcoded_def> def_queue(def_queue_size);
+// def_queue is closed once the last http worker is done
+std::atomic<std::size_t> http_workers_running = num_http_workers;
 
 std::string api_key;
 
-// can have multiple http workers
-void http_worker()
+aimd_limiter limiter(initial_concurrency, min_concurrency, num_http_workers * pipeline_depth);
+
+// metrics are printed every metrics_interval, and written with --metrics (see metrics_worker())
+// the queue depths show which stage limits the crawl: a full word_queue means the http workers (network, or cpu if
+// transcode_time is a large part of request latency), and a full def_queue means adding to the dictionary (disk)
+constexpr auto metrics_interval = std::chrono::seconds(10);
+// time from sending a request to receiving its response, for each http worker
+std::array<latency_histogram, num_http_workers> request_latency;
+// request_latency of all http workers
+latency_histogram total_request_latency;
+// time spent transcoding each def, over all the pieces it was received in
+latency_histogram transcode_time;
+// time taken by each add_words() call
+latency_histogram add_time;
+// response bytes received (compressed size if the response was compressed and had a length)
+std::atomic<std::uint64_t> bytes_downloaded = 0;
+std::atomic<std::uint64_t> num_retries = 0;
+// updated by main after adding to dict_file, which isn't thread safe
+std::atomic<std::uint64_t> words_added = 0, defs_deduplicated = 0;
+
+std::mutex failed_words_mutex;
+std::vector<std::string> failed_words;
+
+void add_failed_word(std::string_view word, std::string_view reason)
+{
+	std::cerr << word << ": " << reason << std::endl;
+	std::lock_guard lock(failed_words_mutex);
+	failed_words.emplace_back(word);
+}
+
+std::string url_encode(std::string_view in)
 {
-	httplib::SSLClient http_client("www.dictionaryapi.com");
-	while (!word_finished.test() || word_buf_start != word_buf_end)
+	std::string s;
+	for (char c : in)
+	{
+		if (('A' <= c && c <= 'Z') ||
+			('a' <= c && c <= 'z') ||
+			('0' <= c && c <= '9') ||
+			c == '-' || c == '.' || c == '_' || c == '~')
+			{ s += c; }
+		else
+			{ s += std::format("%{:X}", c); }
+	}
+	return s;
+}
+
+// request for the def of a word, which may be a retry
+struct def_request
+{
+	std::string_view word;
+	std::size_t attempt = 0;
+	// when the request was sent if in flight, or when it may be retried otherwise
+	aimd_limiter::clock::time_point time{};
+};
+
+// delay before retrying a request, with jittered exponential backoff
+// @param res  the response, if there was one, for Retry-After
+std::chrono::milliseconds retry_delay(std::size_t attempt, const httplib::Response* res)
+{
+	thread_local std::mt19937 rng(std::random_device{}());
+	// full jitter, so that requests which were throttled together aren't retried together
+	const auto max_delay = std::min<std::chrono::milliseconds>(retry_base_delay * (1 << attempt), retry_max_delay);
+	auto delay = std::chrono::milliseconds(std::uniform_int_distribution<std::chrono::milliseconds::rep>(0, max_delay.count())(rng));
+	if (res && res->has_header("Retry-After"))
+	{
+		// only the delay-seconds form is handled, not an HTTP date
+		const std::string retry_after = res->get_header_value("Retry-After");
+		std::chrono::seconds::rep seconds;
+		if (std::from_chars(retry_after.data(), retry_after.data() + retry_after.size(), seconds).ec == std::errc())
+			{ delay = std::max<std::chrono::milliseconds>(delay, std::chrono::seconds(seconds)); }
+	}
+	return delay;
+}
+
+// can have multiple http workers, each with one connection
+// requests are pipelined, so that each connection has up to pipeline_depth requests in flight instead of needing a thread for each.
+// responses are transcoded as they are received (see def_transcoder), so a whole response body is never held in memory
+// @param worker_ind  index in request_latency
+void http_worker(std::size_t worker_ind)
+{
+	pipelined_connection connection("www.dictionaryapi.com");
+	// in the order they were sent
+	std::deque<def_request> in_flight;
+	// waiting to be sent again
+	std::vector<def_request> retries;
+	bool words_done = false;
+
+	// reused, so that the encoder doesn't grow a new buffer for each def
+	std::vector<std::uint8_t> cbor_buf;
+	std::vector<std::string> stems;
+	const auto on_stem = [&stems](std::string_view stem) { stems.emplace_back(stem); };
+	// of the response being received
+	std::optional<def_transcoder<decltype(on_stem)&>> transcoder;
+	// why the response being received couldn't be transcoded, after which the rest of it is skipped. empty if it hasn't failed
+	std::string transcode_error;
+	std::chrono::steady_clock::duration transcode_elapsed{};
+	std::uint64_t body_size = 0;
+	const std::function<void(std::string_view)> on_body = [&](std::string_view piece)
+	{
+		body_size += piece.size();
+		if (!transcode_error.empty())
+			{ return; }
+		const auto start = std::chrono::steady_clock::now();
+		try
+			{ transcoder->add(piece); }
+		catch (const std::exception& e)
+			{ transcode_error = e.what(); }
+		transcode_elapsed += std::chrono::steady_clock::now() - start;
+	};
+
+	// a request failed in a way that may be temporary. it has already been released from limiter
+	const auto retry_or_fail = [&retries](def_request req, std::string_view reason, const httplib::Response* res)
+	{
+		if (req.attempt == max_retries)
+		{
+			add_failed_word(req.word, reason);
+			return;
+		}
+		req.time = aimd_limiter::clock::now() + retry_delay(req.attempt, res);
+		req.attempt++;
+		retries.push_back(std::move(req));
+		num_retries.fetch_add(1, std::memory_order_relaxed);
+	};
+	// the connection was closed, so requests in flight after the first one have to be sent again
+	const auto resend_in_flight = [&in_flight, &retries]()
 	{
-		static constexpr auto url_encode = [](std::string_view in)
+		for (auto& req : in_flight)
 		{
-			std::string s;
-			for (char c : in)
+			limiter.cancel();
+			req.time = {};
+			retries.push_back(std::move(req));
+		}
+		in_flight.clear();
+	};
+
+	while (true)
+	{
+		// send requests until the pipeline is full, or there is no request which can be sent yet
+		while (in_flight.size() < pipeline_depth)
+		{
+			const auto now = aimd_limiter::clock::now();
+			std::optional<def_request> req;
+			if (const auto it = std::ranges::find_if(retries, [now](const def_request& r) { return r.time <= now; }); it != retries.end())
+			{
+				req = std::move(*it);
+				retries.erase(it);
+			}
+			else if (!words_done)
 			{
-				if (('A' <= c && c <= 'Z') ||
-					('a' <= c && c <= 'z') ||
-					('0' <= c && c <= '9') ||
-					c == '-' || c == '.' || c == '_' || c == '~')
-					{ s += c; }
+				if (const auto word = word_queue.pop())
+					{ req = def_request{ word.value() }; }
 				else
-					{ s += std::format("%{:X}", c); }
+					{ words_done = true; }
 			}
-			return s;
-		};
+			if (!req)
+				{ break; }
 
-		std::size_t ind;
+			// only wait if nothing is in flight, since this connection's responses may be what the limit is waiting for
+			if (in_flight.empty())
+				{ limiter.acquire(); }
+			else if (!limiter.try_acquire())
+			{
+				retries.push_back(std::move(req.value()));
+				break;
+			}
+
+			if (httplib::Error error; !connection.is_open() && !connection.connect(error))
+			{
+				limiter.release({}, true);
+				retry_or_fail(std::move(req.value()), httplib::to_string(error), nullptr);
+				break;
+			}
+			req->time = aimd_limiter::clock::now();
+			const bool sent = connection.send(httplib::append_query_params("/api/v3/references/collegiate/json/" + url_encode(req->word), { { "key", api_key } }));
+			in_flight.push_back(std::move(req.value()));
+			// the failure is handled below, like a failed receive()
+			if (!sent)
+				{ break; }
+		}
 
-		do
+		if (in_flight.empty())
 		{
-			ind = word_buf_start;
-			// wait if buf_end == buf_start (buffer is empty)
-			word_buf_end.wait(ind);
+			if (retries.empty())
+			{
+				if (words_done)
+					{ break; }
+				continue;
+			}
+			// only retries which are waiting for their backoff remain
+			std::this_thread::sleep_until(std::ranges::min(retries, {}, &def_request::time).time);
+			continue;
 		}
-		while (!word_lock.try_lock());
 
-		const std::string word = std::move(word_buf[ind]);
-		word_buf_start = (ind + 1) % word_buf_size;
-		word_buf_start.notify_one();
+		httplib::Response res;
+		def_request req = std::move(in_flight.front());
+		in_flight.pop_front();
+		stems.clear();
+		transcoder.emplace(project_defs, on_stem, cbor_buf);
+		transcode_error.clear();
+		transcode_elapsed = {};
+		body_size = 0;
+		if (!connection.receive(res, on_body))
+		{
+			limiter.release(aimd_limiter::clock::now() - req.time, true);
+			retry_or_fail(std::move(req), "connection failed", nullptr);
+			resend_in_flight();
+			continue;
+		}
 
-		word_lock.unlock();
+		const auto latency = aimd_limiter::clock::now() - req.time;
+		request_latency[worker_ind].add(latency);
+		total_request_latency.add(latency);
+		bytes_downloaded.fetch_add(res.has_header("Content-Encoding") && res.has_header("Content-Length") ?
+			res.get_header_value_u64("Content-Length") : res.body.size() + body_size, std::memory_order_relaxed);
 
-		auto res = http_client.Get(httplib::append_query_params("/api/v3/references/collegiate/json/" + url_encode(word), { { "key", api_key } }));
-		if (!res || res->status != 200)
+		const bool temporary = (res.status == 429 || res.status >= 500);
+		limiter.release(latency, temporary);
+		if (temporary)
+			{ retry_or_fail(std::move(req), std::format("HTTP {}", res.status), &res); }
+		else if (res.status != 200)
+			{ add_failed_word(req.word, std::format("HTTP {}", res.status)); }
+		else
 		{
-			std::cerr << word << std::endl;
-			std::exit(-1);
+			if (transcode_error.empty())
+			{
+				const auto start = std::chrono::steady_clock::now();
+				try
+					{ transcoder->finish(); }
+				catch (const std::exception& e)
+					{ transcode_error = e.what(); }
+				transcode_elapsed += std::chrono::steady_clock::now() - start;
+			}
+			transcode_time.add(transcode_elapsed);
+			if (transcode_error.empty())
+				{ def_queue.push(transcoded_def{ req.word, std::vector<std::uint8_t>(cbor_buf.begin(), cbor_buf.end()), std::move(stems) }); }
+			else
+				{ add_failed_word(req.word, transcode_error); }
 		}
+		if (!connection.is_open())
+			{ resend_in_flight(); }
+	}
+	if (--http_workers_running == 0)
+		{ def_queue.close(); }
+}
 
-		std::size_t next = (def_buf_end + 1) % def_buf_size;
+// @param elapsed  time since the crawl started
+void print_metrics(std::ostream& out, std::chrono::steady_clock::duration elapsed)
+{
+	const auto ms = [](auto d) { return static_cast<double>(d.count()) / 1000; };
+	const double seconds = std::chrono::duration<double>(elapsed).count();
+	const auto added = words_added.load(std::memory_order_relaxed);
+	std::size_t failed;
+	{
+		std::lock_guard lock(failed_words_mutex);
+		failed = failed_words.size();
+	}
+	out << std::format("[{:.0f}s] {} words ({:.1f}/s), {} failed, {} retries\n", seconds, added, (seconds > 0 ? added / seconds : 0), failed, num_retries.load(std::memory_order_relaxed));
+	out << std::format("  queues: words {}/{}, defs {}/{}\n", word_queue.size(), word_queue.capacity(), def_queue.size(), def_queue.capacity());
+	out << std::format("  requests: {} in flight (limit {}), p50 {:.1f}ms, p99 {:.1f}ms, {:.1f} MiB downloaded\n",
+		limiter.active_count(), limiter.limit(), ms(total_request_latency.quantile(0.5)), ms(total_request_latency.quantile(0.99)),
+		static_cast<double>(bytes_downloaded.load(std::memory_order_relaxed)) / (1 << 20));
+	out << std::format("  transcode: mean {:.2f}ms, {:.1f}s total\n", ms(transcode_time.mean()), ms(transcode_time.sum()) / 1000);
+	out << std::format("  add_words: mean {:.1f}ms, {:.1f}s total, {:.1f}% of defs deduplicated",
+		ms(add_time.mean()), ms(add_time.sum()) / 1000, (added == 0 ? 0 : 100.0 * defs_deduplicated.load(std::memory_order_relaxed) / added)) << std::endl;
+}
 
-		// wait if buf_start == buf_end + 1 (buffer is full)
-		def_buf_start.wait(next);
-		if (def_finished.test())
-			{ return; }
+// write metrics in the Prometheus text format
+void write_prometheus_metrics(std::ostream& out)
+{
+	out << "# TYPE save_words_queue_depth gauge\n";
+	out << "save_words_queue_depth{queue=\"words\"} " << word_queue.size() << '\n';
+	out << "save_words_queue_depth{queue=\"defs\"} " << def_queue.size() << '\n';
+	out << "# TYPE save_words_requests_in_flight gauge\nsave_words_requests_in_flight " << limiter.active_count() << '\n';
+	out << "# TYPE save_words_concurrency_limit gauge\nsave_words_concurrency_limit " << limiter.limit() << '\n';
+	out << "# TYPE save_words_request_duration_seconds histogram\n";
+	for (std::size_t i = 0; i < num_http_workers; i++)
+		{ request_latency[i].write_prometheus(out, "save_words_request_duration_seconds", std::format("worker=\"{}\"", i)); }
+	out << "# TYPE save_words_retries_total counter\nsave_words_retries_total " << num_retries.load(std::memory_order_relaxed) << '\n';
+	out << "# TYPE save_words_downloaded_bytes_total counter\nsave_words_downloaded_bytes_total " << bytes_downloaded.load(std::memory_order_relaxed) << '\n';
+	out << "# TYPE save_words_transcode_duration_seconds histogram\n";
+	transcode_time.write_prometheus(out, "save_words_transcode_duration_seconds", "");
+	out << "# TYPE save_words_add_duration_seconds histogram\n";
+	add_time.write_prometheus(out, "save_words_add_duration_seconds", "");
+	out << "# TYPE save_words_words_added_total counter\nsave_words_words_added_total " << words_added.load(std::memory_order_relaxed) << '\n';
+	out << "# TYPE save_words_defs_deduplicated_total counter\nsave_words_defs_deduplicated_total " << defs_deduplicated.load(std::memory_order_relaxed) << '\n';
+	std::lock_guard lock(failed_words_mutex);
+	out << "# TYPE save_words_failed_words_total counter\nsave_words_failed_words_total " << failed_words.size() << '\n';
+}
 
-		def_buf[def_buf_end] = { std::move(word), std::move(res->body) };
-		def_buf_end = next;
-		def_buf_end.notify_one();
+// print metrics every metrics_interval until stopped
+// @param prometheus_filename  file which metrics are also written to in the Prometheus text format (e.g. for the node exporter textfile collector), or empty
+void metrics_worker(std::stop_token stop, std::string prometheus_filename)
+{
+	const auto start = std::chrono::steady_clock::now();
+	std::mutex m;
+	std::condition_variable_any cv;
+	std::unique_lock lock(m);
+	while (!cv.wait_for(lock, stop, metrics_interval, []() { return false; }) && !stop.stop_requested())
+	{
+		print_metrics(std::cout, std::chrono::steady_clock::now() - start);
+		if (!prometheus_filename.empty())
+		{
+			// replaced at once, so that it is never read partially written
+			const std::string temp_filename = prometheus_filename + ".tmp";
+			{
+				std::ofstream fout(temp_filename);
+				write_prometheus_metrics(fout);
+			}
+			std::error_code ec;
+			std::filesystem::rename(temp_filename, prometheus_filename, ec);
+		}
 	}
-	def_finished.test_and_set();
-	def_buf_start.notify_all(); // unblock and end all other http worker threads
 }
 
 // should have only 1 file read worker
-void file_read_worker()
+// repeated words are skipped, since they aren't checked for when adding to the dictionary (add_words<false, true>)
+// @param word_list  contents of the word list, one word per line (LF or CRLF)
+// @param done_words  words which are already in the dictionary, and are skipped
+void file_read_worker(std::string_view word_list, const std::unordered_set<std::string>& done_words)
 {
-	std::ifstream fin("words.txt"); // NB: words.txt should have no duplicates!
-	std::string word;
-	while (std::getline(fin, word))
+	// words which have been queued or are done. set elements don't move, so they can be viewed
+	std::unordered_set<std::string_view> seen(done_words.begin(), done_words.end());
+	seen.reserve(seen.size() + std::ranges::count(word_list, '\n') + 1);
+	std::size_t num_skipped = 0;
+	while (!word_list.empty())
 	{
-		std::size_t next = (word_buf_end + 1) % word_buf_size;
-
-		// wait if buf_start == buf_end + 1 (buffer is full)
-		word_buf_start.wait(next);
-
-		word_buf[word_buf_end] = std::move(word);
-		word_buf_end = next;
-		word_buf_end.notify_one();
+		const std::size_t end = std::min(word_list.find('\n'), word_list.size());
+		std::string_view word = word_list.substr(0, end);
+		word_list.remove_prefix(std::min(end + 1, word_list.size()));
+		if (word.ends_with('\r'))
+			{ word.remove_suffix(1); }
+		if (word.empty())
+			{ continue; }
+		if (seen.insert(word).second)
+			{ word_queue.push(word); }
+		else
+			{ num_skipped++; }
 	}
-	word_finished.test_and_set();
+	word_queue.close();
+	std::cout << "word list read, " << num_skipped << " repeated or existing words skipped" << std::endl;
 }
 
-int main()
+// usage: save_words [--resume | --bulk] [--metrics <file>] [word list (default words.txt)]
+// without --resume, data.sdict is recreated. with it, words which are already in data.sdict are skipped
+// with --bulk, data.sdict is written in one pass at the end (see dictionary_file_builder) instead of being added to
+// and flushed at checkpoints, so it is cheaper to build but a crash loses the whole crawl
+// (and its words section is front coded, since a bulk built file is mostly read afterwards)
+// with --metrics, metrics are also written to the file in the Prometheus text format
+int main(int argc, char** argv)
 {
-	if (std::filesystem::exists("data.sdict")) { std::filesystem::remove("data.sdict"); }
-	dictionary_file dict_file("data.sdict");
+	bool resume = false, bulk = false;
+	std::string words_filename = "words.txt", metrics_filename;
+	for (int i = 1; i < argc; i++)
+	{
+		const std::string_view arg = argv[i];
+		if (arg == "--resume")
+			{ resume = true; }
+		else if (arg == "--bulk")
+			{ bulk = true; }
+		else if (arg == "--metrics" && i + 1 < argc)
+			{ metrics_filename = argv[++i]; }
+		else if (arg.starts_with("-"))
+		{
+			std::cerr << "Unexpected argument " << arg << "\nusage: save_words [--resume | --bulk] [--metrics <file>] [word list]" << std::endl;
+			return -1;
+		}
+		else
+			{ words_filename = arg; }
+	}
+	if (resume && bulk)
+	{
+		std::cerr << "--resume and --bulk can't be used together" << std::endl;
+		return -1;
+	}
+
+	// only one of these is used
+	std::optional<dictionary_file> opened_file;
+	std::optional<dictionary_file_builder> builder;
+	if (bulk)
+		{ builder.emplace("data.sdict", true, true); }
+	else
+	{
+		if (!resume && std::filesystem::exists("data.sdict")) { std::filesystem::remove("data.sdict"); }
+		opened_file.emplace("data.sdict");
+		// reported after each flush which modified the file (i.e. at checkpoints)
+		opened_file->set_stats_hook([](const dictionary_file::statistics& stats)
+		{
+			const auto ms = [](auto d) { return std::chrono::duration<double, std::milli>(d).count(); };
+			std::cout << std::format("  data.sdict: {} seeks, {} i/o calls, {:.1f} MiB read, {} rewrites, flushes {:.1f}ms total\n",
+				stats.seeks, stats.io_calls, static_cast<double>(stats.bytes_read) / (1 << 20), stats.rewrites, ms(stats.flush_time));
+		});
+	}
 	{
 		std::ifstream fin("api_key.txt");
 		if (!fin)
 			{ return -1; }
 		fin >> api_key;
 	}
+
+	// pairs of stem (`meta.stems` of each entry) and word whose def contains the entry
+	std::vector<std::pair<std::string, std::string>> stems;
+	// copied, since contains() can't be called by file_read_worker while words are being added
+	std::unordered_set<std::string> done_words;
+	if (resume && !opened_file->created_file)
+	{
+		// fetched defs are added as CBOR
+		if (opened_file->def_encoding() != static_cast<std::uint32_t>(def_encoding::encoding::cbor))
+		{
+			std::cerr << "data.sdict isn't CBOR encoded (see sdict_tool --recode), so can't be resumed" << std::endl;
+			return -1;
+		}
+		// the stem index is replaced at the end, so the stems of defs from earlier runs are parsed again
+		std::vector<def_view::word_info> entries;
+		opened_file->for_each_def([&](std::span<const std::byte> def, std::span<const std::string_view> def_words)
+		{
+			entries.clear();
+			cbor_parse::parse(def, entries);
+			for (const auto word : def_words)
+			{
+				for (const auto& entry : entries)
+				{
+					for (const auto stem : entry.stems)
+						{ stems.emplace_back(stem, word); }
+				}
+				done_words.emplace(word);
+			}
+		});
+		std::cout << "resuming after " << done_words.size() << " words" << std::endl;
+	}
 	
-	std::jthread t(file_read_worker);
+#ifndef _WIN32
+	// a write to a connection which the server closed would otherwise end the process, instead of failing the write
+	std::signal(SIGPIPE, SIG_IGN);
+#endif
+	mapped_file word_list;
+	try
+		{ word_list.open(words_filename); }
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return -1;
+	}
+	std::jthread t(file_read_worker, std::string_view(reinterpret_cast<const char*>(word_list.data().data()), word_list.data().size()), std::cref(done_words));
 	std::array<std::jthread, num_http_workers> ts;
-	for (auto& e : ts)
-		{ e = std::jthread(http_worker); }
+	for (std::size_t i = 0; i < num_http_workers; i++)
+		{ ts[i] = std::jthread(http_worker, i); }
 	
+	const auto start = std::chrono::steady_clock::now();
+	std::jthread metrics_t(metrics_worker, metrics_filename);
+
 	std::size_t num = 0;
-	while (!def_finished.test() || def_buf_start != def_buf_end)
+	std::vector<std::pair<std::string_view, std::vector<std::uint8_t>>> pending;
+	pending.reserve(add_batch_size);
+	const auto add_pending = [&]()
 	{
-		std::vector<std::uint8_t> cbor_bytes;
-		
-		// wait if buf_end == buf_start (buffer is empty)
-		def_buf_end.wait(def_buf_start);
-		
-		const std::pair<std::string, std::string> p = std::move(def_buf[def_buf_start]);
-		def_buf_start = (def_buf_start + 1) % def_buf_size;
-		def_buf_start.notify_one();
-		
-		jsoncons::json_string_cursor cursor(p.second);
-		jsoncons::cbor::cbor_bytes_encoder encoder(cbor_bytes);
-		
-		using jsoncons::staj_event_type;
-		
-		for (; !cursor.done(); cursor.next())
+		const auto add_start = std::chrono::steady_clock::now();
+		if (builder)
 		{
-			const auto& event = cursor.current();
-			switch (event.event_type())
-			{
-				case staj_event_type::begin_array:
-					encoder.begin_array();
-					break;
-				case staj_event_type::end_array:
-					encoder.end_array();
-					break;
-				case staj_event_type::begin_object:
-					encoder.begin_object();
-					break;
-				case staj_event_type::end_object:
-					encoder.end_object();
-					break;
-				case staj_event_type::key:
-					encoder.key(event.get<jsoncons::string_view>());
-					break;
-				case staj_event_type::string_value:
-					encoder.string_value(event.get<jsoncons::string_view>());
-					break;
-				case staj_event_type::null_value:
-					encoder.null_value();
-					break;
-				case staj_event_type::bool_value:
-					encoder.bool_value(event.get<bool>());
-					break;
-				case staj_event_type::int64_value:
-					encoder.int64_value(event.get<int64_t>());
-					break;
-				case staj_event_type::uint64_value:
-					encoder.uint64_value(event.get<uint64_t>());
-					break;
-				case staj_event_type::double_value:
-					encoder.double_value(event.get<double>());
-					break;
-				default:
-					std::cerr << "Unhandled event type: " << event.event_type() << " " << "\n";
-					break;
-			}
+			// defs are only deduplicated by finish(), so defs_deduplicated stays 0
+			builder->add_words(pending);
+			words_added.fetch_add(pending.size(), std::memory_order_relaxed);
 		}
-		
-		dict_file.add_word<false, true>(p.first, std::as_bytes(std::span(cbor_bytes)));
+		else
+		{
+			words_added.fetch_add(opened_file->add_words<false, true>(pending), std::memory_order_relaxed);
+			defs_deduplicated.store(opened_file->num_deduplicated_defs(), std::memory_order_relaxed);
+		}
+		add_time.add(std::chrono::steady_clock::now() - add_start);
+		pending.clear();
+	};
+	while (auto def = def_queue.pop())
+	{
+		for (auto& stem : def->stems)
+			{ stems.emplace_back(std::move(stem), def->word); }
+		pending.emplace_back(def->word, std::move(def->def));
+		if (pending.size() >= add_batch_size)
+			{ add_pending(); }
 		
 		num++;
-		if (num % 10 == 0)
-			{ std::cout << num << std::endl; }
+		if (opened_file && num % checkpoint_interval == 0)
+		{
+			// words added since the last flush are lost on a crash, and fetched again when resuming
+			add_pending();
+			opened_file->flush();
+		}
+	}
+	add_pending();
+	if (opened_file)
+		{ opened_file->flush(); }
+	else
+		{ std::cout << "writing " << builder->num_words() << " words" << std::endl; }
+	dictionary_file& dict_file = (builder ? builder->finish() : opened_file.value());
+	metrics_t = {};
+	print_metrics(std::cout, std::chrono::steady_clock::now() - start);
+
+	// def_queue is only closed after word_queue, but the word list may still be being read
+	t.join();
+	// all words have been copied into the dictionary. it may be failed_words_filename, which can't be replaced while mapped on windows
+	word_list.close();
+	if (!failed_words.empty())
+	{
+		std::ofstream fout{ std::string(failed_words_filename) };
+		for (const auto& word : failed_words)
+			{ fout << word << '\n'; }
+		std::cout << failed_words.size() << " words failed, written to " << failed_words_filename << std::endl;
 	}
-	dict_file.flush();
+	else if (std::filesystem::exists(failed_words_filename))
+		{ std::filesystem::remove(failed_words_filename); }
+
+	dict_file.set_stem_index(stems);
+	dict_file.build_fuzzy_index();
+	dict_file.add_bloom_filter();
+#ifdef SDICT_USE_ZSTD
+	std::cout << "compressing" << std::endl;
+	dict_file.compress_defs();
+#endif
+	return failed_words.empty() ? 0 : 1;
 }
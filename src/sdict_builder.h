@@ -0,0 +1,172 @@
+#ifndef SDICT_BUILDER_H
+#define SDICT_BUILDER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "sdict_file.h"
+
+// creates a new dictionary file in one pass, for building a whole dictionary at once
+// defs are streamed to a temporary file as they are added, and words are collected in memory.
+// finish() sorts the words once, and writes the file with its inds and words sections at exactly the size needed,
+// copying defs from the temporary file. adding to a dictionary_file instead starts with small sections,
+// which are rewritten (along with every def) each time they run out of space
+class dictionary_file_builder
+{
+private:
+	std::string filename;
+	std::string defs_filename;
+	std::ofstream defs_out;
+	// size of the temporary defs file, which def_inds are offsets into
+	std::uint64_t defs_size = 0;
+	// holds the words until finish(), then the built file
+	dictionary_file file;
+	// see set_def_encoding()
+	std::uint32_t def_encoding = 0;
+	bool finished = false;
+
+public:
+	// @param filename_  file to create. it is replaced if it already exists, once finish() is called
+	// @param deduplicate  whether identical defs are stored once (see dictionary_file::open())
+	// @param front_code_words  whether the words section is front coded (see dictionary_file::front_code_words())
+	// @throws std::runtime_error  if the temporary file could not be created
+	explicit dictionary_file_builder(std::string_view filename_, bool deduplicate = true, bool front_code_words = false) :
+		filename(filename_), defs_filename(filename + ".defs.tmp"),
+		defs_out(defs_filename, std::ios::out | std::ios::binary | std::ios::trunc)
+	{
+		if (!defs_out)
+			{ throw std::runtime_error("Unable to create temporary file " + defs_filename); }
+		// same as a newly created file
+		file.filename = filename;
+		file.file_open_type = dictionary_file::open_type::none;
+		file.do_dedup = deduplicate;
+		file.flags = dictionary_file::flag_xxh64 | (front_code_words ? dictionary_file::flag_front_coded_words : 0);
+	}
+
+	dictionary_file_builder(const dictionary_file_builder&) = delete;
+	dictionary_file_builder& operator=(const dictionary_file_builder&) = delete;
+
+	~dictionary_file_builder()
+	{
+		if (!finished)
+		{
+			defs_out.close();
+			std::error_code ec;
+			std::filesystem::remove(defs_filename, ec);
+		}
+	}
+
+	// add a word and its def. the def is written to the temporary file right away
+	// words may be added in any order, but not more than once
+	// Complexity: O(def_len) (amortized)
+	// File Access: Write, 12 + def_len bytes (plus padding, buffered)
+	// @throws std::runtime_error  on file i/o error, or if the defs don't fit in a file
+	// @throws std::logic_error  if called after finish()
+	void add_word(std::string_view word, std::span<const std::byte> def)
+	{
+		if (finished)
+			{ throw std::logic_error("Builder is already finished"); }
+		if (def.empty())
+			{ throw std::invalid_argument("Definition must not be empty"); }
+		// laid out as in the built file, so that write_file() copies runs of defs at once
+		const std::uint64_t def_ind = file.align_def(defs_size);
+		if (def_ind >= file.def_offset_limit())
+			{ throw std::runtime_error("Definitions are too large for one file"); }
+
+		std::vector<std::byte> header(def_ind - defs_size);
+		header.reserve(header.size() + 12);
+		dictionary_file::append_uint32_LE(def.size(), header);
+		dictionary_file::append_uint64_LE(file.def_hash(def), header);
+		defs_out.write(reinterpret_cast<const char*>(header.data()), header.size());
+		defs_out.write(reinterpret_cast<const char*>(def.data()), def.size());
+		if (!defs_out)
+			{ throw std::runtime_error("File I/O error"); }
+		file.words.emplace_back(word, def_ind);
+		defs_size = def_ind + 12 + def.size();
+	}
+	void add_word(std::string_view word, std::span<const char> def) { add_word(word, std::as_bytes(def)); }
+
+	// add multiple words (see add_word())
+	// @param entries  range of pairs of word (convertible to std::string_view) and def (contiguous range of bytes or chars)
+	template<std::ranges::input_range R>
+	void add_words(R&& entries)
+	{
+		for (auto&& [word, def] : entries)
+			{ add_word(std::string_view(word), std::as_bytes(std::span(def))); }
+	}
+
+	// record the encoding of the defs in the built file (see dictionary_file::set_def_encoding())
+	// Complexity: O(1)
+	// File Access: No
+	void set_def_encoding(std::uint32_t id) noexcept
+		{ def_encoding = id; }
+
+	// Complexity: O(1)
+	// File Access: No
+	std::size_t num_words() const noexcept
+		{ return file.words.size(); }
+
+	// write the dictionary file, and remove the temporary file
+	// identical defs are merged here if deduplicating, and defs are laid out in word order
+	// Complexity: O(n_words * log(n_words) + total_words_len + total_defs_size)
+	// File Access: Map (temporary file); Create; Write, n_words * 24 + total_words_len + n_words + total_defs_size bytes; Rename; Delete
+	// @throws std::runtime_error  on file i/o error
+	// @throws std::logic_error  if a word was added more than once, or if already finished
+	// @return the built file, opened as read only. valid as long as the builder
+	dictionary_file& finish()
+	{
+		if (finished)
+			{ throw std::logic_error("Builder is already finished"); }
+		defs_out.close();
+		if (defs_out.fail())
+			{ throw std::runtime_error("File I/O error"); }
+
+		auto& words = file.words;
+		if (words.empty())
+		{
+			// nothing to copy, so the file is created as usual
+			finished = true;
+			std::filesystem::remove(defs_filename);
+			if (std::filesystem::exists(filename))
+				{ std::filesystem::remove(filename); }
+			file.open(filename, true, file.do_dedup);
+			if (def_encoding != 0)
+				{ file.set_def_encoding(def_encoding); }
+			return file;
+		}
+
+		words.sort();
+		if (words.has_adjacent_dup())
+			{ throw std::logic_error("Repeated words were added"); }
+		const std::uint64_t words_len = words.total_len(0, words.size()) + words.size(); // null terminated
+		if (words.size() >= std::numeric_limits<std::uint32_t>::max() / 2 || words_len > std::numeric_limits<std::uint32_t>::max())
+			{ throw std::runtime_error("Too many words for one file"); }
+		file.reserved_words = static_cast<std::uint32_t>(words.size());
+		file.words_sect_size = static_cast<std::uint32_t>(words_len);
+
+		std::vector<std::pair<std::uint32_t, std::vector<std::byte>>> new_extensions;
+		if (def_encoding != 0)
+		{
+			std::vector<std::byte> data;
+			dictionary_file::append_uint32_LE(def_encoding, data);
+			new_extensions.emplace_back(dictionary_file::ext_def_encoding, std::move(data));
+			file.def_encoding_id = def_encoding;
+		}
+		file.write_file(defs_filename, 0, false, new_extensions);
+		finished = true;
+		std::filesystem::remove(defs_filename);
+		return file;
+	}
+};
+
+#endif
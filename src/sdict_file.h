@@ -3,11 +3,19 @@
 
 #include <algorithm>
 #include <array>
+#include <atomic>
 #include <cassert>
+#include <chrono>
 #include <compare>
+#include <concepts>
 #include <cstdint>
+#include <exception>
 #include <filesystem>
 #include <fstream>
+#include <functional>
+#include <iterator>
+#include <limits>
+#include <memory>
 #include <numeric>
 #include <optional>
 #include <ranges>
@@ -15,39 +23,158 @@
 #include <stdexcept>
 #include <string>
 #include <string_view>
+#include <thread>
+#include <tuple>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 
+#ifdef SDICT_USE_ZSTD
+#include <zstd.h>
+#include <zdict.h>
+#endif
+
+#include "bloom.h"
+#include "def_table.h"
+#include "front_coding.h"
+#include "fuzzy.h"
+#include "hash.h"
+#include "lru_cache.h"
+#include "mapped_file.h"
+#include "positioned_file.h"
+#include "text_index.h"
+#include "word_table.h"
+
 // file containing dictionary info (words and definitions)
-// magic bytes: SDICT[0x01][0x00] or 53 44 49 43 54 01 00 in ASCII
-// 0x01 is the current file version number
+// magic bytes: SDICT[0x04][0x00] or 53 44 49 43 54 04 00 in ASCII
+// 0x04 is the current file version number. older versions can still be read and
+// updated in place, and are converted to the current version whenever they are rewritten
 // File format:
 // [Magic Bytes]
 // reserved_words words_sect_size
 // num_words
+// flags (version 2+; unsigned 32-bit (4-byte LE) integer, see flag_* constants)
+// ExtInd (version 3+; offset of extension table after defs section, or 0 if there is none)
 // (inds section)
 // WInd WInd WInd WInd ... (reserved_words in total, only first num_words have a useful value; unsigned 32-bit (4-byte LE) integer offset after word section)
 // DInd DInd DInd DInd ... (reserved_words in total, only first num_words have a useful value; unsigned 32-bit (4-byte LE) integer offset after defs section)
 // note that these indices start at 1. 0 is used to denote "no index"
+// in version 4+, DInd (and every other offset after the defs section: ExtInd, and offsets in the extension table and word segments)
+// counts in units of def_alignment_v4 bytes, and every def and extension starts at such a multiple (padded with nulls),
+// which lifts the size limit of the defs section from 4 GiB to 32 GiB while keeping indices 32-bit
+// (hash index, version 2+)
+//     Slot Slot Slot Slot ... (reserved_words * 2 in total; open addressing table with linear probing)
+//     each slot contains an unsigned 32-bit (4-byte LE) entry number and an unsigned 32-bit (4-byte LE) tag.
+//     the entry number is the position of the word in WInd/DInd, starting at 1 (0 denotes an empty slot),
+//     and the tag is the upper 32 bits of the FNV-1a hash of the word. a word starts probing at (hash % slot count)
 // (words section)
 //     word word word word ... (num_words in total, null terminated; occupies words_size bytes)
+//     if flag_front_coded_words is set (version 4+), words are instead front coded in entry (sorted) order,
+//     in blocks of front_coding::block_size (see front_coding), and the WInd of each word is that of the start of its block.
+//     the main sections are then never updated in place, and new words are appended as word segments (see below) until the next rewrite
 // (defs section)
 //     def def def def ... (num_words in total; each def contains a unsigned 32-bit (4-byte LE) integer as size and unsigned 64-bit (8-byte LE) int as hash)
+//     if flag_codec_prefix is set, the first byte of each def's data is a def_codec specifying how the rest is encoded.
+//     size and hash always refer to the stored (encoded) data.
+//     the hash is XXH64 if flag_xxh64 is set, and FNV-1a otherwise
+// (extensions, version 3+)
+//     extension data and the extension table are stored in the defs section like defs, but are not referenced by any word.
+//     the extension table contains pairs of unsigned 32-bit (4-byte LE) integers, a tag and
+//     the offset of extension data after defs section (starting at 1, like DInd)
+//     when new words don't fit in the main (inds and words) sections, they may be appended as word segment
+//     extensions instead of rewriting the file. the main sections are merged with all segments on the next rewrite
+//     files written by this version carry a metadata checksum extension, which is updated in place whenever
+//     anything before the defs section changes
 class dictionary_file
 {
 private:
+	// builds files through write_file()
+	friend class dictionary_file_builder;
+
 	constexpr static std::uint32_t init_reserved_words = 32;
 	constexpr static std::uint32_t init_words_sect_size = 256;
 
 	// batch size for batched def reads
 	constexpr static std::size_t batch_size = 4096;
+	// minimum number of defs for each thread when verifying defs
+	constexpr static std::size_t min_defs_per_thread = 256;
+	// size at which buffered defs are written in add_words()
+	constexpr static std::size_t write_buffer_size = 1 << 20;
+	// minimum size of reads by for_each_def()
+	constexpr static std::size_t scan_chunk_size = 1 << 20;
+	// definitions at most this far apart are read by find_many() in one read, along with the bytes between them
+	constexpr static std::size_t max_merged_gap = 1 << 16;
+	// in lean mode (see open_mapped()), every this many words are kept in memory. each starts a front coded block
+	constexpr static std::size_t word_sample_interval = 64;
+	static_assert(word_sample_interval % front_coding::block_size == 0);
 
 	// convert string literal to array, removing the null delimiter
 	template<std::size_t N>
 	constexpr static auto strlit_to_array(const char (&a)[N])
 		{ std::array<char, N - 1> arr; std::copy_n(a, N - 1, arr.begin()); return arr; }
 
-	constexpr static std::array magic_bytes = strlit_to_array("SDICT\x01\x00");
+	constexpr static std::array magic_bytes = strlit_to_array("SDICT\x04\x00");
+	// index of version number in magic_bytes
+	constexpr static std::size_t version_byte_ind = 5;
+	constexpr static std::uint8_t current_version = 4;
+	// alignment of defs in version 4+, and unit of stored def offsets (see File format)
+	constexpr static std::uint64_t def_alignment_v4 = 8;
+
+	// each def is prefixed with a def_codec byte
+	constexpr static std::uint32_t flag_codec_prefix = 1;
+	// def hashes are XXH64 instead of FNV-1a (set for all newly created files)
+	constexpr static std::uint32_t flag_xxh64 = 2;
+	// the words section is front coded (version 4+, see File format)
+	constexpr static std::uint32_t flag_front_coded_words = 4;
+	constexpr static std::uint32_t known_flags = flag_codec_prefix | flag_xxh64 | flag_front_coded_words;
+
+	// extension tags, as 4 ASCII characters read as a LE integer
+	// zstd dictionary used by def_codec::zstd ("ZDIC")
+	constexpr static std::uint32_t ext_zstd_dict = 0x4349445A;
+	// words that did not fit in the main sections ("WSEG"). may appear multiple times
+	// contains an unsigned 32-bit (4-byte LE) word count, followed by that many entries of
+	// unsigned 32-bit (4-byte LE) DInd, unsigned 32-bit (4-byte LE) word length, and word (not null terminated)
+	constexpr static std::uint32_t ext_word_segment = 0x47455357;
+	// checksum of everything before the defs section ("MSUM")
+	// contains an unsigned 64-bit (8-byte LE) XXH64 of bytes [0, defs section), followed by
+	// unsigned 32-bit (4-byte LE) checksum_* flags and 4 reserved bytes (0)
+	constexpr static std::uint32_t ext_metadata_checksum = 0x4D55534D;
+	constexpr static std::uint32_t metadata_checksum_size = 16;
+	// all def hashes have either been computed from their data by writers or verified, so full verification can be skipped
+	constexpr static std::uint32_t checksum_defs_verified = 1;
+	// defs are laid out in the sorted order of the words referring to them (as written by rewrites), with none appended since.
+	// advisory, so that lookups of neighbouring words can rely on readahead
+	constexpr static std::uint32_t checksum_defs_clustered = 2;
+	// bloom filter over all words ("BLOM"), updated in place by flushes and rebuilt on rewrites
+	// contains an unsigned 32-bit (4-byte LE) number of hash functions k, unsigned 32-bit (4-byte LE) bits per reserved word,
+	// followed by the filter bits (a multiple of 64 bits in total, see bloom.h)
+	constexpr static std::uint32_t ext_bloom_filter = 0x4D4F4C42;
+	// index from stems (e.g. inflected forms) to words ("STEM"), for words which are not in the dictionary themselves
+	// contains an unsigned 32-bit (4-byte LE) entry count, followed by that many entries of unsigned 32-bit (4-byte LE) stem length,
+	// unsigned 32-bit (4-byte LE) word length, stem, and word (neither null terminated). entries are sorted by stem, with no repeats
+	constexpr static std::uint32_t ext_stem_index = 0x4D455453;
+	// symmetric delete fuzzy index over words ("FUZY"), see build_fuzzy_index()
+	// contains unsigned 32-bit (4-byte LE) max edit distance, word count, and entry count,
+	// followed by that many unsigned 32-bit (4-byte LE) word end offsets (exclusive, in the word pool),
+	// that many entries of unsigned 64-bit (8-byte LE) XXH64 of a variant and unsigned 32-bit (4-byte LE) word number
+	// (sorted by hash), and the word pool (concatenated words)
+	constexpr static std::uint32_t ext_fuzzy_index = 0x595A5546;
+	// inverted index from terms of definition text to words ("TEXT"), see set_text_index()
+	// contains unsigned 32-bit (4-byte LE) word count and term count, followed by that many unsigned 32-bit (4-byte LE)
+	// word end offsets (exclusive, in the word pool), that many entries of unsigned 32-bit (4-byte LE) term end offset
+	// (exclusive, in the term pool) and postings end offset (exclusive, in the postings), the word pool, the term pool
+	// (both concatenated, sorted), and the postings. the postings of each term are increasing word numbers, as LEB128 varint deltas
+	constexpr static std::uint32_t ext_text_index = 0x54584554;
+	// encoding of the data of every def ("DENC"), see set_def_encoding(). defs are in encoding 0 if there is none
+	// contains an unsigned 32-bit (4-byte LE) encoding id
+	constexpr static std::uint32_t ext_def_encoding = 0x434E4544;
+
+	enum class def_codec : std::uint8_t
+	{
+		raw = 0,
+		// single zstd frame, using the ext_zstd_dict dictionary if present
+		zstd = 1
+	};
 
 	std::string filename;
 	// main file object. all public member functions except close() and add_word<false>()
@@ -55,34 +182,165 @@ private:
 	std::fstream file;
 	enum class open_type { no_file, none, read, write, read_write };
 	open_type file_open_type = open_type::no_file;
+	// whole-file read only mapping, only used when opened through open_mapped()
+	// `file` is kept closed while this is open
+	mapped_file mapping;
+	// separate read only handle for find(), which is const and doesn't touch `file`
+	// reopened whenever the file is created or replaced, and kept closed while `mapping` is open
+	positioned_file pread_file;
 
+	std::uint8_t file_version = current_version;
 	std::uint32_t reserved_words, words_sect_size;
-	struct word_info
-	{
-		std::string word;
-		std::uint32_t def_ind;
-		constexpr std::strong_ordering operator<=>(const word_info& other) const
-			{ return word <=> other.word; }
-		constexpr bool operator==(const word_info& other) const
-			{ return word == other.word; }
-		constexpr friend std::strong_ordering operator<=>(const word_info& lhs, std::string_view rhs)
-			{ return lhs.word <=> rhs; }
-		constexpr friend bool operator==(const word_info& lhs, std::string_view rhs)
-			{ return lhs.word == rhs; }
-		constexpr friend std::strong_ordering operator<=>(std::string_view lhs, const word_info& rhs)
-			{ return lhs <=> rhs.word; }
-		constexpr friend bool operator==(std::string_view lhs, const word_info& rhs)
-			{ return lhs == rhs.word; }
-	};
 	// sorted
-	// uint32_t is offset from the start of the defs section
-	// (i.e. starts from 0, despite indices starting from 1 on disk)
-	std::vector<word_info> words;
+	// def_ind is offset from the start of the defs section in bytes
+	// (i.e. starts from 0, despite indices starting from 1 on disk, and is not in units of def_alignment())
+	word_table words;
 	std::size_t first_new_word = -1;
+	// whether the file was mapped in lean mode (see open_mapped()). `words` is then empty, and word_sample holds
+	// every word_sample_interval-th word of the main sections (which hold all words), the rest being decoded from the mapping
+	bool lean_words = false;
+	word_table word_sample;
+	// number of words in lean mode
+	std::size_t num_lean_words = 0;
+
+	// in-memory copy of the on-disk hash index (entry numbers only, tags are recomputed)
+	// empty when the file is version 1 or mapped (where the mapping is probed directly)
+	std::vector<std::uint32_t> hash_slots;
+
+	std::uint32_t flags = 0;
+	// pairs of extension tag and offset from the start of the defs section
+	std::vector<std::pair<std::uint32_t, std::uint64_t>> extensions;
+	// number of words (in `words`) which are stored in ext_word_segment extensions instead of the main sections
+	// new words are only written to the main sections when this is 0
+	std::size_t num_segment_words = 0;
+	// whether def hashes are known to be correct (see checksum_defs_verified)
+	bool defs_verified = true;
+	// whether defs are in word order (see checksum_defs_clustered)
+	bool defs_clustered = true;
+	// contents of the ext_bloom_filter extension, viewing `bloom_buf` or the mapping. empty if there is no filter
+	std::span<const std::byte> bloom_filter;
+	std::vector<std::byte> bloom_buf;
+	// entries of the ext_stem_index extension (stem and word), viewing `stem_buf` or the mapping. sorted by stem
+	std::vector<std::pair<std::string_view, std::string_view>> stem_index;
+	std::vector<std::byte> stem_buf;
+	// contents of the ext_fuzzy_index extension, viewing `fuzzy_buf` or the mapping. empty if there is no index
+	std::span<const std::byte> fuzzy_index;
+	std::vector<std::byte> fuzzy_buf;
+	// contents of the ext_text_index extension, viewing `fulltext_buf` or the mapping. empty if there is no index
+	std::span<const std::byte> fulltext_index;
+	std::vector<std::byte> fulltext_buf;
+	// contents of the ext_def_encoding extension, or 0 if there is none
+	std::uint32_t def_encoding_id = 0;
+
+#ifdef SDICT_USE_ZSTD
+	struct zstd_deleter
+	{
+		void operator()(ZSTD_CCtx* p) const { ZSTD_freeCCtx(p); }
+		void operator()(ZSTD_CDict* p) const { ZSTD_freeCDict(p); }
+		void operator()(ZSTD_DDict* p) const { ZSTD_freeDDict(p); }
+		void operator()(ZSTD_DCtx* p) const { ZSTD_freeDCtx(p); }
+	};
+	// compression level used for new defs
+	int zstd_level = 19;
+	std::unique_ptr<ZSTD_CCtx, zstd_deleter> zstd_cctx;
+	// contents of the ext_zstd_dict extension (empty if there is none)
+	std::vector<std::byte> zstd_dict;
+	// created on first use, null if there is no dictionary
+	std::unique_ptr<ZSTD_CDict, zstd_deleter> zstd_cdict;
+	std::unique_ptr<ZSTD_DDict, zstd_deleter> zstd_ddict;
+#endif
 	
-	// map of def size and hash to inds
-	std::unordered_map<std::uint32_t, std::unordered_map<std::uint64_t, std::vector<std::uint32_t>>> existing_defs;
+	// def size and hash to inds
+	def_table existing_defs;
 	bool do_dedup = true;
+	// words added with add_word() or add_words() whose def was deduplicated, since opening
+	std::size_t num_dedup_hits = 0;
+
+	struct cached_def
+	{
+		// decoded
+		std::vector<std::byte> data;
+		// stored hash
+		std::uint64_t hash;
+	};
+	// recently read defs by def_ind, null unless enabled by set_def_cache_capacity(). cleared whenever def_inds may change
+	std::unique_ptr<sharded_lru_cache<std::uint64_t, cached_def>> def_cache;
+
+public:
+	// counters of lookups and file i/o since construction or the last reset_stats(), see stats()
+	// i/o through the mapping (see open_mapped()) is not counted, since it doesn't issue reads
+	struct statistics
+	{
+		// calls of find(), find_view() and find_stream(), and how many of them found the word
+		std::uint64_t finds = 0, hits = 0, misses = 0;
+		// bytes read from the file
+		std::uint64_t bytes_read = 0;
+		// stream seeks, and reads and writes issued (positioned reads, and stream reads or writes of one contiguous range,
+		// several of which a stream may buffer into one syscall). i/o of the new file written by rewrite_file() is not counted
+		std::uint64_t seeks = 0, io_calls = 0;
+		// times the whole file was rewritten (see flush())
+		std::uint64_t rewrites = 0;
+		// added words whose def was shared with an existing def (see num_deduplicated_defs())
+		std::uint64_t dedup_hits = 0;
+		// lookups which found their def in the def cache, or had to read it (see set_def_cache_capacity())
+		std::uint64_t def_cache_hits = 0, def_cache_misses = 0;
+		// total time spent opening (reading the index of) the file and in flush()
+		std::chrono::nanoseconds read_file_time{}, flush_time{};
+	};
+
+	// result of fsck()
+	struct fsck_report
+	{
+		// every problem found. empty if the file is sound
+		std::vector<std::string> errors;
+		// words in the main sections and word segments, and distinct defs referenced by them
+		std::size_t num_words = 0, num_defs = 0;
+		// bytes of the defs section not used by any def or extension (e.g. replaced defs), which compact() would reclaim
+		std::uint64_t unreferenced_bytes = 0;
+		// whether the words section is in sorted order, as after a rewrite. words added in place are appended out of order
+		bool words_sorted = true;
+	};
+	// called with stats() after every flush() which modified the file, and when the file is closed (including on destruction)
+	using stats_hook = std::function<void(const statistics&)>;
+
+private:
+	// relaxed atomics, since const lookups may be called concurrently
+	struct stat_counters
+	{
+		std::atomic<std::uint64_t> finds = 0, hits = 0, bytes_read = 0, seeks = 0, io_calls = 0, rewrites = 0, dedup_hits = 0, def_cache_hits = 0, def_cache_misses = 0;
+		std::atomic<std::chrono::nanoseconds::rep> read_file_ns = 0, flush_ns = 0;
+	};
+	mutable stat_counters counters;
+	stats_hook on_stats;
+
+	template<typename T>
+	static void count(std::atomic<T>& counter, T n = 1) noexcept { counter.fetch_add(n, std::memory_order_relaxed); }
+	// count i/o on `file` or pread_file
+	void count_io(std::uint64_t seeks, std::uint64_t calls, std::uint64_t bytes_read = 0) const noexcept
+	{
+		count(counters.seeks, seeks);
+		count(counters.io_calls, calls);
+		count(counters.bytes_read, bytes_read);
+	}
+	// count i/o on `f`, only if it is `file` (and not e.g. the new file of write_file())
+	void count_io(const std::fstream& f, std::uint64_t seeks, std::uint64_t calls, std::uint64_t bytes_read = 0) const noexcept
+	{
+		if (&f == &file)
+			{ count_io(seeks, calls, bytes_read); }
+	}
+	// count a lookup of a word, which was found if `found`
+	void count_find(bool found) const noexcept
+	{
+		count(counters.finds, std::uint64_t(1));
+		if (found)
+			{ count(counters.hits, std::uint64_t(1)); }
+	}
+	// pass stats() to on_stats, if it is set
+	void report_stats() const
+	{
+		if (on_stats)
+			{ on_stats(stats()); }
+	}
 
 public:
 	// true if a file was created on construction, false if it was read from
@@ -94,7 +352,8 @@ public:
 
 	// @param create_if_not_exists  whether to create a new file if an existing one is not found
 	// @param deduplicate  whether to enable deduplication
-	// @param check_defs  whether to verify definition hashes (expensive)
+	// @param check_defs  whether to verify definition hashes (expensive).
+	//     skipped if the file is marked as verified and its metadata checksum matches
 	// @throws std::runtime_error  on file i/o error or if parsing receives an unexpected value
 	dictionary_file(std::string_view filename_, bool create_if_not_exists = true, bool deduplicate = true, bool check_defs = true)
 	{
@@ -109,18 +368,34 @@ public:
 				{ flush(); }
 			catch (...) {}
 		}
+		if (file.is_open() || mapping.is_open())
+		{
+			try
+				{ report_stats(); }
+			catch (...) {}
+		}
 	}
 	
 	// associate given filename with this object and open as input (reading contents or creating if not exists)
-	// TODO: update complexity
-	// Complexity: O(reserved_words + total_words_len + N*log(N)), where N is number of words
-	// File Access: Read, magic_bytes.size() + 8 + reserved_words * 8 + total_words_len
+	// the metadata checksum (if present) is always verified, and def hashes are verified if check_defs is set
+	// and the file is not marked as verified. otherwise, use find(word, true) to verify defs as they are read
+	// Complexity: O(reserved_words + words_sect_size + N*log(N)), where N is number of words
+	//     (plus O(total_defs_size / n_threads) if def hashes are verified)
+	// File Access: Read, magic_bytes.size() + 16 + reserved_words * 24 + words_sect_size
+	//     (plus Map if deduplicate or check_defs)
 	// @throws std::runtime_error  on file i/o or parsing error
 	void open(std::string_view filename_, bool create_if_not_exists = true, bool deduplicate = true, bool check_defs = true)
 	{
 		filename = filename_;
 		file_open_type = open_type::none;
 		do_dedup = deduplicate;
+		num_dedup_hits = 0;
+		existing_defs.clear();
+		mapping.close();
+		bloom_filter = {};
+		stem_index.clear();
+		fuzzy_index = {};
+		fulltext_index = {};
 		
 		if (!std::filesystem::is_regular_file(filename))
 		{
@@ -135,18 +410,23 @@ public:
 		else
 		{
 			open();
+			check_defs = check_defs && !defs_verified;
 			if (deduplicate || check_defs)
 			{
-				for (const auto& [word, def_ind] : words)
+				// defs are read through a separate mapping so that verification doesn't go through `file`
+				const mapped_file defs_mapping(filename);
+				if (check_defs)
+				{
+					verify_defs(defs_mapping.data());
+					defs_verified = true;
+				}
+				if (deduplicate)
 				{
-					auto [size, hash] = get_def_size_and_hash(def_ind);
-					assert(size != 0);
-					if (deduplicate)
-						{ existing_defs[size][hash].push_back(def_ind); } // keep old def_ind value if exists
-					if (check_defs)
+					existing_defs.reserve(words.size());
+					for (const auto& [word_off, word_len, def_ind] : words)
 					{
-						if (hash != hash_existing_def(def_ind, size))
-							{ throw std::runtime_error("Definition hash does not match. File may be corrupted"); }
+						const auto [def, hash] = def_view_and_hash(def_ind, defs_mapping.data());
+						existing_defs.insert(def.size(), hash, def_ind); // keep old def_ind value if exists
 					}
 				}
 			}
@@ -155,17 +435,71 @@ public:
 		}
 	}
 
+	// associate given filename with this object and map it read only. the file must already exist
+	// find_view() can then be used to access definitions without copying.
+	// add_word() will throw until the file is opened again through open(string_view)
+	// Complexity: O(reserved_words + words_sect_size + N*log(N)), where N is number of words
+	//     (plus O(total_defs_size / n_threads) if def hashes are verified)
+	// File Access: Map
+	// @param check_defs  whether to verify definition hashes (expensive).
+	//     skipped if the file is marked as verified and its metadata checksum matches
+	// @param lean  keep only every word_sample_interval-th word in memory instead of every word, for long running readers of large files.
+	//     words are looked up through the hash index, and prefix_bounds() and word_at() decode the few words they need from the mapping,
+	//     while prefix_range() and for_each_def() throw. only applies if all words are in a front coded words section
+	//     (see front_code_words()) and none are in word segments. other files are loaded as usual
+	// @throws std::runtime_error  on file i/o or parsing error
+	void open_mapped(std::string_view filename_, bool check_defs = true, bool lean = false)
+	{
+		filename = filename_;
+		file_open_type = open_type::none;
+		do_dedup = false;
+		existing_defs.clear();
+		mapping.close();
+		bloom_filter = {};
+		stem_index.clear();
+		fuzzy_index = {};
+		fulltext_index = {};
+		first_new_word = -1;
+
+		if (!std::filesystem::is_regular_file(filename))
+		{
+			if (std::filesystem::exists(filename))
+				{ throw std::runtime_error(std::string(filename) + " exists but is not a regular file"); }
+			throw std::runtime_error(std::string(filename) + " does not exist, not creating");
+		}
+
+		if (file.is_open())
+			{ file.close(); }
+		pread_file.close();
+		mapping.open(filename);
+		// hash index is probed directly from the mapping
+		read_file(false, lean);
+
+		if (check_defs && !defs_verified)
+		{
+			verify_defs(mapping.data());
+			defs_verified = true;
+		}
+		created_file = false;
+	}
+
 	// open file as input and read contents
-	// Complexity: O(reserved_words + total_words_len + N*log(N)), where N is number of words
-	// File Access: Read, magic_bytes.size() + 8 + reserved_words * 8 + total_words_len
+	// Complexity: O(reserved_words + words_sect_size + N*log(N)), where N is number of words
+	// File Access: Read, magic_bytes.size() + 16 + reserved_words * 24 + words_sect_size
 	// @throws std::runtime_error  on file i/o or parsing error
 	// @throws std::logic_error  if there is no associated file
 	void open()
 	{
 		if (file_open_type == open_type::no_file)
 			{ throw std::logic_error("No associated file. Call open(string_view) first"); }
+		mapping.close();
+		bloom_filter = {};
+		stem_index.clear();
+		fuzzy_index = {};
+		fulltext_index = {};
 		open_in();
 		read_file();
+		pread_file.open(filename);
 	}
 
 	// Complexity: O(1)
@@ -174,8 +508,16 @@ public:
 	{
 		if (file_open_type == open_type::no_file)
 			{ throw std::logic_error("No associated file. Call open(string_view) first"); }
+		if (file.is_open() || mapping.is_open())
+			{ report_stats(); }
 		if (file.is_open())
 			{ file.close(); }
+		mapping.close();
+		bloom_filter = {};
+		stem_index.clear();
+		fuzzy_index = {};
+		fulltext_index = {};
+		pread_file.close();
 		file_open_type = open_type::none;
 	}
 	
@@ -183,7 +525,10 @@ public:
 	// expects defs to already be written
 	// If no rewrite is necessary (word inds and words fit in their respective sections):
 	//   Complexity: O(N*log(N)), where N is number of words
-	//   File Acess: Write, total_new_words_len + n_new_words * 4
+	//   File Acess: Write, total_new_words_len + n_new_words * 8 (+ n_new_words * 8 for hash index)
+	// If new words don't fit, but there are at least as many words in the main sections as in word segments (version 3+):
+	//   Complexity: O(N*log(N) + n_extensions), where N is number of words
+	//   File Access: Write, total_new_words_len + n_new_words * 8 + n_extensions * 8 + 40 bytes
 	// Otherwise:
 	//   Complexity: O(n_words + total_words_len + total_defs_size)
 	//   File Access: Create; Read, reserved_words * 8 + words_sect_size + total_defs_size bytes;
@@ -194,69 +539,538 @@ public:
 	// @throws std::logic_error  if there is no associated file
 	// @return whether file was modified
 	bool flush()
+	{
+		const auto start = std::chrono::steady_clock::now();
+		const bool modified = flush_impl();
+		count(counters.flush_ns, (std::chrono::steady_clock::now() - start).count());
+		if (modified)
+			{ report_stats(); }
+		return modified;
+	}
+	
+#ifdef SDICT_USE_ZSTD
+	// compress all definitions with zstd, using a dictionary trained over the existing definitions.
+	// definitions added afterwards are compressed with the same dictionary,
+	// and find() / find_view() decompress transparently
+	// words that have not been flushed will be flushed first
+	// Complexity: O(n_words + total_words_len + total_defs_size), plus dictionary training
+	// File Access: Read, up to max_sample_size bytes; plus File Access of rewrite_file()
+	// @param level  zstd compression level, used for this object only
+	// @param dict_capacity  maximum size of the trained dictionary
+	// @param max_sample_size  maximum total size of definitions used for training
+	// @throws std::runtime_error  on file i/o error
+	// @throws std::logic_error  if there is no associated file, the file is mapped, or definitions are already compressed
+	void compress_defs(int level = 19, std::size_t dict_capacity = 112640, std::size_t max_sample_size = 64 << 20)
 	{
 		if (file_open_type == open_type::no_file)
 			{ throw std::logic_error("No associated file. Call open(string_view) first"); }
-		if (first_new_word == -1)
-			{ open_in(); return false; }
+		if (mapping.is_open())
+			{ throw std::logic_error("File is mapped read only. Call open(string_view) first"); }
+		if ((flags & flag_codec_prefix) != 0)
+			{ throw std::logic_error("Definitions are already compressed"); }
+		flush();
+
+		std::vector<std::uint64_t> def_inds;
+		def_inds.reserve(words.size());
+		for (const auto& [word_off, word_len, def_ind] : words)
+			{ def_inds.push_back(def_ind); }
+		std::ranges::sort(def_inds);
+		def_inds.erase(std::ranges::unique(def_inds).begin(), def_inds.end());
+
+		std::vector<std::byte> samples, buf;
+		std::vector<std::size_t> sample_sizes;
+		for (const auto def_ind : def_inds)
+		{
+			const auto def = read_stored_def(def_ind, buf, false);
+			if (samples.size() + def.size() > max_sample_size)
+				{ break; }
+			samples.insert(samples.end(), def.begin(), def.end());
+			sample_sizes.push_back(def.size());
+		}
+		std::vector<std::byte> dict(dict_capacity);
+		const std::size_t dict_size = ZDICT_trainFromBuffer(dict.data(), dict.size(), samples.data(), sample_sizes.data(), static_cast<unsigned>(sample_sizes.size()));
+		// training fails if there are too few samples, in which case defs are compressed without a dictionary
+		if (ZDICT_isError(dict_size))
+			{ dict.clear(); }
+		else
+			{ dict.resize(dict_size); }
+
+		const auto old_flags = flags;
+		const auto old_level = zstd_level;
+		try
+		{
+			flags |= flag_codec_prefix;
+			zstd_level = level;
+			zstd_dict = dict;
+			zstd_cdict.reset();
+			zstd_ddict.reset();
+			if (!zstd_dict.empty())
+			{
+				zstd_ddict.reset(ZSTD_createDDict(zstd_dict.data(), zstd_dict.size()));
+				if (!zstd_ddict)
+					{ throw std::runtime_error("Unable to load zstd dictionary"); }
+			}
+			std::vector<std::pair<std::uint32_t, std::vector<std::byte>>> new_extensions;
+			if (!dict.empty())
+				{ new_extensions.emplace_back(ext_zstd_dict, std::move(dict)); }
+			rewrite_file(reserved_words, words_sect_size, true, new_extensions);
+		}
+		catch (...)
+		{
+			flags = old_flags;
+			zstd_level = old_level;
+			zstd_dict.clear();
+			zstd_cdict.reset();
+			zstd_ddict.reset();
+			throw;
+		}
+	}
+#endif
+
+	// rewrite the file, keeping only definitions that are referenced by a word, laid out in word order.
+	// the index and words sections are shrunk to the smallest size that fits all words
+	// the file is converted to current_version (see rewrite_file())
+	// words that have not been flushed will be flushed first
+	// Complexity: O(n_words + total_words_len + total_defs_size)
+	// File Access: that of flush(), plus that of rewrite_file()
+	// @throws std::runtime_error  on file i/o error
+	// @throws std::logic_error  if there is no associated file or the file is mapped
+	// @return number of bytes reclaimed
+	std::uintmax_t compact()
+	{
+		if (file_open_type == open_type::no_file)
+			{ throw std::logic_error("No associated file. Call open(string_view) first"); }
+		if (mapping.is_open())
+			{ throw std::logic_error("File is mapped read only. Call open(string_view) first"); }
+		flush();
+		const auto old_size = std::filesystem::file_size(filename);
+
+		const auto old_reserved_words = reserved_words;
+		const auto old_words_sect_size = words_sect_size;
+		std::uint32_t new_reserved_words = init_reserved_words;
+		while (new_reserved_words < words.size())
+			{ new_reserved_words *= 2; }
+		std::uint32_t new_words_sect_size = init_words_sect_size;
+		const auto words_total_len = words.total_len(0, words.size());
+		while (new_words_sect_size < words_total_len)
+			{ new_words_sect_size *= 2; }
+		reserved_words = std::min(reserved_words, new_reserved_words);
+		words_sect_size = std::min(words_sect_size, new_words_sect_size);
+		try
+			{ rewrite_file(old_reserved_words, old_words_sect_size); }
+		catch (...)
+		{
+			reserved_words = old_reserved_words;
+			words_sect_size = old_words_sect_size;
+			throw;
+		}
+
+		const auto new_size = std::filesystem::file_size(filename);
+		return (old_size > new_size ? old_size - new_size : 0);
+	}
+
+	// compact() the file with a front coded words section (see File format), which is usually much smaller
+	// since sorted words share long prefixes. later rewrites keep it front coded.
+	// words added afterwards are appended as word segments instead of in place, so this suits files which are mostly read
+	// Complexity: that of compact()
+	// File Access: that of compact()
+	// @throws std::runtime_error  on file i/o error
+	// @throws std::logic_error  if there is no associated file or the file is mapped
+	// @return number of bytes reclaimed
+	std::uintmax_t front_code_words()
+	{
+		const auto old_flags = flags;
+		flags |= flag_front_coded_words;
+		try
+			{ return compact(); }
+		catch (...)
+		{
+			flags = old_flags;
+			throw;
+		}
+	}
+
+	// add a bloom filter over all words, replacing any existing one. contains(), find() and maybe_contains()
+	// then reject most absent words without searching. the filter is kept up to date by flush()
+	// and rebuilt with the same density whenever the file is rewritten
+	// words that have not been flushed will be flushed first
+	// Complexity: O(n_words + reserved_words * bits_per_word / 8)
+	// File Access: Write, 20 + reserved_words * bits_per_word / 8 + 16 + n_extensions * 8 bytes
+	//     (or File Access of rewrite_file() if the file is older than version 3)
+	// @param bits_per_word  filter bits per reserved word. 10 gives about 1% false positives once all reserved words are used
+	// @throws std::runtime_error  on file i/o error
+	// @throws std::logic_error  if there is no associated file, the file is mapped, or bits_per_word is not in [1, 64]
+	void add_bloom_filter(std::uint32_t bits_per_word = 10)
+	{
+		if (file_open_type == open_type::no_file)
+			{ throw std::logic_error("No associated file. Call open(string_view) first"); }
+		if (mapping.is_open())
+			{ throw std::logic_error("File is mapped read only. Call open(string_view) first"); }
+		if (bits_per_word == 0 || bits_per_word > 64)
+			{ throw std::logic_error("Bloom filter bits per word must be between 1 and 64"); }
+		flush();
 
+		build_bloom_filter(bits_per_word);
+		if (file_version < 3)
+		{
+			// rewrite converts to a version with extensions, and writes the new filter
+			rewrite_file(reserved_words, words_sect_size);
+			return;
+		}
 		open_in_out();
-		
-		static constexpr auto reduce_fn =
-			[](std::size_t init, const word_info& elem) -> std::size_t
-				{ return init + elem.word.size() + 1; }; // +1 for null character
-		std::size_t cur_words_total_len = std::reduce(words.begin(), words.begin() + first_new_word, std::size_t(0), reduce_fn); // TODO: replace with uz following support
-		std::size_t words_total_len = std::reduce(words.begin() + first_new_word, words.end(), cur_words_total_len, reduce_fn);
-		auto old_words_sect_size = words_sect_size;
-		while (words_sect_size < words_total_len)
-			{ words_sect_size *= 2; }
-		if (words_sect_size != old_words_sect_size || reserved_words < words.size())
+		std::erase_if(extensions, [](const auto& ext) { return ext.first == ext_bloom_filter; });
+		extensions.emplace_back(ext_bloom_filter, append_def(bloom_buf, file, defs_section_offset()));
+		write_extension_table(file, defs_section_offset());
+		write_metadata_checksum(file);
+		open_in();
+	}
+
+	// set the stem index (e.g. from inflected forms to their headword), replacing any existing one.
+	// find(), find_view() and find_stream() look up words which are not in the dictionary through it.
+	// entries whose word is not in the dictionary or whose stem is a word in the dictionary are skipped,
+	// and only the first entry for each stem is kept. the index is kept as-is when the file is rewritten
+	// words that have not been flushed will be flushed first
+	// Complexity: O(n_entries * log(n_entries) + total_entries_len)
+	// File Access: that of set_extension(), with data size 4 + n_entries * 8 + total_entries_len
+	// @param entries  range of pairs of stem and word (both convertible to std::string_view)
+	// @throws std::runtime_error  on file i/o error
+	// @throws std::logic_error  if there is no associated file or the file is mapped
+	template<std::ranges::input_range R>
+	void set_stem_index(R&& entries)
+	{
+		if (file_open_type == open_type::no_file)
+			{ throw std::logic_error("No associated file. Call open(string_view) first"); }
+		if (mapping.is_open())
+			{ throw std::logic_error("File is mapped read only. Call open(string_view) first"); }
+		flush();
+
+		std::vector<std::pair<std::string, std::string>> sorted;
+		for (auto&& [entry_stem, entry_word] : entries)
 		{
-			sort_words();
-			const auto old_reserved_words = reserved_words;
-			while (reserved_words < words.size())
-				{ reserved_words *= 2; }
-			rewrite_file(old_reserved_words, old_words_sect_size);
-			return true;
+			const std::string_view stem(entry_stem), word(entry_word);
+			if (stem != word && !contains(stem) && contains(word))
+				{ sorted.emplace_back(stem, word); }
 		}
+		std::ranges::stable_sort(sorted, {}, &std::pair<std::string, std::string>::first);
+		const auto repeated = std::ranges::unique(sorted, {}, &std::pair<std::string, std::string>::first);
+		sorted.erase(repeated.begin(), repeated.end());
 
-		std::vector<std::streamoff> inds;
-		inds.resize(words.size() - first_new_word);
+		std::vector<std::byte> data;
+		append_uint32_LE(sorted.size(), data);
+		for (const auto& [stem, word] : sorted)
+		{
+			append_uint32_LE(stem.size(), data);
+			append_uint32_LE(word.size(), data);
+			const auto stem_bytes = std::as_bytes(std::span(stem)), word_bytes = std::as_bytes(std::span(word));
+			data.insert(data.end(), stem_bytes.begin(), stem_bytes.end());
+			data.insert(data.end(), word_bytes.begin(), word_bytes.end());
+		}
 
-		// write num words
-		file.seekp(inds_section_offset() - 4, std::ios::beg);
-		write_uint32_LE(words.size());
+		set_extension(ext_stem_index, data);
+		stem_buf = std::move(data);
+		load_stem_index(stem_buf);
+	}
 
-		// write new words
+	// Complexity: O(log(n_stems))
+	// File Access: No
+	// @return word that `stem` maps to in the stem index, if any
+	std::optional<std::string_view> resolve_stem(std::string_view stem) const
+	{
+		const auto it = std::ranges::lower_bound(stem_index, stem, {}, &std::pair<std::string_view, std::string_view>::first);
+		if (it == stem_index.end() || it->first != stem)
+			{ return {}; }
+		return it->second;
+	}
+
+	// build a fuzzy index over all words, replacing any existing one. suggest() can then find words close to a query.
+	// the index is kept as-is when the file is rewritten, so words added afterwards are not suggested until it is rebuilt
+	// this stores a hash of every variant of every word with up to max_distance characters deleted,
+	// so the index is about 12 * max_distance * total_words_len bytes for max_distance 1
+	// words that have not been flushed will be flushed first
+	// Complexity: O(n_variants * log(n_variants)), where n_variants is O(n_words * avg_word_len^max_distance)
+	// File Access: that of set_extension(), with data size 12 + n_words * 4 + n_variants * 12 + total_words_len
+	// @param max_distance  maximum edit distance of suggestions
+	// @throws std::runtime_error  on file i/o error
+	// @throws std::logic_error  if there is no associated file, the file is mapped, or max_distance is not 1 or 2
+	void build_fuzzy_index(std::uint32_t max_distance = 1)
+	{
+		if (file_open_type == open_type::no_file)
+			{ throw std::logic_error("No associated file. Call open(string_view) first"); }
+		if (mapping.is_open())
+			{ throw std::logic_error("File is mapped read only. Call open(string_view) first"); }
+		if (max_distance == 0 || max_distance > 2)
+			{ throw std::logic_error("Fuzzy index distance must be 1 or 2"); }
+		flush();
+
+		// pairs of variant hash and word number
+		std::vector<std::pair<std::uint64_t, std::uint32_t>> entries;
+		entries.reserve(words.total_len(0, words.size()) * max_distance + words.size());
+		for (std::size_t i = 0; i < words.size(); i++)
 		{
-			file.seekp(words_section_offset() + cur_words_total_len, std::ios::beg);
-			std::size_t bytes_written = 0;
-			for (std::size_t i = first_new_word; i < words.size(); i++)
+			fuzzy::for_each_delete(words.word(i), max_distance, [&](std::string_view variant)
+				{ entries.emplace_back(xxh64(std::as_bytes(std::span(variant))), static_cast<std::uint32_t>(i)); });
+		}
+		std::ranges::sort(entries);
+		entries.erase(std::ranges::unique(entries).begin(), entries.end());
+
+		std::vector<std::byte> data;
+		data.reserve(12 + words.size() * 4 + entries.size() * 12 + words.total_len(0, words.size()));
+		append_uint32_LE(max_distance, data);
+		append_uint32_LE(words.size(), data);
+		append_uint32_LE(entries.size(), data);
+		std::uint32_t pool_size = 0;
+		for (const auto& rec : words)
+		{
+			pool_size += words.word(rec).size();
+			append_uint32_LE(pool_size, data);
+		}
+		for (const auto [hash, word_num] : entries)
+		{
+			append_uint64_LE(hash, data);
+			append_uint32_LE(word_num, data);
+		}
+		for (const auto& rec : words)
+		{
+			const auto word_bytes = std::as_bytes(std::span(words.word(rec)));
+			data.insert(data.end(), word_bytes.begin(), word_bytes.end());
+		}
+
+		set_extension(ext_fuzzy_index, data);
+		fuzzy_buf = std::move(data);
+		fuzzy_index = fuzzy_buf;
+	}
+
+	// find words within the edit distance of the fuzzy index (see build_fuzzy_index()) of `word`,
+	// including `word` itself if it is in the index. edits are insertions, deletions, substitutions and adjacent transpositions
+	// Complexity: O(word_len^max_distance * log(n_variants) + n_candidates * word_len^2)
+	// File Access: No
+	// @param max_results  maximum number of words to return
+	// @throws std::runtime_error  if the fuzzy index is corrupted
+	// @return suggested words, by increasing distance and then in sorted order. empty if there is no fuzzy index.
+	//     the views are valid until the file is closed or reopened, or the index is rebuilt
+	std::vector<std::string_view> suggest(std::string_view word, std::size_t max_results = 8) const
+	{
+		if (fuzzy_index.empty())
+			{ return {}; }
+		const std::uint32_t max_distance = read_uint32_LE(fuzzy_index.first(4));
+		const std::uint32_t n_words = read_uint32_LE(fuzzy_index.subspan(4, 4));
+		const std::uint32_t n_entries = read_uint32_LE(fuzzy_index.subspan(8, 4));
+		const auto word_ends = fuzzy_index.subspan(12, static_cast<std::size_t>(n_words) * 4);
+		const auto entries = fuzzy_index.subspan(12 + word_ends.size(), static_cast<std::size_t>(n_entries) * 12);
+		const auto pool = fuzzy_index.subspan(12 + word_ends.size() + entries.size());
+		const auto entry_hash = [&](std::uint32_t i) { return read_uint64_LE(entries.subspan(static_cast<std::size_t>(i) * 12, 8)); };
+
+		std::vector<std::uint32_t> candidates;
+		fuzzy::for_each_delete(word, max_distance, [&](std::string_view variant)
+		{
+			const auto hash = xxh64(std::as_bytes(std::span(variant)));
+			const auto inds = std::views::iota(std::uint32_t(0), n_entries);
+			auto it = std::ranges::partition_point(inds, [&](std::uint32_t i) { return entry_hash(i) < hash; });
+			for (; it != inds.end() && entry_hash(*it) == hash; ++it)
+				{ candidates.push_back(read_uint32_LE(entries.subspan(static_cast<std::size_t>(*it) * 12 + 8, 4))); }
+		});
+		std::ranges::sort(candidates);
+		candidates.erase(std::ranges::unique(candidates).begin(), candidates.end());
+
+		// pairs of distance and word
+		std::vector<std::pair<std::uint32_t, std::string_view>> results;
+		for (const auto word_num : candidates)
+		{
+			if (word_num >= n_words)
+				{ throw std::runtime_error("Fuzzy index entry out of range. File may be corrupted"); }
+			// word ends were validated on load
+			const std::uint32_t word_start = (word_num == 0 ? 0 : read_uint32_LE(word_ends.subspan((word_num - 1) * 4, 4)));
+			const std::uint32_t word_end = read_uint32_LE(word_ends.subspan(word_num * 4, 4));
+			const std::string_view candidate(reinterpret_cast<const char*>(pool.data()) + word_start, word_end - word_start);
+			const auto distance = fuzzy::edit_distance(word, candidate, max_distance);
+			if (distance <= max_distance)
+				{ results.emplace_back(distance, candidate); }
+		}
+		std::ranges::sort(results);
+		std::vector<std::string_view> suggestions;
+		for (const auto& [distance, suggestion] : results | std::views::take(max_results))
+			{ suggestions.push_back(suggestion); }
+		return suggestions;
+	}
+
+	// set the full-text index from the text of definitions (e.g. as rendered, without markup), replacing any existing one.
+	// find_text() can then find the words whose text contains given terms (see text_index::for_each_term()).
+	// entries whose word is not in the dictionary are skipped, and the terms of repeated words are merged.
+	// the index is kept as-is when the file is rewritten, so words added afterwards are not found until it is rebuilt
+	// words that have not been flushed will be flushed first
+	// Complexity: O(total_text_len + n_postings * log(n_postings) + n_terms * log(n_terms))
+	// File Access: that of set_extension(), with data size 8 + n_words * 4 + n_terms * 8 + total_words_len + total_terms_len
+	//     + about 1-2 bytes per distinct term of each word
+	// @param entries  range of pairs of word and text (both convertible to std::string_view)
+	// @throws std::runtime_error  on file i/o error
+	// @throws std::logic_error  if there is no associated file or the file is mapped
+	template<std::ranges::input_range R>
+	void set_text_index(R&& entries)
+	{
+		if (file_open_type == open_type::no_file)
+			{ throw std::logic_error("No associated file. Call open(string_view) first"); }
+		if (mapping.is_open())
+			{ throw std::logic_error("File is mapped read only. Call open(string_view) first"); }
+		flush();
+
+		std::vector<std::string> indexed;
+		std::unordered_map<std::string, std::uint32_t> term_ids;
+		// pairs of term id and entry number (in `indexed`)
+		std::vector<std::pair<std::uint32_t, std::uint32_t>> postings;
+		for (auto&& [entry_word, entry_text] : entries)
+		{
+			const std::string_view word(entry_word), text(entry_text);
+			if (!contains(word))
+				{ continue; }
+			const auto entry_num = static_cast<std::uint32_t>(indexed.size());
+			indexed.emplace_back(word);
+			text_index::for_each_term(text, [&](std::string_view term)
 			{
-				inds[i - first_new_word] = cur_words_total_len + bytes_written;
-				const auto& word = words[i].word;
-				file.write(word.c_str(), word.size() + 1); // write the null as well
-				bytes_written += word.size() + 1;
-			}
+				const auto [it, inserted] = term_ids.try_emplace(std::string(term), static_cast<std::uint32_t>(term_ids.size()));
+				postings.emplace_back(it->second, entry_num);
+			});
 		}
 
-		// write word inds
-		file.seekp(inds_section_offset() + first_new_word * 4, std::ios::beg);
-		for (const auto i : inds)
-			{ write_uint32_LE(i + 1); }
+		// renumber words and terms in sorted order, so that postings (and so results) are sorted by word
+		std::vector<std::uint32_t> order(indexed.size());
+		std::iota(order.begin(), order.end(), std::uint32_t(0));
+		std::ranges::sort(order, {}, [&indexed](std::uint32_t i) -> const std::string& { return indexed[i]; });
+		std::vector<std::uint32_t> word_nums(indexed.size());
+		std::vector<std::string_view> unique_words;
+		for (const auto i : order)
+		{
+			if (unique_words.empty() || unique_words.back() != indexed[i])
+				{ unique_words.push_back(indexed[i]); }
+			word_nums[i] = static_cast<std::uint32_t>(unique_words.size() - 1);
+		}
+		std::vector<std::pair<std::string_view, std::uint32_t>> terms(term_ids.begin(), term_ids.end());
+		std::ranges::sort(terms);
+		std::vector<std::uint32_t> term_nums(terms.size());
+		for (std::size_t i = 0; i < terms.size(); i++)
+			{ term_nums[terms[i].second] = static_cast<std::uint32_t>(i); }
+		for (auto& posting : postings)
+			{ posting = { term_nums[posting.first], word_nums[posting.second] }; }
+		std::ranges::sort(postings);
+		postings.erase(std::ranges::unique(postings).begin(), postings.end());
 
-		// write def inds
-		file.seekp(inds_section_offset() + (reserved_words + first_new_word) * 4, std::ios::beg);
-		for (const auto [word, def_ind] : words | std::views::drop(first_new_word))
-			{ write_uint32_LE(def_ind + 1); }
+		std::vector<std::byte> encoded;
+		// postings end offset of each term
+		std::vector<std::uint32_t> ends(terms.size());
+		for (std::size_t i = 0; i < postings.size(); i++)
+		{
+			const auto [term, word] = postings[i];
+			const bool first = (i == 0 || postings[i - 1].first != term);
+			text_index::append_varint(first ? word : word - postings[i - 1].second, encoded);
+			ends[term] = static_cast<std::uint32_t>(encoded.size());
+		}
 
-		sort_words();
-		
-		// file will be flushed when closed and reopened
-		open_in();
-		return true;
+		std::vector<std::byte> data;
+		append_uint32_LE(unique_words.size(), data);
+		append_uint32_LE(terms.size(), data);
+		std::uint32_t pool_size = 0;
+		for (const auto word : unique_words)
+		{
+			pool_size += word.size();
+			append_uint32_LE(pool_size, data);
+		}
+		pool_size = 0;
+		for (std::size_t i = 0; i < terms.size(); i++)
+		{
+			pool_size += terms[i].first.size();
+			append_uint32_LE(pool_size, data);
+			append_uint32_LE(ends[i], data);
+		}
+		for (const auto word : unique_words)
+		{
+			const auto word_bytes = std::as_bytes(std::span(word));
+			data.insert(data.end(), word_bytes.begin(), word_bytes.end());
+		}
+		for (const auto term : terms | std::views::keys)
+		{
+			const auto term_bytes = std::as_bytes(std::span(term));
+			data.insert(data.end(), term_bytes.begin(), term_bytes.end());
+		}
+		data.insert(data.end(), encoded.begin(), encoded.end());
+
+		set_extension(ext_text_index, data);
+		fulltext_buf = std::move(data);
+		fulltext_index = fulltext_buf;
 	}
-	
+
+	// find words whose text in the full-text index (see set_text_index()) contains every term of `query`
+	// Complexity: O(n_query_terms * (log(n_terms) + n_postings_of_term))
+	// File Access: No
+	// @param max_results  maximum number of words to return
+	// @throws std::runtime_error  if the full-text index is corrupted
+	// @return matching words in sorted order. empty if there is no full-text index or `query` has no terms.
+	//     the views are valid until the file is closed or reopened, or the index is rebuilt
+	std::vector<std::string_view> find_text(std::string_view query, std::size_t max_results = -1) const
+	{
+		if (fulltext_index.empty())
+			{ return {}; }
+		// validated on load
+		const std::uint32_t n_words = read_uint32_LE(fulltext_index.first(4));
+		const std::uint32_t n_terms = read_uint32_LE(fulltext_index.subspan(4, 4));
+		const auto word_ends = fulltext_index.subspan(8, static_cast<std::size_t>(n_words) * 4);
+		const auto term_entries = fulltext_index.subspan(8 + word_ends.size(), static_cast<std::size_t>(n_terms) * 8);
+		const std::uint32_t word_pool_size = (n_words == 0 ? 0 : read_uint32_LE(word_ends.last(4)));
+		const std::uint32_t term_pool_size = (n_terms == 0 ? 0 : read_uint32_LE(term_entries.last(8).first(4)));
+		const auto word_pool = fulltext_index.subspan(8 + word_ends.size() + term_entries.size(), word_pool_size);
+		const auto term_pool = fulltext_index.subspan(8 + word_ends.size() + term_entries.size() + word_pool_size, term_pool_size);
+		const auto encoded = fulltext_index.subspan(8 + word_ends.size() + term_entries.size() + word_pool_size + term_pool_size);
+		const auto pool_str = [](std::span<const std::byte> pool, std::span<const std::byte> ends, std::size_t stride, std::uint32_t i)
+		{
+			const std::uint32_t start = (i == 0 ? 0 : read_uint32_LE(ends.subspan((i - 1) * stride, 4)));
+			const std::uint32_t end = read_uint32_LE(ends.subspan(i * stride, 4));
+			return std::string_view(reinterpret_cast<const char*>(pool.data()) + start, end - start);
+		};
+
+		std::optional<std::vector<std::uint32_t>> matches;
+		std::vector<std::uint32_t> term_words;
+		bool missing = false;
+		text_index::for_each_term(query, [&](std::string_view term)
+		{
+			if (missing)
+				{ return; }
+			const auto inds = std::views::iota(std::uint32_t(0), n_terms);
+			const auto it = std::ranges::partition_point(inds, [&](std::uint32_t i) { return pool_str(term_pool, term_entries, 8, i) < term; });
+			if (it == inds.end() || pool_str(term_pool, term_entries, 8, *it) != term)
+			{
+				missing = true;
+				return;
+			}
+			const std::uint32_t start = (*it == 0 ? 0 : read_uint32_LE(term_entries.subspan((*it - 1) * 8 + 4, 4)));
+			const std::uint32_t end = read_uint32_LE(term_entries.subspan(*it * 8 + 4, 4));
+			auto in = encoded.subspan(start, end - start);
+			term_words.clear();
+			while (!in.empty())
+			{
+				const auto delta = text_index::read_varint(in);
+				if (!delta)
+					{ throw std::runtime_error("Incorrect full-text index posting. File may be corrupted"); }
+				const std::uint64_t word = (term_words.empty() ? 0 : std::uint64_t(term_words.back())) + delta.value();
+				if (word >= n_words)
+					{ throw std::runtime_error("Incorrect full-text index posting. File may be corrupted"); }
+				term_words.push_back(static_cast<std::uint32_t>(word));
+			}
+			if (!matches)
+				{ matches = term_words; }
+			else
+			{
+				std::vector<std::uint32_t> both;
+				std::ranges::set_intersection(matches.value(), term_words, std::back_inserter(both));
+				matches = std::move(both);
+			}
+		});
+		if (missing || !matches)
+			{ return {}; }
+
+		std::vector<std::string_view> results;
+		for (std::size_t i = 0; i < matches->size() && i < max_results; i++)
+			{ results.push_back(pool_str(word_pool, word_ends, 4, (*matches)[i])); }
+		return results;
+	}
+
 	// TODO: something to add a stream of data (with part of definition added at a time)
 	// TODO: override def instead of ignoring if word exists
 	// If flush_words:
@@ -268,14 +1082,18 @@ public:
 	//     if false, contains(), num_words(), get_def(), and add_word<_, false>() will be slow, until flush() or add_word<true>() is called
 	//     repeatedly calling add_word<false, false> will result in minor slowdowns from dup checking, consider using add_word<false, true> instead
 	// @tparam skip_dup_check  whether to skip checking for duplicates. note that flushing is significantly slower than duplicate checking
+	// if definitions are compressed (see compress_defs()), `def` is compressed before being written
 	// @throws std::runtime_error  on file i/o or parsing error
 	// @throws std::logic_error  if there is no associated file
+	// @throws std::length_error  if the defs section would grow past what the file version can address (see check_def_ind())
 	// @return whether the word/def was successfully inserted
 	template<bool flush_words = true, bool skip_dup_check = false>
 	bool add_word(std::string_view word, std::span<const std::byte> def)
 	{
 		if (file_open_type == open_type::no_file)
 			{ throw std::logic_error("No associated file. Call open(string_view) first"); }
+		if (mapping.is_open())
+			{ throw std::logic_error("File is mapped read only. Call open(string_view) first"); }
 		if constexpr (!skip_dup_check)
 		{
 			if (find_def_ind(word) != -1)
@@ -284,10 +1102,15 @@ public:
 
 		if (first_new_word == -1)
 			{ first_new_word = words.size(); }
+
+		std::vector<std::byte> encoded;
+		def = encode_def(def, encoded);
 		
 		if (auto def_ind = (do_dedup ? get_existing_def_ind(def) : std::nullopt))
 		{
-			words.emplace_back(std::string(word), def_ind.value());
+			words.emplace_back(word, def_ind.value());
+			num_dedup_hits++;
+			count(counters.dedup_hits, std::uint64_t(1));
 		}
 		else
 		{
@@ -295,25 +1118,35 @@ public:
 			
 			// add def to words
 			file.seekg(0, std::ios::end);
+			count_io(1, 1);
 			std::streamoff cur_def_offset = file.tellg();
 			assert(cur_def_offset >= defs_section_offset());
 			cur_def_offset -= defs_section_offset();
 			if (cur_def_offset < 0)
 				{ throw std::runtime_error("Incorrect file size (too small)"); }
-			words.emplace_back(std::string(word), cur_def_offset);
+			const auto padding = align_def(cur_def_offset) - cur_def_offset;
+			cur_def_offset += padding;
+			check_def_ind(cur_def_offset);
+			words.emplace_back(word, cur_def_offset);
 			
-			auto hash = fnv1a(def);
+			auto hash = def_hash(def);
 
 			if (do_dedup)
 			{
 				// add def to existing_defs
-				existing_defs[def.size()][hash].push_back(cur_def_offset);
+				existing_defs.insert(def.size(), hash, cur_def_offset);
 			}
 			
 			// add def to file
+			write_nulls(padding);
 			write_uint32_LE(def.size());
 			write_uint64_LE(hash);
 			file.write(reinterpret_cast<const char*>(def.data()), def.size());
+			// make def visible to pread_file
+			file.flush();
+			check_file();
+			// appended after the defs of every word, wherever the word sorts
+			defs_clustered = false;
 		}
 		
 		if constexpr (flush_words)
@@ -322,34 +1155,1097 @@ public:
 	}
 	template<bool flush_words = true, bool skip_dup_check = false>
 	bool add_word(std::string_view word, std::span<const char> def) { return add_word<flush_words, skip_dup_check>(word, std::as_bytes(def)); }
+
+	// add multiple words at once. new defs are buffered and written in large batches,
+	// and words are flushed (sorted and merged) once at the end
+	// words which already exist, or are repeated in `entries`, are skipped
+	// Complexity: O(n_entries + total_defs_len) (+ O(n_entries * n_unflushed_words) if called after add_word<false>()),
+	//     plus that of flush() if flush_words
+	// File Access: Write, total_new_defs_len + n_new_defs * 12 bytes in batches of write_buffer_size bytes,
+	//     plus that of flush() if flush_words
+	// @tparam flush_words  whether to flush words after adding (see add_word())
+	// @tparam skip_dup_check  whether to skip checking for duplicate words. repeated words will cause flush() to throw
+	// @param entries  range of pairs of word (convertible to std::string_view) and def (contiguous range of bytes or chars)
+	// @throws std::runtime_error  on file i/o or parsing error
+	// @throws std::logic_error  if there is no associated file
+	// @return number of words inserted
+	template<bool flush_words = true, bool skip_dup_check = false, std::ranges::input_range R>
+	std::size_t add_words(R&& entries)
+	{
+		if (file_open_type == open_type::no_file)
+			{ throw std::logic_error("No associated file. Call open(string_view) first"); }
+		if (mapping.is_open())
+			{ throw std::logic_error("File is mapped read only. Call open(string_view) first"); }
+
+		open_in_out();
+		file.seekg(0, std::ios::end);
+		count_io(1, 0);
+		// offset of the start of `out` from the start of the defs section
+		std::streamoff out_offset = file.tellg();
+		assert(out_offset >= defs_section_offset());
+		out_offset -= defs_section_offset();
+		if (out_offset < 0)
+			{ throw std::runtime_error("Incorrect file size (too small)"); }
+
+		std::vector<std::byte> out;
+		// inds of defs in `out`, which can't be read from the file yet
+		def_table buffered_defs;
+		const auto write_out = [&]()
+		{
+			file.seekp(0, std::ios::end);
+			file.write(reinterpret_cast<const char*>(out.data()), out.size());
+			count_io(1, 1);
+			// make defs visible to pread_file
+			file.flush();
+			check_file();
+			buffered_defs.for_each([this](std::uint32_t size, std::uint64_t hash, std::uint64_t ind)
+				{ existing_defs.insert(size, hash, ind); });
+			out_offset += out.size();
+			out.clear();
+			buffered_defs.clear();
+		};
+		const auto find_buffered_def = [&](std::span<const std::byte> def, std::uint64_t hash) -> std::optional<std::uint64_t>
+		{
+			return buffered_defs.find_if(def.size(), hash, [&](std::uint64_t ind)
+				{ return std::ranges::equal(std::span(out).subspan(ind - out_offset + 12, def.size()), def); });
+		};
+
+		const std::size_t batch_start = words.size();
+		std::unordered_set<std::string> batch_words;
+		std::vector<std::byte> encoded;
+		std::size_t num_inserted = 0;
+		for (auto&& [entry_word, entry_def] : entries)
+		{
+			const std::string_view word(entry_word);
+			if constexpr (!skip_dup_check)
+			{
+				if (find_def_ind(word, batch_start) != -1 || !batch_words.emplace(word).second)
+					{ continue; }
+			}
+
+			if (first_new_word == -1)
+				{ first_new_word = words.size(); }
+
+			const auto def = encode_def(std::as_bytes(std::span(entry_def)), encoded);
+			assert(!def.empty());
+			const auto hash = def_hash(def);
+			std::optional<std::uint64_t> def_ind;
+			if (do_dedup)
+			{
+				def_ind = get_existing_def_ind(def);
+				if (!def_ind)
+					{ def_ind = find_buffered_def(def, hash); }
+			}
+			if (def_ind)
+			{
+				num_dedup_hits++;
+				count(counters.dedup_hits, std::uint64_t(1));
+			}
+			else
+			{
+				const std::uint64_t out_end = out_offset + out.size();
+				def_ind = align_def(out_end);
+				check_def_ind(def_ind.value());
+				out.resize(out.size() + (def_ind.value() - out_end));
+				append_uint32_LE(def.size(), out);
+				append_uint64_LE(hash, out);
+				out.insert(out.end(), def.begin(), def.end());
+				if (do_dedup)
+					{ buffered_defs.insert(def.size(), hash, def_ind.value()); }
+				defs_clustered = false;
+			}
+			words.emplace_back(word, def_ind.value());
+			num_inserted++;
+
+			if (out.size() >= write_buffer_size)
+				{ write_out(); }
+		}
+		if (!out.empty())
+			{ write_out(); }
+
+		if constexpr (flush_words)
+			{ flush(); }
+		return num_inserted;
+	}
 	
+	// absent words are usually rejected by the bloom filter, if there is one
 	// Complexity: O(log(n_words))
 	// File Access: No
 	bool contains(std::string_view word) const
 	{
-		std::uint32_t ind = find_def_ind(word);
+		const std::uint64_t ind = find_def_ind(word);
 		return (ind != -1);
 	}
 
-	// Complexity: O(1)
-	// File Access: no
-	std::size_t num_words() const noexcept
+	// cheaper version of contains() which may return false positives
+	// Complexity: O(1) if there is a bloom filter and all words are flushed, otherwise that of contains()
+	// File Access: No
+	// @return false if `word` is definitely not in the dictionary
+	bool maybe_contains(std::string_view word) const
 	{
-		return words.size();
+		if (!bloom_filter.empty() && first_new_word == -1)
+			{ return bloom_may_contain(word); }
+		return contains(word);
 	}
 
-	// Complexity: O(def_size)
-	// File Access: Read, def_size + 4 bytes
+	// find words starting with `prefix`, in sorted order
+	// words added with add_word<false>() are not included until flush() is called
+	// Complexity: O(log(n_words) + limit * prefix_len)
+	// File Access: No
+	// @param limit  maximum number of words to return
+	// @return lazy range of std::string_view (no allocation). invalidated by add_word()
+	// @throws std::logic_error  in lean mode (see open_mapped()), where prefix_bounds() and word_at() can be used instead
+	auto prefix_range(std::string_view prefix, std::size_t limit = -1) const
+	{
+		if (lean_words)
+			{ throw std::logic_error("Words are not in memory in lean mode. Use prefix_bounds() instead"); }
+		const std::size_t end_ind = ((first_new_word == -1) ? words.size() : first_new_word);
+		const std::size_t first = words.lower_bound(end_ind, prefix);
+		std::size_t last = first;
+		while (last < end_ind && last - first < limit && words.word(last).starts_with(prefix))
+			{ last++; }
+		return std::views::iota(first, last) | std::views::transform([this](std::size_t i) { return words.word(i); });
+	}
+
+	// range [first, last) of the indices (see word_at()) of the words starting with `prefix`, for looking up completions
+	// as they are typed. words added with add_word<false>() are not included until flush() is called
+	// Complexity: O(log(n_words) * prefix_len), or O(log(within_len) * prefix_len) with `within`
+	//     (plus O(word_sample_interval * word_len) in lean mode, see open_mapped())
+	// File Access: No (pages of the mapping may be faulted in, in lean mode)
+	// @param within  range to search in, which must contain the result, e.g. the result for a shorter prefix of `prefix`
+	// @throws std::runtime_error  in lean mode, if the words section is corrupted
+	std::pair<std::size_t, std::size_t> prefix_bounds(std::string_view prefix, std::pair<std::size_t, std::size_t> within = { 0, -1 }) const
+	{
+		const std::size_t end_ind = std::min(within.second, (first_new_word == -1) ? num_words() : first_new_word);
+		const auto search = [this, end_ind](std::size_t first, auto pred)
+			{ return (lean_words ? lean_partition_point(first, end_ind, pred) : words.partition_point(first, end_ind, pred)); };
+		const std::size_t first = search(std::min(within.first, end_ind), [prefix](std::string_view w) { return w < prefix; });
+		return { first, search(first, [prefix](std::string_view w) { return w.starts_with(prefix); }) };
+	}
+
+	// Complexity: O(word_len) (O(front_coding::block_size * word_len) in lean mode, see open_mapped())
+	// File Access: No (pages of the mapping may be faulted in, in lean mode)
+	// @param i  index of a word in sorted order, e.g. from prefix_bounds(). invalidated by add_word()
+	// @throws std::runtime_error  in lean mode, if the words section is corrupted
+	std::string word_at(std::size_t i) const
+	{
+		if (!lean_words)
+			{ return std::string(words.word(i)); }
+		std::string res;
+		for_each_lean_word(i, i + 1, [&res](std::size_t, std::string_view word) { res = word; return false; });
+		return res;
+	}
+
+	// call `f(def, words)` for every definition in file order, with the words (as std::span<const std::string_view>) which refer to it.
+	// shared definitions (see `deduplicate` in open()) are visited once. definitions are decoded like find(),
+	// and `def` and `words` are only valid during the call. words added with add_word<false>() are included
+	// definitions are read sequentially in large chunks, or through the mapping (advised as sequential) if mapped,
+	// so visiting every definition is much faster than calling find() for every word
+	// Complexity: O(n_words*log(n_words) + total_defs_size)
+	// File Access: Read, total_defs_size + n_defs * 12 bytes, in reads of at least scan_chunk_size bytes (No if mapped)
+	// @param check_defs  whether to verify definition hashes
+	// @throws std::runtime_error  on file i/o or decoding error, or if check_defs is set and a hash does not match
+	// @throws std::logic_error  if the file is not open, or in lean mode (see open_mapped())
+	template<typename F>
+	void for_each_def(F&& f, bool check_defs = false) const
+	{
+		if (!mapping.is_open() && !pread_file.is_open())
+			{ throw std::logic_error("File is not open. Call open(string_view) first"); }
+		if (lean_words)
+			{ throw std::logic_error("Words are not in memory in lean mode. Open the file without lean mode first"); }
+
+		// pairs of def_ind and index in words, in file order
+		std::vector<std::pair<std::uint64_t, std::uint32_t>> refs;
+		refs.reserve(words.size());
+		for (std::size_t i = 0; i < words.size(); i++)
+			{ refs.emplace_back(words[i].def_ind, static_cast<std::uint32_t>(i)); }
+		// already in file order if the file is clustered, unless defs are shared
+		if (!std::ranges::is_sorted(refs))
+			{ std::ranges::sort(refs); }
+
+		std::vector<std::string_view> def_words;
+		std::vector<std::byte> buf;
+		// the file is read in chunks starting at chunk_start, unless mapped
+		std::vector<std::byte> chunk;
+		std::uint64_t chunk_start = 0;
+		std::size_t chunk_len = 0;
+		// @return `len` bytes of the file at `off`, read into chunk if they aren't already
+		const auto read_at = [&](std::uint64_t off, std::size_t len) -> std::span<const std::byte>
+		{
+			if (off < chunk_start || off + len > chunk_start + chunk_len)
+			{
+				chunk.resize(std::max(len, scan_chunk_size));
+				chunk_start = off;
+				chunk_len = pread_file.read_some(off, chunk);
+				count_io(0, 1, chunk_len);
+				if (chunk_len < len)
+					{ throw std::runtime_error("Definition size is greater than file size. File may be corrupted"); }
+			}
+			return std::span(chunk).subspan(off - chunk_start, len);
+		};
+
+		// pages are dropped soon after being read while advised as sequential, so the advice is reset after the scan
+		struct advice_guard
+		{
+			const mapped_file& mapping;
+			explicit advice_guard(const mapped_file& mapping_) : mapping(mapping_) { mapping.advise(mapped_file::access_pattern::sequential); }
+			~advice_guard() { mapping.advise(mapped_file::access_pattern::normal); }
+		};
+		std::optional<advice_guard> guard;
+		if (mapping.is_open())
+			{ guard.emplace(mapping); }
+
+		for (std::size_t first = 0; first < refs.size();)
+		{
+			const auto def_ind = refs[first].first;
+			std::size_t last = first + 1;
+			while (last < refs.size() && refs[last].first == def_ind)
+				{ last++; }
+
+			std::span<const std::byte> stored;
+			std::uint64_t hash;
+			if (mapping.is_open())
+				{ std::tie(stored, hash) = def_view_and_hash(def_ind); }
+			else
+			{
+				const std::uint64_t def_off = defs_section_offset() + def_ind;
+				const auto header = read_at(def_off, 12);
+				const auto size = read_uint32_LE(header.first(4));
+				hash = read_uint64_LE(header.subspan(4, 8));
+				if (size == 0)
+					{ throw std::runtime_error("Read 0 definition size. File may be corrupted"); }
+				stored = read_at(def_off + 12, size);
+			}
+			if (check_defs && hash != def_hash(stored))
+				{ throw std::runtime_error("Definition hash does not match. File may be corrupted"); }
+
+			def_words.clear();
+			for (std::size_t i = first; i < last; i++)
+				{ def_words.push_back(words.word(refs[i].second)); }
+			f(decode_def(stored, buf), std::span<const std::string_view>(def_words));
+			first = last;
+		}
+	}
+
+	// Complexity: O(1)
+	// File Access: no
+	std::size_t num_words() const noexcept
+	{
+		return (lean_words ? num_lean_words : words.size());
+	}
+
+	// Complexity: O(1)
+	// File Access: No
+	// @return number of words added since the file was opened whose def was shared with an existing def instead of written (see `deduplicate` in open())
+	std::size_t num_deduplicated_defs() const noexcept
+	{
+		return num_dedup_hits;
+	}
+
+	// encoding of the data of every def, which the file only records for readers (see def_encoding.h).
+	// 0 for files which have never had it set
+	// Complexity: O(1)
+	// File Access: No
+	std::uint32_t def_encoding() const noexcept
+	{
+		return def_encoding_id;
+	}
+
+	// record that the data of every def is in encoding `id`, for readers (see def_encoding()). defs are stored as given either way,
+	// so this is meant for new files, or files whose defs have all been converted. it is kept as-is when the file is rewritten
+	// words that have not been flushed will be flushed first
+	// Complexity: O(n_extensions)
+	// File Access: that of set_extension(), with data size 4
 	// @throws std::runtime_error  on file i/o error
-	std::optional<std::vector<char>> find(std::string_view word, bool check_def = false)
+	// @throws std::logic_error  if there is no associated file or the file is mapped
+	void set_def_encoding(std::uint32_t id)
+	{
+		if (file_open_type == open_type::no_file)
+			{ throw std::logic_error("No associated file. Call open(string_view) first"); }
+		if (mapping.is_open())
+			{ throw std::logic_error("File is mapped read only. Call open(string_view) first"); }
+		flush();
+		std::vector<std::byte> data;
+		append_uint32_LE(id, data);
+		set_extension(ext_def_encoding, data);
+		def_encoding_id = id;
+	}
+
+	// whether definitions are laid out in the sorted order of their words, so that neighbouring words have neighbouring definitions
+	// rewrites (including compact()) lay definitions out in word order, and definitions added afterwards are appended out of order
+	// until the next rewrite. unknown for files written by older versions, which are reported as not clustered
+	// Complexity: O(1)
+	// File Access: No
+	bool is_clustered() const noexcept
+	{
+		return defs_clustered;
+	}
+
+	// check the structure of the file at `filename` without opening it, reporting every problem instead of throwing on the first:
+	// header fields, that every index entry is in bounds, that the hash index reaches every word and only valid entries,
+	// that words are unique, that every def referenced by a word or extension fits in the file with a non-zero size
+	// and a matching hash, that defs don't overlap, and the metadata checksum.
+	// only problems in the header stop the check, since the other sections can't be located without it
+	// Complexity: O(reserved_words + words_sect_size + N*log(N) + total_defs_size / n_threads), where N is number of words
+	// File Access: Map
+	// @param n_threads  number of threads to hash defs on
+	// @throws std::runtime_error  if the file can't be mapped
+	static fsck_report fsck(std::string_view filename, std::size_t n_threads = std::thread::hardware_concurrency())
+	{
+		fsck_report report;
+		const auto error = [&report](std::string msg) { report.errors.push_back(std::move(msg)); };
+		// holds the header fields, so that section offsets and def hashes can be computed as for an opened file
+		dictionary_file f;
+		f.filename = filename;
+		f.mapping.open(f.filename);
+		const auto data = f.mapping.data();
+
+		// header
+		if (data.size() < static_cast<std::size_t>(inds_section_offset(1)))
+		{
+			error("File is smaller than its header");
+			return report;
+		}
+		std::array<char, magic_bytes.size()> arr;
+		std::ranges::transform(data.first(magic_bytes.size()), arr.begin(), [](std::byte b) { return static_cast<char>(b); });
+		f.file_version = static_cast<std::uint8_t>(arr[version_byte_ind]);
+		arr[version_byte_ind] = magic_bytes[version_byte_ind];
+		if (!std::ranges::equal(magic_bytes, arr))
+		{
+			error("Incorrect magic bytes");
+			return report;
+		}
+		if (f.file_version == 0 || f.file_version > current_version)
+			{ error("Unsupported file version " + std::to_string(f.file_version)); }
+		else if (data.size() < static_cast<std::size_t>(f.inds_section_offset()))
+			{ error("File is smaller than its header"); }
+		if (!report.errors.empty())
+			{ return report; }
+		f.reserved_words = read_uint32_LE(data.subspan(magic_bytes.size(), 4));
+		f.words_sect_size = read_uint32_LE(data.subspan(magic_bytes.size() + 4, 4));
+		const std::uint32_t num_words = read_uint32_LE(data.subspan(num_words_offset(), 4));
+		if (f.reserved_words == 0)
+			{ error("Read 0 reserved words"); }
+		if (f.words_sect_size == 0)
+			{ error("Read 0 word section size"); }
+		if (num_words > f.reserved_words)
+			{ error("Number of words " + std::to_string(num_words) + " is greater than reserved words " + std::to_string(f.reserved_words)); }
+		if (f.file_version >= 2)
+		{
+			f.flags = read_uint32_LE(data.subspan(flags_offset(), 4));
+			if ((f.flags & ~known_flags) != 0 || (f.file_version < 4 && (f.flags & flag_front_coded_words) != 0))
+				{ error("Unknown flags set"); }
+		}
+		const std::uint32_t ext_ind = (f.file_version >= 3 ? read_uint32_LE(data.subspan(ext_ind_offset(), 4)) : 0);
+		if (static_cast<std::uintmax_t>(f.defs_section_offset()) > data.size())
+			{ error("Reported indices + words section sizes is greater than file size"); }
+		if (!report.errors.empty())
+			{ return report; }
+		const std::streamoff defs_off = f.defs_section_offset();
+
+		// stored defs referenced by words and extensions, with a description of the first referrer
+		std::vector<std::pair<std::uint64_t, std::string>> refs;
+		const auto describe_tag = [](std::uint32_t tag)
+		{
+			std::string res = "extension ";
+			for (int i = 0; i < 4; i++)
+				{ res += static_cast<char>((tag >> (i * 8)) & 0xFF); }
+			return res;
+		};
+		// a stored def, or empty if it doesn't fit in the file (which is reported when defs are checked)
+		const auto view_stored = [&](std::uint64_t def_ind) -> std::optional<std::span<const std::byte>>
+		{
+			try
+				{ return f.def_view_and_hash(def_ind, data, defs_off).first; }
+			catch (const std::exception&)
+				{ return {}; }
+		};
+
+		// extensions
+		if (ext_ind != 0)
+		{
+			refs.emplace_back(f.decode_def_ind(ext_ind), "extension table");
+			if (const auto table = view_stored(f.decode_def_ind(ext_ind)))
+			{
+				if (table->size() % 8 != 0)
+					{ error("Incorrect extension table size"); }
+				for (std::size_t i = 0; i + 8 <= table->size(); i += 8)
+				{
+					const std::uint32_t tag = read_uint32_LE(table->subspan(i, 4));
+					const std::uint32_t ind = read_uint32_LE(table->subspan(i + 4, 4));
+					if (ind == 0)
+					{
+						error(describe_tag(tag) + ": Read 0 extension index");
+						continue;
+					}
+					f.extensions.emplace_back(tag, f.decode_def_ind(ind));
+					refs.emplace_back(f.decode_def_ind(ind), describe_tag(tag));
+				}
+			}
+		}
+		if (const auto checksum_ind = f.find_extension(ext_metadata_checksum))
+		{
+			if (const auto checksum = view_stored(checksum_ind.value()))
+			{
+				if (checksum->size() != metadata_checksum_size)
+					{ error("Incorrect metadata checksum size"); }
+				else if (read_uint64_LE(checksum->first(8)) != xxh64(data.first(defs_off)))
+					{ error("Metadata checksum does not match"); }
+			}
+		}
+
+		// index entries. the first num_words entries are used, and the rest must be empty
+		const auto word_inds = data.subspan(f.inds_section_offset(), static_cast<std::size_t>(f.reserved_words) * 4);
+		const auto def_inds = data.subspan(f.inds_section_offset() + static_cast<std::size_t>(f.reserved_words) * 4, static_cast<std::size_t>(f.reserved_words) * 4);
+		const auto words_chars = std::string_view(reinterpret_cast<const char*>(data.data()) + f.words_section_offset(), f.words_sect_size);
+		// words of the main sections by entry, empty if their entry is invalid
+		std::vector<std::optional<std::string_view>> entry_words(num_words);
+		// decoded words if front coded, which entry_words refer to (never reallocated)
+		std::vector<std::string> decoded_words;
+		decoded_words.reserve(num_words);
+		const bool front_coded = (f.flags & flag_front_coded_words) != 0;
+		// block being decoded if front coded, empty if its word ind is invalid
+		std::optional<front_coding::block_reader> block;
+		for (std::uint32_t i = 0; i < f.reserved_words; i++)
+		{
+			const std::uint32_t word_ind = read_uint32_LE(word_inds.subspan(i * 4, 4));
+			const std::uint32_t def_ind = read_uint32_LE(def_inds.subspan(i * 4, 4));
+			const auto entry = "index entry " + std::to_string(i + 1);
+			if (i >= num_words)
+			{
+				if (word_ind != 0 || def_ind != 0)
+					{ error(entry + ": Unused entry is set"); }
+				continue;
+			}
+			if (front_coded)
+			{
+				if (i % front_coding::block_size == 0)
+				{
+					block.reset();
+					if (word_ind == 0 || word_ind - 1 >= f.words_sect_size)
+						{ error(entry + ": Word index out of range"); }
+					else
+						{ block.emplace(data.subspan(f.words_section_offset() + word_ind - 1, f.words_sect_size - (word_ind - 1))); }
+				}
+				else if (word_ind != read_uint32_LE(word_inds.subspan((i - 1) * 4, 4)))
+					{ error(entry + ": Word index does not match its block"); }
+				if (block)
+				{
+					if (const auto word = block->next())
+						{ entry_words[i] = decoded_words.emplace_back(word.value()); }
+					else
+					{
+						error(entry + ": Incorrect front coded word");
+						block.reset();
+					}
+				}
+			}
+			else if (word_ind == 0 || word_ind - 1 >= f.words_sect_size)
+				{ error(entry + ": Word index out of range"); }
+			else
+			{
+				const auto word_len = words_chars.substr(word_ind - 1).find('\0');
+				if (word_len == std::string_view::npos)
+					{ error(entry + ": Word is not null terminated"); }
+				else
+					{ entry_words[i] = words_chars.substr(word_ind - 1, word_len); }
+			}
+			if (def_ind == 0)
+				{ error(entry + ": Word has no definition"); }
+			else
+				{ refs.emplace_back(f.decode_def_ind(def_ind), entry_words[i] ? "word \"" + std::string(*entry_words[i]) + '"' : entry); }
+		}
+
+		// hash index (version 2+)
+		if (const std::uint64_t num_slots = f.hash_slot_count(); num_slots != 0)
+		{
+			const auto slots = data.subspan(f.hash_index_offset(), num_slots * 8);
+			std::vector<bool> seen(num_words);
+			std::size_t num_used = 0;
+			for (std::uint64_t slot = 0; slot < num_slots; slot++)
+			{
+				const std::uint32_t entry = read_uint32_LE(slots.subspan(slot * 8, 4));
+				if (entry == 0)
+					{ continue; }
+				num_used++;
+				const auto desc = "hash slot " + std::to_string(slot);
+				if (entry > num_words)
+					{ error(desc + ": Entry out of range"); }
+				else if (seen[entry - 1])
+					{ error(desc + ": Entry " + std::to_string(entry) + " is repeated"); }
+				else
+				{
+					seen[entry - 1] = true;
+					const auto& word = entry_words[entry - 1];
+					if (word && read_uint32_LE(slots.subspan(slot * 8 + 4, 4)) != word_hash(*word) >> 32)
+						{ error(desc + ": Tag does not match word \"" + std::string(*word) + '"'); }
+				}
+			}
+			if (num_used != num_words)
+				{ error("Hash index has " + std::to_string(num_used) + " entries for " + std::to_string(num_words) + " words"); }
+			// every word must be found by probing from its hash, as lookups do
+			for (std::uint32_t i = 0; i < num_words; i++)
+			{
+				if (!entry_words[i])
+					{ continue; }
+				const auto hash = word_hash(*entry_words[i]);
+				bool found = false;
+				for (std::uint64_t slot = hash % num_slots, j = 0; j < num_slots && !found; slot = (slot + 1) % num_slots, j++)
+				{
+					const std::uint32_t entry = read_uint32_LE(slots.subspan(slot * 8, 4));
+					if (entry == 0)
+						{ break; }
+					found = (entry == i + 1);
+				}
+				if (!found)
+					{ error("word \"" + std::string(*entry_words[i]) + "\": Not reachable through the hash index"); }
+			}
+		}
+
+		// words of word segments
+		std::vector<std::string_view> all_words;
+		all_words.reserve(num_words);
+		for (std::uint32_t i = 0; i < num_words; i++)
+		{
+			if (!entry_words[i])
+				{ continue; }
+			if (!all_words.empty() && report.words_sorted && all_words.back() >= *entry_words[i])
+				{ report.words_sorted = false; }
+			all_words.push_back(*entry_words[i]);
+		}
+		for (const auto [tag, seg_ind] : f.extensions)
+		{
+			if (tag != ext_word_segment)
+				{ continue; }
+			auto segment = view_stored(seg_ind).value_or(std::span<const std::byte>());
+			if (segment.empty())
+				{ continue; }
+			const std::uint32_t count = (segment.size() >= 4 ? read_uint32_LE(segment.first(4)) : 0);
+			segment = segment.subspan(std::min<std::size_t>(segment.size(), 4));
+			for (std::uint32_t i = 0; i < count; i++)
+			{
+				const std::uint32_t def_ind = (segment.size() >= 8 ? read_uint32_LE(segment.first(4)) : 0);
+				const std::uint32_t word_len = (segment.size() >= 8 ? read_uint32_LE(segment.subspan(4, 4)) : 0);
+				if (segment.size() < 8 || def_ind == 0 || segment.size() - 8 < word_len)
+				{
+					error(describe_tag(tag) + ": Incorrect word segment entry " + std::to_string(i));
+					break;
+				}
+				const auto word = std::string_view(reinterpret_cast<const char*>(segment.data()) + 8, word_len);
+				all_words.push_back(word);
+				refs.emplace_back(f.decode_def_ind(def_ind), "word \"" + std::string(word) + '"');
+				segment = segment.subspan(8 + word_len);
+			}
+		}
+		report.num_words = all_words.size();
+		std::ranges::sort(all_words);
+		for (auto it = all_words.begin(); (it = std::adjacent_find(it, all_words.end())) != all_words.end(); it = std::upper_bound(it, all_words.end(), *it))
+			{ error("word \"" + std::string(*it) + "\": Repeated"); }
+
+		// defs, in file order, hashed in parallel
+		std::ranges::stable_sort(refs, {}, &std::pair<std::uint64_t, std::string>::first);
+		refs.erase(std::ranges::unique(refs, {}, &std::pair<std::uint64_t, std::string>::first).begin(), refs.end());
+		report.num_defs = refs.size();
+		// end of each def after the defs section offset (including padding up to the next def), or 0 if it doesn't fit
+		std::vector<std::uint64_t> def_ends(refs.size());
+		n_threads = std::clamp<std::size_t>(n_threads, 1, refs.size() / min_defs_per_thread + 1);
+		std::vector<std::vector<std::string>> thread_errors(n_threads);
+		{
+			std::vector<std::jthread> workers;
+			workers.reserve(n_threads);
+			for (std::size_t t = 0; t < n_threads; t++)
+			{
+				workers.emplace_back([&, t]()
+				{
+					for (std::size_t i = refs.size() * t / n_threads; i < refs.size() * (t + 1) / n_threads; i++)
+					{
+						const auto& [def_ind, who] = refs[i];
+						try
+						{
+							const auto [def, hash] = f.def_view_and_hash(def_ind, data, defs_off);
+							def_ends[i] = f.align_def(def_ind + 12 + def.size());
+							if (hash != f.def_hash(def))
+								{ thread_errors[t].push_back(who + ": Definition hash does not match"); }
+						}
+						catch (const std::exception& e)
+							{ thread_errors[t].push_back(who + ": " + e.what()); }
+					}
+				});
+			}
+		}
+		for (auto& errors : thread_errors)
+			{ std::ranges::move(errors, std::back_inserter(report.errors)); }
+
+		std::uint64_t covered = 0, prev_end = 0;
+		for (std::size_t i = 0; i < refs.size(); i++)
+		{
+			if (def_ends[i] == 0)
+				{ continue; }
+			if (refs[i].first < prev_end)
+				{ error(refs[i].second + ": Definition overlaps the previous definition"); }
+			if (def_ends[i] > prev_end)
+			{
+				covered += def_ends[i] - std::max<std::uint64_t>(refs[i].first, prev_end);
+				prev_end = def_ends[i];
+			}
+		}
+		const std::uint64_t defs_size = f.align_def(data.size() - defs_off);
+		report.unreferenced_bytes = defs_size - std::min<std::uint64_t>(covered, defs_size);
+		return report;
+	}
+
+	// cheap enough to be called while lookups are running on other threads, but counters may be read mid-update
+	// Complexity: O(1)
+	// File Access: No
+	// @return counters since construction or the last reset_stats()
+	statistics stats() const noexcept
+	{
+		const auto load = [](const auto& counter) { return counter.load(std::memory_order_relaxed); };
+		statistics res;
+		res.finds = load(counters.finds);
+		res.hits = load(counters.hits);
+		res.misses = res.finds - std::min(res.hits, res.finds);
+		res.bytes_read = load(counters.bytes_read);
+		res.seeks = load(counters.seeks);
+		res.io_calls = load(counters.io_calls);
+		res.rewrites = load(counters.rewrites);
+		res.dedup_hits = load(counters.dedup_hits);
+		res.def_cache_hits = load(counters.def_cache_hits);
+		res.def_cache_misses = load(counters.def_cache_misses);
+		res.read_file_time = std::chrono::nanoseconds(load(counters.read_file_ns));
+		res.flush_time = std::chrono::nanoseconds(load(counters.flush_ns));
+		return res;
+	}
+
+	// set all counters of stats() to 0
+	// Complexity: O(1)
+	// File Access: No
+	void reset_stats() noexcept
+	{
+		for (auto* counter : { &counters.finds, &counters.hits, &counters.bytes_read, &counters.seeks, &counters.io_calls, &counters.rewrites,
+			&counters.dedup_hits, &counters.def_cache_hits, &counters.def_cache_misses })
+			{ counter->store(0, std::memory_order_relaxed); }
+		counters.read_file_ns.store(0, std::memory_order_relaxed);
+		counters.flush_ns.store(0, std::memory_order_relaxed);
+	}
+
+	// set the function which is passed stats() after every flush() which modified the file, and when the file is closed
+	// (by close() or destruction), e.g. to log them. an empty function disables it
+	// Complexity: O(1)
+	void set_stats_hook(stats_hook hook)
+	{
+		on_stats = std::move(hook);
+	}
+
+	// keep up to about `capacity` bytes of recently read definitions in memory, decoded, so that find() and find_view()
+	// of popular words skip reading and decoding them. 0 (the default) disables the cache.
+	// not used by lookups with check_def set, or for uncompressed definitions of mapped files (which aren't read or copied anyway)
+	// must not be called concurrently with lookups
+	// Complexity: O(n_shards)
+	// File Access: No
+	void set_def_cache_capacity(std::size_t capacity)
 	{
-		std::uint32_t ind = find_def_ind(word);
+		if (capacity == 0)
+			{ def_cache.reset(); }
+		else
+			{ def_cache = std::make_unique<sharded_lru_cache<std::uint64_t, cached_def>>(capacity); }
+	}
+
+	// compressed definitions are decompressed transparently.
+	// words which are not in the dictionary are looked up through the stem index, if there is one (see set_stem_index())
+	// uses positioned reads (or the mapping) only, so it is safe to call concurrently from multiple threads,
+	// as long as no non-const member function is called at the same time
+	// Complexity: O(def_size)
+	// File Access: Read, def_size + 12 bytes (No if mapped)
+	// @throws std::runtime_error  on file i/o or decoding error
+	std::optional<std::vector<char>> find(std::string_view word, bool check_def = false) const
+	{
+		const std::uint64_t ind = find_def_ind_or_stem(word);
+		count_find(ind != -1);
 		if (ind == -1)
 			{ return {}; }
-		return read_def_whole(ind, check_def);
+		if (use_def_cache(check_def))
+		{
+			const auto cached = read_cached_def(ind);
+			const auto chars = reinterpret_cast<const char*>(cached->data.data());
+			return std::vector<char>(chars, chars + cached->data.size());
+		}
+		std::vector<std::byte> buf;
+		std::span<const std::byte> def;
+		std::vector<char> stored;
+		if (mapping.is_open())
+		{
+			const auto [view, hash] = def_view_and_hash(ind);
+			if (check_def && hash != def_hash(view))
+				{ throw std::runtime_error("Definition hash does not match. File may be corrupted"); }
+			def = view;
+		}
+		else
+		{
+			stored = read_def_whole(ind, check_def);
+			if ((flags & flag_codec_prefix) == 0)
+				{ return stored; }
+			def = std::as_bytes(std::span(stored));
+		}
+		def = decode_def(def, buf);
+		const auto chars = reinterpret_cast<const char*>(def.data());
+		return std::vector<char>(chars, chars + def.size());
+	}
+
+	// find() for several words at once. definitions are read in file order rather than in the order of `words_`,
+	// and those at most max_merged_gap apart are read in one read, so random reads become mostly sequential.
+	// definitions in the def cache (see set_def_cache_capacity()) aren't read, and those read are added to it.
+	// safe to call concurrently like find()
+	// Complexity: O(n_words*log(n_words) + total_defs_size)
+	// File Access: Read, about one read of the defs (with 12 bytes each) and the gaps between them per run of nearby defs (No if mapped)
+	// @return definition of each of `words_`, in the same order, or empty if it isn't found
+	// @throws std::runtime_error  on file i/o or decoding error, or if check_def is set and a hash does not match
+	std::vector<std::optional<std::vector<char>>> find_many(std::span<const std::string_view> words_, bool check_def = false) const
+	{
+		std::vector<std::optional<std::vector<char>>> res(words_.size());
+		// pairs of def_ind and index in words_, in file order
+		std::vector<std::pair<std::uint64_t, std::size_t>> refs;
+		refs.reserve(words_.size());
+		for (std::size_t i = 0; i < words_.size(); i++)
+		{
+			const std::uint64_t ind = find_def_ind_or_stem(words_[i]);
+			count_find(ind != -1);
+			if (ind != -1)
+				{ refs.emplace_back(ind, i); }
+		}
+		std::ranges::sort(refs);
+
+		const bool use_cache = use_def_cache(check_def);
+		// refs [first, last) of each def which has to be read, in file order
+		std::vector<std::pair<std::size_t, std::size_t>> to_read;
+		// set the results of refs [first, last) to the decoded `def`
+		const auto set_results = [&](std::size_t first, std::size_t last, std::span<const std::byte> def)
+		{
+			const auto chars = reinterpret_cast<const char*>(def.data());
+			for (std::size_t i = first; i < last; i++)
+				{ res[refs[i].second].emplace(chars, chars + def.size()); }
+		};
+		for (std::size_t first = 0; first < refs.size();)
+		{
+			std::size_t last = first + 1;
+			while (last < refs.size() && refs[last].first == refs[first].first)
+				{ last++; }
+			if (use_cache)
+			{
+				if (const auto cached = def_cache->find(refs[first].first))
+				{
+					count(counters.def_cache_hits, std::uint64_t(1));
+					set_results(first, last, cached->data);
+					first = last;
+					continue;
+				}
+				count(counters.def_cache_misses, std::uint64_t(1));
+			}
+			to_read.emplace_back(first, last);
+			first = last;
+		}
+
+		std::vector<std::byte> buf;
+		// check and decode a stored def, caching it if use_cache
+		const auto add_def = [&](std::pair<std::size_t, std::size_t> def_refs, std::span<const std::byte> stored, std::uint64_t hash)
+		{
+			if (check_def && hash != def_hash(stored))
+				{ throw std::runtime_error("Definition hash does not match. File may be corrupted"); }
+			const auto def = decode_def(stored, buf);
+			set_results(def_refs.first, def_refs.second, def);
+			if (use_cache)
+			{
+				auto cached = std::make_shared<const cached_def>(std::vector<std::byte>(def.begin(), def.end()), hash);
+				def_cache->insert(refs[def_refs.first].first, cached, sizeof(cached_def) + cached->data.size());
+			}
+		};
+		if (mapping.is_open())
+		{
+			for (const auto def_refs : to_read)
+			{
+				const auto [stored, hash] = def_view_and_hash(refs[def_refs.first].first);
+				add_def(def_refs, stored, hash);
+			}
+			return res;
+		}
+
+		std::vector<std::byte> chunk;
+		for (std::size_t first = 0; first < to_read.size();)
+		{
+			const auto def_off = [&](std::size_t i) -> std::uint64_t { return defs_section_offset() + refs[to_read[i].first].first; };
+			// run of defs [first, last) which are close enough to be read at once
+			std::size_t last = first + 1;
+			while (last < to_read.size() && def_off(last) - def_off(last - 1) <= max_merged_gap)
+				{ last++; }
+			// the last def usually fits in batch_size, and is read further below if not
+			const std::uint64_t chunk_start = def_off(first);
+			chunk.resize(def_off(last - 1) - chunk_start + batch_size);
+			std::size_t chunk_len = pread_file.read_some(chunk_start, chunk);
+			count_io(0, 1, chunk_len);
+			for (std::size_t i = first; i < last; i++)
+			{
+				const std::size_t off = def_off(i) - chunk_start;
+				if (chunk_len < off + 12)
+					{ throw std::runtime_error("Definition offset is greater than file size. File may be corrupted"); }
+				const auto size = read_uint32_LE(std::span(chunk).subspan(off, 4));
+				const auto hash = read_uint64_LE(std::span(chunk).subspan(off + 4, 8));
+				if (size == 0)
+					{ throw std::runtime_error("Read 0 definition size. File may be corrupted"); }
+				if (chunk_len < off + 12 + size)
+				{
+					// the rest of a def which extends past the chunk
+					chunk.resize(off + 12 + size);
+					const auto rest_len = pread_file.read_some(chunk_start + chunk_len, std::span(chunk).subspan(chunk_len));
+					count_io(0, 1, rest_len);
+					chunk_len += rest_len;
+					if (chunk_len < off + 12 + size)
+						{ throw std::runtime_error("Definition size is greater than file size. File may be corrupted"); }
+				}
+				add_def(to_read[i], std::span(chunk).subspan(off + 12, size), hash);
+			}
+			first = last;
+		}
+		return res;
+	}
+
+	// retrieve a definition directly from the mapping, without copying
+	// words are looked up through the stem index like find()
+	// the returned span is valid until the file is closed or reopened.
+	// if the definition is compressed, it is decompressed into a buffer local to the calling thread
+	// (or taken from the def cache, see set_def_cache_capacity()) instead, and the span is only valid until the next call to find_view() on that thread
+	// Complexity: O(log(n_words)) (O(def_size) if check_def or compressed)
+	// File Access: No (pages of the mapping may be faulted in)
+	// @throws std::runtime_error  on corrupted definition
+	// @throws std::logic_error  if the file was not opened through open_mapped()
+	std::optional<std::span<const std::byte>> find_view(std::string_view word, bool check_def = false) const
+	{
+		if (const auto found = find_view_and_hash(word, check_def))
+			{ return found->first; }
+		return {};
+	}
+
+	// same as find_view(), but also returns the stored hash of the definition (which is of the stored bytes, before decompression)
+	// the hash changes whenever the definition does, so it can be used to tell if a copy is stale (e.g. as an http etag)
+	// Complexity: O(log(n_words)) (O(def_size) if check_def or compressed)
+	// File Access: No (pages of the mapping may be faulted in)
+	// @return pair of definition and stored hash
+	// @throws std::runtime_error  on corrupted definition
+	// @throws std::logic_error  if the file was not opened through open_mapped()
+	std::optional<std::pair<std::span<const std::byte>, std::uint64_t>> find_view_and_hash(std::string_view word, bool check_def = false) const
+	{
+		if (!mapping.is_open())
+			{ throw std::logic_error("File is not mapped. Call open_mapped(string_view) first"); }
+		const std::uint64_t ind = find_def_ind_or_stem(word);
+		count_find(ind != -1);
+		if (ind == -1)
+			{ return {}; }
+		if (use_def_cache(check_def))
+		{
+			// kept alive until the next call on this thread, even if evicted
+			thread_local std::shared_ptr<const cached_def> held;
+			held = read_cached_def(ind);
+			return std::pair(std::span<const std::byte>(held->data), held->hash);
+		}
+		const auto [def, hash] = def_view_and_hash(ind);
+		if (check_def && hash != def_hash(def))
+			{ throw std::runtime_error("Definition hash does not match. File may be corrupted"); }
+		thread_local std::vector<std::byte> buf;
+		return std::pair(decode_def(def, buf), hash);
+	}
+
+	// hint that the definitions of `words` will be looked up soon, so that their pages are read in the background
+	// (e.g. to warm up the page cache at startup). the first page of every definition is requested before any size is read,
+	// so that the reads overlap. words which aren't found or can't be read are skipped. does nothing unless mapped
+	// Complexity: O(n_words * log(n_words))
+	// File Access: No (the first page of each definition may be faulted in, after being read ahead)
+	// @param words  range of std::string_view
+	template<typename R>
+	void will_need(R&& words) const noexcept
+	{
+		if (!mapping.is_open())
+			{ return; }
+		try
+		{
+			std::vector<std::uint64_t> def_offs;
+			for (const std::string_view word : words)
+			{
+				const std::uint64_t ind = find_def_ind_or_stem(word);
+				if (ind == -1)
+					{ continue; }
+				def_offs.push_back(defs_section_offset() + ind);
+				mapping.will_need(def_offs.back(), 12);
+			}
+			// the rest of larger definitions, once their sizes can be read
+			for (const auto def_off : def_offs)
+			{
+				if (def_off > mapping.size() || mapping.size() - def_off < 12)
+					{ continue; }
+				mapping.will_need(def_off, 12 + read_uint32_LE(mapping.data().subspan(def_off, 4)));
+			}
+		}
+		catch (const std::exception&) {}
+	}
+
+	// pass a definition to `callback` in pieces of at most batch_size bytes, without materializing it
+	// words are looked up through the stem index like find()
+	// compressed definitions are decompressed incrementally.
+	// if check_def is set, the hash is only verified after the last piece has been passed to `callback`
+	// Complexity: O(def_size)
+	// File Access: Read, def_size + 12 bytes (No if mapped)
+	// @param callback  invoked with each piece as std::span<const std::byte>, which is only valid during the call
+	// @return whether `word` was found
+	// @throws std::runtime_error  on file i/o or decoding error, or if check_def is set and the hash does not match
+	template<std::invocable<std::span<const std::byte>> F>
+	bool find_stream(std::string_view word, F&& callback, bool check_def = false)
+	{
+		const std::uint64_t ind = find_def_ind_or_stem(word);
+		count_find(ind != -1);
+		if (ind == -1)
+			{ return false; }
+		auto hasher = make_def_hasher();
+		def_stream_decoder decoder(*this);
+		const auto consume = [&](std::span<const std::byte> stored)
+		{
+			if (check_def)
+				{ hasher.update(stored); }
+			decoder.decode(stored, callback);
+		};
+
+		std::uint64_t hash;
+		if (mapping.is_open())
+		{
+			const auto [def, stored_hash] = def_view_and_hash(ind);
+			hash = stored_hash;
+			for (std::size_t i = 0; i < def.size(); i += batch_size)
+				{ consume(def.subspan(i, std::min(batch_size, def.size() - i))); }
+		}
+		else
+		{
+			const auto def_off = defs_section_offset() + static_cast<std::streamoff>(ind);
+			file.seekg(def_off, std::ios::beg);
+			const auto size = read_uint32_LE();
+			check_file();
+			hash = read_uint64_LE();
+			check_file();
+			count_io(1, 2, 12);
+			if (size == 0)
+				{ throw std::runtime_error("Read 0 definition size. File may be corrupted"); }
+			for (int i = 0; i < (size - 1) / batch_size + 1; i++) // (size / batch_size) rounded up
+			{
+				const auto [data, read_amt] = read_def_batched(i, size, def_off + 12);
+				consume(std::as_bytes(std::span(data).first(read_amt)));
+			}
+		}
+		decoder.finish();
+		if (check_def && hash != hasher.digest())
+			{ throw std::runtime_error("Definition hash does not match. File may be corrupted"); }
+		return true;
 	}
 
 private:
+	// flush() without timing or reporting stats
+	bool flush_impl()
+	{
+		if (file_open_type == open_type::no_file)
+			{ throw std::logic_error("No associated file. Call open(string_view) first"); }
+		if (first_new_word == -1)
+		{
+			if (!mapping.is_open())
+				{ open_in(); }
+			return false;
+		}
+
+		open_in_out();
+		
+		std::size_t cur_words_total_len = words.total_len(0, first_new_word);
+		std::size_t words_total_len = cur_words_total_len + words.total_len(first_new_word, words.size());
+		if (num_segment_words != 0 || (flags & flag_front_coded_words) != 0 || words_sect_size < words_total_len || reserved_words < words.size())
+		{
+			// new words don't fit in the main sections (or main sections are frozen because segments exist or words are front coded)
+			// append them as a segment if the main sections are still larger than all segments,
+			// otherwise merge everything through a rewrite. this keeps the total cost of rewrites proportional to file size
+			const std::size_t num_new_words = words.size() - first_new_word;
+			const std::size_t num_main_words = first_new_word - num_segment_words;
+			if (file_version >= 3 && num_segment_words + num_new_words <= num_main_words)
+			{
+				append_word_segment();
+				update_bloom_filter();
+				write_metadata_checksum(file);
+				sort_words();
+				open_in();
+				return true;
+			}
+
+			sort_words();
+			const auto old_words_sect_size = words_sect_size;
+			while (words_sect_size < words_total_len)
+				{ words_sect_size *= 2; }
+			const auto old_reserved_words = reserved_words;
+			while (reserved_words < words.size())
+				{ reserved_words *= 2; }
+			rewrite_file(old_reserved_words, old_words_sect_size);
+			return true;
+		}
+
+		std::vector<std::streamoff> inds;
+		inds.resize(words.size() - first_new_word);
+
+		// write num words
+		file.seekp(num_words_offset(), std::ios::beg);
+		write_uint32_LE(words.size());
+		// num words, words, word inds and def inds
+		count_io(4, 4);
+
+		// write new words
+		{
+			file.seekp(words_section_offset() + cur_words_total_len, std::ios::beg);
+			std::size_t bytes_written = 0;
+			for (std::size_t i = first_new_word; i < words.size(); i++)
+			{
+				inds[i - first_new_word] = cur_words_total_len + bytes_written;
+				const auto word = words.word(i);
+				file.write(word.data(), word.size());
+				file.put('\0');
+				bytes_written += word.size() + 1;
+			}
+		}
+
+		// write word inds
+		file.seekp(inds_section_offset() + first_new_word * 4, std::ios::beg);
+		for (const auto i : inds)
+			{ write_uint32_LE(i + 1); }
+
+		// write def inds
+		file.seekp(inds_section_offset() + (reserved_words + first_new_word) * 4, std::ios::beg);
+		for (std::size_t i = first_new_word; i < words.size(); i++)
+			{ write_uint32_LE(encode_def_ind(words[i].def_ind)); }
+
+		// insert new entries into hash index. only modified slots are written
+		if (file_version >= 2)
+		{
+			std::vector<std::uint32_t> modified_slots;
+			modified_slots.reserve(words.size() - first_new_word);
+			for (std::size_t i = first_new_word; i < words.size(); i++)
+				{ modified_slots.push_back(insert_hash_slot(hash_slots, words.word(i), i + 1)); }
+			std::ranges::sort(modified_slots);
+			for (const auto slot : modified_slots)
+			{
+				file.seekp(hash_index_offset() + static_cast<std::streamoff>(slot) * 8, std::ios::beg);
+				write_uint32_LE(hash_slots[slot]);
+				write_uint32_LE(word_hash(words.word(hash_slots[slot] - 1)) >> 32);
+			}
+			count_io(modified_slots.size(), modified_slots.size());
+		}
+		update_bloom_filter();
+		write_metadata_checksum(file);
+
+		sort_words();
+		
+		// file will be flushed when closed and reopened
+		open_in();
+		return true;
+	}
+
 	// oper file as input
 	// leaves file as read only
 	void open_in()
@@ -443,6 +2339,23 @@ private:
 	}
 	void write_uint64_LE(std::uint64_t num) { write_uint64_LE(num, file); }
 
+	// expects `in` to contain at least 4 bytes
+	constexpr static std::uint32_t read_uint32_LE(std::span<const std::byte> in)
+	{
+		std::uint32_t val = 0;
+		for (std::size_t i = 0; i < 4; i++)
+			{ val += std::to_integer<std::uint32_t>(in[i]) << (i * 8); }
+		return val;
+	}
+	// expects `in` to contain at least 8 bytes
+	constexpr static std::uint64_t read_uint64_LE(std::span<const std::byte> in)
+	{
+		std::uint64_t val = 0;
+		for (std::size_t i = 0; i < 8; i++)
+			{ val += std::to_integer<std::uint64_t>(in[i]) << (i * 8); }
+		return val;
+	}
+
 	// expects file to be writable
 	static void write_nulls(std::size_t count, std::fstream& fout)
 	{
@@ -451,23 +2364,88 @@ private:
 	}
 	void write_nulls(std::size_t count) { write_nulls(count, file); }
 	
-	constexpr static std::streamoff inds_section_offset()
+	constexpr static std::streamoff num_words_offset()
+	{
+		return magic_bytes.size() + 4 + 4;
+	}
+	// version 2+
+	constexpr static std::streamoff flags_offset()
+	{
+		return num_words_offset() + 4;
+	}
+	// version 3+
+	constexpr static std::streamoff ext_ind_offset()
+	{
+		return flags_offset() + 4;
+	}
+	constexpr static std::streamoff inds_section_offset(std::uint8_t version)
+	{
+		return num_words_offset() + 4 + (version >= 2 ? 4 : 0) + (version >= 3 ? 4 : 0);
+	}
+	constexpr std::streamoff inds_section_offset() const
+		{ return inds_section_offset(file_version); }
+	constexpr static std::streamoff hash_index_offset(std::uint8_t version, std::uint32_t reserved_words_)
 	{
-		return magic_bytes.size() + 4 + 4 + 4;
+		return inds_section_offset(version) + static_cast<std::streamoff>(reserved_words_) * 4 * 2;
 	}
-	constexpr static std::streamoff words_section_offset(std::uint32_t reserved_words_)
+	constexpr std::streamoff hash_index_offset() const
+		{ return hash_index_offset(file_version, reserved_words); }
+	// 0 if there is no hash index
+	constexpr static std::uint64_t hash_slot_count(std::uint8_t version, std::uint32_t reserved_words_)
 	{
-		return inds_section_offset() + reserved_words_ * 4 * 2;
+		return (version >= 2 ? static_cast<std::uint64_t>(reserved_words_) * 2 : 0);
+	}
+	constexpr std::uint64_t hash_slot_count() const
+		{ return hash_slot_count(file_version, reserved_words); }
+	constexpr static std::streamoff words_section_offset(std::uint8_t version, std::uint32_t reserved_words_)
+	{
+		return hash_index_offset(version, reserved_words_) + static_cast<std::streamoff>(hash_slot_count(version, reserved_words_)) * 8;
 	}
 	constexpr std::streamoff words_section_offset() const
-		{ return words_section_offset(reserved_words); }
-	constexpr static std::streamoff defs_section_offset(std::uint32_t reserved_words_, std::uint32_t words_sect_size_)
+		{ return words_section_offset(file_version, reserved_words); }
+	constexpr static std::streamoff defs_section_offset(std::uint8_t version, std::uint32_t reserved_words_, std::uint32_t words_sect_size_)
 	{
-		return words_section_offset(reserved_words_) + words_sect_size_;
+		return words_section_offset(version, reserved_words_) + words_sect_size_;
 	}
 	constexpr std::streamoff defs_section_offset() const
-		{ return defs_section_offset(reserved_words, words_sect_size); }
+		{ return defs_section_offset(file_version, reserved_words, words_sect_size); }
 	
+	// defs (and extensions) start at multiples of this from the start of the defs section, and stored def offsets count in its units
+	constexpr static std::uint64_t def_alignment(std::uint8_t version)
+		{ return (version >= 4 ? def_alignment_v4 : 1); }
+	constexpr std::uint64_t def_alignment() const { return def_alignment(file_version); }
+	// @return `def_ind` rounded up to def_alignment()
+	constexpr std::uint64_t align_def(std::uint64_t def_ind) const
+	{
+		const auto align = def_alignment();
+		return (def_ind + align - 1) / align * align;
+	}
+	// @return the largest def_ind which can be stored (exclusive)
+	constexpr std::uint64_t def_offset_limit() const { return std::numeric_limits<std::uint32_t>::max() * def_alignment(); }
+
+	// @throws std::length_error  if `def_ind` can't be stored
+	void check_def_ind(std::uint64_t def_ind) const
+	{
+		if (def_ind < def_offset_limit())
+			{ return; }
+		if (file_version < 4)
+			{ throw std::length_error("Defs section is too large for file version " + std::to_string(file_version) + " (rewrite the file, e.g. with compact(), to convert it)"); }
+		throw std::length_error("Defs section is too large");
+	}
+	// @param def_ind  offset from the start of the defs section, aligned to def_alignment()
+	// @return 1-based index as stored in the file
+	// @throws std::length_error  if `def_ind` can't be stored
+	std::uint32_t encode_def_ind(std::uint64_t def_ind) const
+	{
+		assert(def_ind % def_alignment() == 0);
+		check_def_ind(def_ind);
+		return static_cast<std::uint32_t>(def_ind / def_alignment() + 1);
+	}
+	// @param ind  non-zero index as stored in the file
+	// @return offset from the start of the defs section
+	constexpr std::uint64_t decode_def_ind(std::uint32_t ind) const
+		{ return static_cast<std::uint64_t>(ind - 1) * def_alignment(); }
+
 	constexpr static std::uint64_t fnv_init = 0xcbf29ce484222325;
 	
 	// @param init  value to use for hash initialization. can be used to continue calculating a hash with additional data
@@ -482,84 +2460,102 @@ private:
 		return hash;
 	}
 
+	// hash used for the hash index
+	static std::uint64_t word_hash(std::string_view word)
+	{
+		return fnv1a(std::as_bytes(std::span(word)));
+	}
+
+	// streaming hasher for defs, using FNV-1a or XXH64
+	class def_hasher
+	{
+	private:
+		bool use_xxh64;
+		std::uint64_t fnv_hash = fnv_init;
+		xxh64_hasher xxh;
+
+	public:
+		constexpr explicit def_hasher(bool use_xxh64_) : use_xxh64(use_xxh64_) {}
+
+		constexpr void update(std::span<const std::byte> data)
+		{
+			if (use_xxh64)
+				{ xxh.update(data); }
+			else
+				{ fnv_hash = fnv1a(data, fnv_hash); }
+		}
+
+		constexpr std::uint64_t digest() const
+			{ return (use_xxh64 ? xxh.digest() : fnv_hash); }
+	};
+
+	// @return hasher for defs of this file, according to flags
+	def_hasher make_def_hasher() const
+		{ return def_hasher((flags & flag_xxh64) != 0); }
+
+	// hash of a (stored) def, according to flags
+	std::uint64_t def_hash(std::span<const std::byte> def) const
+	{
+		if ((flags & flag_xxh64) != 0)
+			{ return xxh64(def); }
+		return fnv1a(def);
+	}
+
+	// insert an entry into a hash index (which must have at least one empty slot)
+	// Complexity: O(1) average
+	// File Access: No
+	// @param entry  entry number (starting from 1)
+	// @return slot which entry was inserted into
+	static std::uint32_t insert_hash_slot(std::vector<std::uint32_t>& slots, std::string_view word, std::uint32_t entry)
+	{
+		assert(entry != 0);
+		std::uint64_t slot = word_hash(word) % slots.size();
+		while (slots[slot] != 0)
+			{ slot = (slot + 1) % slots.size(); }
+		slots[slot] = entry;
+		return slot;
+	}
+
 	// @param expected_size  expected size, or 0 to skip size checking
 	// @return pair of size and hash or { 0, 0 } if size does not match expected
-	std::pair<std::uint32_t, std::uint64_t> get_def_size_and_hash(std::uint32_t def_ind, std::uint32_t expected_size, std::streamoff defs_section_offset_)
+	std::pair<std::uint32_t, std::uint64_t> get_def_size_and_hash(std::uint64_t def_ind, std::uint32_t expected_size, std::streamoff defs_section_offset_)
 	{
-		auto def_off = defs_section_offset_ + def_ind;
+		auto def_off = defs_section_offset_ + static_cast<std::streamoff>(def_ind);
 		file.seekg(def_off, std::ios::beg);
 		std::uint32_t size = read_uint32_LE();
 		check_file();
+		count_io(1, 1, 4);
 		if (size == 0)
 			{ throw std::runtime_error("Read 0 definition size. File may be corrupted"); }
 		if (expected_size != 0 && size != expected_size)
 			{ return {0, 0}; }
 		std::uint64_t hash = read_uint64_LE();
 		check_file();
+		count_io(0, 1, 8);
 		return { size, hash };
 	}
-	auto get_def_size_and_hash(std::uint32_t def_ind, std::uint32_t expected_size = 0) { return get_def_size_and_hash(def_ind, expected_size, defs_section_offset()); }
+	auto get_def_size_and_hash(std::uint64_t def_ind, std::uint32_t expected_size = 0) { return get_def_size_and_hash(def_ind, expected_size, defs_section_offset()); }
 	
 	// retrieve hash of definition from file (fast)
 	// @param expected_size  expected size, or 0 to skip size checking
 	// @return hash, or nullopt if size does not match expected_size
-	std::optional<std::uint64_t> get_def_hash(std::uint32_t def_ind, std::uint32_t expected_size, std::streamoff defs_section_offset_)
+	std::optional<std::uint64_t> get_def_hash(std::uint64_t def_ind, std::uint32_t expected_size, std::streamoff defs_section_offset_)
 	{
 		auto [size, hash] = get_def_size_and_hash(def_ind, expected_size, defs_section_offset_);
 		if (size == 0)
 			{ return {}; }
 		return hash;
 	}
-	auto get_def_hash(std::uint32_t def_ind, std::uint32_t expected_size = 0) { return get_def_hash(def_ind, expected_size, defs_section_offset()); }
-	
-	// hash definition found in file (slow)
-	// should only be used to verify hashes on open()
-	// @param expected_size  expected size, or 0 to skip size checking
-	// @return hash, or nullopt if size does not match expected_size
-	std::optional<std::uint64_t> hash_existing_def(std::uint32_t def_ind, std::uint32_t expected_size = 0)
-	{
-		std::uint64_t hash = fnv_init;
-
-		auto def_off = defs_section_offset() + def_ind;
-		file.seekg(def_off, std::ios::beg);
-		std::uint32_t size = read_uint32_LE();
-		check_file();
-		if (size == 0)
-			{ throw std::runtime_error("Read 0 definition size. File may be corrupted"); }
-
-		if (expected_size != 0 && size != expected_size)
-			{ return {}; }
-		
-		file.ignore(8); // skip reading existing hash
-
-		for (int i = 0; i < (size - 1) / batch_size + 1; i++) // (size / batch_size) rounded up
-		{
-			const auto [data, read_amt] = read_def_batched(i, size, def_off + 12);
-			check_file();
-			hash = fnv1a(std::as_bytes(std::span(data).subspan(0, read_amt)), hash);
-		}
-		return hash;
-	}
+	auto get_def_hash(std::uint64_t def_ind, std::uint32_t expected_size = 0) { return get_def_hash(def_ind, expected_size, defs_section_offset()); }
 	
-	std::optional<std::uint32_t> get_existing_def_ind(std::span<const std::byte> def)
+	std::optional<std::uint64_t> get_existing_def_ind(std::span<const std::byte> def)
 	{
 		assert(!def.empty() && static_cast<std::uint32_t>(def.size()) == def.size());
+		if (existing_defs.empty())
+			{ return {}; }
 		const std::uint32_t size = def.size();
-		const auto it = existing_defs.find(size);
-		if (it != existing_defs.end())
-		{
-			const auto hash = fnv1a(def);
-			const auto it2 = it->second.find(hash);
-			if (it2 != it->second.end())
-			{
-				for (const auto def_ind : it2->second)
-				{
-					if (get_def_hash(def_ind, size) == hash)
-						{ return def_ind; }
-				}
-			}
-		}
-		return {};
+		const auto hash = def_hash(def);
+		return existing_defs.find_if(size, hash, [&](std::uint64_t def_ind) { return get_def_hash(def_ind, size) == hash; });
 	};
 	
 	// @throws std::runtime_error  if file is invalid
@@ -579,69 +2575,655 @@ private:
 	{
 		assert(words.empty());
 
+		file_version = current_version;
 		reserved_words = init_reserved_words;
 		words_sect_size = init_words_sect_size;
+		hash_slots.assign(hash_slot_count(), 0);
+		flags = flag_xxh64;
+		extensions.clear();
+		num_segment_words = 0;
+		lean_words = false;
+		word_sample.clear();
+		num_lean_words = 0;
+		defs_verified = true;
+		defs_clustered = true;
+		bloom_filter = {};
+		stem_index.clear();
+		fuzzy_index = {};
+		fulltext_index = {};
+		bloom_buf.clear();
+		stem_buf.clear();
+		fuzzy_buf.clear();
+		fulltext_buf.clear();
+		def_encoding_id = 0;
+		load_codec();
 
 		open_out();
 
 		// magic bytes
 		file.write(magic_bytes.data(), magic_bytes.size());
 
-		write_uint32_LE(reserved_words);
-		write_uint32_LE(words_sect_size);
-		write_uint32_LE(0); // no words yet
+		write_uint32_LE(reserved_words);
+		write_uint32_LE(words_sect_size);
+		write_uint32_LE(0); // no words yet
+		write_uint32_LE(flags);
+		write_uint32_LE(0); // no extensions
+
+		write_nulls(reserved_words * 4 * 2); // 4 bytes per index, once for words and once for defs
+		write_nulls(hash_slot_count() * 8); // empty hash index
+
+		write_nulls(words_sect_size); // no words yet
+
+		// we don't actually need to fill the defs section with nulls
+		// since defs will simply be appended to the end
+		extensions.emplace_back(ext_metadata_checksum, append_def(std::vector<std::byte>(metadata_checksum_size), file, defs_section_offset()));
+		write_extension_table(file, defs_section_offset());
+		open_in_out();
+		write_metadata_checksum(file);
+
+		open_in(); // re-open as read only
+		pread_file.open(filename);
+	}
+
+	// read `size` bytes at `off`, from the mapping if it is open or from `file` otherwise
+	// expects file to be readable or mapped
+	// Complexity: O(size) (O(1) if mapped)
+	// File Access: Read, size bytes (No if mapped)
+	// @param buf  buffer to read into if not mapped
+	// @return view of bytes read, valid until `buf` is modified or the file is closed
+	// @throws std::runtime_error  on file i/o error
+	std::span<const std::byte> read_section(std::streamoff off, std::size_t size, std::vector<std::byte>& buf)
+	{
+		if (mapping.is_open())
+		{
+			if (static_cast<std::uintmax_t>(off) > mapping.size() || mapping.size() - off < size)
+				{ throw std::runtime_error("Unexpected EOF"); }
+			return mapping.data().subspan(off, size);
+		}
+		buf.resize(size);
+		file.seekg(off, std::ios::beg);
+		file.read(reinterpret_cast<char*>(buf.data()), size);
+		check_file();
+		count_io(1, 1, size);
+		return buf;
+	}
+
+	// read a whole def (or extension) stored at `def_ind`, without decoding
+	// expects file to be readable or mapped
+	// Complexity: O(def_size)
+	// File Access: Read, 12 + def_size bytes (No if mapped)
+	// @param buf  buffer to read into if not mapped
+	// @return stored data (excluding size and hash), valid until `buf` is modified or the file is closed
+	// @throws std::runtime_error  on file i/o error or hash mismatch
+	std::span<const std::byte> read_stored_def(std::uint64_t def_ind, std::vector<std::byte>& buf, bool check_def, std::streamoff defs_section_offset_)
+	{
+		const auto def_off = defs_section_offset_ + static_cast<std::streamoff>(def_ind);
+		const auto def_header = read_section(def_off, 12, buf);
+		const auto size = read_uint32_LE(def_header.first(4));
+		const auto hash = read_uint64_LE(def_header.subspan(4, 8));
+		if (size == 0)
+			{ throw std::runtime_error("Read 0 definition size. File may be corrupted"); }
+		const auto data = read_section(def_off + 12, size, buf);
+		if (check_def && hash != def_hash(data))
+			{ throw std::runtime_error("Definition hash does not match. File may be corrupted"); }
+		return data;
+	}
+	std::span<const std::byte> read_stored_def(std::uint64_t def_ind, std::vector<std::byte>& buf, bool check_def = true) { return read_stored_def(def_ind, buf, check_def, defs_section_offset()); }
+
+	// append a def (or extension) to the end of `fout`, after padding to def_alignment()
+	// expects `fout` to be writable
+	// Complexity: O(def_size)
+	// File Access: Write, 12 + def_size bytes (plus padding)
+	// @param defs_sect_start  offset of the defs section in `fout`
+	// @return offset of the def from the start of the defs section
+	// @throws std::length_error  if the def would start past the offsets which can be stored
+	std::uint64_t append_def(std::span<const std::byte> def, std::fstream& fout, std::streamoff defs_sect_start) const
+	{
+		fout.seekp(0, std::ios::end);
+		assert(fout.tellp() >= defs_sect_start);
+		const std::uint64_t end = static_cast<std::streamoff>(fout.tellp()) - defs_sect_start;
+		const std::uint64_t def_ind = align_def(end);
+		check_def_ind(def_ind);
+		write_nulls(def_ind - end, fout);
+		write_uint32_LE(def.size(), fout);
+		write_uint64_LE(def_hash(def), fout);
+		fout.write(reinterpret_cast<const char*>(def.data()), def.size());
+		count_io(fout, 1, 1);
+		return def_ind;
+	}
+
+	static void append_uint32_LE(std::uint32_t num, std::vector<std::byte>& out)
+	{
+		for (std::size_t i = 0; i < 4; i++)
+			{ out.push_back(static_cast<std::byte>((num >> (i * 8)) & 0xFF)); }
+	}
+	static void append_uint64_LE(std::uint64_t num, std::vector<std::byte>& out)
+	{
+		for (std::size_t i = 0; i < 8; i++)
+			{ out.push_back(static_cast<std::byte>((num >> (i * 8)) & 0xFF)); }
+	}
+
+	// add extension `tag` with contents `data`, replacing any existing one, and leave file as read only
+	// Complexity: O(data_size + n_extensions)
+	// File Access: Write, 12 + data_size + 12 + 16 + n_extensions * 8 + 4 bytes
+	//     (or File Access of rewrite_file() if the file is older than version 3)
+	void set_extension(std::uint32_t tag, const std::vector<std::byte>& data)
+	{
+		if (file_version < 3)
+		{
+			// rewrite converts to a version with extensions
+			std::vector<std::pair<std::uint32_t, std::vector<std::byte>>> new_extensions;
+			new_extensions.emplace_back(tag, data);
+			rewrite_file(reserved_words, words_sect_size, false, new_extensions);
+			return;
+		}
+		open_in_out();
+		std::erase_if(extensions, [tag](const auto& ext) { return ext.first == tag; });
+		extensions.emplace_back(tag, append_def(data, file, defs_section_offset()));
+		write_extension_table(file, defs_section_offset());
+		write_metadata_checksum(file);
+		open_in();
+	}
+
+	// append the extension table to the end of `fout` and point the header to it
+	// expects `fout` to be writable and at least version 3
+	// Complexity: O(n_extensions)
+	// File Access: Write, 16 + n_extensions * 8 bytes
+	// @param defs_sect_start  offset of the defs section in `fout`
+	void write_extension_table(std::fstream& fout, std::streamoff defs_sect_start) const
+	{
+		assert(!extensions.empty());
+		std::vector<std::byte> table;
+		table.reserve(extensions.size() * 8);
+		for (const auto [tag, ext_ind] : extensions)
+		{
+			append_uint32_LE(tag, table);
+			append_uint32_LE(encode_def_ind(ext_ind), table);
+		}
+		const auto table_ind = append_def(table, fout, defs_sect_start);
+		fout.seekp(ext_ind_offset(), std::ios::beg);
+		write_uint32_LE(encode_def_ind(table_ind), fout);
+		count_io(fout, 1, 1);
+	}
+
+	// append words [first_new_word, words.size()) to the file as a new word segment
+	// expects file to be writable and at least version 3
+	// Complexity: O(n_new_words + total_new_words_len + n_extensions)
+	// File Access: Write, 12 + total_new_words_len + n_new_words * 8 + 16 + n_extensions * 8 + 4 bytes
+	void append_word_segment()
+	{
+		assert(file_version >= 3 && first_new_word != -1);
+		std::vector<std::byte> segment;
+		segment.reserve(4 + (words.size() - first_new_word) * 8 + words.total_len(first_new_word, words.size()));
+		append_uint32_LE(words.size() - first_new_word, segment);
+		for (std::size_t i = first_new_word; i < words.size(); i++)
+		{
+			const auto word = std::as_bytes(std::span(words.word(i)));
+			append_uint32_LE(encode_def_ind(words[i].def_ind), segment);
+			append_uint32_LE(word.size(), segment);
+			segment.insert(segment.end(), word.begin(), word.end());
+		}
+		extensions.emplace_back(ext_word_segment, append_def(segment, file, defs_section_offset()));
+		write_extension_table(file, defs_section_offset());
+		num_segment_words += words.size() - first_new_word;
+	}
+
+	// XXH64 of bytes [0, defs_section_offset()) of `f`
+	// expects `f` to be readable
+	// Complexity: O(reserved_words + words_sect_size)
+	// File Access: Read, defs_section_offset() bytes
+	// @throws std::runtime_error  on file i/o error
+	std::uint64_t metadata_checksum(std::fstream& f) const
+	{
+		xxh64_hasher hasher;
+		std::vector<char> buf(std::min<std::size_t>(write_buffer_size, defs_section_offset()));
+		f.seekg(0, std::ios::beg);
+		count_io(f, 1, 0);
+		for (std::streamoff off = 0; off < defs_section_offset(); off += buf.size())
+		{
+			const auto read_amt = std::min<std::size_t>(buf.size(), defs_section_offset() - off);
+			f.read(buf.data(), read_amt);
+			check_file(f);
+			count_io(f, 0, 1, read_amt);
+			hasher.update(std::as_bytes(std::span(buf).first(read_amt)));
+		}
+		return hasher.digest();
+	}
+	// expects file to be readable or mapped
+	// File Access: Read, defs_section_offset() bytes (No if mapped)
+	std::uint64_t metadata_checksum()
+	{
+		if (mapping.is_open())
+			{ return xxh64(mapping.data().first(defs_section_offset())); }
+		return metadata_checksum(file);
+	}
+
+	// update the metadata checksum extension in place, if there is one
+	// expects `f` to be readable and writable, and all sections before the defs section to be final
+	// Complexity: O(reserved_words + words_sect_size)
+	// File Access: Read, defs_section_offset() bytes; Write, 8 + metadata_checksum_size bytes
+	// @throws std::runtime_error  on file i/o error
+	void write_metadata_checksum(std::fstream& f) const
+	{
+		const auto checksum_ind = find_extension(ext_metadata_checksum);
+		if (!checksum_ind)
+			{ return; }
+		std::vector<std::byte> data;
+		data.reserve(metadata_checksum_size);
+		append_uint64_LE(metadata_checksum(f), data);
+		append_uint32_LE((defs_verified ? checksum_defs_verified : 0) | (defs_clustered ? checksum_defs_clustered : 0), data);
+		append_uint32_LE(0, data);
+		f.seekp(defs_section_offset() + static_cast<std::streamoff>(checksum_ind.value()) + 4, std::ios::beg); // skip size
+		write_uint64_LE(def_hash(data), f);
+		f.write(reinterpret_cast<const char*>(data.data()), data.size());
+		check_file(f);
+		count_io(f, 1, 1);
+	}
+
+	// Complexity: O(k)
+	// File Access: No
+	// @return false if `word` is definitely not in the filter. true if there is no filter
+	bool bloom_may_contain(std::string_view word) const noexcept
+	{
+		if (bloom_filter.empty())
+			{ return true; }
+		return bloom::may_contain(bloom_filter.subspan(8), read_uint32_LE(bloom_filter.first(4)), word);
+	}
+
+	// set bits of `word` in bloom_buf, which must contain a filter
+	// Complexity: O(k)
+	void bloom_insert(std::string_view word)
+		{ bloom::insert(std::span(bloom_buf).subspan(8), read_uint32_LE(std::span(bloom_buf).first(4)), word); }
+
+	// build a bloom filter over all words in bloom_buf, sized for reserved_words
+	// Complexity: O(n_words + reserved_words * bits_per_word / 8)
+	// File Access: No
+	// @throws std::length_error  if the filter would be larger than a def can be
+	void build_bloom_filter(std::uint32_t bits_per_word)
+	{
+		const std::uint64_t num_bits = std::max<std::uint64_t>(64, (static_cast<std::uint64_t>(reserved_words) * bits_per_word + 63) / 64 * 64);
+		if (num_bits / 8 + 8 > std::numeric_limits<std::uint32_t>::max())
+			{ throw std::length_error("Bloom filter is too large"); }
+		bloom_buf.clear();
+		bloom_buf.reserve(8 + num_bits / 8);
+		append_uint32_LE(bloom::num_hashes(bits_per_word), bloom_buf);
+		append_uint32_LE(bits_per_word, bloom_buf);
+		bloom_buf.resize(8 + num_bits / 8);
+		for (const auto& rec : words)
+			{ bloom_insert(words.word(rec)); }
+		bloom_filter = bloom_buf;
+	}
+
+	// add words [first_new_word, words.size()) to the bloom filter, and write it in place
+	// does nothing if there is no filter
+	// expects file to be writable
+	// Complexity: O(n_new_words + reserved_words * bits_per_word / 8)
+	// File Access: Write, 8 + bloom filter size bytes
+	// @throws std::runtime_error  on file i/o error
+	void update_bloom_filter()
+	{
+		const auto bloom_ind = find_extension(ext_bloom_filter);
+		if (!bloom_ind || bloom_buf.empty())
+			{ return; }
+		for (std::size_t i = first_new_word; i < words.size(); i++)
+			{ bloom_insert(words.word(i)); }
+		file.seekp(defs_section_offset() + static_cast<std::streamoff>(bloom_ind.value()) + 4, std::ios::beg); // skip size
+		write_uint64_LE(def_hash(bloom_buf));
+		file.write(reinterpret_cast<const char*>(bloom_buf.data()), bloom_buf.size());
+		check_file();
+		count_io(1, 1);
+	}
+
+	// @return offset of extension data from the start of the defs section, or nullopt if not found
+	std::optional<std::uint64_t> find_extension(std::uint32_t tag) const
+	{
+		const auto it = std::ranges::find(extensions, tag, &std::pair<std::uint32_t, std::uint64_t>::first);
+		if (it == extensions.end())
+			{ return {}; }
+		return it->second;
+	}
+
+	// set up codec state after flags and extensions are loaded
+	// expects file to be readable or mapped
+	// @throws std::runtime_error  on file i/o error
+	void load_codec()
+	{
+#ifdef SDICT_USE_ZSTD
+		zstd_cdict.reset();
+		zstd_ddict.reset();
+		zstd_dict.clear();
+		if (const auto dict_ind = find_extension(ext_zstd_dict))
+		{
+			std::vector<std::byte> buf;
+			const auto dict = read_stored_def(dict_ind.value(), buf);
+			zstd_dict.assign(dict.begin(), dict.end());
+			zstd_ddict.reset(ZSTD_createDDict(zstd_dict.data(), zstd_dict.size()));
+			if (!zstd_ddict)
+				{ throw std::runtime_error("Unable to load zstd dictionary. File may be corrupted"); }
+		}
+#endif
+	}
+
+	// encode a definition for storage, according to flags
+	// Complexity: O(def_size)
+	// File Access: No
+	// @param buf  buffer for the encoded definition
+	// @return encoded definition, either `def` itself or a view of `buf`
+	std::span<const std::byte> encode_def(std::span<const std::byte> def, std::vector<std::byte>& buf)
+	{
+		if ((flags & flag_codec_prefix) == 0)
+			{ return def; }
+#ifdef SDICT_USE_ZSTD
+		if (!zstd_cctx)
+			{ zstd_cctx.reset(ZSTD_createCCtx()); }
+		if (!zstd_cdict && !zstd_dict.empty())
+			{ zstd_cdict.reset(ZSTD_createCDict(zstd_dict.data(), zstd_dict.size(), zstd_level)); }
+		if (zstd_cctx)
+		{
+			buf.resize(1 + ZSTD_compressBound(def.size()));
+			buf[0] = std::byte(def_codec::zstd);
+			const std::size_t res = (zstd_cdict ?
+				ZSTD_compress_usingCDict(zstd_cctx.get(), buf.data() + 1, buf.size() - 1, def.data(), def.size(), zstd_cdict.get()) :
+				ZSTD_compressCCtx(zstd_cctx.get(), buf.data() + 1, buf.size() - 1, def.data(), def.size(), zstd_level));
+			// store raw if compression doesn't help
+			if (!ZSTD_isError(res) && res < def.size())
+			{
+				buf.resize(1 + res);
+				return buf;
+			}
+		}
+#endif
+		buf.resize(1 + def.size());
+		buf[0] = std::byte(def_codec::raw);
+		std::ranges::copy(def, buf.begin() + 1);
+		return buf;
+	}
+
+	// decode a stored definition, according to flags
+	// Complexity: O(def_size)
+	// File Access: No
+	// @param buf  buffer for the decoded definition
+	// @return decoded definition, either a subspan of `def` or a view of `buf`
+	// @throws std::runtime_error  on unknown codec or decoding error
+	std::span<const std::byte> decode_def(std::span<const std::byte> def, std::vector<std::byte>& buf) const
+	{
+		if ((flags & flag_codec_prefix) == 0)
+			{ return def; }
+		if (def.empty())
+			{ throw std::runtime_error("Missing definition codec. File may be corrupted"); }
+		const auto data = def.subspan(1);
+		switch (static_cast<def_codec>(def[0]))
+		{
+			case def_codec::raw:
+				return data;
+			case def_codec::zstd:
+			{
+#ifdef SDICT_USE_ZSTD
+				const auto size = ZSTD_getFrameContentSize(data.data(), data.size());
+				if (size == ZSTD_CONTENTSIZE_ERROR || size == ZSTD_CONTENTSIZE_UNKNOWN || size > std::numeric_limits<std::uint32_t>::max())
+					{ throw std::runtime_error("Invalid zstd frame. File may be corrupted"); }
+				thread_local std::unique_ptr<ZSTD_DCtx, zstd_deleter> dctx(ZSTD_createDCtx());
+				buf.resize(size);
+				const std::size_t res = (zstd_ddict ?
+					ZSTD_decompress_usingDDict(dctx.get(), buf.data(), buf.size(), data.data(), data.size(), zstd_ddict.get()) :
+					ZSTD_decompressDCtx(dctx.get(), buf.data(), buf.size(), data.data(), data.size()));
+				if (ZSTD_isError(res) || res != size)
+					{ throw std::runtime_error("Unable to decompress definition. File may be corrupted"); }
+				return buf;
+#else
+				throw std::runtime_error("Definition is zstd compressed, but zstd support is not enabled");
+#endif
+			}
+			default:
+				throw std::runtime_error("Unknown definition codec. File may be corrupted");
+		}
+	}
+
+	// incremental version of decode_def(), for defs which are read in pieces
+	class def_stream_decoder
+	{
+	private:
+		const dictionary_file& dict;
+		// whether the codec byte has been read (always true if defs are not codec prefixed)
+		bool has_codec;
+		def_codec codec = def_codec::raw;
+#ifdef SDICT_USE_ZSTD
+		std::unique_ptr<ZSTD_DCtx, zstd_deleter> dctx;
+		// last return value of ZSTD_decompressStream, 0 once a frame is complete
+		std::size_t zstd_res = 0;
+		std::array<std::byte, batch_size> out_buf;
+#endif
 
-		write_nulls(reserved_words * 4 * 2); // 4 bytes per index, once for words and once for defs
+		// @throws std::runtime_error  on unknown codec
+		void begin(def_codec codec_)
+		{
+			codec = codec_;
+			switch (codec)
+			{
+				case def_codec::raw:
+					break;
+				case def_codec::zstd:
+				{
+#ifdef SDICT_USE_ZSTD
+					dctx.reset(ZSTD_createDCtx());
+					if (!dctx || (dict.zstd_ddict && ZSTD_isError(ZSTD_DCtx_refDDict(dctx.get(), dict.zstd_ddict.get()))))
+						{ throw std::runtime_error("Unable to create zstd decompression context"); }
+					zstd_res = 1;
+					break;
+#else
+					throw std::runtime_error("Definition is zstd compressed, but zstd support is not enabled");
+#endif
+				}
+				default:
+					throw std::runtime_error("Unknown definition codec. File may be corrupted");
+			}
+		}
 
-		write_nulls(words_sect_size); // no words yet
+	public:
+		explicit def_stream_decoder(const dictionary_file& dict_) : dict(dict_), has_codec((dict_.flags & flag_codec_prefix) == 0) {}
 
-		// we don't actually need to fill the defs section with nulls
-		// since defs will simply be appended to the end
+		// decode the next piece of a stored def, passing decoded data to `callback`
+		// Complexity: O(stored.size()) (amortized, if compressed)
+		// @throws std::runtime_error  on unknown codec or decoding error
+		template<typename F>
+		void decode(std::span<const std::byte> stored, F& callback)
+		{
+			if (!has_codec && !stored.empty())
+			{
+				begin(static_cast<def_codec>(stored[0]));
+				stored = stored.subspan(1);
+				has_codec = true;
+			}
+			if (stored.empty())
+				{ return; }
+			if (codec == def_codec::raw)
+				{ std::invoke(callback, stored); return; }
+#ifdef SDICT_USE_ZSTD
+			ZSTD_inBuffer in{ stored.data(), stored.size(), 0 };
+			ZSTD_outBuffer out;
+			// output may still be buffered if out_buf was filled completely
+			do
+			{
+				out = { out_buf.data(), out_buf.size(), 0 };
+				zstd_res = ZSTD_decompressStream(dctx.get(), &out, &in);
+				if (ZSTD_isError(zstd_res))
+					{ throw std::runtime_error("Unable to decompress definition. File may be corrupted"); }
+				if (out.pos != 0)
+					{ std::invoke(callback, std::span<const std::byte>(out_buf.data(), out.pos)); }
+			} while (in.pos < in.size || out.pos == out.size);
+#endif
+		}
 
-		open_in(); // re-open as read only
-	}
+		// @throws std::runtime_error  if the def ended prematurely
+		void finish() const
+		{
+			if (!has_codec)
+				{ throw std::runtime_error("Missing definition codec. File may be corrupted"); }
+#ifdef SDICT_USE_ZSTD
+			if (codec == def_codec::zstd && zstd_res != 0)
+				{ throw std::runtime_error("Truncated zstd frame. File may be corrupted"); }
+#endif
+		}
+	};
 
-	// expects file to be readable
-	// Complexity: O(reserved_words + total_words_len + N*log(N)), where N is number of words
-	// File Access: Read, magic_bytes.size() + 8 + reserved_words * 8 + total_words_len
+	// expects file to be readable or mapped
+	// each section is read in bulk (or viewed directly from the mapping) and parsed in memory
+	// Complexity: O(reserved_words + words_sect_size + N*log(N)), where N is number of words
+	// File Access: Read, magic_bytes.size() + 12 + reserved_words * 8 + words_sect_size (+ reserved_words * 16 if load_hash_index)
+	//     + size of extension table and word segments (No if mapped)
+	// @param load_hash_index  whether to load and validate the hash index (version 2+)
+	// @param lean  whether to load only a sample of the words if possible, see open_mapped(). expects file to be mapped if set
 	// @throws std::runtime_error  on file i/o error or if parsing receives an unexpected value
-	void read_file()
+	void read_file(bool load_hash_index = true, bool lean = false)
 	{
-		if (!file)
+		if (!mapping.is_open() && !file)
 			{ throw std::runtime_error("Error reading from file"); }
+		const auto start = std::chrono::steady_clock::now();
+		// the file may have been replaced
+		if (def_cache)
+			{ def_cache->clear(); }
 		
-		std::uintmax_t file_size = std::filesystem::file_size(filename);
+		const std::uintmax_t file_size = (mapping.is_open() ? mapping.size() : std::filesystem::file_size(filename));
+		std::vector<std::byte> buf;
+		std::size_t num_words;
+		std::uint32_t ext_ind = 0;
 		
-		file.seekg(0, std::ios::beg);
 		{
+			// all versions have at least inds_section_offset(current_version) bytes
+			// (indices section cannot be empty since reserved_words > 0)
+			const auto header = read_section(0, inds_section_offset(current_version), buf);
 			std::array<char, magic_bytes.size()> arr;
-			file.read(arr.data(), arr.size());
-			check_file();
+			std::ranges::transform(header.first(magic_bytes.size()), arr.begin(), [](std::byte b) { return static_cast<char>(b); });
+			file_version = static_cast<std::uint8_t>(arr[version_byte_ind]);
+			arr[version_byte_ind] = magic_bytes[version_byte_ind];
 			if (!std::ranges::equal(magic_bytes, arr))
 				{ throw std::runtime_error("Incorrect magic bytes. File may be corrupted"); }
+			if (file_version == 0 || file_version > current_version)
+				{ throw std::runtime_error("Unsupported file version " + std::to_string(file_version)); }
+
+			reserved_words = read_uint32_LE(header.subspan(magic_bytes.size(), 4));
+			if (reserved_words == 0)
+				{ throw std::runtime_error("Read 0 reserved words. File may be corrupted"); }
+			words_sect_size = read_uint32_LE(header.subspan(magic_bytes.size() + 4, 4));
+			if (words_sect_size == 0)
+				{ throw std::runtime_error("Read 0 word section size. File may be corrupted"); }
+			num_words = read_uint32_LE(header.subspan(num_words_offset(), 4));
+			if (num_words > reserved_words)
+				{ throw std::runtime_error("Number of words is greater than total reserved words. File may be corrupted"); }
+			flags = 0;
+			if (file_version >= 2)
+			{
+				flags = read_uint32_LE(header.subspan(flags_offset(), 4));
+				if ((flags & ~known_flags) != 0 || (file_version < 4 && (flags & flag_front_coded_words) != 0))
+					{ throw std::runtime_error("Unknown flags set. File may be corrupted"); }
+			}
+			if (file_version >= 3)
+				{ ext_ind = read_uint32_LE(header.subspan(ext_ind_offset(), 4)); }
 		}
-		reserved_words = read_uint32_LE();
-		check_file();
-		if (reserved_words == 0)
-			{ throw std::runtime_error("Read 0 reserved words. File may be corrupted"); }
-		words_sect_size = read_uint32_LE();
-		check_file();
-		if (words_sect_size == 0)
-			{ throw std::runtime_error("Read 0 word section size. File may be corrupted"); }
-		std::size_t num_words = read_uint32_LE();
-		check_file();
-		if (num_words > reserved_words)
-			{ throw std::runtime_error("Number of words is greater than total reserved words. File may be corrupted"); }
 		
-		if (static_cast<std::uintmax_t>(reserved_words) * 8 + static_cast<std::uintmax_t>(num_words) > file_size)
+		if (static_cast<std::uintmax_t>(defs_section_offset()) > file_size)
 			{ throw std::runtime_error("Reported indices + words section sizes is greater than file size. File may be corrupted"); }
-		
-		static const auto sort_and_find_dup = [](auto& v) -> bool
+
+		extensions.clear();
+		if (ext_ind != 0)
 		{
-			std::ranges::sort(v);
-			auto it = std::ranges::adjacent_find(v);
-			return (it != std::ranges::end(v));
-		};
+			const auto table = read_stored_def(decode_def_ind(ext_ind), buf);
+			if (table.size() % 8 != 0)
+				{ throw std::runtime_error("Incorrect extension table size. File may be corrupted"); }
+			for (std::size_t i = 0; i < table.size(); i += 8)
+			{
+				const std::uint32_t ind = read_uint32_LE(table.subspan(i + 4, 4));
+				if (ind == 0)
+					{ throw std::runtime_error("Read 0 extension index. File may be corrupted"); }
+				extensions.emplace_back(read_uint32_LE(table.subspan(i, 4)), decode_def_ind(ind));
+			}
+		}
+
+		defs_verified = false;
+		defs_clustered = false;
+		if (const auto checksum_ind = find_extension(ext_metadata_checksum))
+		{
+			const auto data = read_stored_def(checksum_ind.value(), buf);
+			if (data.size() != metadata_checksum_size)
+				{ throw std::runtime_error("Incorrect metadata checksum size. File may be corrupted"); }
+			const auto checksum = read_uint64_LE(data.first(8));
+			const auto checksum_flags = read_uint32_LE(data.subspan(8, 4));
+			if (checksum != metadata_checksum())
+				{ throw std::runtime_error("Metadata checksum does not match. File may be corrupted"); }
+			defs_verified = (checksum_flags & checksum_defs_verified) != 0;
+			defs_clustered = (checksum_flags & checksum_defs_clustered) != 0;
+		}
+
+		bloom_filter = {};
+		stem_index.clear();
+		fuzzy_index = {};
+		fulltext_index = {};
+		bloom_buf.clear();
+		stem_buf.clear();
+		fuzzy_buf.clear();
+		fulltext_buf.clear();
+		if (const auto bloom_ind = find_extension(ext_bloom_filter))
+		{
+			const auto data = read_stored_def(bloom_ind.value(), buf);
+			if (data.size() < 16 || (data.size() - 8) % 8 != 0)
+				{ throw std::runtime_error("Incorrect bloom filter size. File may be corrupted"); }
+			const auto num_hashes = read_uint32_LE(data.first(4));
+			const auto bits_per_word = read_uint32_LE(data.subspan(4, 4));
+			if (num_hashes == 0 || num_hashes > 64 || bits_per_word == 0 || bits_per_word > 64)
+				{ throw std::runtime_error("Incorrect bloom filter parameters. File may be corrupted"); }
+			if (mapping.is_open())
+				{ bloom_filter = data; }
+			else
+			{
+				bloom_buf.assign(data.begin(), data.end());
+				bloom_filter = bloom_buf;
+			}
+		}
+		if (const auto stem_ind = find_extension(ext_stem_index))
+		{
+			const auto data = read_stored_def(stem_ind.value(), buf);
+			if (mapping.is_open())
+				{ load_stem_index(data); }
+			else
+			{
+				stem_buf.assign(data.begin(), data.end());
+				load_stem_index(stem_buf);
+			}
+		}
+		if (const auto fuzzy_ind = find_extension(ext_fuzzy_index))
+		{
+			const auto data = read_stored_def(fuzzy_ind.value(), buf);
+			validate_fuzzy_index(data);
+			if (mapping.is_open())
+				{ fuzzy_index = data; }
+			else
+			{
+				fuzzy_buf.assign(data.begin(), data.end());
+				fuzzy_index = fuzzy_buf;
+			}
+		}
+		if (const auto text_ind = find_extension(ext_text_index))
+		{
+			const auto data = read_stored_def(text_ind.value(), buf);
+			validate_text_index(data);
+			if (mapping.is_open())
+				{ fulltext_index = data; }
+			else
+			{
+				fulltext_buf.assign(data.begin(), data.end());
+				fulltext_index = fulltext_buf;
+			}
+		}
+		def_encoding_id = 0;
+		if (const auto encoding_ind = find_extension(ext_def_encoding))
+		{
+			const auto data = read_stored_def(encoding_ind.value(), buf);
+			if (data.size() != 4)
+				{ throw std::runtime_error("Incorrect definition encoding size. File may be corrupted"); }
+			def_encoding_id = read_uint32_LE(data);
+		}
+		load_codec();
+		
 		// sort by first range and find duplicates in first range only
 		static const auto sort_and_find_dup_zipped = [](auto&&... args) -> bool
 		{
@@ -652,63 +3234,181 @@ private:
 		};
 
 		{
-			std::vector<std::uint32_t> word_inds, def_inds;
-			for (std::uint32_t i = 0; i < reserved_words; i++)
-			{
-				std::uint32_t ind = read_uint32_LE();
-				check_file();
-				if (ind != 0)
-					{ word_inds.emplace_back(ind - 1); }
-			}
-			for (std::uint32_t i = 0; i < reserved_words; i++)
+			std::vector<std::uint32_t> word_inds;
+			std::vector<std::uint64_t> def_inds;
+			word_inds.reserve(num_words);
+			def_inds.reserve(num_words);
 			{
-				std::uint32_t ind = read_uint32_LE();
-				check_file();
-				if (ind != 0)
-					{ def_inds.emplace_back(ind - 1); }
+				const auto inds = read_section(inds_section_offset(), static_cast<std::size_t>(reserved_words) * 4 * 2, buf);
+				for (std::uint32_t i = 0; i < reserved_words; i++)
+				{
+					std::uint32_t ind = read_uint32_LE(inds.subspan(i * 4, 4));
+					if (ind != 0)
+						{ word_inds.emplace_back(ind - 1); }
+				}
+				for (std::uint32_t i = reserved_words; i < reserved_words * 2; i++)
+				{
+					std::uint32_t ind = read_uint32_LE(inds.subspan(i * 4, 4));
+					if (ind != 0)
+						{ def_inds.emplace_back(decode_def_ind(ind)); }
+				}
 			}
 			if (word_inds.size() != num_words || def_inds.size() != num_words)
 				{ throw std::runtime_error("Incorrect number of valid indices. File may be corrupted"); }
 
-			// multiple words can share the same def_ind but word_inds must be unique
-			if (sort_and_find_dup_zipped(word_inds, def_inds))
-				{ throw std::runtime_error("Found repeated indices. File may be corrupted"); }
+			hash_slots.clear();
+			if (file_version >= 2 && load_hash_index)
+			{
+				hash_slots.resize(hash_slot_count());
+				const auto slots = read_section(hash_index_offset(), hash_slots.size() * 8, buf);
+				std::size_t num_used = 0;
+				for (auto [i, entry] : hash_slots | std::views::enumerate)
+				{
+					entry = read_uint32_LE(slots.subspan(i * 8, 4));
+					if (entry > num_words)
+						{ throw std::runtime_error("Hash index entry out of range. File may be corrupted"); }
+					if (entry != 0)
+						{ num_used++; }
+				}
+				if (num_used != num_words)
+					{ throw std::runtime_error("Incorrect number of hash index entries. File may be corrupted"); }
+			}
 
 			words.clear();
-			std::streamoff section_off = words_section_offset();
-			for (const auto [word_off, def_off] : std::views::zip(word_inds, def_inds))
+			word_sample.clear();
+			lean_words = lean && (flags & flag_front_coded_words) != 0 && !find_extension(ext_word_segment);
+			num_lean_words = (lean_words ? num_words : 0);
+			if (!lean_words)
+				{ words.reserve(num_words, words_sect_size); }
+			const auto words_sect = read_section(words_section_offset(), words_sect_size, buf);
+			if ((flags & flag_front_coded_words) != 0)
 			{
-				file.seekg(section_off + word_off, std::ios::beg);
-				check_file();
-				std::string word;
-				for (std::size_t j = 0; j < words_sect_size - word_off; j++)
+				// words of a block share its word_ind, and are decoded in entry order.
+				// in lean mode, only the first word of each sampled block is decoded
+				std::optional<front_coding::block_reader> block;
+				for (std::size_t i = 0; i < num_words; i++)
 				{
-					char c;
-					file.get(c);
-					check_file();
-					if (c == '\0')
-						{ break; }
-					word += c;
+					if (i % front_coding::block_size == 0)
+					{
+						if (word_inds[i] >= words_sect_size)
+							{ throw std::runtime_error("Word index is greater than words section size. File may be corrupted"); }
+						block.emplace(words_sect.subspan(word_inds[i]));
+					}
+					else if (word_inds[i] != word_inds[i - 1])
+						{ throw std::runtime_error("Word index does not match its block. File may be corrupted"); }
+					if (lean_words && i % word_sample_interval != 0)
+						{ continue; }
+					const auto word = block->next();
+					if (!word)
+						{ throw std::runtime_error("Incorrect front coded word. File may be corrupted"); }
+					(lean_words ? word_sample : words).emplace_back(word.value(), def_inds[i]);
 				}
-				words.emplace_back(std::move(word), def_off);
 			}
+			else
+			{
+				// multiple words can share the same def_ind but word_inds must be unique
+				if (sort_and_find_dup_zipped(word_inds, def_inds))
+					{ throw std::runtime_error("Found repeated indices. File may be corrupted"); }
+
+				const auto words_chars = std::string_view(reinterpret_cast<const char*>(words_sect.data()), words_sect.size());
+				for (const auto [word_off, def_off] : std::views::zip(word_inds, def_inds))
+				{
+					if (word_off >= words_sect_size)
+						{ throw std::runtime_error("Word index is greater than words section size. File may be corrupted"); }
+					// if no null is found, the word extends until the end of the section
+					const auto word_len = words_chars.substr(word_off).find('\0');
+					words.emplace_back(words_chars.substr(word_off, word_len), def_off);
+				}
+			}
+		}
+
+		num_segment_words = 0;
+		for (const auto [tag, ext_ind] : extensions)
+		{
+			if (tag != ext_word_segment)
+				{ continue; }
+			auto segment = read_stored_def(ext_ind, buf);
+			if (segment.size() < 4)
+				{ throw std::runtime_error("Incorrect word segment size. File may be corrupted"); }
+			const std::uint32_t count = read_uint32_LE(segment.first(4));
+			segment = segment.subspan(4);
+			for (std::uint32_t i = 0; i < count; i++)
+			{
+				if (segment.size() < 8)
+					{ throw std::runtime_error("Incorrect word segment size. File may be corrupted"); }
+				const std::uint32_t def_ind = read_uint32_LE(segment.first(4));
+				const std::uint32_t word_len = read_uint32_LE(segment.subspan(4, 4));
+				if (def_ind == 0 || segment.size() - 8 < word_len)
+					{ throw std::runtime_error("Incorrect word segment entry. File may be corrupted"); }
+				words.emplace_back(std::string_view(reinterpret_cast<const char*>(segment.data()) + 8, word_len), decode_def_ind(def_ind));
+				segment = segment.subspan(8 + word_len);
+			}
+			num_segment_words += count;
 		}
 
-		if (sort_and_find_dup(words))
+		words.sort();
+		if (words.has_adjacent_dup())
 			{ throw std::runtime_error("Found repeated words. File may be corrupted"); }
+		words.compact_arena();
+		// the other words are only checked when decoded
+		if (!word_sample.is_sorted() || word_sample.has_adjacent_dup())
+			{ throw std::runtime_error("Front coded words are not sorted. File may be corrupted"); }
+		count(counters.read_file_ns, (std::chrono::steady_clock::now() - start).count());
 	}
 	
 	// expects file to be readable
 	// leaves file as read only
+	// the file will be converted to current_version
 	// Complixity: O(n_words + total_words_len + total_defs_size)
-	// File Access: Create; Read, old_reserved_words * 8 + old_words_sect_size + total_defs_size bytes;
-	//     Write, reserved_words * 8 + words_sect_size + total_defs_size bytes; Rename; Delete
-	void rewrite_file(std::uint32_t old_reserved_words, std::uint32_t old_words_sect_size)
+	// File Access: Create; Map; Write, reserved_words * 24 + words_sect_size + total_defs_size bytes; Rename; Delete
+	// @param encode_defs  whether to encode defs with encode_def(). defs in the old file must not be codec prefixed
+	// @param new_extensions  extensions to add, replacing existing extensions with the same tag
+	void rewrite_file(std::uint32_t old_reserved_words, std::uint32_t old_words_sect_size, bool encode_defs = false,
+		const std::vector<std::pair<std::uint32_t, std::vector<std::byte>>>& new_extensions = {})
+	{
+		file.flush();
+		count(counters.rewrites, std::uint64_t(1));
+		write_file(filename, defs_section_offset(file_version, old_reserved_words, old_words_sect_size), encode_defs, new_extensions);
+	}
+
+	// write a new file at `filename` (replacing it if it exists) with the current reserved_words, words_sect_size, flags and `words`,
+	// except that a front coded words section is sized to fit exactly (updating words_sect_size),
+	// where def_inds in `words` and offsets in `extensions` are relative to `source_defs_offset` in `source`.
+	// used by rewrite_file() with the current file as the source, and by dictionary_file_builder with its temporary defs file
+	// leaves file as read only
+	// Complexity: O(n_words + total_words_len + total_defs_size)
+	// File Access: Create; Map (source); Write, reserved_words * 24 + words_sect_size + total_defs_size bytes; Rename; Delete
+	// @param encode_defs  whether to encode defs with encode_def(). defs in `source` must not be codec prefixed
+	// @param new_extensions  extensions to add, replacing existing extensions with the same tag
+	void write_file(const std::string& source, std::streamoff source_defs_offset, bool encode_defs,
+		const std::vector<std::pair<std::uint32_t, std::vector<std::byte>>>& new_extensions)
 	{
+		file_version = current_version;
+		// defs are moved
+		if (def_cache)
+			{ def_cache->clear(); }
+
 		assert(reserved_words >= words.size());
-		assert(words_sect_size >= std::reduce(words.begin(), words.end(), std::size_t(0), // TODO: replace with uz following support
-			[](std::size_t init, const word_info& elem) -> std::size_t
-				{ return init + elem.word.size() + 1; }));
+		// lay out words in sorted order, matching the words section
+		words.compact_arena();
+		// if front coding, the words section and WInd of each word, sized to fit exactly
+		std::vector<std::byte> coded_words;
+		std::vector<std::uint32_t> coded_word_inds;
+		if ((flags & flag_front_coded_words) != 0)
+		{
+			coded_word_inds.reserve(words.size());
+			for (std::size_t i = 0; i < words.size(); i += front_coding::block_size)
+			{
+				const std::size_t last = std::min(words.size(), i + front_coding::block_size);
+				const std::size_t block_start = coded_words.size();
+				front_coding::append_block(std::views::iota(i, last) | std::views::transform([this](std::size_t j) { return words.word(j); }), coded_words);
+				if (coded_words.size() >= std::numeric_limits<std::uint32_t>::max())
+					{ throw std::length_error("Words section is too large"); }
+				coded_word_inds.insert(coded_word_inds.end(), last - i, static_cast<std::uint32_t>(block_start + 1));
+			}
+			words_sect_size = std::max<std::uint32_t>(static_cast<std::uint32_t>(coded_words.size()), 1);
+		}
+		assert(words_sect_size >= (coded_word_inds.empty() ? words.total_len(0, words.size()) : coded_words.size()));
 
 		// create new file for output and swap with current file
 		const std::string new_file = filename + ".tmp";
@@ -720,24 +3420,46 @@ private:
 		write_uint32_LE(reserved_words, file2);
 		write_uint32_LE(words_sect_size, file2);
 		write_uint32_LE(words.size(), file2);
+		write_uint32_LE(flags, file2);
+		write_uint32_LE(0, file2); // placeholder for extension table
 		
 		// inds section
 		std::uint32_t bytes_written = 0;
-		for (const auto& [word, def_ind] : words)
+		for (std::size_t i = 0; i < words.size(); i++)
 		{
-			write_uint32_LE(bytes_written + 1, file2);
-			bytes_written += word.size() + 1;
+			write_uint32_LE(coded_word_inds.empty() ? bytes_written + 1 : coded_word_inds[i], file2);
+			bytes_written += words[i].length + 1;
 		}
 		write_nulls((reserved_words - words.size()) * 4, file2);
 		// defs will be rearranged, just use a placeholder for now
 		write_nulls(reserved_words * 4, file2);
+
+		// hash index. words are written in sorted order, so entry numbers follow `words`
+		hash_slots.assign(hash_slot_count(), 0);
+		for (std::size_t i = 0; i < words.size(); i++)
+			{ insert_hash_slot(hash_slots, words.word(i), i + 1); }
+		for (const auto entry : hash_slots)
+		{
+			write_uint32_LE(entry, file2);
+			write_uint32_LE(entry == 0 ? 0 : word_hash(words.word(entry - 1)) >> 32, file2);
+		}
 		
 		// words section
 		bytes_written = 0;
-		for (const auto& [word, def_ind] : words)
+		if ((flags & flag_front_coded_words) != 0)
+		{
+			file2.write(reinterpret_cast<const char*>(coded_words.data()), coded_words.size());
+			bytes_written = coded_words.size();
+		}
+		else
 		{
-			file2.write(word.c_str(), word.size() + 1); // write the null as well
-			bytes_written += word.size() + 1;
+			for (const auto& rec : words)
+			{
+				const auto word = words.word(rec);
+				file2.write(word.data(), word.size());
+				file2.put('\0');
+				bytes_written += word.size() + 1;
+			}
 		}
 		write_nulls(words_sect_size - bytes_written, file2);
 
@@ -746,126 +3468,121 @@ private:
 			if (do_dedup)
 			{
 				existing_defs.clear();
+				existing_defs.reserve(words.size());
 			}
 
 			std::streampos defs_sect_start = file2.tellp();
 			assert(defs_sect_start == defs_section_offset());
-			std::streamoff old_defs_sect_off = defs_section_offset(old_reserved_words, old_words_sect_size);
+			const std::streamoff old_defs_sect_off = source_defs_offset;
+			// defs are read from a mapping of the old file, and runs of defs which are consecutive in the old file
+			// are written with a single write, so large files are copied with few syscalls
+			// (the mapping is closed before the rename, which would fail on windows otherwise)
+			const mapped_file old_mapping(source);
+			const auto old_data = old_mapping.data();
+			// old def_ind to new def_ind
+			std::unordered_map<std::uint64_t, std::uint64_t> copied_inds;
+			copied_inds.reserve(words.size());
+			// duplicates are found up front, and share the new def of the first def they duplicate
+			const auto duplicates = (do_dedup && !encode_defs ? find_duplicate_defs(old_data, old_defs_sect_off) : std::unordered_map<std::uint64_t, std::uint64_t>());
+			std::vector<std::byte> encoded_buf;
+
+			// current end of defs section in the new file
+			std::uint64_t defs_end = 0;
+			// defs in [run_start, run_end) of the old defs section which are yet to be written, to end at defs_end
+			std::uint64_t run_start = 0, run_end = 0;
+			const auto write_run = [&]()
+			{
+				const auto run = old_data.subspan(old_defs_sect_off + run_start, run_end - run_start);
+				file2.write(reinterpret_cast<const char*>(run.data()), run.size());
+				run_start = run_end;
+			};
 			
-			for (auto& [word, def_ind] : words)
+			for (auto& [word_off, word_len, def_ind] : words)
 			{
-				std::streamoff cur_def_off = old_defs_sect_off + def_ind;
-				file.seekg(cur_def_off, std::ios::beg);
-				std::uint32_t size = read_uint32_LE();
-				check_file();
-				if (size == 0)
-					{ throw std::runtime_error("Read 0 definition size. File may be corrupted"); }
-				
-				std::optional<std::uint64_t> old_hash;
-				if (do_dedup)
-				{
-					const auto it = existing_defs.find(size);
-					if (it != existing_defs.end())
-					{
-						const auto res = get_def_size_and_hash(def_ind, size, old_defs_sect_off);
-						const auto size2 = res.first;
-						old_hash = res.second;
-						if (size2 == size)
-						{
-							const auto it2 = it->second.find(old_hash.value());
-							if (it2 != it->second.end())
-							{
-								bool found_match = false;
-								for (const std::streamoff found_def_ind : it2->second)
-								{
-									file.seekg(cur_def_off, std::ios::beg);
-									auto read_size = read_uint32_LE();
-									check_file();
-									if (read_size != size)
-										{ continue; }
-									file2.seekg(defs_sect_start + found_def_ind, std::ios::beg);
-									read_size = read_uint32_LE(file2);
-									check_file(file2);
-									if (read_size != size)
-										{ continue; }
-									// we've already read the hash from `file` through get_def_hash
-									const auto hash2 = read_uint64_LE(file2);
-									if (hash2 != old_hash.value())
-										{ continue; }
-
-									static constexpr std::size_t cmp_batch_size = 1024;
-									bool mismatch = false;
-									for (int i = 0; i < (size - 1) / batch_size + 1; i++) // (size / cmp_batch_size) rounded up
-									{
-										const auto [data, read_amt] = read_def_batched(i, size, cur_def_off + 12);
-										check_file();
-										const auto [data2, read_amt2] = read_def_batched(i, size, defs_sect_start + (found_def_ind + 12), file2);
-										check_file(file2);
-										if (read_amt != read_amt2 || data != data2)
-											{ mismatch = true; break; }
-									}
-									if (!mismatch)
-										{ def_ind = found_def_ind; found_match = true; break; }
-								}
-								if (found_match)
-									{ continue; }
-							}
-						}
-					}
-				}
+				// defs that were shared in the old file stay shared, even without dedup
+				const auto dup_it = duplicates.find(def_ind);
+				const auto [copied_it, inserted] = copied_inds.try_emplace(dup_it == duplicates.end() ? def_ind : dup_it->second);
+				if (!inserted)
+					{ def_ind = copied_it->second; continue; }
+				// new def_ind, set whenever def_ind is assigned below
+				std::uint64_t& new_def_ind = copied_it->second;
 
-				std::uint64_t hash = [old_hash, cur_def_off, this]()
-				{
-					if (!do_dedup)
-						{ return fnv_init; } // will be written to the file but we don't care (will be overwritten)
-					if (old_hash)
-						{ return old_hash.value(); }
-					file.seekg(cur_def_off + 4, std::ios::beg);
-					std::uint64_t hash = read_uint64_LE();
-					check_file();
-					return hash;
-				}();
-				
-				file2.seekp(0, std::ios::end);
-				assert(file2.tellp() >= defs_sect_start);
-				def_ind = file2.tellp() - defs_sect_start;
-
-				write_uint32_LE(size, file2);
-				write_uint64_LE(hash, file2);
-				
-				for (int i = 0; i < (size - 1) / batch_size + 1; i++) // (size / batch_size) rounded up
+				const auto [def, hash] = def_view_and_hash(def_ind, old_data, old_defs_sect_off);
+				const std::uint32_t size = def.size();
+
+				if (encode_defs)
 				{
-					const auto [data, read_amt] = read_def_batched(i, size, cur_def_off + 12);
-					check_file();
-					file2.write(data.data(), read_amt);
-					if (!do_dedup)
-					{
-						hash = fnv1a(std::as_bytes(std::span(data).subspan(0, read_amt)), hash);
-					}
+					write_run();
+					const auto encoded = encode_def(def, encoded_buf);
+					def_ind = new_def_ind = append_def(encoded, file2, defs_sect_start);
+					defs_end = def_ind + 12 + encoded.size();
+					if (do_dedup)
+						{ existing_defs.insert(encoded.size(), def_hash(encoded), def_ind); }
+					continue;
 				}
-				
-				if (!do_dedup)
+
+				// stored size and hash are copied as-is. the run continues if the gap after it in the old file
+				// is the padding needed in the new file (as between aligned defs), which is copied along with it
+				const std::uint64_t aligned_end = align_def(defs_end);
+				if (run_start == run_end || def_ind < run_end || def_ind - run_end != aligned_end - defs_end)
 				{
-					file2.seekp(defs_sect_start + static_cast<std::streamoff>(def_ind), std::ios::beg);
-					write_uint64_LE(hash, file2);
+					write_run();
+					write_nulls(aligned_end - defs_end, file2);
+					run_start = run_end = def_ind;
 				}
-				else
+				check_def_ind(aligned_end);
+				run_end = def_ind + 12 + size;
+				def_ind = new_def_ind = aligned_end;
+				defs_end = aligned_end + 12 + size;
+				if (do_dedup)
 				{
-					assert(!std::ranges::contains(existing_defs[size][hash], def_ind));
-					existing_defs[size][hash].push_back(def_ind);
+					assert(!existing_defs.contains(size, hash, def_ind));
+					existing_defs.insert(size, hash, def_ind);
 				}
+				if (run_end - run_start >= write_buffer_size)
+					{ write_run(); }
+			}
+			write_run();
+
+			// extensions are copied as-is, followed by a new extension table
+			// word segments are dropped since all words are now in the main sections
+			std::erase_if(extensions, [&](const auto& ext)
+			{
+				return ext.first == ext_word_segment || ext.first == ext_metadata_checksum || ext.first == ext_bloom_filter ||
+					std::ranges::contains(new_extensions, ext.first, &std::pair<std::uint32_t, std::vector<std::byte>>::first);
+			});
+			num_segment_words = 0;
+			for (auto& [tag, ext_ind] : extensions)
+			{
+				ext_ind = append_def(def_view_and_hash(ext_ind, old_data, old_defs_sect_off).first, file2, defs_sect_start);
+			}
+			for (const auto& [tag, data] : new_extensions)
+				{ extensions.emplace_back(tag, append_def(data, file2, defs_sect_start)); }
+			if (!bloom_filter.empty())
+			{
+				// reserved_words may have grown
+				build_bloom_filter(read_uint32_LE(bloom_filter.subspan(4, 4)));
+				extensions.emplace_back(ext_bloom_filter, append_def(bloom_buf, file2, defs_sect_start));
 			}
+			// placeholder, written once all other sections are final
+			extensions.emplace_back(ext_metadata_checksum, append_def(std::vector<std::byte>(metadata_checksum_size), file2, defs_sect_start));
+			write_extension_table(file2, defs_sect_start);
 		}
 
 		// update def inds
 		file2.seekp(inds_section_offset() + reserved_words * 4, std::ios::beg);
-		for (const auto& [word, def_ind] : words)
-			{ write_uint32_LE(def_ind + 1, file2); }
+		for (const auto& [word_off, word_len, def_ind] : words)
+			{ write_uint32_LE(encode_def_ind(def_ind), file2); }
 		write_nulls((reserved_words - words.size()) * 4, file2);
+		// defs were copied in word order
+		defs_clustered = true;
+		write_metadata_checksum(file2);
 
 		file.close();
+		file_open_type = open_type::none;
 		file2.close();
 		std::filesystem::rename(new_file, filename);
+		pread_file.open(filename);
 
 		open_in();
 	}
@@ -875,31 +3592,270 @@ private:
 	void sort_words()
 	{
 		assert(0 <= first_new_word && first_new_word <= words.size());
-		std::sort(words.begin() + first_new_word, words.end());
-		if (std::adjacent_find(words.begin() + first_new_word, words.end()) != words.end())
+		words.sort(first_new_word);
+		if (words.has_adjacent_dup(first_new_word))
 			{ throw std::logic_error("Repeated words were inserted"); }
-		std::inplace_merge(words.begin(), words.begin() + first_new_word, words.end());
+		words.merge(first_new_word);
 		first_new_word = -1;
-		assert(std::ranges::is_sorted(words));
+		assert(words.is_sorted());
 	}
 	
+	// find_def_ind(), falling back to the word `word` maps to in the stem index
+	// Complexity: O(log(n_words) + log(n_stems))
+	// File Access: No
+	std::uint64_t find_def_ind_or_stem(std::string_view word) const
+	{
+		const std::uint64_t ind = find_def_ind(word);
+		if (ind != -1)
+			{ return ind; }
+		const auto stem_word = resolve_stem(word);
+		return (stem_word ? find_def_ind(stem_word.value()) : -1);
+	}
+
+	// check header and word offsets of ext_fuzzy_index contents (entries are checked in suggest())
+	// Complexity: O(n_words)
+	// File Access: No
+	// @throws std::runtime_error  if `data` is malformed
+	static void validate_fuzzy_index(std::span<const std::byte> data)
+	{
+		if (data.size() < 12)
+			{ throw std::runtime_error("Incorrect fuzzy index size. File may be corrupted"); }
+		const std::uint32_t max_distance = read_uint32_LE(data.first(4));
+		const std::uint64_t n_words = read_uint32_LE(data.subspan(4, 4));
+		const std::uint64_t n_entries = read_uint32_LE(data.subspan(8, 4));
+		if (max_distance == 0 || max_distance > 2)
+			{ throw std::runtime_error("Incorrect fuzzy index distance. File may be corrupted"); }
+		if (data.size() - 12 < n_words * 4 + n_entries * 12)
+			{ throw std::runtime_error("Incorrect fuzzy index size. File may be corrupted"); }
+		const std::uint64_t pool_size = data.size() - 12 - n_words * 4 - n_entries * 12;
+		std::uint32_t prev_end = 0;
+		for (std::size_t i = 0; i < n_words; i++)
+		{
+			const std::uint32_t end = read_uint32_LE(data.subspan(12 + i * 4, 4));
+			if (end < prev_end || end > pool_size)
+				{ throw std::runtime_error("Incorrect fuzzy index word offset. File may be corrupted"); }
+			prev_end = end;
+		}
+	}
+
+	// check header, word and term offsets of ext_text_index contents (postings are checked in find_text())
+	// Complexity: O(n_words + n_terms)
+	// File Access: No
+	// @throws std::runtime_error  if `data` is malformed
+	static void validate_text_index(std::span<const std::byte> data)
+	{
+		if (data.size() < 8)
+			{ throw std::runtime_error("Incorrect full-text index size. File may be corrupted"); }
+		const std::uint64_t n_words = read_uint32_LE(data.first(4));
+		const std::uint64_t n_terms = read_uint32_LE(data.subspan(4, 4));
+		if (data.size() - 8 < n_words * 4 + n_terms * 8)
+			{ throw std::runtime_error("Incorrect full-text index size. File may be corrupted"); }
+		std::uint64_t remaining = data.size() - 8 - n_words * 4 - n_terms * 8;
+		std::uint32_t prev_end = 0;
+		for (std::size_t i = 0; i < n_words; i++)
+		{
+			const std::uint32_t end = read_uint32_LE(data.subspan(8 + i * 4, 4));
+			if (end < prev_end || end > remaining)
+				{ throw std::runtime_error("Incorrect full-text index word offset. File may be corrupted"); }
+			prev_end = end;
+		}
+		remaining -= prev_end;
+		std::uint32_t prev_term_end = 0;
+		for (std::size_t i = 0; i < n_terms; i++)
+		{
+			const std::uint32_t end = read_uint32_LE(data.subspan(8 + n_words * 4 + i * 8, 4));
+			if (end < prev_term_end || end > remaining)
+				{ throw std::runtime_error("Incorrect full-text index term offset. File may be corrupted"); }
+			prev_term_end = end;
+		}
+		remaining -= prev_term_end;
+		std::uint32_t prev_postings_end = 0;
+		for (std::size_t i = 0; i < n_terms; i++)
+		{
+			const std::uint32_t end = read_uint32_LE(data.subspan(8 + n_words * 4 + i * 8 + 4, 4));
+			if (end < prev_postings_end || end > remaining)
+				{ throw std::runtime_error("Incorrect full-text index postings offset. File may be corrupted"); }
+			prev_postings_end = end;
+		}
+	}
+
+	// parse contents of the ext_stem_index extension into stem_index, viewing `data`
+	// Complexity: O(n_stems)
+	// File Access: No
+	// @throws std::runtime_error  on parsing error
+	void load_stem_index(std::span<const std::byte> data)
+	{
+		stem_index.clear();
+		if (data.size() < 4)
+			{ throw std::runtime_error("Incorrect stem index size. File may be corrupted"); }
+		const std::uint32_t count = read_uint32_LE(data.first(4));
+		data = data.subspan(4);
+		stem_index.reserve(std::min<std::size_t>(count, data.size() / 8));
+		for (std::uint32_t i = 0; i < count; i++)
+		{
+			if (data.size() < 8)
+				{ throw std::runtime_error("Incorrect stem index size. File may be corrupted"); }
+			const std::uint32_t stem_len = read_uint32_LE(data.first(4));
+			const std::uint32_t word_len = read_uint32_LE(data.subspan(4, 4));
+			if (data.size() - 8 < static_cast<std::uint64_t>(stem_len) + word_len)
+				{ throw std::runtime_error("Incorrect stem index entry. File may be corrupted"); }
+			const auto chars = reinterpret_cast<const char*>(data.data()) + 8;
+			stem_index.emplace_back(std::string_view(chars, stem_len), std::string_view(chars + stem_len, word_len));
+			data = data.subspan(8 + static_cast<std::size_t>(stem_len) + word_len);
+		}
+		if (std::ranges::adjacent_find(stem_index, std::ranges::greater_equal{}, &std::pair<std::string_view, std::string_view>::first) != stem_index.end())
+			{ throw std::runtime_error("Stem index is not sorted. File may be corrupted"); }
+	}
+
 	// find def_ind corresponding to a word in `words`,
 	// using a binary search followed by linear search
 	// Complexity: O(log(n_words))
 	// File Access: No
-	std::uint32_t find_def_ind(std::string_view word) const
+	// @param last  only search words before this index (not applicable if mapped)
+	std::uint64_t find_def_ind(std::string_view word, std::size_t last = -1) const
 	{
-		const auto end_it = ((first_new_word == -1) ? words.end() : words.begin() + first_new_word);
-		auto it = std::lower_bound(words.begin(), end_it, word);
-		if (it == end_it || it->word != word)
+		last = std::min(last, words.size());
+		if (!bloom_may_contain(word))
+		{
+			// only unflushed words are not in the filter
+			if (first_new_word == -1 || first_new_word >= last)
+				{ return -1; }
+			const auto ind = words.find(first_new_word, last, word);
+			return (ind == last ? -1 : words[ind].def_ind);
+		}
+		if (mapping.is_open() && file_version >= 2)
+		{
+			// words in segments are not in the hash index
+			const auto ind = find_def_ind_mapped(word);
+			if (ind != -1 || num_segment_words == 0)
+				{ return ind; }
+		}
+		const auto end_ind = std::min(((first_new_word == -1) ? words.size() : first_new_word), last);
+		auto ind = words.lower_bound(end_ind, word);
+		if (ind == end_ind || words.word(ind) != word)
 		{
-			if (end_it == words.end())
+			if (end_ind == last)
 				{ return -1; }
-			it = std::find(end_it, words.end(), word);
-			if (it == words.end())
+			ind = words.find(end_ind, last, word);
+			if (ind == last)
+				{ return -1; }
+		}
+		return words[ind].def_ind;
+	}
+
+	// find def_ind corresponding to a word by probing the mapped hash index
+	// expects file to be mapped and version 2+
+	// Complexity: O(1) average
+	// File Access: No (pages of the mapping may be faulted in)
+	// @throws std::runtime_error  on corrupted hash index
+	std::uint64_t find_def_ind_mapped(std::string_view word) const
+	{
+		const auto data = mapping.data();
+		const std::uint64_t num_slots = hash_slot_count();
+		const auto slots = data.subspan(hash_index_offset(), num_slots * 8);
+		const auto word_inds = data.subspan(inds_section_offset(), reserved_words * 4);
+		const auto def_inds = data.subspan(inds_section_offset() + reserved_words * 4, reserved_words * 4);
+		const auto words_sect = data.subspan(words_section_offset(), words_sect_size);
+
+		const auto hash = word_hash(word);
+		const std::uint32_t tag = hash >> 32;
+		for (std::uint64_t slot = hash % num_slots, i = 0; i < num_slots; slot = (slot + 1) % num_slots, i++)
+		{
+			const std::uint32_t entry = read_uint32_LE(slots.subspan(slot * 8, 4));
+			if (entry == 0)
 				{ return -1; }
+			if (read_uint32_LE(slots.subspan(slot * 8 + 4, 4)) != tag)
+				{ continue; }
+			if (entry > num_words())
+				{ throw std::runtime_error("Hash index entry out of range. File may be corrupted"); }
+			const std::uint32_t word_off = read_uint32_LE(word_inds.subspan((entry - 1) * 4, 4)) - 1;
+			if ((flags & flag_front_coded_words) != 0)
+			{
+				// decode the block up to the entry's word
+				if (word_off >= words_sect.size())
+					{ continue; }
+				front_coding::block_reader block(words_sect.subspan(word_off));
+				std::optional<std::string_view> cur_word;
+				for (std::size_t j = 0; j <= (entry - 1) % front_coding::block_size; j++)
+				{
+					if (!(cur_word = block.next()))
+						{ break; }
+				}
+				if (cur_word == word)
+					{ return decode_def_ind(read_uint32_LE(def_inds.subspan((entry - 1) * 4, 4))); }
+				continue;
+			}
+			if (word_off >= words_sect.size() || words_sect.size() - word_off < word.size() + 1)
+				{ continue; }
+			const auto cur_word = words_sect.subspan(word_off, word.size() + 1);
+			if (cur_word.back() == std::byte(0) && std::ranges::equal(cur_word.first(word.size()), std::as_bytes(std::span(word))))
+				{ return decode_def_ind(read_uint32_LE(def_inds.subspan((entry - 1) * 4, 4))); }
+		}
+		return -1;
+	}
+
+	// Complexity: O(1)
+	// File Access: No (a page of the mapping may be faulted in, in lean mode)
+	// @param i  index of a word in sorted order
+	// @throws std::runtime_error  in lean mode, if its index is 0
+	std::uint64_t def_ind_at(std::size_t i) const
+	{
+		if (!lean_words)
+			{ return words[i].def_ind; }
+		const std::uint32_t ind = read_uint32_LE(mapping.data().subspan(inds_section_offset() + (reserved_words + i) * 4, 4));
+		if (ind == 0)
+			{ throw std::runtime_error("Read 0 definition index. File may be corrupted"); }
+		return decode_def_ind(ind);
+	}
+
+	// call `f(i, word)` for words [first, last) in sorted order (which is entry order), decoding their blocks from the mapping,
+	// until it returns false. `word` is only valid during the call
+	// expects lean mode (see open_mapped())
+	// Complexity: O((last - first + front_coding::block_size) * word_len)
+	// File Access: No (pages of the mapping may be faulted in)
+	// @throws std::runtime_error  on corrupted words section
+	template<typename F>
+	void for_each_lean_word(std::size_t first, std::size_t last, F&& f) const
+	{
+		const auto data = mapping.data();
+		const auto word_inds = data.subspan(inds_section_offset(), reserved_words * 4);
+		// block offsets were validated on load
+		const auto words_sect = data.subspan(words_section_offset(), words_sect_size);
+		std::optional<front_coding::block_reader> block;
+		for (std::size_t i = first - first % front_coding::block_size; i < last; i++)
+		{
+			if (i % front_coding::block_size == 0)
+				{ block.emplace(words_sect.subspan(read_uint32_LE(word_inds.subspan(i * 4, 4)) - 1)); }
+			const auto word = block->next();
+			if (!word)
+				{ throw std::runtime_error("Incorrect front coded word. File may be corrupted"); }
+			if (i >= first && !f(i, word.value()))
+				{ return; }
 		}
-		return it->def_ind;
+	}
+
+	// word_table::partition_point() in lean mode (see open_mapped()). word_sample is searched first,
+	// and then only the words between two samples are decoded
+	// Complexity: O(log(n_words / word_sample_interval) + word_sample_interval * word_len)
+	// File Access: No (pages of the mapping may be faulted in)
+	// @throws std::runtime_error  on corrupted words section
+	template<typename Pred>
+	std::size_t lean_partition_point(std::size_t first, std::size_t last, Pred pred) const
+	{
+		// samples within [first, last)
+		const std::size_t sample_first = std::min((first + word_sample_interval - 1) / word_sample_interval, word_sample.size());
+		const std::size_t sample_last = std::clamp((last + word_sample_interval - 1) / word_sample_interval, sample_first, word_sample.size());
+		// the result is between the last sample `pred` is true of and the next one
+		const std::size_t sample = word_sample.partition_point(sample_first, sample_last, pred);
+		std::size_t res = (sample == sample_last ? last : sample * word_sample_interval);
+		for_each_lean_word((sample == sample_first ? first : (sample - 1) * word_sample_interval), res, [&](std::size_t i, std::string_view word)
+		{
+			if (pred(word))
+				{ return true; }
+			res = i;
+			return false;
+		});
+		return res;
 	}
 
 	// `batch_ind` * `batch_size` must be less than `size`
@@ -919,29 +3875,225 @@ private:
 		check_file(fin);
 		return { arr, read_amt };
 	}
-	std::pair<std::array<char, batch_size>, std::size_t> read_def_batched(int batch_ind, std::uint32_t size, std::streamoff data_start_pos) { return read_def_batched(batch_ind, size, data_start_pos, file); }
+	std::pair<std::array<char, batch_size>, std::size_t> read_def_batched(int batch_ind, std::uint32_t size, std::streamoff data_start_pos)
+	{
+		auto res = read_def_batched(batch_ind, size, data_start_pos, file);
+		count_io(1, 1, res.second);
+		return res;
+	}
 	
-	// expects file to be readable
+	// expects file to be mapped
+	// Complexity: O(1)
+	// File Access: No
+	// @param def_ind  start position of definition (including data size)
+	// @return pair of definition data (excluding size and hash) and stored hash
+	// @throws std::runtime_error  if the definition does not fit in the file
+	std::pair<std::span<const std::byte>, std::uint64_t> def_view_and_hash(std::uint64_t def_ind) const { return def_view_and_hash(def_ind, mapping.data()); }
+	// @param data  whole file contents
+	std::pair<std::span<const std::byte>, std::uint64_t> def_view_and_hash(std::uint64_t def_ind, std::span<const std::byte> data) const { return def_view_and_hash(def_ind, data, defs_section_offset()); }
+	std::pair<std::span<const std::byte>, std::uint64_t> def_view_and_hash(std::uint64_t def_ind, std::span<const std::byte> data, std::streamoff defs_section_offset_) const
+	{
+		const std::size_t def_off = defs_section_offset_ + def_ind;
+		if (def_off > data.size() || data.size() - def_off < 12)
+			{ throw std::runtime_error("Definition offset is greater than file size. File may be corrupted"); }
+		const auto size = read_uint32_LE(data.subspan(def_off, 4));
+		if (size == 0)
+			{ throw std::runtime_error("Read 0 definition size. File may be corrupted"); }
+		if (data.size() - def_off - 12 < size)
+			{ throw std::runtime_error("Definition size is greater than file size. File may be corrupted"); }
+		return { data.subspan(def_off + 12, size), read_uint64_LE(data.subspan(def_off + 4, 8)) };
+	}
+
+	// verify hashes of all defs referenced by `words`
+	// defs are split into disjoint ranges (in file order) which are hashed in parallel
+	// Complexity: O(total_defs_size / n_threads)
+	// File Access: No (pages of `data` may be faulted in)
+	// @param data  whole file contents
+	// @throws std::runtime_error  if a hash does not match or a def does not fit in `data`
+	void verify_defs(std::span<const std::byte> data) const
+	{
+		std::vector<std::uint64_t> def_inds;
+		def_inds.reserve(num_words());
+		for (std::size_t i = 0; i < num_words(); i++)
+			{ def_inds.push_back(def_ind_at(i)); }
+		std::ranges::sort(def_inds);
+		def_inds.erase(std::ranges::unique(def_inds).begin(), def_inds.end());
+
+		for_each_range_parallel(def_inds.size(), [&](std::size_t first, std::size_t last)
+		{
+			for (std::size_t i = first; i < last; i++)
+			{
+				const auto [def, hash] = def_view_and_hash(def_inds[i], data);
+				if (hash != def_hash(def))
+					{ throw std::runtime_error("Definition hash does not match. File may be corrupted"); }
+			}
+		});
+	}
+
+	// call `f(first, last)` for disjoint ranges covering [0, n), each on its own thread
+	// (one per hardware thread, but with at least min_defs_per_thread items each), or on this thread if there is only one
+	// @throws  the first exception thrown by `f`, once all threads have finished
+	template<typename F>
+	static void for_each_range_parallel(std::size_t n, const F& f)
+	{
+		const std::size_t n_threads = std::clamp<std::size_t>(std::thread::hardware_concurrency(), 1, n / min_defs_per_thread + 1);
+		if (n_threads == 1)
+		{
+			f(std::size_t(0), n);
+			return;
+		}
+
+		std::vector<std::exception_ptr> errors(n_threads);
+		{
+			std::vector<std::jthread> workers;
+			workers.reserve(n_threads);
+			for (std::size_t t = 0; t < n_threads; t++)
+			{
+				workers.emplace_back([&, t]()
+				{
+					try
+						{ f(n * t / n_threads, n * (t + 1) / n_threads); }
+					catch (...)
+						{ errors[t] = std::current_exception(); }
+				});
+			}
+		}
+		for (const auto& e : errors)
+		{
+			if (e)
+				{ std::rethrow_exception(e); }
+		}
+	}
+
+	// find the defs referenced by `words` which duplicate another one, before rewriting (see write_file()).
+	// defs are grouped by their stored size and hash, and the contents of each def of a group are compared with the first
+	// of the group on several threads, so copying defs afterwards is a single sequential pass without comparisons
+	// Complexity: O(N*log(N) + duplicate_defs_size / n_threads), where N is number of distinct def_inds
+	// File Access: No (pages of `data` may be faulted in)
+	// @param data  whole file contents
+	// @param defs_section_offset_  offset of the defs section in `data`
+	// @return def_ind of each def which duplicates one before it in the file to the def_ind of the first such def
+	std::unordered_map<std::uint64_t, std::uint64_t> find_duplicate_defs(std::span<const std::byte> data, std::streamoff defs_section_offset_) const
+	{
+		// (size, hash, def_ind) of every def, by size and hash, then in file order
+		std::vector<std::tuple<std::uint32_t, std::uint64_t, std::uint64_t>> defs;
+		defs.reserve(words.size());
+		for (const auto& [word_off, word_len, def_ind] : words)
+			{ defs.emplace_back(0, 0, def_ind); }
+		std::ranges::sort(defs, {}, [](const auto& d) { return std::get<2>(d); });
+		defs.erase(std::ranges::unique(defs).begin(), defs.end());
+		// headers are read in file order
+		for (auto& [size, hash, def_ind] : defs)
+		{
+			const auto [def, stored_hash] = def_view_and_hash(def_ind, data, defs_section_offset_);
+			size = static_cast<std::uint32_t>(def.size());
+			hash = stored_hash;
+		}
+		std::ranges::sort(defs);
+
+		// defs which may duplicate the first of their group (index into defs), and whether they do
+		std::vector<std::pair<std::size_t, std::size_t>> candidates;
+		for (std::size_t first = 0; first < defs.size();)
+		{
+			std::size_t last = first + 1;
+			while (last < defs.size() && std::get<0>(defs[last]) == std::get<0>(defs[first]) && std::get<1>(defs[last]) == std::get<1>(defs[first]))
+				{ candidates.emplace_back(last++, first); }
+			first = last;
+		}
+		const auto def_at = [&](std::size_t i) { return def_view_and_hash(std::get<2>(defs[i]), data, defs_section_offset_).first; };
+		// not std::vector<bool>, which threads can't write to separately
+		std::vector<char> equal(candidates.size());
+		for_each_range_parallel(candidates.size(), [&](std::size_t first, std::size_t last)
+		{
+			for (std::size_t i = first; i < last; i++)
+				{ equal[i] = std::ranges::equal(def_at(candidates[i].first), def_at(candidates[i].second)); }
+		});
+
+		std::unordered_map<std::uint64_t, std::uint64_t> res;
+		res.reserve(candidates.size());
+		// distinct defs of the current group other than its first, in the rare case that hashes collide
+		std::vector<std::size_t> others;
+		for (std::size_t i = 0; i < candidates.size(); i++)
+		{
+			const auto [cur, first] = candidates[i];
+			if (i == 0 || candidates[i - 1].second != first)
+				{ others.clear(); }
+			if (equal[i])
+				{ res.emplace(std::get<2>(defs[cur]), std::get<2>(defs[first])); continue; }
+			const auto match = std::ranges::find_if(others, [&](std::size_t other) { return std::ranges::equal(def_at(cur), def_at(other)); });
+			if (match != others.end())
+				{ res.emplace(std::get<2>(defs[cur]), std::get<2>(defs[*match])); }
+			else
+				{ others.push_back(cur); }
+		}
+		return res;
+	}
+
+	// Complexity: O(1)
+	// File Access: No
+	// @return whether lookups should go through def_cache
+	bool use_def_cache(bool check_def) const noexcept
+		{ return def_cache && !check_def && (!mapping.is_open() || (flags & flag_codec_prefix) != 0); }
+
+	// the decoded def at `def_ind`, from def_cache or read and added to it
+	// expects def_cache to be set
+	// Complexity: O(1) on cache hit, otherwise O(def_size)
+	// File Access: No on cache hit, otherwise Read, 12 + def_size bytes (No if mapped)
+	// @throws std::runtime_error  on file i/o or decoding error
+	std::shared_ptr<const cached_def> read_cached_def(std::uint64_t def_ind) const
+	{
+		if (auto cached = def_cache->find(def_ind))
+		{
+			count(counters.def_cache_hits, std::uint64_t(1));
+			return cached;
+		}
+		count(counters.def_cache_misses, std::uint64_t(1));
+		std::vector<char> stored;
+		std::span<const std::byte> def;
+		std::uint64_t hash;
+		if (mapping.is_open())
+			{ std::tie(def, hash) = def_view_and_hash(def_ind); }
+		else
+		{
+			std::tie(stored, hash) = read_def_whole_and_hash(def_ind);
+			def = std::as_bytes(std::span(stored));
+		}
+		std::vector<std::byte> buf;
+		def = decode_def(def, buf);
+		auto res = std::make_shared<const cached_def>(std::vector<std::byte>(def.begin(), def.end()), hash);
+		def_cache->insert(def_ind, res, sizeof(cached_def) + res->data.size());
+		return res;
+	}
+
+	// read through pread_file, so this may be called from multiple threads at once
+	// expects pread_file to be open
 	// Complexity: O(def_size)
-	// File Access: Read, 4 + def_size bytes
+	// File Access: Read, 12 + def_size bytes
 	// @param def_ind  start position of definition (including data size)
-	std::vector<char> read_def_whole(std::uint32_t def_ind, bool check_def = false)
+	// @throws std::runtime_error  on file i/o error, or if check_def is set and the hash does not match
+	std::vector<char> read_def_whole(std::uint64_t def_ind, bool check_def = false) const
+		{ return read_def_whole_and_hash(def_ind, check_def).first; }
+	// @return pair of definition data and stored hash
+	std::pair<std::vector<char>, std::uint64_t> read_def_whole_and_hash(std::uint64_t def_ind, bool check_def = false) const
 	{
-		file.seekg(defs_section_offset() + def_ind, std::ios::beg);
-		const auto size = read_uint32_LE();
-		check_file();
-		const auto hash = read_uint64_LE();
-		check_file();
+		const std::uint64_t def_off = defs_section_offset() + def_ind;
+		std::array<std::byte, 12> header;
+		pread_file.read(def_off, header);
+		count_io(0, 1, header.size());
+		const auto size = read_uint32_LE(std::span(header).first(4));
+		const auto hash = read_uint64_LE(std::span(header).subspan(4, 8));
+		if (size == 0)
+			{ throw std::runtime_error("Read 0 definition size. File may be corrupted"); }
 		
 		std::vector<char> v(size);
-		file.read(v.data(), size);
-		check_file();
+		pread_file.read(def_off + 12, std::as_writable_bytes(std::span(v)));
+		count_io(0, 1, size);
 		
-		if (check_def && hash != fnv1a(std::as_bytes(std::span(v))))
+		if (check_def && hash != def_hash(std::as_bytes(std::span(v))))
 		{
 			throw std::runtime_error("Definition hash does not match. File may be corrupted");
 		}
-		return v;
+		return { std::move(v), hash };
 	}
 };
 
@@ -0,0 +1,457 @@
+// headless validation of a whole offline dictionary: every definition is parsed and rendered as in search_word,
+// on a pool of threads, and parse failures and throughput are reported
+// usage: sdict_tool [options] <file.sdict>
+//   -j <n>              number of threads (default: number of hardware threads)
+//   --parser <parser>   coro (begin_parse, default) or direct (cbor_parse::parse, as used by search_word).
+//                       definitions which aren't CBOR (see def_encoding.h) are always parsed directly
+//   --no-render         only parse definitions
+//   --check-defs        verify definition hashes
+//   --build-text-index  afterwards, store a full-text index of the rendered definitions in the file
+//                       (see dictionary_file::set_text_index()), for dictionary_cli --search
+// failures are printed to stderr as "<word>: <error>", and a summary is printed to stdout, e.g.
+// {"words":102345,"failed":0,"threads":8,"seconds":3.12,"words_per_sec":32803.5,"def_mb_per_sec":41.2,"rendered_chars":183204511,"clustered":true}
+// where clustered is whether definitions are laid out in word order (see dictionary_file::is_clustered())
+// returns 1 if any definition failed
+//
+// usage: sdict_tool --fsck [-j <n>] <file.sdict>
+// checks the structure of the file instead (see dictionary_file::fsck()), hashing definitions on -j threads.
+// the file doesn't need to open successfully. every problem is printed to stderr, and a summary to stdout, e.g.
+// {"errors":0,"words":102345,"defs":101872,"unreferenced_bytes":0,"words_sorted":true,"threads":8,"seconds":0.41}
+// returns 1 if any problem was found
+//
+// usage: sdict_tool --bench-codecs <file.sdict>
+// compares the def encodings (see def_encoding.h) on every definition of a CBOR encoded file: all of them are encoded
+// with each encoding, and then parsed as by search_word, on one thread. a line is printed to stdout for each encoding, e.g.
+// {"encoding":"flat","defs":101872,"bytes":80123456,"ratio":0.62,"encode_seconds":1.20,"parse_seconds":0.31,"defs_per_sec":328619.4,"mb_per_sec":246.5}
+// where ratio is the size relative to CBOR, parse_seconds is the fastest of parse_rounds passes over all definitions,
+// and mb_per_sec is of the encoded definitions
+//
+// usage: sdict_tool --recode <encoding> <out.sdict> <file.sdict>
+// writes a copy of the file with its definitions in another encoding (cbor or flat), which is recorded in the copy for readers.
+// definitions can only be encoded from CBOR. stem, fuzzy and full-text indexes aren't copied, so need to be built again
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <ranges>
+#include <span>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <utility>
+#include <vector>
+
+#include <jsoncons_ext/cbor/cbor.hpp>
+
+#include "co_util.h"
+#include "def_encoding.h"
+#include "dict_parse.h"
+#include "json_coro_cursor.h"
+#include "render_entries.h"
+#include "sdict_builder.h"
+#include "sdict_file.h"
+#include "text_index.h"
+
+namespace
+{
+	// word indices handed out to a worker at a time
+	constexpr std::size_t chunk_size = 64;
+	// passes over all definitions with each encoding by --bench-codecs, of which the fastest is reported
+	constexpr std::size_t parse_rounds = 3;
+
+	// range based work stealing over [0, n_items).
+	// each worker starts with an equal contiguous range and takes chunks from its front,
+	// and a worker whose range is empty steals the back half of the largest other range
+	class work_queue
+	{
+	private:
+		struct range
+		{
+			std::mutex mutex;
+			std::size_t begin = 0, end = 0;
+		};
+		std::vector<std::unique_ptr<range>> ranges;
+
+	public:
+		work_queue(std::size_t n_items, std::size_t n_workers)
+		{
+			for (std::size_t i = 0; i < n_workers; i++)
+			{
+				auto& r = *ranges.emplace_back(std::make_unique<range>());
+				r.begin = n_items * i / n_workers;
+				r.end = n_items * (i + 1) / n_workers;
+			}
+		}
+
+		// @return next chunk of items for `worker`, or empty if there is no work left
+		std::optional<std::pair<std::size_t, std::size_t>> next(std::size_t worker)
+		{
+			auto& own = *ranges[worker];
+			while (true)
+			{
+				{
+					std::lock_guard lock(own.mutex);
+					if (own.begin != own.end)
+					{
+						const auto begin = own.begin;
+						own.begin = std::min(own.begin + chunk_size, own.end);
+						return std::pair(begin, own.begin);
+					}
+				}
+
+				// sizes are only a hint, they are checked again once locked
+				range* victim = nullptr;
+				std::size_t victim_size = 0;
+				for (const auto& r : ranges)
+				{
+					std::lock_guard lock(r->mutex);
+					if (r->end - r->begin > victim_size)
+						{ victim = r.get(); victim_size = r->end - r->begin; }
+				}
+				if (victim == nullptr)
+					{ return {}; }
+
+				std::scoped_lock lock(own.mutex, victim->mutex);
+				if (victim->begin == victim->end)
+					{ continue; }
+				const auto mid = victim->begin + (victim->end - victim->begin) / 2;
+				own.begin = mid;
+				own.end = victim->end;
+				victim->end = mid;
+			}
+		}
+	};
+
+	struct options
+	{
+		std::string filename;
+		std::size_t num_threads = std::max(std::thread::hardware_concurrency(), 1u);
+		bool direct_parser = false;
+		bool render = true;
+		bool check_defs = false;
+		bool build_text_index = false;
+		bool fsck = false;
+		bool bench_codecs = false;
+		// with --recode, the encoding and the file to write
+		std::optional<def_encoding::encoding> recode;
+		std::string recode_filename;
+	};
+
+	// state of one worker, reused across definitions so that they don't allocate once warmed up
+	struct worker_state
+	{
+		std::vector<word_info> data;
+		std::vector<def_view::word_info> view_data;
+		rendered_def rendered;
+
+		std::size_t num_words = 0, def_bytes = 0, rendered_chars = 0;
+		std::vector<std::pair<std::string_view, std::string>> failures;
+		// with build_text_index, pairs of word and its distinct terms (space separated)
+		// words are copied, since the mapping is closed to write the index
+		std::vector<std::pair<std::string, std::string>> texts;
+		std::vector<std::string> terms;
+	};
+
+	// parse and render the definition of `word`
+	// @throws std::runtime_error  if it can't be read or parsed
+	void process(const dictionary_file& file, std::string_view word, const options& opts, worker_state& state)
+	{
+		const auto def = file.find_view(word, opts.check_defs);
+		if (!def)
+			{ throw std::runtime_error("Word has no definition"); }
+		state.def_bytes += def->size();
+		state.rendered.clear();
+
+		const auto encoding = def_encoding::from_id(file.def_encoding());
+		if (opts.direct_parser || encoding != def_encoding::encoding::cbor)
+		{
+			state.view_data.clear();
+			def_encoding::parse(encoding, def.value(), state.view_data);
+			if (opts.render)
+				{ render_entries(std::span<const def_view::word_info>(state.view_data), word, state.rendered); }
+		}
+		else
+		{
+			state.data.clear();
+			auto cursor = cursor_coro_wrapper<jsoncons::cbor::cbor_bytes_cursor>(def.value());
+			task<void> parse_task = begin_parse(cursor, state.data);
+			parse_task.rethrow_if_failed();
+			if (!parse_task.coro_handle.done())
+				{ throw std::runtime_error("CBOR parsing ended prematurely"); }
+			if (opts.render)
+				{ render_entries(std::span<const word_info>(state.data), word, state.rendered); }
+		}
+		state.rendered_chars += state.rendered.text.size();
+
+		if (opts.build_text_index)
+		{
+			// only distinct terms are kept, so that the texts of all words fit in memory
+			state.terms.clear();
+			text_index::for_each_term(std::string_view(state.rendered.text.data(), state.rendered.text.size()), [&state](std::string_view term)
+				{ state.terms.emplace_back(term); });
+			std::ranges::sort(state.terms);
+			state.terms.erase(std::ranges::unique(state.terms).begin(), state.terms.end());
+			std::string joined;
+			for (const auto& term : state.terms)
+			{
+				joined += term;
+				joined += ' ';
+			}
+			state.texts.emplace_back(word, std::move(joined));
+		}
+	}
+
+	// encode every definition of `file` with each encoding, time parsing all of them, and print the results
+	// Complexity: O(n_encodings * parse_rounds * total_defs_size)
+	// @throws std::runtime_error  on file i/o error, if the file isn't CBOR encoded, or if a definition can't be parsed
+	void bench_codecs(const dictionary_file& file)
+	{
+		if (file.def_encoding() != static_cast<std::uint32_t>(def_encoding::encoding::cbor))
+			{ throw std::runtime_error("Definitions can only be encoded from CBOR"); }
+		std::vector<std::vector<std::byte>> cbor_defs;
+		std::uint64_t cbor_bytes = 0;
+		file.for_each_def([&](std::span<const std::byte> def, std::span<const std::string_view>)
+		{
+			cbor_defs.emplace_back(def.begin(), def.end());
+			cbor_bytes += def.size();
+		});
+
+		std::vector<def_view::word_info> entries;
+		std::vector<std::byte> buf;
+		for (const auto encoding : def_encoding::all)
+		{
+			std::vector<std::vector<std::byte>> defs;
+			defs.reserve(cbor_defs.size());
+			std::uint64_t bytes = 0;
+			const auto encode_start = std::chrono::steady_clock::now();
+			for (const auto& def : cbor_defs)
+			{
+				const auto encoded = def_encoding::encode(encoding, def, buf);
+				defs.emplace_back(encoded.begin(), encoded.end());
+				bytes += encoded.size();
+			}
+			const std::chrono::duration<double> encode_elapsed = std::chrono::steady_clock::now() - encode_start;
+
+			double parse_seconds = std::numeric_limits<double>::max();
+			for (std::size_t i = 0; i < parse_rounds; i++)
+			{
+				const auto start = std::chrono::steady_clock::now();
+				for (const auto& def : defs)
+				{
+					entries.clear();
+					def_encoding::parse(encoding, def, entries);
+				}
+				const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+				parse_seconds = std::min(parse_seconds, std::max(elapsed.count(), 1e-9));
+			}
+			std::cout << std::format(R"({{"encoding":"{}","defs":{},"bytes":{},"ratio":{:.2f},"encode_seconds":{:.2f},"parse_seconds":{:.2f},"defs_per_sec":{:.1f},"mb_per_sec":{:.1f}}})",
+				def_encoding::name(encoding), defs.size(), bytes, static_cast<double>(bytes) / static_cast<double>(std::max<std::uint64_t>(cbor_bytes, 1)),
+				encode_elapsed.count(), parse_seconds, static_cast<double>(defs.size()) / parse_seconds,
+				static_cast<double>(bytes) / parse_seconds / (1024 * 1024)) << std::endl;
+		}
+	}
+
+	// write a copy of `file` to `out_filename`, with every definition in `encoding`
+	// Complexity: O(n_words * log(n_words) + total_defs_size)
+	// @throws std::runtime_error  on file i/o error, or if a definition can't be encoded
+	void recode(const dictionary_file& file, def_encoding::encoding encoding, const std::string& out_filename)
+	{
+		const auto from = def_encoding::from_id(file.def_encoding());
+		if (from != encoding && from != def_encoding::encoding::cbor)
+			{ throw std::runtime_error("Definitions can only be encoded from CBOR"); }
+		dictionary_file_builder builder(out_filename, true, true);
+		std::vector<std::byte> buf;
+		file.for_each_def([&](std::span<const std::byte> def, std::span<const std::string_view> def_words)
+		{
+			const auto encoded = (from == encoding ? def : def_encoding::encode(encoding, def, buf));
+			for (const auto word : def_words)
+				{ builder.add_word(word, encoded); }
+		});
+		builder.set_def_encoding(static_cast<std::uint32_t>(encoding));
+		builder.finish();
+	}
+
+	options parse_args(int argc, char** argv)
+	{
+		options opts;
+		for (int i = 1; i < argc; i++)
+		{
+			const std::string_view arg = argv[i];
+			const auto next_arg = [&]() -> std::string_view
+			{
+				if (i + 1 >= argc)
+					{ throw std::invalid_argument(std::format("Missing value for {}", arg)); }
+				return argv[++i];
+			};
+			if (arg == "-j")
+				{ opts.num_threads = std::max<std::size_t>(std::stoull(std::string(next_arg())), 1); }
+			else if (arg == "--parser")
+			{
+				const auto parser = next_arg();
+				if (parser != "coro" && parser != "direct")
+					{ throw std::invalid_argument(std::format("Unknown parser {}", parser)); }
+				opts.direct_parser = (parser == "direct");
+			}
+			else if (arg == "--no-render")
+				{ opts.render = false; }
+			else if (arg == "--check-defs")
+				{ opts.check_defs = true; }
+			else if (arg == "--build-text-index")
+				{ opts.build_text_index = true; }
+			else if (arg == "--fsck")
+				{ opts.fsck = true; }
+			else if (arg == "--bench-codecs")
+				{ opts.bench_codecs = true; }
+			else if (arg == "--recode")
+			{
+				const auto name = next_arg();
+				opts.recode = def_encoding::from_name(name);
+				if (!opts.recode)
+					{ throw std::invalid_argument(std::format("Unknown encoding {}", name)); }
+				opts.recode_filename = next_arg();
+			}
+			else if (arg.starts_with("-") || !opts.filename.empty())
+				{ throw std::invalid_argument(std::format("Unexpected argument {}", arg)); }
+			else
+				{ opts.filename = arg; }
+		}
+		if (opts.filename.empty())
+			{ throw std::invalid_argument("No dictionary file given"); }
+		if (opts.build_text_index && !opts.render)
+			{ throw std::invalid_argument("--build-text-index needs definitions to be rendered"); }
+		if (opts.fsck && opts.build_text_index)
+			{ throw std::invalid_argument("--fsck doesn't modify the file, so can't be combined with --build-text-index"); }
+		if ((opts.bench_codecs || opts.recode) && (opts.fsck || opts.build_text_index || (opts.bench_codecs && opts.recode)))
+			{ throw std::invalid_argument("--bench-codecs and --recode can't be combined with other modes"); }
+		return opts;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	options opts;
+	try
+		{ opts = parse_args(argc, argv); }
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << "\nusage: sdict_tool [-j <n>] [--parser coro|direct] [--no-render] [--check-defs] [--build-text-index] <file.sdict>"
+			"\n       sdict_tool --fsck [-j <n>] <file.sdict>"
+			"\n       sdict_tool --bench-codecs <file.sdict>"
+			"\n       sdict_tool --recode cbor|flat <out.sdict> <file.sdict>" << std::endl;
+		return 1;
+	}
+
+	if (opts.fsck)
+	{
+		try
+		{
+			const auto start = std::chrono::steady_clock::now();
+			const auto report = dictionary_file::fsck(opts.filename, opts.num_threads);
+			const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+			for (const auto& error : report.errors)
+				{ std::cerr << error << '\n'; }
+			std::cout << std::format(R"({{"errors":{},"words":{},"defs":{},"unreferenced_bytes":{},"words_sorted":{},"threads":{},"seconds":{:.2f}}})",
+				report.errors.size(), report.num_words, report.num_defs, report.unreferenced_bytes, report.words_sorted,
+				opts.num_threads, elapsed.count()) << std::endl;
+			return report.errors.empty() ? 0 : 1;
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << e.what() << std::endl;
+			return 1;
+		}
+	}
+
+	if (opts.bench_codecs || opts.recode)
+	{
+		try
+		{
+			dictionary_file file;
+			file.open_mapped(opts.filename, false);
+			if (opts.bench_codecs)
+				{ bench_codecs(file); }
+			else
+				{ recode(file, opts.recode.value(), opts.recode_filename); }
+			return 0;
+		}
+		catch (const std::exception& e)
+		{
+			std::cerr << e.what() << std::endl;
+			return 1;
+		}
+	}
+
+	try
+	{
+		dictionary_file file;
+		// definitions are checked while processing if requested, in parallel
+		file.open_mapped(opts.filename, false);
+		std::vector<std::string_view> words;
+		words.reserve(file.num_words());
+		for (const auto word : file.prefix_range(""))
+			{ words.push_back(word); }
+
+		work_queue queue(words.size(), opts.num_threads);
+		std::vector<worker_state> states(opts.num_threads);
+		const auto start = std::chrono::steady_clock::now();
+		{
+			std::vector<std::jthread> workers;
+			for (std::size_t i = 0; i < opts.num_threads; i++)
+			{
+				workers.emplace_back([&, i]()
+				{
+					auto& state = states[i];
+					while (const auto chunk = queue.next(i))
+					{
+						for (std::size_t j = chunk->first; j < chunk->second; j++)
+						{
+							try
+								{ process(file, words[j], opts, state); }
+							catch (const std::exception& e)
+								{ state.failures.emplace_back(words[j], e.what()); }
+							state.num_words++;
+						}
+					}
+				});
+			}
+		}
+		const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+		std::size_t num_words = 0, num_failed = 0, def_bytes = 0, rendered_chars = 0;
+		for (const auto& state : states)
+		{
+			for (const auto& [word, error] : state.failures)
+				{ std::cerr << word << ": " << error << '\n'; }
+			num_words += state.num_words;
+			num_failed += state.failures.size();
+			def_bytes += state.def_bytes;
+			rendered_chars += state.rendered_chars;
+		}
+		const double seconds = std::max(elapsed.count(), 1e-9);
+		std::cout << std::format(R"({{"words":{},"failed":{},"threads":{},"seconds":{:.2f},"words_per_sec":{:.1f},"def_mb_per_sec":{:.1f},"rendered_chars":{},"clustered":{}}})",
+			num_words, num_failed, opts.num_threads, seconds, static_cast<double>(num_words) / seconds,
+			static_cast<double>(def_bytes) / seconds / (1024 * 1024), rendered_chars, file.is_clustered()) << std::endl;
+
+		if (opts.build_text_index)
+		{
+			file.close();
+			file.open(opts.filename, false);
+			file.set_text_index(states | std::views::transform(&worker_state::texts) | std::views::join);
+		}
+		return num_failed == 0 ? 0 : 1;
+	}
+	catch (const std::exception& e)
+	{
+		std::cerr << e.what() << std::endl;
+		return 1;
+	}
+}
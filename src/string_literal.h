@@ -0,0 +1,20 @@
+#ifndef STRING_LITERAL_H
+#define STRING_LITERAL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <string_view>
+
+// string literal usable as a template parameter
+template<std::size_t size>
+struct string_literal_wrapper
+{
+	char data[size];
+	consteval string_literal_wrapper(const char (&str)[size])
+		{ std::copy_n(str, size, data); }
+
+	// without null terminator
+	constexpr std::string_view view() const noexcept { return std::string_view(data, size - 1); }
+};
+
+#endif
@@ -1,11 +1,13 @@
 #ifndef STYLES_H
 #define STYLES_H
 
-#include <array>
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string_view>
 #include <utility>
-
-#include <FL/Fl.H>
-#include <FL/Fl_Text_Display.H>
+#include <vector>
 
 enum style_modifier : unsigned char
 {
@@ -21,27 +23,6 @@ enum class style : unsigned char
 	title  = 0b00001101,
 };
 
-const Fl_Fontsize SMALL_SIZE = static_cast<Fl_Fontsize>(0.8 * FL_NORMAL_SIZE);
-const Fl_Fontsize TITLE_SIZE = static_cast<Fl_Fontsize>(1.5 * FL_NORMAL_SIZE);
-
-const std::array<Fl_Text_Display::Style_Table_Entry, 14> styles =
-{ {
-	{ FL_BLACK, FL_HELVETICA,             FL_NORMAL_SIZE }, // 00000000 - normal
-	{ FL_BLACK, FL_HELVETICA_BOLD,        FL_NORMAL_SIZE }, // 00000001 - bold
-	{ FL_BLACK, FL_HELVETICA_ITALIC,      FL_NORMAL_SIZE }, // 00000010 - italic
-	{ FL_BLACK, FL_HELVETICA_BOLD_ITALIC, FL_NORMAL_SIZE }, // 00000011 - bold+italic
-	{ FL_BLACK, FL_HELVETICA,             SMALL_SIZE     }, // 00000100 - small
-	{ FL_BLACK, FL_HELVETICA_BOLD,        SMALL_SIZE     }, // 00000101 - bold small
-	{ FL_BLACK, FL_HELVETICA_ITALIC,      SMALL_SIZE     }, // 00000110 - italic small
-	{ FL_BLACK, FL_HELVETICA_BOLD_ITALIC, SMALL_SIZE     }, // 00000111 - bold+italic small
-	{ FL_BLUE,  FL_COURIER,               FL_NORMAL_SIZE }, // 00001000 - link
-	{ FL_BLUE,  FL_COURIER_BOLD,          FL_NORMAL_SIZE }, // 00001001 - link bold
-	{ FL_BLUE,  FL_COURIER_ITALIC,        FL_NORMAL_SIZE }, // 00001010 - link italic
-	{ FL_BLUE,  FL_COURIER_BOLD_ITALIC,   FL_NORMAL_SIZE }, // 00001011 - link bold+italic
-	{ FL_BLUE,  FL_COURIER,               SMALL_SIZE     }, // 00001100 - link small
-	{ FL_BLACK, FL_HELVETICA,             TITLE_SIZE     }  // 00001101 - title
-} };
-
 constexpr char get_style(style base_style = style::normal, unsigned char modifiers = 0)
 {
 	unsigned char style = std::to_underlying(base_style);
@@ -62,4 +43,61 @@ constexpr char get_style(unsigned char modifiers)
 	return get_style(style::normal, modifiers);
 }
 
+// characters [start, start + length) of a text, which all have the same style (from get_style)
+// rendered text keeps its styles as runs, and they are only expanded to one style per character
+// (as used by Fl_Text_Display::highlight_data) when shown
+struct style_run
+{
+	std::uint32_t start, length;
+	char style;
+};
+
+// append `length` characters with `style` to the end of `runs`, extending the last run if it has the same style
+// Complexity: O(1) amortized
+inline void append_style(std::vector<style_run>& runs, std::size_t length, char style)
+{
+	if (length == 0)
+		{ return; }
+	if (!runs.empty() && runs.back().style == style)
+		{ runs.back().length += static_cast<std::uint32_t>(length); }
+	else
+	{
+		const std::uint32_t start = runs.empty() ? 0 : runs.back().start + runs.back().length;
+		runs.emplace_back(start, static_cast<std::uint32_t>(length), style);
+	}
+}
+
+// append styles of `styles` (one per character) to the end of `runs`
+// Complexity: O(styles.size())
+inline void append_styles(std::vector<style_run>& runs, std::string_view styles)
+{
+	for (std::size_t i = 0; i < styles.size();)
+	{
+		const auto run_end = std::min(styles.find_first_not_of(styles[i], i), styles.size());
+		append_style(runs, run_end - i, styles[i]);
+		i = run_end;
+	}
+}
+
+// Complexity: O(1)
+// @return number of characters covered by `runs`
+inline std::size_t styles_length(std::span<const style_run> runs)
+	{ return runs.empty() ? 0 : runs.back().start + runs.back().length; }
+
+// expand styles of characters from `from` onwards to one style per character
+// Complexity: O(log(n_runs) + expanded length)
+// @param out  buffer which is written to, and must hold styles_length(runs) - from characters
+inline void expand_styles(std::span<const style_run> runs, std::size_t from, char* out)
+{
+	auto it = std::ranges::upper_bound(runs, from, {}, &style_run::start);
+	if (it != runs.begin())
+		{ it--; }
+	for (; it != runs.end(); it++)
+	{
+		const std::size_t start = std::max<std::size_t>(it->start, from), end = it->start + it->length;
+		if (start < end)
+			{ out = std::fill_n(out, end - start, it->style); }
+	}
+}
+
 #endif
@@ -0,0 +1,77 @@
+#ifndef TEXT_INDEX_H
+#define TEXT_INDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// helpers for the full-text (inverted) index of dictionary_file over definition text
+// terms are runs of ASCII letters and digits or non-ASCII bytes (so UTF-8 characters are kept whole), lowercased.
+// posting lists are increasing word numbers, stored as LEB128 varint deltas
+namespace text_index
+{
+	// terms longer than this are truncated, so that e.g. long numbers or urls don't bloat the index
+	constexpr std::size_t max_term_len = 64;
+
+	// call `f` with every term of `text`, in order (repeats included)
+	// Complexity: O(text_len)
+	// @param f  function taking a std::string_view, which is only valid during the call
+	template<typename F>
+	void for_each_term(std::string_view text, F&& f)
+	{
+		std::string term;
+		const auto is_term_char = [](unsigned char c)
+			{ return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c >= 0x80; };
+		for (std::size_t i = 0; i < text.size();)
+		{
+			if (!is_term_char(text[i]))
+			{
+				i++;
+				continue;
+			}
+			term.clear();
+			for (; i < text.size() && is_term_char(text[i]); i++)
+			{
+				if (term.size() < max_term_len)
+					{ term.push_back((text[i] >= 'A' && text[i] <= 'Z') ? static_cast<char>(text[i] - 'A' + 'a') : text[i]); }
+			}
+			f(std::string_view(term));
+		}
+	}
+
+	inline void append_varint(std::uint32_t num, std::vector<std::byte>& out)
+	{
+		while (num >= 0x80)
+		{
+			out.push_back(static_cast<std::byte>((num & 0x7F) | 0x80));
+			num >>= 7;
+		}
+		out.push_back(static_cast<std::byte>(num));
+	}
+
+	// read a varint from the front of `in`, and advance it past it
+	// @return the number, or empty if `in` ends within it or it doesn't fit in 32 bits
+	inline std::optional<std::uint32_t> read_varint(std::span<const std::byte>& in)
+	{
+		std::uint32_t num = 0;
+		for (std::size_t i = 0; i < 5 && i < in.size(); i++)
+		{
+			const auto b = static_cast<std::uint8_t>(in[i]);
+			if (i == 4 && b > 0x0F)
+				{ return {}; }
+			num |= static_cast<std::uint32_t>(b & 0x7F) << (i * 7);
+			if ((b & 0x80) == 0)
+			{
+				in = in.subspan(i + 1);
+				return num;
+			}
+		}
+		return {};
+	}
+}
+
+#endif
@@ -5,7 +5,6 @@
 #include <array>
 #include <cctype>
 #include <cstdint>
-#include <limits>
 #include <ranges>
 #include <string>
 #include <string_view>
@@ -52,224 +51,103 @@ struct check_struct
 template<auto val>
 constexpr auto check = check_struct<val>::val;
 
-// constructs a flat trie from sorted `tokens`, where all children of a node are stored sequentially.
-// {0, 0} denotes the end of a list of children
-// and {0, n}, where n > 0, denotes the end of a key, with n - 1 being its index in `tokens`
-// @return pair of trie array and max token length
-template<typename index_type = std::size_t>
-constexpr auto build_trie()
+constexpr std::size_t max_token_len = std::ranges::max(tokens | std::views::transform([](std::string_view s) { return s.size(); }));
+
+// whether each character appears in any token, so that braces which can't hold a token are left early
+constexpr std::array<bool, 256> token_chars = []()
 {
-	constexpr std::size_t max_len = []()
-	{
-		std::size_t max_size = 0;
-		for (auto s : tokens)
-		{
-			max_size = std::max(max_size, s.size());
-		}
-		return max_size;
-	}();
-	constexpr std::size_t trie_size = []()
+	std::array<bool, 256> res{};
+	for (auto s : tokens)
 	{
-		std::size_t size = 0;
+		for (unsigned char c : s)
+			{ res[c] = true; }
+	}
+	return res;
+}();
 
-		constexpr auto requal = [](std::string_view lhs, std::string_view rhs)
-			{ return std::equal(lhs.rbegin(), lhs.rend(), rhs.rbegin(), rhs.rend()); };
+// perfect hash of `tokens` from their length and first and last characters, with multipliers found at compile time,
+// so a whole token is resolved with one table lookup and one comparison once its end ('|' or '}') is found
+constexpr std::size_t token_table_size = 128;
 
-		for (std::size_t i = 0; i < max_len; i++)
-		{
-			char prev = 0;
-			std::string_view prev_par;
-			bool added = false;
-			for (auto s : tokens)
-			{
+constexpr std::size_t token_hash(std::string_view s, std::uint32_t mul_first, std::uint32_t mul_last)
+{
+	return ((static_cast<unsigned char>(s.front()) * mul_first) ^ (static_cast<unsigned char>(s.back()) * mul_last) ^ s.size())
+		% token_table_size;
+}
 
-				if (i != 0 && s.size() >= i && !requal(s.substr(0, i), prev_par))
-				{
-					prev_par = s.substr(0, i);
-					if (prev != 0)
-						{ size++; }
-					prev = 0;
+struct token_table_type
+{
+	// index in `tokens` + 1 of the token with each hash, or 0 if there is none
+	std::array<std::uint8_t, token_table_size> slots{};
+	std::uint32_t mul_first = 0, mul_last = 0;
+};
 
-					if (s.size() == i)
-						{ size++; added = true; }
-				}
-				if (s.size() > i && s[i] != prev)
-				{
-					prev = s[i];
-					size++;
-					added = true;
-				}
-			}
-			if (added)
-				{ size++; }
-		}
-		std::string_view prev_par;
-		for (auto [tokens_ind, s] : tokens | std::views::enumerate)
-		{
-			if (s.size() == max_len && !requal(s, prev_par))
-			{
-				prev_par = s;
-				size++;
-			}
-		}
-		return size;
-	}();
-	static_assert(trie_size <= std::numeric_limits<index_type>::max(), "index type too small");
-	constexpr auto t = []()
+constexpr token_table_type token_table = []()
+{
+	for (std::uint32_t mul_first = 1; mul_first < 256; mul_first++)
 	{
-		std::array<std::pair<char, index_type>, trie_size> t{};
-		std::array<index_type, max_len - 1> offsets;
-		std::size_t cur_ind = 0;
-		
-		const auto update_parent_ref = [&t, &cur_ind](std::size_t i, std::string_view s)
+		for (std::uint32_t mul_last = 1; mul_last < 256; mul_last++)
 		{
-			std::size_t start_ind = 0;
-			for (std::size_t j = 0; j < i; j++)
+			token_table_type res{ {}, mul_first, mul_last };
+			bool collision = false;
+			for (std::size_t i = 0; i < tokens.size() && !collision; i++)
 			{
-				for (std::size_t k = start_ind; k < t.size(); k++)
-				{
-					auto& [c, ind] = t[k];
-					if (c == 0 && ind == 0)
-						{ return; }
-					else if (c == s[j])
-					{
-						if (j == i - 1)
-						{
-							if (ind == 0)
-								{ ind = cur_ind; }
-							return;
-						}
-						start_ind = ind;
-						break;
-					}
-				}
-			}
-		};
-
-		constexpr auto requal = [](std::string_view lhs, std::string_view rhs)
-			{ return std::equal(lhs.rbegin(), lhs.rend(), rhs.rbegin(), rhs.rend()); };
-
-		for (std::size_t i = 0; i < max_len; i++)
-		{
-			if (i != 0)
-				{ offsets[i - 1] = cur_ind; }
-			char prev = 0;
-			std::string_view prev_par;
-			bool added = false;
-			for (auto [tokens_ind, s] : tokens | std::views::enumerate)
-			{
-
-				if (i != 0 && s.size() >= i && !requal(s.substr(0, i), prev_par))
-				{
-					prev_par = s.substr(0, i);
-					if (prev != 0)
-						{ cur_ind++; }
-					update_parent_ref(i, s);
-					prev = 0;
-
-					if (s.size() == i)
-					{
-						t[cur_ind] = { 0, tokens_ind + 1 };
-						cur_ind++;
-						added = true;
-					}
-				}
-				if (s.size() > i && s[i] != prev)
-				{
-					prev = s[i];
-					t[cur_ind] = { prev, 0 };
-					cur_ind++;
-					added = true;
-				}
+				auto& slot = res.slots[token_hash(tokens[i], mul_first, mul_last)];
+				collision = (slot != 0);
+				slot = static_cast<std::uint8_t>(i + 1);
 			}
-			if (added)
-			{ cur_ind++; }
+			if (!collision)
+				{ return res; }
 		}
-		std::string_view prev_par;
-		for (auto [tokens_ind, s] : tokens | std::views::enumerate)
-		{
-			if (s.size() == max_len && !requal(s, prev_par))
-			{
-				prev_par = s;
-				update_parent_ref(max_len, s);
+	}
+	return token_table_type{};
+}();
+static_assert(token_table.mul_first != 0, "no perfect hash of tokens found, increase token_table_size");
 
-				t[cur_ind] = { 0, tokens_ind + 1 };
-				cur_ind++;
-			}
-		}
-		return t;
-	}();
-	constexpr std::string_view error_msg = [&t]() -> std::string_view
-	{
-		for (auto [c, i] : t)
-		{
-			if (c == 0)
-			{
-				if (i > tokens.size())
-					{ return "delimiter has invalid index"; }
-			}
-			else
-			{
-				if (i == 0 || i >= t.size())
-					{ return "character has invalid index"; }
-				if (t[i].first == 0 && t[i].second == 0)
-					{ return "child cannot be separator"; }
-			}
-		}
-		return {};
-	}();
-	static_assert(error_msg == "", "invalid trie, see error_msg for more details");
-	return std::make_pair(t, max_len);
+// Complexity: O(1)
+// @return index of `token` in `tokens`, or -1 if it isn't one
+constexpr std::size_t find_token(std::string_view token)
+{
+	if (token.empty() || token.size() > max_token_len)
+		{ return -1; }
+	const std::size_t slot = token_table.slots[token_hash(token, token_table.mul_first, token_table.mul_last)];
+	return (slot != 0 && tokens[slot - 1] == token) ? slot - 1 : -1;
 }
 
-// searches a flat trie created by `create_trie`
-// @return -1 for partial match, 0 for no match, or index + 1 for full match
-template<typename index_type, std::size_t size>
-constexpr int search_trie(const std::array<std::pair<char, index_type>, size>& arr, std::string_view key)
-{
-	index_type start_ind = 0;
-	for (index_type i = 0; i <= key.size(); i++)
+static_assert([]()
 	{
-		if (i == key.size())
-		{
-			if (arr[start_ind].first == 0 && arr[start_ind].second > 0)
-				{ return arr[start_ind].second; }
-			return -1;
-		}
-		for (index_type j = start_ind; j < arr.size(); j++)
+		for (std::size_t i = 0; i < tokens.size(); i++)
 		{
-			const auto [c, ind] = arr[j];
-			if (c == 0)
-			{
-				if (ind == 0)
-					{ return 0; }
-			}
-			else if (c == key[i])
-			{
-				start_ind = ind;
-				break;
-			}
-			else if (c > key[i])
-				{ return 0; }
+			if (find_token(tokens[i]) != i || find_token(std::string(tokens[i]) + "x") != -1)
+				{ return false; }
 		}
-	}
-	return 0;
-}
+		return find_token("") == -1 && find_token("/") == -1;
+	}(), "find_token must find exactly the tokens");
 
-constexpr auto tokens_data = build_trie();
-constexpr auto tokens_trie = tokens_data.first;
-constexpr auto max_token_len = tokens_data.second;
+// scratch buffers of parse_def_text, which can be kept across calls so that rendering a def doesn't allocate
+struct render_context
+{
+	// fields of a token with multiple fields. first element is token itself (e.g. "a_link")
+	std::vector<std::string_view> token_fields;
+	// uppercased text, if add can't uppercase in place
+	std::string caps;
+};
 
-// @param add  callable with arguments (string_view, char) to add text with specified formatting
+// @param add  callable with arguments (string_view, char) to add text with specified formatting.
+//             if it is also callable with (string_view, char, bool), all caps text is added with the bool set to true,
+//             and should be uppercased by add (e.g. in place in its buffer)
 // @param get_pos  callable with no arguments to get current position
-void parse_def_text(std::string_view text, const auto& add, const auto& get_pos)
+// @param ctx  scratch buffers, reused across calls
+void parse_def_text(std::string_view text, const auto& add, const auto& get_pos, render_context& ctx)
 {
 	// TODO: {inf}, {p_br}, {sup}, {gloss},
 	// {dx}, {dx_def}, {dx_ety}, {ma}, {dxt}, {ds}
 	std::size_t start_ind = 0, brace_start = 0;
 	bool in_brace = false, found_token = false;
-	int last_search_res = 0;
-	std::vector<std::string_view> token_fields; // fields of a token with multiple fields. first element is token itself (e.g. "a_link")
+	// index in `tokens` of the token of the current brace, once it has ended
+	std::size_t cur_token = -1;
+	auto& token_fields = ctx.token_fields;
+	token_fields.clear();
 
 	style base_style = style::normal;
 	int num_bold = 0, num_italic = 0, num_small = 0, num_allcaps = 0;
@@ -292,37 +170,58 @@ void parse_def_text(std::string_view text, const auto& add, const auto& get_pos)
 		return get_style(base_style, get_cur_style_mod());
 	};
 
-	const auto add_rich = [&num_allcaps, &add, &get_cur_style](std::string_view str, char style = 0, bool force_caps = false)
+	const auto add_rich = [&num_allcaps, &add, &get_cur_style, &ctx](std::string_view str, char style = 0, bool force_caps = false)
 	{
 		if (style == 0)
 			{ style = get_cur_style(); }
 		if (num_allcaps <= 0 && !force_caps)
 			{ add(str, style); } 
+		else if constexpr (requires { add(str, style, true); })
+			{ add(str, style, true); }
 		else
 		{
-			std::string str_caps;
-			str_caps.resize(str.size());
-			std::transform(str.begin(), str.end(), str_caps.begin(), [](unsigned char c)
+			ctx.caps.resize(str.size());
+			std::transform(str.begin(), str.end(), ctx.caps.begin(), [](unsigned char c)
 				{ return std::toupper(c); });
-			add(str_caps, style);
+			add(ctx.caps, style);
 		}
 	};
 
-	for (auto [i, c] : text | std::views::enumerate)
+	for (std::size_t i = 0; i < text.size(); i++)
 	{
+		if (!in_brace)
+		{
+			// outside braces only '{' matters, so skip straight to the next one (find() is vectorized, e.g. through memchr)
+			i = text.find('{', i);
+			if (i == std::string_view::npos)
+				{ break; }
+		}
+		const char c = text[i];
+
 		if (in_brace)
 		{
 			switch (c)
 			{
 			case '|':
-				found_token = true;
+				if (!found_token)
+				{
+					cur_token = find_token(text.substr(start_ind + 1, i - start_ind - 1));
+					if (cur_token == -1)
+					{
+						reset_state();
+						break;
+					}
+					found_token = true;
+				}
 				token_fields.emplace_back(text.substr(start_ind + 1, i - start_ind - 1));
 				start_ind = i;
 				break;
 			case '}':
-				if (last_search_res > 0) // must be full match
+				if (!found_token)
+					{ cur_token = find_token(text.substr(start_ind + 1, i - start_ind - 1)); }
+				if (cur_token != -1)
 				{
-					switch (last_search_res - 1)
+					switch (cur_token)
 					{
 					case check<token_ind("bc")>:
 						add(": ", get_style(style_bold));
@@ -464,16 +363,9 @@ void parse_def_text(std::string_view text, const auto& add, const auto& get_pos)
 				reset_state();
 				break;
 			default:
-				if (!found_token)
-				{
-					if (i - start_ind > max_token_len)
-						{ reset_state(); }
-
-					auto search_res = search_trie(tokens_trie, text.substr(start_ind + 1, i - start_ind));
-					last_search_res = search_res;
-					if (search_res == 0) // partial or full match ok
-						{ reset_state(); }
-				}
+				// the token is only looked up once it ends, but braces which can't hold one are left as soon as possible
+				if (!found_token && (!token_chars[static_cast<unsigned char>(c)] || i - start_ind > max_token_len))
+					{ reset_state(); }
 				break;
 			}
 		}
@@ -481,7 +373,7 @@ void parse_def_text(std::string_view text, const auto& add, const auto& get_pos)
 		if (!in_brace && c == '{')
 		{
 			in_brace = true;
-			last_search_res = 0;
+			cur_token = -1;
 			if (i != start_ind)
 				{ add_rich(text.substr(start_ind, i - start_ind)); }
 			start_ind = i;
@@ -494,4 +386,11 @@ void parse_def_text(std::string_view text, const auto& add, const auto& get_pos)
 	}
 }
 
+// parse_def_text with its own scratch buffers
+void parse_def_text(std::string_view text, const auto& add, const auto& get_pos)
+{
+	render_context ctx;
+	parse_def_text(text, add, get_pos, ctx);
+}
+
 #endif
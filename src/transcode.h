@@ -0,0 +1,250 @@
+#ifndef TRANSCODE_H
+#define TRANSCODE_H
+
+#include <cstdint>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include <jsoncons/json.hpp>
+#include <jsoncons/json_filter.hpp>
+#include <jsoncons/json_parser.hpp>
+#include <jsoncons_ext/cbor/cbor.hpp>
+
+// filter for transcoding events, which drops object fields that the def parsers (dict_parse.h, cbor_parse.h) never read,
+// e.g. `art`, `uros`, `dros`, `et`, `shortdef`. parsing then doesn't have to walk over them, and the file is smaller
+class def_projection
+{
+private:
+	enum class kind : std::uint8_t
+	{
+		entry, // element of the root array
+		meta,
+		def, // element of `def`
+		sense, // anything in `sseq`
+		any // keep all fields
+	};
+
+	// kind of each open container (for arrays, the kind of objects in them), and whether it is an object
+	std::vector<std::pair<kind, bool>> stack;
+	// kind of the container opened by the value of the last key
+	kind value_kind = kind::any;
+	// whether the value of the last key is dropped
+	bool skip_value = false;
+	// nesting level within a dropped value
+	std::size_t skip_depth = 0;
+
+	static bool is_kept(kind k, std::string_view key)
+	{
+		switch (k)
+		{
+		case kind::entry:
+			return key == "meta" || key == "def";
+		case kind::meta:
+			return key == "id" || key == "stems" || key == "offensive";
+		case kind::def:
+			return key == "sseq";
+		case kind::sense:
+			return key == "sense" || key == "sn" || key == "dt" || key == "sdsense" || key == "sd";
+		default:
+			return true;
+		}
+	}
+
+	static kind child_kind(kind k, std::string_view key)
+	{
+		switch (k)
+		{
+		case kind::entry:
+			return (key == "meta" ? kind::meta : kind::def);
+		case kind::def: [[fallthrough]];
+		case kind::sense:
+			return kind::sense;
+		default:
+			return kind::any;
+		}
+	}
+
+public:
+	// @param key  the key, if `type` is staj_event_type::key
+	// @return whether the event should be written. must be called with every event of a def, in order
+	bool keep(jsoncons::staj_event_type type, std::string_view key = {})
+	{
+		using jsoncons::staj_event_type;
+		const bool is_begin = (type == staj_event_type::begin_array || type == staj_event_type::begin_object);
+		const bool is_end = (type == staj_event_type::end_array || type == staj_event_type::end_object);
+		if (skip_depth > 0)
+		{
+			if (is_begin)
+				{ skip_depth++; }
+			else if (is_end)
+				{ skip_depth--; }
+			return false;
+		}
+		if (std::exchange(skip_value, false))
+		{
+			if (is_begin)
+				{ skip_depth = 1; }
+			return false;
+		}
+
+		if (type == staj_event_type::key)
+		{
+			const kind cur = stack.back().first;
+			if (!is_kept(cur, key))
+				{ skip_value = true; return false; }
+			value_kind = child_kind(cur, key);
+		}
+		else if (is_begin)
+		{
+			// the root array holds entries, and arrays in an array hold the same kind as their parent
+			const kind k = stack.empty() ? kind::entry : (stack.back().second ? value_kind : stack.back().first);
+			stack.emplace_back(k, type == staj_event_type::begin_object);
+		}
+		else if (is_end)
+			{ stack.pop_back(); }
+		return true;
+	}
+};
+
+// forwards the events of a definition as returned by the API (JSON) to an encoder, see def_transcoder
+template<typename F>
+class def_transcoding_filter : public jsoncons::json_filter
+{
+private:
+	using staj_event_type = jsoncons::staj_event_type;
+
+	bool project;
+	def_projection projection;
+	F on_stem;
+	// whether the last key was "stems", and whether the parser is inside a stems array
+	bool stems_key = false, in_stems = false;
+
+	// @param key  the key, if `type` is staj_event_type::key
+	// @return whether the event is written (see def_projection)
+	bool keep(staj_event_type type, std::string_view key = {})
+	{
+		if (project && !projection.keep(type, key))
+			{ return false; }
+		stems_key = false;
+		return true;
+	}
+
+	bool visit_begin_object(jsoncons::semantic_tag tag, const jsoncons::ser_context& context, std::error_code& ec) override
+		{ return !keep(staj_event_type::begin_object) || destination().begin_object(tag, context, ec); }
+	bool visit_end_object(const jsoncons::ser_context& context, std::error_code& ec) override
+		{ return !keep(staj_event_type::end_object) || destination().end_object(context, ec); }
+	bool visit_begin_array(jsoncons::semantic_tag tag, const jsoncons::ser_context& context, std::error_code& ec) override
+	{
+		const bool after_stems_key = stems_key;
+		if (!keep(staj_event_type::begin_array))
+			{ return true; }
+		in_stems = after_stems_key;
+		return destination().begin_array(tag, context, ec);
+	}
+	bool visit_end_array(const jsoncons::ser_context& context, std::error_code& ec) override
+	{
+		if (!keep(staj_event_type::end_array))
+			{ return true; }
+		in_stems = false;
+		return destination().end_array(context, ec);
+	}
+	bool visit_key(const string_view_type& name, const jsoncons::ser_context& context, std::error_code& ec) override
+	{
+		if (!keep(staj_event_type::key, name))
+			{ return true; }
+		stems_key = (name == "stems");
+		return destination().key(name, context, ec);
+	}
+	bool visit_string(const string_view_type& value, jsoncons::semantic_tag tag, const jsoncons::ser_context& context, std::error_code& ec) override
+	{
+		if (!keep(staj_event_type::string_value))
+			{ return true; }
+		if (in_stems)
+			{ on_stem(std::string_view(value)); }
+		return destination().string_value(value, tag, context, ec);
+	}
+	bool visit_null(jsoncons::semantic_tag tag, const jsoncons::ser_context& context, std::error_code& ec) override
+		{ return !keep(staj_event_type::null_value) || destination().null_value(tag, context, ec); }
+	bool visit_bool(bool value, jsoncons::semantic_tag tag, const jsoncons::ser_context& context, std::error_code& ec) override
+		{ return !keep(staj_event_type::bool_value) || destination().bool_value(value, tag, context, ec); }
+	bool visit_int64(std::int64_t value, jsoncons::semantic_tag tag, const jsoncons::ser_context& context, std::error_code& ec) override
+		{ return !keep(staj_event_type::int64_value) || destination().int64_value(value, tag, context, ec); }
+	bool visit_uint64(std::uint64_t value, jsoncons::semantic_tag tag, const jsoncons::ser_context& context, std::error_code& ec) override
+		{ return !keep(staj_event_type::uint64_value) || destination().uint64_value(value, tag, context, ec); }
+	bool visit_double(double value, jsoncons::semantic_tag tag, const jsoncons::ser_context& context, std::error_code& ec) override
+		{ return !keep(staj_event_type::double_value) || destination().double_value(value, tag, context, ec); }
+
+public:
+	def_transcoding_filter(jsoncons::json_visitor& encoder, bool project_, F on_stem_) :
+		jsoncons::json_filter(encoder), project(project_), on_stem(std::forward<F>(on_stem_)) {}
+};
+
+// transcodes a definition as returned by the API (JSON) to CBOR, as stored in sdict files.
+// the JSON is given in pieces (e.g. as it is received), and is never held whole: each piece is parsed as it is added,
+// and the parser only buffers a token which is split between pieces
+// @tparam F  type of on_stem, which may be a reference
+template<typename F>
+class def_transcoder
+{
+private:
+	jsoncons::cbor::cbor_bytes_encoder encoder;
+	def_transcoding_filter<F> filter;
+	jsoncons::json_parser parser;
+
+public:
+	// @param project  whether to only keep the fields which are parsed (see def_projection)
+	// @param on_stem  called with each stem (string in `meta.stems`) of each entry, as std::string_view
+	// @param cbor_bytes  replaced by the CBOR encoded definition, which is complete once finish() returns. its capacity is reused
+	def_transcoder(bool project, F on_stem, std::vector<std::uint8_t>& cbor_bytes) :
+		encoder(cbor_bytes), filter(encoder, project, std::forward<F>(on_stem))
+	{
+		cbor_bytes.clear();
+	}
+
+	// the filter and the encoder refer to each other and to cbor_bytes
+	def_transcoder(const def_transcoder&) = delete;
+	def_transcoder& operator=(const def_transcoder&) = delete;
+
+	// Complexity: O(piece_len)
+	// @throws jsoncons::ser_error  on JSON parse error
+	void add(std::string_view piece)
+	{
+		parser.update(piece.data(), piece.size());
+		parser.parse_some(filter);
+	}
+
+	// end the JSON, which must be complete
+	// @throws jsoncons::ser_error  on JSON parse error
+	void finish()
+	{
+		parser.finish_parse(filter);
+		parser.check_done();
+		encoder.flush();
+	}
+};
+
+// transcode a whole definition, see def_transcoder
+// Complexity: O(json_len)
+// @param project  whether to only keep the fields which are parsed (see def_projection)
+// @param on_stem  called with each stem (string in `meta.stems`) of each entry, as std::string_view
+// @param cbor_bytes  replaced by the CBOR encoded definition. its capacity is reused
+// @throws jsoncons::ser_error  on JSON parse error
+template<typename F>
+void transcode_def(std::string_view json, bool project, F&& on_stem, std::vector<std::uint8_t>& cbor_bytes)
+{
+	def_transcoder<F&> transcoder(project, on_stem, cbor_bytes);
+	transcoder.add(json);
+	transcoder.finish();
+}
+
+// @return CBOR encoded definition (see above)
+template<typename F>
+std::vector<std::uint8_t> transcode_def(std::string_view json, bool project, F&& on_stem)
+{
+	std::vector<std::uint8_t> cbor_bytes;
+	transcode_def(json, project, std::forward<F>(on_stem), cbor_bytes);
+	return cbor_bytes;
+}
+
+#endif
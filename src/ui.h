@@ -1,14 +1,42 @@
+#include <array>
+
 #include <FL/Fl.H>
 #include <FL/Fl_Double_Window.H>
 #include <FL/Fl_Group.H>
 #include <FL/Fl_Input.H>
 #include <FL/Fl_Button.H>
+#include <FL/Fl_Hold_Browser.H>
 #include <FL/Fl_Text_Buffer.H>
+#include <FL/Fl_Text_Display.H>
 
-#include "links.h"
+#include "linked_text_display.h"
 #include "styles.h"
 
+const Fl_Fontsize SMALL_SIZE = static_cast<Fl_Fontsize>(0.8 * FL_NORMAL_SIZE);
+const Fl_Fontsize TITLE_SIZE = static_cast<Fl_Fontsize>(1.5 * FL_NORMAL_SIZE);
+
+// indexed by style (see get_style in styles.h), less 'A'
+const std::array<Fl_Text_Display::Style_Table_Entry, 14> styles =
+{ {
+	{ FL_BLACK, FL_HELVETICA,             FL_NORMAL_SIZE }, // 00000000 - normal
+	{ FL_BLACK, FL_HELVETICA_BOLD,        FL_NORMAL_SIZE }, // 00000001 - bold
+	{ FL_BLACK, FL_HELVETICA_ITALIC,      FL_NORMAL_SIZE }, // 00000010 - italic
+	{ FL_BLACK, FL_HELVETICA_BOLD_ITALIC, FL_NORMAL_SIZE }, // 00000011 - bold+italic
+	{ FL_BLACK, FL_HELVETICA,             SMALL_SIZE     }, // 00000100 - small
+	{ FL_BLACK, FL_HELVETICA_BOLD,        SMALL_SIZE     }, // 00000101 - bold small
+	{ FL_BLACK, FL_HELVETICA_ITALIC,      SMALL_SIZE     }, // 00000110 - italic small
+	{ FL_BLACK, FL_HELVETICA_BOLD_ITALIC, SMALL_SIZE     }, // 00000111 - bold+italic small
+	{ FL_BLUE,  FL_COURIER,               FL_NORMAL_SIZE }, // 00001000 - link
+	{ FL_BLUE,  FL_COURIER_BOLD,          FL_NORMAL_SIZE }, // 00001001 - link bold
+	{ FL_BLUE,  FL_COURIER_ITALIC,        FL_NORMAL_SIZE }, // 00001010 - link italic
+	{ FL_BLUE,  FL_COURIER_BOLD_ITALIC,   FL_NORMAL_SIZE }, // 00001011 - link bold+italic
+	{ FL_BLUE,  FL_COURIER,               SMALL_SIZE     }, // 00001100 - link small
+	{ FL_BLACK, FL_HELVETICA,             TITLE_SIZE     }  // 00001101 - title
+} };
+
 void search_word(Fl_Widget*);
+void search_input(Fl_Widget*);
+void pick_suggestion(Fl_Widget*);
 void nav_back(Fl_Widget*);
 void nav_forward(Fl_Widget*);
 
@@ -33,6 +61,8 @@ public:
 	end_group end_top_bar;
 	Linked_Text_Display text_display;
 	Fl_Text_Buffer text_buf, style_buf;
+	// completions of search_bar, over text_display while shown
+	Fl_Hold_Browser suggestions;
 
 	FLTK_UI() :
 		window(480, 320, "Dictionary"),
@@ -43,12 +73,13 @@ public:
 		button_forward(45, 10, 25, 25, "\342\206\222"),
 		end_top_bar(top_bar),
 		text_display(15, 45, 450, 260),
-		text_buf(), style_buf()
+		text_buf(), style_buf(),
+		suggestions(80, 35, 310, 150)
 	{
 		window.resizable(text_display);
 		top_bar.resizable(search_bar);
-		search_bar.callback(search_word);
-		search_bar.when(FL_WHEN_ENTER_KEY | FL_WHEN_NOT_CHANGED);
+		search_bar.callback(search_input);
+		search_bar.when(FL_WHEN_CHANGED | FL_WHEN_ENTER_KEY | FL_WHEN_NOT_CHANGED);
 		search_button.callback(search_word);
 		button_back.deactivate();
 		button_back.callback(nav_back);
@@ -58,6 +89,10 @@ public:
 		text_display.buffer(text_buf);
 		text_display.highlight_data(&style_buf, styles.data(), styles.size(), 0, [](int, void*){}, nullptr);
 		text_buf.canUndo(0); style_buf.canUndo(0);
+		// words are shown as is, without formatting
+		suggestions.format_char(0);
+		suggestions.callback(pick_suggestion);
+		suggestions.hide();
 		window.end();
 	}
 	
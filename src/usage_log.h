@@ -0,0 +1,117 @@
+#ifndef USAGE_LOG_H
+#define USAGE_LOG_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <ranges>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// how often each word is looked up, kept across runs so that the definitions used most can be warmed up at startup.
+// stored as a small text file of "<count> <word>" lines, of only the max_words most used words.
+// counts are halved whenever their total reaches decay_total, so words which stop being looked up fade out
+class usage_log
+{
+public:
+	constexpr static std::size_t max_words = 1024;
+	constexpr static std::uint64_t decay_total = 1 << 16;
+
+private:
+	std::unordered_map<std::string, std::uint32_t> counts;
+	std::uint64_t total = 0;
+
+	// Complexity: O(n_words)
+	void decay()
+	{
+		total = 0;
+		for (auto it = counts.begin(); it != counts.end();)
+		{
+			it->second /= 2;
+			total += it->second;
+			it = (it->second == 0 ? counts.erase(it) : std::next(it));
+		}
+	}
+
+	// Complexity: O(n_words * log(n_words))
+	// @return (count, word) of every word, most used first (then alphabetically)
+	std::vector<std::pair<std::uint32_t, std::string_view>> ranked() const
+	{
+		std::vector<std::pair<std::uint32_t, std::string_view>> res;
+		res.reserve(counts.size());
+		for (const auto& [word, count] : counts)
+			{ res.emplace_back(count, word); }
+		std::ranges::sort(res, [](const auto& a, const auto& b) { return a.first != b.first ? a.first > b.first : a.second < b.second; });
+		return res;
+	}
+
+public:
+	// add the counts saved in `filename`. a missing file is empty, and malformed lines are skipped
+	// Complexity: O(file_size)
+	// File Access: Read, file_size
+	void load(const std::string& filename)
+	{
+		std::ifstream fin(filename);
+		std::uint32_t count;
+		std::string word;
+		while (fin >> count && fin.get() == ' ' && std::getline(fin, word))
+		{
+			if (!word.empty() && count > 0)
+			{
+				counts[word] += count;
+				total += count;
+			}
+		}
+		while (total >= decay_total)
+			{ decay(); }
+	}
+
+	// count a lookup of `word`
+	// Complexity: O(1) amortized
+	void record(std::string_view word)
+	{
+		if (word.empty())
+			{ return; }
+		counts[std::string(word)]++;
+		if (++total >= decay_total)
+			{ decay(); }
+	}
+
+	// Complexity: O(n_words * log(n_words))
+	// @return the `k` most used words, most used first
+	std::vector<std::string> top(std::size_t k) const
+	{
+		std::vector<std::string> res;
+		for (const auto& [count, word] : ranked() | std::views::take(k))
+			{ res.emplace_back(word); }
+		return res;
+	}
+
+	// write the max_words most used words to `filename`, replacing it (through a temporary file, so it is never left half written)
+	// Complexity: O(n_words * log(n_words))
+	// File Access: Write, at most max_words lines
+	// @return false on file i/o error, in which case `filename` is unchanged
+	bool save(const std::string& filename) const
+	{
+		const std::string tmp_file = filename + ".tmp";
+		{
+			std::ofstream fout(tmp_file, std::ios::trunc);
+			for (const auto& [count, word] : ranked() | std::views::take(max_words))
+				{ fout << count << ' ' << word << '\n'; }
+			if (!fout.flush())
+				{ return false; }
+		}
+		std::error_code ec;
+		std::filesystem::rename(tmp_file, filename, ec);
+		return !ec;
+	}
+};
+
+#endif
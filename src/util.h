@@ -1,18 +1,10 @@
 #ifndef UTIL_H
 #define UTIL_H
 
-#include <algorithm>
-
 #include <FL/Fl.H>
 #include <FL/Fl_Text_Buffer.H>
 
-template<std::size_t size>
-struct string_literal_wrapper
-{
-	char data[size];
-	consteval string_literal_wrapper(const char (&str)[size])
-		{ std::copy_n(str, size, data); }
-};
+#include "string_literal.h"
 
 template<string_literal_wrapper key, typename T>
 struct Fl_Text_Buffer_m
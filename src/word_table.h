@@ -0,0 +1,150 @@
+#ifndef WORD_TABLE_H
+#define WORD_TABLE_H
+
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// compact list of words with associated definition indices
+// all words are stored back to back in a single char arena, and each record refers
+// to a range of the arena. records are sorted instead of the words themselves,
+// so reordering never moves string data
+class word_table
+{
+public:
+	struct record
+	{
+		std::uint32_t offset, length;
+		// offset from the start of the defs section
+		std::uint64_t def_ind;
+	};
+
+private:
+	std::string arena;
+	std::vector<record> records;
+
+public:
+	using iterator = std::vector<record>::iterator;
+	using const_iterator = std::vector<record>::const_iterator;
+
+	std::string_view word(const record& r) const noexcept
+		{ return { arena.data() + r.offset, r.length }; }
+	std::string_view word(std::size_t i) const noexcept
+		{ return word(records[i]); }
+
+	// comparison function object for sorting records by word
+	auto less() const noexcept
+		{ return [this](const record& lhs, const record& rhs) { return word(lhs) < word(rhs); }; }
+
+	// Complexity: O(word_len) amortized
+	// @throws std::length_error  if the arena would exceed 32-bit offsets
+	void emplace_back(std::string_view w, std::uint64_t def_ind)
+	{
+		if (w.size() > std::numeric_limits<std::uint32_t>::max() - arena.size())
+			{ throw std::length_error("Word table is too large"); }
+		records.emplace_back(static_cast<std::uint32_t>(arena.size()), static_cast<std::uint32_t>(w.size()), def_ind);
+		arena.append(w);
+	}
+
+	// @param total_len  total length of all words (not including nulls)
+	void reserve(std::size_t n, std::size_t total_len)
+	{
+		records.reserve(n);
+		arena.reserve(total_len);
+	}
+
+	void clear() noexcept
+	{
+		arena.clear();
+		records.clear();
+	}
+
+	std::size_t size() const noexcept { return records.size(); }
+	bool empty() const noexcept { return records.empty(); }
+	record& operator[](std::size_t i) noexcept { return records[i]; }
+	const record& operator[](std::size_t i) const noexcept { return records[i]; }
+	iterator begin() noexcept { return records.begin(); }
+	iterator end() noexcept { return records.end(); }
+	const_iterator begin() const noexcept { return records.begin(); }
+	const_iterator end() const noexcept { return records.end(); }
+
+	// Complexity: O(last - first)
+	// @return total length of words in [first, last), including a null terminator for each word
+	std::size_t total_len(std::size_t first, std::size_t last) const noexcept
+	{
+		std::size_t len = 0;
+		for (std::size_t i = first; i < last; i++)
+			{ len += records[i].length + 1; }
+		return len;
+	}
+
+	// sort records in [first, size())
+	// Complexity: O(N*log(N)), where N is size() - first
+	void sort(std::size_t first = 0)
+		{ std::sort(records.begin() + first, records.end(), less()); }
+
+	// Complexity: O(N), where N is size() - first
+	// @return whether [first, size()) contains adjacent equal words
+	bool has_adjacent_dup(std::size_t first = 0) const
+	{
+		return std::adjacent_find(records.begin() + first, records.end(),
+			[this](const record& lhs, const record& rhs) { return word(lhs) == word(rhs); }) != records.end();
+	}
+
+	// merge sorted ranges [0, mid) and [mid, size())
+	// Complexity: O(N*log(N)) worst case, O(N) if memory is available
+	void merge(std::size_t mid)
+		{ std::inplace_merge(records.begin(), records.begin() + mid, records.end(), less()); }
+
+	bool is_sorted() const
+		{ return std::is_sorted(records.begin(), records.end(), less()); }
+
+	// binary search in sorted range [0, last)
+	// Complexity: O(log(last))
+	// @return index of first record in [0, last) that is not less than `w`
+	std::size_t lower_bound(std::size_t last, std::string_view w) const
+	{
+		return std::lower_bound(records.begin(), records.begin() + last, w,
+			[this](const record& r, std::string_view w2) { return word(r) < w2; }) - records.begin();
+	}
+
+	// binary search in range [first, last), which `pred` partitions (it is true of the words of a prefix of the range only)
+	// Complexity: O(log(last - first))
+	// @return index of first record in [first, last) for whose word `pred` is false
+	template<typename Pred>
+	std::size_t partition_point(std::size_t first, std::size_t last, Pred pred) const
+	{
+		return std::partition_point(records.begin() + first, records.begin() + last,
+			[this, &pred](const record& r) { return pred(word(r)); }) - records.begin();
+	}
+
+	// linear search in unsorted range [first, last)
+	// Complexity: O(last - first)
+	// @return index of matching record, or last if not found
+	std::size_t find(std::size_t first, std::size_t last, std::string_view w) const
+	{
+		return std::find_if(records.begin() + first, records.begin() + last,
+			[this, w](const record& r) { return word(r) == w; }) - records.begin();
+	}
+
+	// rebuild the arena so words are laid out in record order, for locality during binary search
+	// Complexity: O(total_len)
+	void compact_arena()
+	{
+		std::string new_arena;
+		new_arena.reserve(arena.size());
+		for (auto& r : records)
+		{
+			const auto cur_offset = static_cast<std::uint32_t>(new_arena.size());
+			new_arena.append(word(r));
+			r.offset = cur_offset;
+		}
+		arena = std::move(new_arena);
+	}
+};
+
+#endif
@@ -1,13 +1,33 @@
+#include <algorithm>
+#include <atomic>
 #include <chrono>
+#include <cstdint>
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <map>
 #include <random>
+#include <set>
+#include <sstream>
 #include <span>
+#include <string>
 #include <string_view>
+#include <thread>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
+#include "async_reader.h"
+#include "def_encoding.h"
+#include "dictionary_set.h"
+#include "flat_def.h"
+#include "hash.h"
+#include "json_coro_cursor.h"
+#include "json_util.h"
+#include "live_dictionary.h"
+#include "render_cache.h"
+#include "sdict_builder.h"
 #include "sdict_file.h"
+#include "text_index.h"
 #include <Catch2/catch_test_macros.hpp>
 #include <Catch2/matchers/catch_matchers.hpp>
 #include <Catch2/matchers/catch_matchers_string.hpp>
@@ -55,6 +75,30 @@ static ContainerT random_bytes(std::size_t min_length, std::size_t max_length, u
 	return s;
 }
 
+static void write_uint_LE(std::ostream& fout, std::uint64_t num, std::size_t bytes)
+{
+	for (std::size_t i = 0; i < bytes; i++)
+		{ fout.put(static_cast<char>((num >> (i * 8)) & 0xFF)); }
+}
+
+static std::uint64_t fnv1a(std::string_view s)
+{
+	std::uint64_t hash = 0xcbf29ce484222325;
+	for (unsigned char c : s)
+	{
+		hash ^= c;
+		hash *= 0x100000001b3;
+	}
+	return hash;
+}
+
+static char file_version(std::string_view filename)
+{
+	std::ifstream fin{std::string(filename), std::ios::binary};
+	fin.seekg(5);
+	return fin.get();
+}
+
 TEST_CASE("create when exists", "[sdict]")
 {
 	constexpr std::string_view filename = "test.sdict";
@@ -305,7 +349,2149 @@ TEST_CASE("create and add", "[sdict]")
 	std::filesystem::remove(filename);
 }
 
+TEST_CASE("read mapped", "[sdict]")
+{
+	constexpr std::string_view filename = "test.sdict";
+	if (std::filesystem::exists(filename))
+		{ std::filesystem::remove(filename); }
+
+	std::unordered_map<std::string, std::vector<std::byte>> words;
+	{
+		dictionary_file file(filename);
+		for (std::size_t i = 0; i < 1024; i++)
+		{
+			std::string word = random_string(1, 32, ' ', '~');
+			auto def = random_bytes<std::vector<std::byte>>(1, 256, 0, 255);
+			if (file.add_word<false>(word, def))
+				{ words.emplace(std::move(word), std::move(def)); }
+		}
+	}
+
+	{
+		dictionary_file file;
+		file.open_mapped(filename);
+		REQUIRE_FALSE(file.created_file);
+		REQUIRE(file.num_words() == words.size());
+		// only a hint, which skips absent words
+		std::vector<std::string_view> warm_words = { "\x7f absent" };
+		for (const auto& [word, def] : words)
+			{ warm_words.push_back(word); }
+		file.will_need(warm_words);
+		for (const auto& [word, def] : words)
+		{
+			REQUIRE(file.contains(word));
+			REQUIRE(cmp_as_bytes(def, file.find_view(word, true).value()));
+			REQUIRE(cmp_as_bytes(def, file.find(word, true).value()));
+		}
+		REQUIRE_FALSE(file.find_view("").has_value());
+		REQUIRE_THROWS_AS(file.add_word("", std::string_view("def")), std::logic_error);
+	}
+
+	std::filesystem::remove(filename);
+}
+
+TEST_CASE("read+write version 1", "[sdict]")
+{
+	constexpr std::string_view filename = "test.sdict";
+	if (std::filesystem::exists(filename))
+		{ std::filesystem::remove(filename); }
+
+	{
+		std::ofstream fout{std::string(filename), std::ios::binary};
+		fout.write("SDICT\x01\x00", 7);
+		write_uint_LE(fout, 2, 4); // reserved words
+		write_uint_LE(fout, 8, 4); // words section size
+		write_uint_LE(fout, 1, 4); // num words
+		write_uint_LE(fout, 1, 4); write_uint_LE(fout, 0, 4); // word inds
+		write_uint_LE(fout, 1, 4); write_uint_LE(fout, 0, 4); // def inds
+		fout.write("a\0\0\0\0\0\0\0", 8);
+		write_uint_LE(fout, 3, 4);
+		write_uint_LE(fout, fnv1a("abc"), 8);
+		fout.write("abc", 3);
+	}
+
+	{
+		dictionary_file file(filename);
+		REQUIRE(file.num_words() == 1);
+		REQUIRE(cmp_as_bytes(std::string_view("abc"), file.find("a", true).value()));
+		// fits in existing sections, file should be updated in place
+		REQUIRE(file.add_word("b", std::string_view("def")));
+	}
+	REQUIRE(file_version(filename) == 1);
+
+	{
+		dictionary_file file(filename);
+		REQUIRE(file.num_words() == 2);
+		REQUIRE(cmp_as_bytes(std::string_view("def"), file.find("b", true).value()));
+		// exceeds reserved words, file should be rewritten with current version
+		REQUIRE(file.add_word("c", std::string_view("ghi")));
+	}
+	REQUIRE(file_version(filename) == 4);
+
+	{
+		dictionary_file file;
+		file.open_mapped(filename);
+		REQUIRE(file.num_words() == 3);
+		REQUIRE(cmp_as_bytes(std::string_view("abc"), file.find_view("a", true).value()));
+		REQUIRE(cmp_as_bytes(std::string_view("def"), file.find_view("b", true).value()));
+		REQUIRE(cmp_as_bytes(std::string_view("ghi"), file.find_view("c", true).value()));
+		REQUIRE_FALSE(file.contains("d"));
+	}
+
+	std::filesystem::remove(filename);
+}
+
 // TODO: test def with unsigned char and char vector (or string)
 // and also with span
 
 // TODO: need more tests
+
+TEST_CASE("prefix range", "[sdict]")
+{
+	constexpr std::string_view filename = "test.sdict";
+	if (std::filesystem::exists(filename))
+		{ std::filesystem::remove(filename); }
+
+	const std::vector<std::string_view> words = { "a", "ab", "abc", "abd", "b", "ba", "bab", "c" };
+	const auto to_vector = [](auto&& r)
+	{
+		std::vector<std::string> v;
+		for (const auto w : r)
+			{ v.emplace_back(w); }
+		return v;
+	};
+	{
+		dictionary_file file(filename);
+		// insert out of order
+		for (const auto i : { 5, 0, 7, 2, 4, 1, 6, 3 })
+			{ REQUIRE(file.add_word(words[i], std::string_view("def"))); }
+
+		REQUIRE(to_vector(file.prefix_range("ab")) == std::vector<std::string>{ "ab", "abc", "abd" });
+		REQUIRE(to_vector(file.prefix_range("a", 2)) == std::vector<std::string>{ "a", "ab" });
+		REQUIRE(to_vector(file.prefix_range("")).size() == words.size());
+		REQUIRE(to_vector(file.prefix_range("bb")).empty());
+		REQUIRE(to_vector(file.prefix_range("d")).empty());
+		REQUIRE(to_vector(file.prefix_range("b", 0)).empty());
+
+		// bounds of a longer prefix are found within those of a shorter one
+		const auto a_bounds = file.prefix_bounds("a");
+		REQUIRE(a_bounds == std::pair<std::size_t, std::size_t>(0, 4));
+		REQUIRE(file.prefix_bounds("ab", a_bounds) == std::pair<std::size_t, std::size_t>(1, 4));
+		REQUIRE(file.prefix_bounds("abd", file.prefix_bounds("ab", a_bounds)) == std::pair<std::size_t, std::size_t>(3, 4));
+		REQUIRE(file.word_at(3) == "abd");
+		REQUIRE(file.prefix_bounds("b") == std::pair<std::size_t, std::size_t>(4, 7));
+		const auto [first, last] = file.prefix_bounds("abe", a_bounds);
+		REQUIRE(first == last);
+		REQUIRE(file.prefix_bounds("") == std::pair<std::size_t, std::size_t>(0, words.size()));
+	}
+
+	{
+		dictionary_file file;
+		file.open_mapped(filename);
+		REQUIRE(to_vector(file.prefix_range("ba")) == std::vector<std::string>{ "ba", "bab" });
+	}
+
+	std::filesystem::remove(filename);
+}
+
+TEST_CASE("read+write codec prefixed", "[sdict]")
+{
+	constexpr std::string_view filename = "test.sdict";
+	if (std::filesystem::exists(filename))
+		{ std::filesystem::remove(filename); }
+
+	{
+		const auto def = std::string("\0abc", 4); // raw codec
+		const auto ext = std::string("xyz");
+		std::string ext_table;
+		{
+			std::ostringstream sout;
+			sout.write("TEST", 4);
+			sout.put(12 + def.size() + 1); sout.write("\0\0\0", 3); // offset of ext, starting at 1
+			ext_table = sout.str();
+		}
+
+		std::ofstream fout{std::string(filename), std::ios::binary};
+		fout.write("SDICT\x03\x00", 7);
+		write_uint_LE(fout, 2, 4); // reserved words
+		write_uint_LE(fout, 8, 4); // words section size
+		write_uint_LE(fout, 1, 4); // num words
+		write_uint_LE(fout, 1, 4); // flags (codec prefix)
+		write_uint_LE(fout, (12 + def.size()) + (12 + ext.size()) + 1, 4); // ext table ind
+		write_uint_LE(fout, 1, 4); write_uint_LE(fout, 0, 4); // word inds
+		write_uint_LE(fout, 1, 4); write_uint_LE(fout, 0, 4); // def inds
+		for (std::uint64_t i = 0; i < 4; i++) // hash index
+		{
+			const bool is_slot = (i == fnv1a("a") % 4);
+			write_uint_LE(fout, is_slot ? 1 : 0, 4);
+			write_uint_LE(fout, is_slot ? fnv1a("a") >> 32 : 0, 4);
+		}
+		fout.write("a\0\0\0\0\0\0\0", 8);
+		for (const auto& data : { def, ext, ext_table })
+		{
+			write_uint_LE(fout, data.size(), 4);
+			write_uint_LE(fout, fnv1a(data), 8);
+			fout.write(data.data(), data.size());
+		}
+	}
+
+	{
+		dictionary_file file(filename);
+		REQUIRE(file.num_words() == 1);
+		REQUIRE(cmp_as_bytes(std::string_view("abc"), file.find("a", true).value()));
+		REQUIRE(file.add_word("b", std::string_view("def")));
+		// exceeds reserved words, file should be rewritten, keeping codec prefixes and extensions
+		REQUIRE(file.add_word("c", std::string_view("ghi")));
+		REQUIRE(cmp_as_bytes(std::string_view("abc"), file.find("a", true).value()));
+	}
+	REQUIRE(file_version(filename) == 3);
+
+	{
+		dictionary_file file;
+		file.open_mapped(filename);
+		REQUIRE(file.num_words() == 3);
+		REQUIRE(cmp_as_bytes(std::string_view("abc"), file.find_view("a", true).value()));
+		REQUIRE(cmp_as_bytes(std::string_view("def"), file.find_view("b", true).value()));
+		REQUIRE(cmp_as_bytes(std::string_view("ghi"), file.find("c", true).value()));
+	}
+
+	std::filesystem::remove(filename);
+}
+
+TEST_CASE("version 4 def alignment", "[sdict]")
+{
+	constexpr std::string_view filename = "test.sdict";
+	if (std::filesystem::exists(filename))
+		{ std::filesystem::remove(filename); }
+	const auto read_uint32 = [&](std::streamoff off)
+	{
+		std::ifstream fin{std::string(filename), std::ios::binary};
+		fin.seekg(off);
+		std::uint32_t val = 0;
+		for (int i = 0; i < 4; i++)
+			{ val |= static_cast<std::uint32_t>(static_cast<unsigned char>(fin.get())) << (i * 8); }
+		return val;
+	};
+
+	SECTION("new file")
+	{
+		// odd sizes, so that unaligned defs would follow each other directly
+		std::vector<std::string> defs;
+		{
+			dictionary_file file(filename);
+			for (std::size_t i = 1; i <= 20; i++)
+			{
+				defs.push_back(std::string(i, 'a' + i));
+				REQUIRE(file.add_word("word" + std::to_string(i), defs.back()));
+			}
+		}
+		REQUIRE(file_version(filename) == 4);
+
+		// stored def inds count in units of 8 bytes
+		const std::uint32_t reserved_words = read_uint32(7), words_sect_size = read_uint32(11), num_words = read_uint32(15);
+		REQUIRE(num_words == defs.size());
+		const std::streamoff inds_off = 27, defs_off = inds_off + reserved_words * 8 + reserved_words * 2 * 8 + words_sect_size;
+		std::set<std::uint32_t> sizes;
+		for (std::uint32_t i = 0; i < num_words; i++)
+		{
+			const std::uint32_t ind = read_uint32(inds_off + reserved_words * 4 + i * 4);
+			REQUIRE(ind != 0);
+			sizes.insert(read_uint32(defs_off + static_cast<std::streamoff>(ind - 1) * 8));
+		}
+		REQUIRE(sizes.size() == defs.size());
+		REQUIRE(*sizes.begin() == 1);
+		REQUIRE(*sizes.rbegin() == 20);
+
+		dictionary_file file;
+		file.open_mapped(filename);
+		for (std::size_t i = 1; i <= 20; i++)
+			{ REQUIRE(cmp_as_bytes(std::string_view(defs[i - 1]), file.find_view("word" + std::to_string(i), true).value())); }
+		file.close();
+		const auto report = dictionary_file::fsck(filename);
+		REQUIRE(report.errors.empty());
+		REQUIRE(report.unreferenced_bytes == 0);
+	}
+
+	SECTION("version 3 file converts when rewritten")
+	{
+		{
+			std::ofstream fout{std::string(filename), std::ios::binary};
+			fout.write("SDICT\x03\x00", 7);
+			write_uint_LE(fout, 2, 4); // reserved words
+			write_uint_LE(fout, 8, 4); // words section size
+			write_uint_LE(fout, 1, 4); // num words
+			write_uint_LE(fout, 0, 4); // flags
+			write_uint_LE(fout, 0, 4); // ext table ind
+			write_uint_LE(fout, 1, 4); write_uint_LE(fout, 0, 4); // word inds
+			write_uint_LE(fout, 1, 4); write_uint_LE(fout, 0, 4); // def inds
+			for (std::uint64_t i = 0; i < 4; i++) // hash index
+			{
+				const bool is_slot = (i == fnv1a("a") % 4);
+				write_uint_LE(fout, is_slot ? 1 : 0, 4);
+				write_uint_LE(fout, is_slot ? fnv1a("a") >> 32 : 0, 4);
+			}
+			fout.write("a\0\0\0\0\0\0\0", 8);
+			write_uint_LE(fout, 3, 4);
+			write_uint_LE(fout, fnv1a("abc"), 8);
+			fout.write("abc", 3);
+		}
+
+		{
+			dictionary_file file(filename);
+			// fits in existing sections, so the def is appended unaligned as in version 3
+			REQUIRE(file.add_word("b", std::string_view("defgh")));
+		}
+		REQUIRE(file_version(filename) == 3);
+		// def inds still count in bytes
+		REQUIRE(read_uint32(27 + 12) == 1 + 12 + 3);
+
+		{
+			dictionary_file file(filename);
+			REQUIRE(cmp_as_bytes(std::string_view("defgh"), file.find("b", true).value()));
+			file.compact();
+		}
+		REQUIRE(file_version(filename) == 4);
+
+		dictionary_file file;
+		file.open_mapped(filename);
+		REQUIRE(file.num_words() == 2);
+		REQUIRE(cmp_as_bytes(std::string_view("abc"), file.find_view("a", true).value()));
+		REQUIRE(cmp_as_bytes(std::string_view("defgh"), file.find_view("b", true).value()));
+		file.close();
+		REQUIRE(dictionary_file::fsck(filename).errors.empty());
+	}
+
+	std::filesystem::remove(filename);
+}
+
+TEST_CASE("add words batch", "[sdict]")
+{
+	constexpr std::string_view filename = "test.sdict";
+	if (std::filesystem::exists(filename))
+		{ std::filesystem::remove(filename); }
+
+	std::vector<std::pair<std::string, std::vector<std::byte>>> entries;
+	std::unordered_map<std::string, std::vector<std::byte>> words;
+	// added beforehand
+	words.emplace("a", std::vector{ std::byte('d'), std::byte('e'), std::byte('f') });
+	for (std::size_t i = 0; i < 4096; i++)
+	{
+		std::string word = random_string(1, 8, 'a', 'z');
+		// some defs are shared
+		auto def = (i % 4 == 0 && !entries.empty() ? entries[i / 2].second : random_bytes(1, 1024, 0, 255));
+		words.emplace(word, def); // keep first def for repeated words
+		entries.emplace_back(std::move(word), std::move(def));
+	}
+
+	{
+		dictionary_file file(filename);
+		REQUIRE(file.add_word("a", std::string_view("def")));
+		REQUIRE(file.add_words(entries) == words.size() - 1);
+		REQUIRE(file.add_words(entries) == 0);
+		REQUIRE(file.num_words() == words.size());
+		for (const auto& [word, def] : words)
+			{ REQUIRE(cmp_as_bytes(def, file.find(word, true).value())); }
+	}
+
+	{
+		dictionary_file file(filename);
+		REQUIRE(file.num_words() == words.size());
+		for (const auto& [word, def] : words)
+			{ REQUIRE(cmp_as_bytes(def, file.find(word, true).value())); }
+	}
+
+	std::filesystem::remove(filename);
+}
+
+TEST_CASE("append word segments", "[sdict]")
+{
+	constexpr std::string_view filename = "test.sdict";
+	if (std::filesystem::exists(filename))
+		{ std::filesystem::remove(filename); }
+
+	std::unordered_map<std::string, std::vector<std::byte>> words;
+	const auto add_words = [&](dictionary_file& file, std::size_t count)
+	{
+		for (std::size_t i = 0; i < count; i++)
+		{
+			std::string word = random_string(1, 32, 'a', 'z');
+			auto def = random_bytes(1, 256, 0, 255);
+			if (file.add_word<false>(word, def))
+				{ words.emplace(std::move(word), std::move(def)); }
+		}
+		file.flush();
+	};
+	const auto check_words = [&](dictionary_file& file)
+	{
+		REQUIRE(file.num_words() == words.size());
+		for (const auto& [word, def] : words)
+			{ REQUIRE(cmp_as_bytes(def, file.find(word, true).value())); }
+	};
+
+	{
+		dictionary_file file(filename);
+		add_words(file, 1000);
+	}
+	const auto reserved_words = [&]()
+	{
+		std::ifstream fin{std::string(filename), std::ios::binary};
+		fin.seekg(7);
+		std::uint32_t val = 0;
+		for (std::size_t i = 0; i < 4; i++)
+			{ val |= static_cast<std::uint32_t>(static_cast<unsigned char>(fin.get())) << (i * 8); }
+		return val;
+	};
+	const auto initial_reserved_words = reserved_words();
+	REQUIRE(initial_reserved_words < words.size() + 100);
+
+	// overflow the reserved words a few times
+	for (std::size_t i = 0; i < 3; i++)
+	{
+		{
+			dictionary_file file(filename);
+			add_words(file, 100);
+			check_words(file);
+		}
+		// new words should be appended, rather than rewriting the whole file with larger sections
+		REQUIRE(reserved_words() == initial_reserved_words);
+	}
+
+	{
+		dictionary_file file;
+		file.open_mapped(filename);
+		check_words(file);
+		for (const auto& [word, def] : words)
+			{ REQUIRE(cmp_as_bytes(def, file.find_view(word).value())); }
+		REQUIRE_FALSE(file.contains("0"));
+	}
+
+	{
+		// more words in segments than in the main sections, everything should be merged
+		dictionary_file file(filename);
+		add_words(file, 2000);
+		check_words(file);
+	}
+	REQUIRE(reserved_words() > initial_reserved_words);
+
+	{
+		dictionary_file file(filename);
+		check_words(file);
+	}
+
+	std::filesystem::remove(filename);
+}
+
+TEST_CASE("detect corrupted def", "[sdict]")
+{
+	constexpr std::string_view filename = "test.sdict";
+	if (std::filesystem::exists(filename))
+		{ std::filesystem::remove(filename); }
+
+	const auto target_def = random_bytes(64, 64, 0, 255);
+	{
+		dictionary_file file(filename);
+		// enough defs to be verified by multiple threads
+		for (std::size_t i = 0; i < 4096; i++)
+			{ file.add_word<false, true>(std::to_string(i), random_bytes(1, 64, 0, 255)); }
+		file.add_word<false, true>("target", target_def);
+	}
+
+	const auto file_contents = [filename]()
+	{
+		std::ifstream fin{std::string(filename), std::ios::binary};
+		return std::vector<char>(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+	};
+	const auto flip_byte = [filename](std::streamoff off)
+	{
+		std::fstream f{std::string(filename), std::ios::in | std::ios::out | std::ios::binary};
+		f.seekg(off, std::ios::beg);
+		const char c = f.get();
+		f.seekp(off, std::ios::beg);
+		f.put(static_cast<char>(~c));
+	};
+
+	REQUIRE_NOTHROW(dictionary_file(filename));
+	{
+		// flip a byte in the words section
+		const auto contents = file_contents();
+		constexpr std::string_view word = "4095";
+		const auto it = std::ranges::search(contents, std::string_view(word.data(), word.size() + 1)).begin();
+		REQUIRE(it != contents.end());
+		flip_byte(it - contents.begin());
+		REQUIRE_THROWS_WITH(dictionary_file(filename, false, false, false), "Metadata checksum does not match. File may be corrupted");
+		REQUIRE_THROWS_WITH(dictionary_file().open_mapped(filename, false), "Metadata checksum does not match. File may be corrupted");
+		flip_byte(it - contents.begin());
+	}
+
+	{
+		// flip last byte of the target def
+		const auto contents = file_contents();
+		const auto it = std::ranges::search(std::as_bytes(std::span(contents)), target_def).begin();
+		REQUIRE(it != std::as_bytes(std::span(contents)).end());
+		flip_byte(it - std::as_bytes(std::span(contents)).begin() + target_def.size() - 1);
+	}
+	// file is marked as verified, so corrupted defs are only detected when they are read
+	REQUIRE_THROWS_WITH(dictionary_file(filename).find("target", true), "Definition hash does not match. File may be corrupted");
+	{
+		dictionary_file file;
+		file.open_mapped(filename);
+		REQUIRE_THROWS_WITH(file.find_view("target", true), "Definition hash does not match. File may be corrupted");
+		REQUIRE_NOTHROW(file.find_view("0", true));
+	}
+
+	{
+		// without the metadata checksum extension (e.g. older files), all defs are verified on open
+		std::fstream f{std::string(filename), std::ios::in | std::ios::out | std::ios::binary};
+		f.seekp(23, std::ios::beg); // ExtInd
+		write_uint_LE(f, 0, 4);
+	}
+	REQUIRE_THROWS_WITH(dictionary_file(filename), "Definition hash does not match. File may be corrupted");
+	REQUIRE_THROWS_WITH(dictionary_file().open_mapped(filename), "Definition hash does not match. File may be corrupted");
+	REQUIRE_NOTHROW(dictionary_file(filename, false, false, false));
+
+	std::filesystem::remove(filename);
+}
+
+TEST_CASE("fsck", "[sdict]")
+{
+	constexpr std::string_view filename = "test.sdict";
+	if (std::filesystem::exists(filename))
+		{ std::filesystem::remove(filename); }
+
+	std::vector<std::vector<std::byte>> target_defs;
+	{
+		dictionary_file file(filename);
+		// enough defs to be checked by multiple threads
+		for (std::size_t i = 0; i < 4096; i++)
+			{ file.add_word<false, true>(std::to_string(i), random_bytes(1, 64, 0, 255)); }
+		for (std::size_t i = 0; i < 2; i++)
+		{
+			target_defs.push_back(random_bytes(64, 64, 0, 255));
+			file.add_word<false, true>("target" + std::to_string(i), target_defs.back());
+		}
+		file.compact();
+	}
+
+	auto report = dictionary_file::fsck(filename);
+	REQUIRE(report.errors.empty());
+	REQUIRE(report.num_words == 4098);
+	REQUIRE(report.words_sorted);
+	REQUIRE(report.unreferenced_bytes == 0);
+
+	const auto flip_byte = [filename](std::streamoff off)
+	{
+		std::fstream f{std::string(filename), std::ios::in | std::ios::out | std::ios::binary};
+		f.seekg(off, std::ios::beg);
+		const char c = f.get();
+		f.seekp(off, std::ios::beg);
+		f.put(static_cast<char>(~c));
+	};
+	std::vector<char> contents;
+	{
+		std::ifstream fin{std::string(filename), std::ios::binary};
+		contents.assign(std::istreambuf_iterator<char>(fin), std::istreambuf_iterator<char>());
+	}
+	// every corrupted def is reported, not only the first
+	for (const auto& def : target_defs)
+	{
+		const auto it = std::ranges::search(std::as_bytes(std::span(contents)), def).begin();
+		REQUIRE(it != std::as_bytes(std::span(contents)).end());
+		flip_byte(it - std::as_bytes(std::span(contents)).begin() + def.size() - 1);
+	}
+	report = dictionary_file::fsck(filename);
+	std::ranges::sort(report.errors);
+	REQUIRE(report.errors == std::vector<std::string>{
+		"word \"target0\": Definition hash does not match", "word \"target1\": Definition hash does not match" });
+	// the same errors are found with any number of threads
+	auto serial_report = dictionary_file::fsck(filename, 1);
+	std::ranges::sort(serial_report.errors);
+	REQUIRE(serial_report.errors == report.errors);
+
+	// a corrupted word is reported along with the metadata checksum, and the defs are still checked
+	const auto it = std::ranges::search(contents, std::string_view("4095", 5)).begin();
+	REQUIRE(it != contents.end());
+	flip_byte(it - contents.begin());
+	report = dictionary_file::fsck(filename);
+	REQUIRE(std::ranges::find(report.errors, "Metadata checksum does not match") != report.errors.end());
+	REQUIRE(std::ranges::find(report.errors, "word \"target1\": Definition hash does not match") != report.errors.end());
+
+	{
+		std::ofstream fout{std::string(filename), std::ios::binary | std::ios::trunc};
+		fout << "not a dictionary, but long enough for a header";
+	}
+	REQUIRE(dictionary_file::fsck(filename).errors == std::vector<std::string>{ "Incorrect magic bytes" });
+	std::filesystem::remove(filename);
+	REQUIRE_THROWS_AS(dictionary_file::fsck(filename), std::runtime_error);
+}
+
+TEST_CASE("xxh64", "[sdict]")
+{
+	static_assert(xxh64({}) == 0xEF46DB3751D8E999);
+	const auto as_bytes = [](std::string_view s) { return std::as_bytes(std::span(s)); };
+	REQUIRE(xxh64(as_bytes("abc")) == 0x44BC2CF5AD770999);
+	REQUIRE(xxh64(as_bytes("Nobody inspects the spammish repetition")) == 0xFBCEA83C8A378BF1);
+
+	// streaming in arbitrary pieces matches hashing all at once
+	const auto data = random_bytes(0, 1024, 0, 255);
+	for (std::size_t piece : { 1, 3, 8, 31, 32, 33, 100 })
+	{
+		xxh64_hasher hasher;
+		for (std::size_t i = 0; i < data.size(); i += piece)
+			{ hasher.update(std::span(data).subspan(i, std::min(piece, data.size() - i))); }
+		REQUIRE(hasher.digest() == xxh64(data));
+	}
+}
+
+TEST_CASE("find stream", "[sdict]")
+{
+	constexpr std::string_view filename = "test.sdict";
+	if (std::filesystem::exists(filename))
+		{ std::filesystem::remove(filename); }
+
+	// dictionary_file::batch_size
+	constexpr std::size_t batch_size = 4096;
+	// spans several batches, with a partial last batch
+	const auto large_def = random_bytes(batch_size * 3 + 1, batch_size * 5, 0, 255);
+	const auto small_def = random_bytes(1, 64, 0, 255);
+	const auto find_stream = [](dictionary_file& file, std::string_view word, bool check_def = false)
+	{
+		std::vector<std::byte> v;
+		const bool found = file.find_stream(word, [&v](std::span<const std::byte> piece)
+		{
+			REQUIRE(piece.size() <= batch_size);
+			v.insert(v.end(), piece.begin(), piece.end());
+		}, check_def);
+		return (found ? std::optional(v) : std::nullopt);
+	};
+	{
+		dictionary_file file(filename);
+		REQUIRE(file.add_word("large", large_def));
+		REQUIRE(file.add_word("small", small_def));
+		REQUIRE(find_stream(file, "large", true) == large_def);
+		REQUIRE(find_stream(file, "small", true) == small_def);
+		REQUIRE(!find_stream(file, "missing"));
+	}
+
+	{
+		dictionary_file file;
+		file.open_mapped(filename);
+		REQUIRE(find_stream(file, "large", true) == large_def);
+		REQUIRE(find_stream(file, "small") == small_def);
+	}
+
+	std::filesystem::remove(filename);
+}
+
+TEST_CASE("find many", "[sdict]")
+{
+	constexpr std::string_view filename = "test.sdict";
+	if (std::filesystem::exists(filename))
+		{ std::filesystem::remove(filename); }
+
+	std::unordered_map<std::string, std::vector<std::byte>> words;
+	{
+		dictionary_file file(filename);
+		// deduplicated, so both words refer to one def
+		REQUIRE(file.add_word<false>("shared0", std::string_view("shared def")));
+		REQUIRE(file.add_word<false>("shared1", std::string_view("shared def")));
+		for (std::size_t i = 0; i < 300; i++)
+		{
+			std::string word = random_string(1, 8, 'a', 'z');
+			auto def = random_bytes(1, 64, 0, 255);
+			if (file.add_word<false>(word, def))
+				{ words.emplace(std::move(word), std::move(def)); }
+		}
+		// last, and larger than what is read past the last def of a run
+		auto large_def = random_bytes(10000, 10000, 0, 255);
+		REQUIRE(file.add_word<false>("LARGE", large_def));
+		words.emplace("LARGE", std::move(large_def));
+	}
+	const auto shared_def = std::as_bytes(std::span(std::string_view("shared def")));
+	words.emplace("shared0", std::vector<std::byte>(shared_def.begin(), shared_def.end()));
+	words.emplace("shared1", std::vector<std::byte>(shared_def.begin(), shared_def.end()));
+
+	// in no particular order, with missing and repeated words
+	std::vector<std::string_view> queries = { "MISSING" };
+	for (const auto& [word, def] : words)
+		{ queries.push_back(word); }
+	queries.push_back(queries[1]);
+	queries.push_back("ALSO MISSING");
+	const auto check = [&](const std::vector<std::optional<std::vector<char>>>& found)
+	{
+		REQUIRE(found.size() == queries.size());
+		for (std::size_t i = 0; i < queries.size(); i++)
+		{
+			const auto it = words.find(std::string(queries[i]));
+			REQUIRE(found[i].has_value() == (it != words.end()));
+			if (found[i])
+				{ REQUIRE(cmp_as_bytes(it->second, found[i].value())); }
+		}
+	};
+
+	{
+		dictionary_file file;
+		file.open(filename);
+		file.reset_stats();
+		check(file.find_many(queries, true));
+		// the defs are close together, so they are read in one read, plus the rest of the large def
+		REQUIRE(file.stats().io_calls <= 2);
+		REQUIRE(file.stats().finds == queries.size());
+		REQUIRE(file.stats().misses == 2);
+		REQUIRE(file.find_many({}).empty());
+
+		file.set_def_cache_capacity(1 << 20);
+		check(file.find_many(queries));
+		file.reset_stats();
+		check(file.find_many(queries));
+		REQUIRE(file.stats().bytes_read == 0);
+		REQUIRE(file.stats().def_cache_misses == 0);
+	}
+
+	{
+		dictionary_file file;
+		file.open_mapped(filename);
+		check(file.find_many(queries, true));
+	}
+
+	std::filesystem::remove(filename);
+}
+
+TEST_CASE("concurrent find", "[sdict]")
+{
+	constexpr std::string_view filename = "test.sdict";
+	if (std::filesystem::exists(filename))
+		{ std::filesystem::remove(filename); }
+
+	std::unordered_map<std::string, std::vector<std::byte>> words;
+	for (std::size_t i = 0; i < 1024; i++)
+		{ words.emplace(random_string(1, 32, 'a', 'z'), random_bytes(1, 1024, 0, 255)); }
+	{
+		dictionary_file file(filename);
+		file.add_words(words);
+	}
+
+	const auto find_all = [&words](const dictionary_file& file)
+	{
+		std::vector<std::jthread> threads;
+		std::atomic<std::size_t> num_mismatched = 0;
+		for (std::size_t i = 0; i < 8; i++)
+		{
+			threads.emplace_back([&]()
+			{
+				for (const auto& [word, def] : words)
+				{
+					const auto res = file.find(word, true);
+					if (!res || !cmp_as_bytes(def, res.value()))
+						{ num_mismatched++; }
+				}
+			});
+		}
+		threads.clear();
+		return num_mismatched.load();
+	};
+
+	{
+		const dictionary_file file(filename);
+		REQUIRE(find_all(file) == 0);
+	}
+
+	{
+		dictionary_file file;
+		file.open_mapped(filename);
+		REQUIRE(find_all(file) == 0);
+	}
+
+	std::filesystem::remove(filename);
+}
+
+// readers hammering one file with every lookup at once, skewed towards a few hot words like a server's.
+// meant to be run with USE_TSAN as well, to catch data races in const lookups
+TEST_CASE("concurrent readers", "[sdict]")
+{
+	constexpr std::string_view filename = "test.sdict";
+	if (std::filesystem::exists(filename))
+		{ std::filesystem::remove(filename); }
+
+	std::vector<std::pair<std::string, std::vector<std::byte>>> words;
+	{
+		dictionary_file file(filename);
+		for (std::size_t i = 0; i < 512; i++)
+		{
+			std::string word = random_string(1, 16, 'a', 'z');
+			auto def = random_bytes(1, 2048, 0, 255);
+			if (file.add_word<false>(word, def))
+				{ words.emplace_back(std::move(word), std::move(def)); }
+		}
+	}
+
+	const auto hammer = [&words](const dictionary_file& file, bool mapped)
+	{
+		constexpr std::size_t num_threads = 8;
+		std::vector<std::jthread> threads;
+		std::atomic<std::size_t> num_mismatched = 0;
+		for (std::size_t t = 0; t < num_threads; t++)
+		{
+			threads.emplace_back([&, t]()
+			{
+				std::mt19937 rng(static_cast<std::uint32_t>(t));
+				// the square of a uniform index, so that low indices are looked up much more often
+				std::uniform_real_distribution<double> dist(0, 1);
+				for (std::size_t i = 0; i < 2000; i++)
+				{
+					const double u = dist(rng);
+					const auto& [word, def] = words[std::min(static_cast<std::size_t>(u * u * static_cast<double>(words.size())), words.size() - 1)];
+					bool matched;
+					switch (i % 3)
+					{
+					case 0:
+						{ matched = cmp_as_bytes(def, file.find(word).value()); break; }
+					case 1:
+						{ matched = (mapped ? cmp_as_bytes(def, file.find_view(word).value()) : file.contains(word)); break; }
+					default:
+					{
+						const std::string_view batch[] = { word, "MISSING", words[i % words.size()].first };
+						const auto found = file.find_many(batch);
+						matched = cmp_as_bytes(def, found[0].value()) && !found[1] && cmp_as_bytes(words[i % words.size()].second, found[2].value());
+						break;
+					}
+					}
+					if (!matched)
+						{ num_mismatched++; }
+				}
+			});
+		}
+		threads.clear();
+		return num_mismatched.load();
+	};
+
+	{
+		dictionary_file file(filename);
+		file.reset_stats();
+		REQUIRE(hammer(file, false) == 0);
+		REQUIRE(file.stats().finds > 0);
+		file.set_def_cache_capacity(64 * 1024);
+		REQUIRE(hammer(file, false) == 0);
+		REQUIRE(file.stats().def_cache_hits > 0);
+	}
+
+	{
+		dictionary_file file;
+		file.open_mapped(filename);
+		REQUIRE(hammer(file, true) == 0);
+	}
+
+	std::filesystem::remove(filename);
+}
+
+TEST_CASE("async reader", "[sdict]")
+{
+	constexpr std::string_view filename = "test.sdict";
+	if (std::filesystem::exists(filename))
+		{ std::filesystem::remove(filename); }
+
+	std::vector<std::pair<std::string, std::vector<std::byte>>> words;
+	{
+		dictionary_file file(filename);
+		for (std::size_t i = 0; i < 1024; i++)
+		{
+			std::string word = random_string(1, 32, 'a', 'z');
+			auto def = random_bytes(1, 1024, 0, 255);
+			if (file.add_word<false>(word, def))
+				{ words.emplace_back(std::move(word), std::move(def)); }
+		}
+		// never present
+		words.emplace_back("A", std::vector<std::byte>());
+	}
+
+	const auto read_all = [&words](const dictionary_file& file)
+	{
+		async_reader reader(file, 4);
+		REQUIRE(!reader.pop());
+		reader.submit_all(words | std::views::keys, true);
+		REQUIRE(reader.in_flight() == words.size());
+		std::vector<bool> completed(words.size());
+		while (auto res = reader.pop())
+		{
+			REQUIRE(!res->error);
+			REQUIRE(res->user_data < words.size());
+			REQUIRE(!completed[res->user_data]);
+			completed[res->user_data] = true;
+			const auto& [word, def] = words[res->user_data];
+			REQUIRE(res->word == word);
+			if (def.empty())
+				{ REQUIRE(!res->def); }
+			else
+				{ REQUIRE(cmp_as_bytes(def, res->def.value())); }
+		}
+		REQUIRE(std::ranges::all_of(completed, std::identity()));
+		REQUIRE(reader.in_flight() == 0);
+		REQUIRE(!reader.try_pop());
+
+		reader.submit(words.front().first, 123);
+		std::size_t num_queued = 1;
+		for (std::size_t i = 0; i < 1000; i++)
+			{ reader.submit(words[i % words.size()].first); num_queued++; }
+		const std::size_t num_dropped = reader.cancel_queued();
+		std::size_t num_popped = 0;
+		while (reader.pop())
+			{ num_popped++; }
+		REQUIRE(num_popped + num_dropped == num_queued);
+		// destroyed with queued reads
+		for (std::size_t i = 0; i < 1000; i++)
+			{ reader.submit(words[i % words.size()].first); }
+	};
+
+	{
+		const dictionary_file file(filename);
+		read_all(file);
+	}
+
+	{
+		dictionary_file file;
+		file.open_mapped(filename);
+		read_all(file);
+	}
+
+	std::filesystem::remove(filename);
+}
+
+TEST_CASE("deduplicate defs", "[sdict]")
+{
+	constexpr std::string_view filename = "test.sdict";
+	if (std::filesystem::exists(filename))
+		{ std::filesystem::remove(filename); }
+
+	std::vector<std::vector<std::byte>> defs;
+	for (std::size_t i = 0; i < 4; i++)
+		{ defs.push_back(random_bytes(4096, 4096, 0, 255)); }
+	std::unordered_map<std::string, std::size_t> words;
+	const auto add_words = [&](dictionary_file& file, std::size_t n)
+	{
+		std::vector<std::pair<std::string, std::vector<std::byte>>> entries;
+		for (std::size_t i = 0; i < n; i++)
+		{
+			std::string word = random_string(1, 16, 'a', 'z');
+			if (words.emplace(word, i % defs.size()).second)
+				{ entries.emplace_back(std::move(word), defs[i % defs.size()]); }
+		}
+		// half through add_word, half in one batch
+		for (std::size_t i = 0; i < entries.size() / 2; i++)
+			{ REQUIRE(file.add_word<false>(entries[i].first, entries[i].second)); }
+		REQUIRE(file.add_words(entries | std::views::drop(entries.size() / 2)) == entries.size() - entries.size() / 2);
+	};
+	{
+		// enough words to cause rewrites
+		dictionary_file file(filename);
+		add_words(file, 2000);
+	}
+	{
+		dictionary_file file(filename);
+		add_words(file, 1000);
+		for (const auto& [word, def] : words)
+			{ REQUIRE(cmp_as_bytes(defs[def], file.find(word, true).value())); }
+	}
+	// each distinct def is only stored once (3000 separate defs would take 12MB)
+	REQUIRE(std::filesystem::file_size(filename) < 300000);
+
+	// duplicates written without deduplication are merged when rewritten with it
+	std::filesystem::remove(filename);
+	words.clear();
+	{
+		dictionary_file file(filename, true, false);
+		add_words(file, 1000);
+	}
+	REQUIRE(std::filesystem::file_size(filename) > 1000000);
+	{
+		dictionary_file file(filename);
+		file.compact();
+		for (const auto& [word, def] : words)
+			{ REQUIRE(cmp_as_bytes(defs[def], file.find(word, true).value())); }
+	}
+	REQUIRE(std::filesystem::file_size(filename) < 300000);
+
+	std::filesystem::remove(filename);
+}
+
+TEST_CASE("for each def", "[sdict]")
+{
+	constexpr std::string_view filename = "test.sdict";
+	if (std::filesystem::exists(filename))
+		{ std::filesystem::remove(filename); }
+
+	std::vector<std::vector<std::byte>> defs;
+	for (std::size_t i = 0; i < 64; i++)
+		{ defs.push_back(random_bytes(1, 4096, 0, 255)); }
+	// larger than a read of for_each_def
+	defs.push_back(random_bytes(3 << 20, 3 << 20, 0, 255));
+	std::unordered_map<std::string, std::size_t> words;
+
+	const auto check = [&](const dictionary_file& file)
+	{
+		std::size_t num_defs = 0;
+		std::unordered_set<std::string> seen;
+		file.for_each_def([&](std::span<const std::byte> def, std::span<const std::string_view> def_words)
+		{
+			num_defs++;
+			REQUIRE(!def_words.empty());
+			for (const auto word : def_words)
+			{
+				REQUIRE(seen.emplace(word).second);
+				REQUIRE(std::ranges::equal(defs[words.at(std::string(word))], def));
+			}
+		}, true);
+		REQUIRE(seen.size() == words.size());
+		// each def is only stored (and visited) once
+		REQUIRE(num_defs == defs.size());
+	};
+
+	{
+		dictionary_file file(filename);
+		for (std::size_t i = 0; i < 1000; i++)
+		{
+			std::string word = random_string(1, 16, 'a', 'z');
+			if (words.emplace(word, i % defs.size()).second)
+				{ REQUIRE(file.add_word<false>(word, defs[i % defs.size()])); }
+		}
+		// including words which are not flushed
+		check(file);
+	}
+	{
+		dictionary_file file;
+		file.open_mapped(filename);
+		check(file);
+	}
+
+	std::filesystem::remove(filename);
+}
+
+TEST_CASE("stats", "[sdict]")
+{
+	constexpr std::string_view filename = "test.sdict";
+	if (std::filesystem::exists(filename))
+		{ std::filesystem::remove(filename); }
+
+	const auto def = random_bytes<std::vector<std::byte>>(100, 100, 0, 255);
+	std::size_t num_reports = 0;
+	{
+		dictionary_file file(filename);
+		file.set_stats_hook([&num_reports](const dictionary_file::statistics&) { num_reports++; });
+		// enough words to cause a rewrite, all sharing one def
+		for (std::size_t i = 0; i < 100; i++)
+			{ REQUIRE(file.add_word(std::to_string(i), def)); }
+		auto stats = file.stats();
+		REQUIRE(stats.rewrites > 0);
+		REQUIRE(stats.dedup_hits == 99);
+		REQUIRE(stats.flush_time.count() > 0);
+		REQUIRE(num_reports == 100);
+
+		file.reset_stats();
+		REQUIRE(file.find("1").has_value());
+		REQUIRE(!file.find("a").has_value());
+		stats = file.stats();
+		REQUIRE(stats.finds == 2);
+		REQUIRE(stats.hits == 1);
+		REQUIRE(stats.misses == 1);
+		// header and def, through positioned reads
+		REQUIRE(stats.bytes_read == 12 + def.size());
+		REQUIRE(stats.io_calls == 2);
+		REQUIRE(stats.seeks == 0);
+		REQUIRE(stats.rewrites == 0);
+	}
+	REQUIRE(num_reports == 101);
+
+	{
+		dictionary_file file;
+		file.open_mapped(filename);
+		REQUIRE(file.stats().read_file_time.count() > 0);
+		REQUIRE(file.find_view("1").has_value());
+		// nothing is read through the mapping
+		REQUIRE(file.stats().bytes_read == 0);
+		REQUIRE(file.stats().hits == 1);
+	}
+
+	std::filesystem::remove(filename);
+}
+
+TEST_CASE("def cache", "[sdict]")
+{
+	constexpr std::string_view filename = "test.sdict";
+	if (std::filesystem::exists(filename))
+		{ std::filesystem::remove(filename); }
+
+	const auto def_a = random_bytes<std::vector<std::byte>>(100, 100, 0, 255);
+	const auto def_b = random_bytes<std::vector<std::byte>>(200, 200, 0, 255);
+	dictionary_file file(filename);
+	REQUIRE(file.add_word("a", def_a));
+	REQUIRE(file.add_word("b", def_b));
+	file.set_def_cache_capacity(1 << 20);
+	file.reset_stats();
+
+	for (std::size_t i = 0; i < 3; i++)
+		{ REQUIRE(cmp_as_bytes(def_a, file.find("a").value())); }
+	REQUIRE(cmp_as_bytes(def_b, file.find("b").value()));
+	auto stats = file.stats();
+	REQUIRE(stats.def_cache_hits == 2);
+	REQUIRE(stats.def_cache_misses == 2);
+	// only the misses are read
+	REQUIRE(stats.bytes_read == 2 * 12 + def_a.size() + def_b.size());
+
+	// checked lookups read the def
+	REQUIRE(cmp_as_bytes(def_a, file.find("a", true).value()));
+	REQUIRE(file.stats().def_cache_hits == 2);
+
+	// the file may have changed while closed
+	file.close();
+	file.open(filename);
+	file.reset_stats();
+	REQUIRE(cmp_as_bytes(def_b, file.find("b").value()));
+	REQUIRE(file.stats().def_cache_misses == 1);
+
+	file.set_def_cache_capacity(0);
+	REQUIRE(cmp_as_bytes(def_b, file.find("b").value()));
+	REQUIRE(file.stats().def_cache_misses == 1);
+	file.close();
+
+	std::filesystem::remove(filename);
+}
+
+TEST_CASE("bulk builder", "[sdict]")
+{
+	constexpr std::string_view filename = "test.sdict";
+	if (std::filesystem::exists(filename))
+		{ std::filesystem::remove(filename); }
+
+	std::vector<std::vector<std::byte>> shared_defs;
+	for (std::size_t i = 0; i < 4; i++)
+		{ shared_defs.push_back(random_bytes(4096, 4096, 0, 255)); }
+	std::unordered_map<std::string, std::vector<std::byte>> words;
+	{
+		dictionary_file_builder builder(filename);
+		std::vector<std::pair<std::string, std::vector<std::byte>>> entries;
+		for (std::size_t i = 0; i < 3000; i++)
+		{
+			std::string word = random_string(1, 16, 'a', 'z');
+			auto def = (i % 2 == 0 ? shared_defs[i % shared_defs.size()] : random_bytes(1, 64, 0, 255));
+			if (words.emplace(word, def).second)
+				{ entries.emplace_back(std::move(word), std::move(def)); }
+		}
+		// half through add_word, half in one batch
+		for (std::size_t i = 0; i < entries.size() / 2; i++)
+			{ builder.add_word(entries[i].first, entries[i].second); }
+		builder.add_words(entries | std::views::drop(entries.size() / 2));
+		REQUIRE(builder.num_words() == words.size());
+
+		dictionary_file& file = builder.finish();
+		REQUIRE(file.num_words() == words.size());
+		for (const auto& [word, def] : words)
+			{ REQUIRE(cmp_as_bytes(def, file.find(word, true).value())); }
+		// can be added to like any other file, even though the sections are full
+		REQUIRE(file.add_word("0", std::string_view("zero")));
+		words.emplace("0", std::vector<std::byte>{ std::byte('z'), std::byte('e'), std::byte('r'), std::byte('o') });
+		REQUIRE_THROWS_AS(builder.finish(), std::logic_error);
+	}
+	REQUIRE_FALSE(std::filesystem::exists(std::string(filename) + ".defs.tmp"));
+	// the shared defs are only stored once (1500 separate copies would take 6MB)
+	REQUIRE(std::filesystem::file_size(filename) < 300000);
+
+	{
+		dictionary_file file;
+		file.open_mapped(filename);
+		REQUIRE(file.num_words() == words.size());
+		for (const auto& [word, def] : words)
+			{ REQUIRE(cmp_as_bytes(def, file.find_view(word, true).value())); }
+	}
+
+	{
+		dictionary_file_builder builder(filename);
+		builder.add_word("a", std::string_view("1"));
+		builder.add_word("a", std::string_view("2"));
+		REQUIRE_THROWS_AS(builder.finish(), std::logic_error);
+	}
+	{
+		dictionary_file_builder builder(filename);
+		dictionary_file& file = builder.finish();
+		REQUIRE(file.num_words() == 0);
+		REQUIRE(file.add_word("a", std::string_view("1")));
+	}
+
+	std::filesystem::remove(filename);
+}
+
+TEST_CASE("compact", "[sdict]")
+{
+	constexpr std::string_view filename = "test.sdict";
+	if (std::filesystem::exists(filename))
+		{ std::filesystem::remove(filename); }
+
+	const auto def = random_bytes(1024, 1024, 0, 255);
+	std::unordered_map<std::string, std::vector<std::byte>> words;
+	{
+		// without dedup, every word gets its own copy of `def`
+		dictionary_file file(filename, true, false);
+		for (std::size_t i = 0; i < 256; i++)
+		{
+			std::string word = random_string(1, 16, 'a', 'z');
+			const auto cur_def = (i % 2 == 0 ? def : random_bytes(1, 64, 0, 255));
+			if (file.add_word<false>(word, cur_def))
+				{ words.emplace(std::move(word), cur_def); }
+		}
+		file.flush();
+		const auto size = std::filesystem::file_size(filename);
+		// nothing is shared, so nothing is reclaimed
+		REQUIRE(file.compact() == 0);
+		REQUIRE(std::filesystem::file_size(filename) == size);
+	}
+
+	{
+		dictionary_file file(filename);
+		const auto size = std::filesystem::file_size(filename);
+		const auto reclaimed = file.compact();
+		REQUIRE(reclaimed > 100 * def.size());
+		REQUIRE(std::filesystem::file_size(filename) == size - reclaimed);
+		for (const auto& [word, cur_def] : words)
+			{ REQUIRE(cmp_as_bytes(cur_def, file.find(word, true).value())); }
+		REQUIRE(file.add_word("0", def));
+		words.emplace("0", def);
+	}
+
+	{
+		dictionary_file file(filename);
+		REQUIRE(file.num_words() == words.size());
+		for (const auto& [word, cur_def] : words)
+			{ REQUIRE(cmp_as_bytes(cur_def, file.find(word, true).value())); }
+	}
+
+	std::filesystem::remove(filename);
+}
+
+TEST_CASE("front coded words", "[sdict]")
+{
+	constexpr std::string_view filename = "test.sdict";
+	constexpr std::string_view plain_filename = "test_plain.sdict";
+	for (const auto name : { filename, plain_filename })
+	{
+		if (std::filesystem::exists(name))
+			{ std::filesystem::remove(name); }
+	}
+	const auto is_front_coded = [&]()
+	{
+		std::ifstream fin{std::string(filename), std::ios::binary};
+		fin.seekg(19); // flags (front coded words)
+		return (fin.get() & 4) != 0;
+	};
+
+	// long shared prefixes, and a block size which doesn't divide the number of words
+	std::map<std::string, std::string> words;
+	for (std::size_t i = 0; i < 1000; i++)
+		{ words.emplace("antidisestablishment" + std::to_string(i * 7919 % 1000), "def " + std::to_string(i)); }
+	words.emplace("", "empty");
+	words.emplace("b", "short");
+	{
+		dictionary_file_builder builder(filename, true, true);
+		dictionary_file_builder plain_builder(plain_filename);
+		for (const auto& [word, def] : words)
+		{
+			builder.add_word(word, std::span(def));
+			plain_builder.add_word(word, std::span(def));
+		}
+		builder.finish();
+		plain_builder.finish();
+	}
+	REQUIRE(is_front_coded());
+	// each word shares at least 20 bytes with the previous one in its block
+	REQUIRE(std::filesystem::file_size(filename) + 15000 < std::filesystem::file_size(plain_filename));
+	std::filesystem::remove(plain_filename);
+
+	const auto check_words = [&]()
+	{
+		{
+			dictionary_file file;
+			file.open_mapped(filename);
+			REQUIRE(file.num_words() == words.size());
+			for (const auto& [word, def] : words)
+				{ REQUIRE(cmp_as_bytes(std::string_view(def), file.find_view(word, true).value())); }
+			REQUIRE_FALSE(file.contains("antidisestablishment"));
+			REQUIRE_FALSE(file.contains("antidisestablishment1000"));
+			std::size_t num_prefixed = 0;
+			for (const auto word : file.prefix_range("antidisestablishment99"))
+			{
+				REQUIRE(word.starts_with("antidisestablishment99"));
+				num_prefixed++;
+			}
+			REQUIRE(num_prefixed == 11);
+
+			// only a sample of the words is in memory, unless some are in word segments
+			dictionary_file lean;
+			lean.open_mapped(filename, true, true);
+			REQUIRE(lean.num_words() == words.size());
+			for (const auto& [word, def] : words)
+				{ REQUIRE(cmp_as_bytes(std::string_view(def), lean.find_view(word, true).value())); }
+			REQUIRE_FALSE(lean.contains("antidisestablishment1000"));
+			for (std::size_t i = 0; i < file.num_words(); i++)
+				{ REQUIRE(lean.word_at(i) == file.word_at(i)); }
+			for (const auto prefix : { "", "a", "antidisestablishment", "antidisestablishment1", "antidisestablishment99", "antidisestablishment999", "b", "c", "z1", "zz" })
+			{
+				REQUIRE(lean.prefix_bounds(prefix) == file.prefix_bounds(prefix));
+				const auto bounds = file.prefix_bounds(prefix);
+				const auto within = file.prefix_bounds(std::string_view(prefix).substr(0, 1));
+				REQUIRE(lean.prefix_bounds(prefix, within) == bounds);
+			}
+		}
+		const auto report = dictionary_file::fsck(filename);
+		REQUIRE(report.errors.empty());
+		REQUIRE(report.num_words == words.size());
+	};
+	check_words();
+
+	SECTION("added words are appended as segments, and rewrites stay front coded")
+	{
+		{
+			dictionary_file file(filename);
+			REQUIRE(file.num_words() == words.size());
+			// fits in the sections, but they aren't updated in place
+			REQUIRE(file.add_word("c", std::string_view("new")));
+			words.emplace("c", "new");
+		}
+		check_words();
+		{
+			dictionary_file file(filename);
+			for (std::size_t i = 0; i < 2000; i++)
+			{
+				const auto word = "z" + std::to_string(i);
+				REQUIRE(file.add_word<false>(word, std::span(word)));
+				words.emplace(word, word);
+			}
+			// more words than the main sections hold, so the file is rewritten
+			file.flush();
+		}
+		REQUIRE(is_front_coded());
+		check_words();
+	}
+
+	SECTION("converting an existing file")
+	{
+		std::filesystem::remove(filename);
+		{
+			dictionary_file file(filename);
+			for (const auto& [word, def] : words)
+				{ REQUIRE(file.add_word<false>(word, std::span(def))); }
+			file.flush();
+			REQUIRE_FALSE(is_front_coded());
+			REQUIRE(file.front_code_words() > 15000);
+		}
+		REQUIRE(is_front_coded());
+		check_words();
+	}
+
+	SECTION("corrupted word")
+	{
+		// the first word of the second block (the words section follows the inds section and hash index)
+		std::fstream f(std::string(filename), std::ios::in | std::ios::out | std::ios::binary);
+		f.seekg(7);
+		std::uint32_t reserved_words = 0;
+		for (int i = 0; i < 4; i++)
+			{ reserved_words |= static_cast<std::uint32_t>(f.get()) << (i * 8); }
+		const std::streamoff word_ind_off = 27 + 16 * 4;
+		f.seekg(word_ind_off);
+		std::uint32_t word_ind = 0;
+		for (int i = 0; i < 4; i++)
+			{ word_ind |= static_cast<std::uint32_t>(f.get()) << (i * 8); }
+		// length of the word, which then runs past the section
+		f.seekp(27 + static_cast<std::streamoff>(reserved_words) * 24 + word_ind - 1);
+		f.put(static_cast<char>(0x7F));
+		f.close();
+		REQUIRE_FALSE(dictionary_file::fsck(filename).errors.empty());
+		dictionary_file file;
+		REQUIRE_THROWS_AS(file.open_mapped(filename, false), std::runtime_error);
+	}
+
+	std::filesystem::remove(filename);
+}
+
+TEST_CASE("clustered defs", "[sdict]")
+{
+	constexpr std::string_view filename = "test.sdict";
+	if (std::filesystem::exists(filename))
+		{ std::filesystem::remove(filename); }
+
+	// @return words in the order of their defs in the file
+	const auto words_in_file_order = [](const dictionary_file& file)
+	{
+		std::vector<std::string> res;
+		file.for_each_def([&](std::span<const std::byte>, std::span<const std::string_view> def_words)
+			{ res.append_range(def_words); });
+		return res;
+	};
+
+	{
+		dictionary_file file(filename);
+		REQUIRE(file.is_clustered());
+		// added in reverse order, so defs are appended out of word order
+		for (std::size_t i = 200; i > 100; i--)
+			{ REQUIRE(file.add_word(std::to_string(i), random_bytes(1, 256, 0, 255))); }
+		REQUIRE(!file.is_clustered());
+		REQUIRE(!std::ranges::is_sorted(words_in_file_order(file)));
+
+		file.compact();
+		REQUIRE(file.is_clustered());
+		REQUIRE(std::ranges::is_sorted(words_in_file_order(file)));
+	}
+	{
+		dictionary_file file(filename);
+		REQUIRE(file.is_clustered());
+		REQUIRE(file.add_word("300", random_bytes(1, 256, 0, 255)));
+		REQUIRE(!file.is_clustered());
+	}
+	{
+		dictionary_file file;
+		file.open_mapped(filename);
+		REQUIRE(!file.is_clustered());
+	}
+
+	std::filesystem::remove(filename);
+}
+
+TEST_CASE("bloom filter", "[sdict]")
+{
+	constexpr std::string_view filename = "test.sdict";
+	if (std::filesystem::exists(filename))
+		{ std::filesystem::remove(filename); }
+
+	std::unordered_map<std::string, std::vector<std::byte>> words;
+	const auto add_words = [&words](dictionary_file& file, std::size_t n)
+	{
+		for (std::size_t i = 0; i < n; i++)
+		{
+			// lowercase words only, so uppercase words are never present
+			std::string word = random_string(1, 16, 'a', 'z');
+			auto def = random_bytes(1, 64, 0, 255);
+			if (file.add_word<false>(word, def))
+				{ words.emplace(std::move(word), std::move(def)); }
+		}
+		file.flush();
+	};
+	const auto check = [&words](const dictionary_file& file)
+	{
+		for (const auto& [word, def] : words)
+		{
+			REQUIRE(file.maybe_contains(word));
+			REQUIRE(file.contains(word));
+		}
+		std::size_t false_positives = 0;
+		for (std::size_t i = 0; i < 4096; i++)
+		{
+			const auto word = random_string(1, 16, 'A', 'Z');
+			REQUIRE(!file.contains(word));
+			if (file.maybe_contains(word))
+				{ false_positives++; }
+		}
+		return false_positives;
+	};
+	{
+		dictionary_file file(filename);
+		add_words(file, 500);
+		file.add_bloom_filter();
+		// 10 bits per reserved word, with at least as many reserved words as words
+		REQUIRE(check(file) < 4096 / 20);
+		// added in place and through a rewrite
+		add_words(file, 10);
+		add_words(file, 1000);
+		REQUIRE(check(file) < 4096 / 20);
+		REQUIRE_THROWS_AS(file.add_bloom_filter(0), std::logic_error);
+	}
+
+	{
+		dictionary_file file(filename);
+		REQUIRE(check(file) < 4096 / 20);
+		REQUIRE(file.add_word("0", std::string_view("def")));
+		REQUIRE(file.contains("0"));
+		words.emplace("0", std::vector<std::byte>{ std::byte('d'), std::byte('e'), std::byte('f') });
+	}
+
+	{
+		dictionary_file file;
+		file.open_mapped(filename);
+		REQUIRE(check(file) < 4096 / 20);
+		for (const auto& [word, def] : words)
+			{ REQUIRE(cmp_as_bytes(def, file.find_view(word).value())); }
+	}
+
+	std::filesystem::remove(filename);
+}
+
+TEST_CASE("stem index", "[sdict]")
+{
+	constexpr std::string_view filename = "test.sdict";
+	if (std::filesystem::exists(filename))
+		{ std::filesystem::remove(filename); }
+
+	const std::vector<std::pair<std::string, std::string>> stems = {
+		{ "running", "run" }, { "ran", "run" }, { "runs", "run" }, { "geese", "goose" },
+		// stem is already a word, word does not exist, and stem equal to word are skipped
+		{ "goose", "run" }, { "walked", "walk" }, { "run", "run" },
+		// first entry for a stem is kept
+		{ "ran", "goose" }
+	};
+	const auto check = [](const dictionary_file& file)
+	{
+		REQUIRE(file.resolve_stem("running") == "run");
+		REQUIRE(file.resolve_stem("ran") == "run");
+		REQUIRE(file.resolve_stem("geese") == "goose");
+		REQUIRE(!file.resolve_stem("goose"));
+		REQUIRE(!file.resolve_stem("walked"));
+		REQUIRE(!file.resolve_stem("run"));
+		REQUIRE(!file.contains("running"));
+		REQUIRE(!file.find("walked"));
+	};
+	{
+		dictionary_file file(filename);
+		REQUIRE(!file.resolve_stem("running"));
+		file.add_word("run", std::string_view("run def"));
+		file.add_word("goose", std::string_view("goose def"));
+		file.set_stem_index(stems);
+		check(file);
+		REQUIRE(cmp_as_bytes(std::string_view("run def"), file.find("running").value()));
+		REQUIRE(cmp_as_bytes(std::string_view("goose def"), file.find("geese").value()));
+
+		// index is kept through rewrites
+		for (std::size_t i = 0; i < 100; i++)
+			{ file.add_word<false>(random_string(1, 16, 'A', 'Z'), random_bytes(1, 64, 0, 255)); }
+		file.flush();
+		file.compact();
+		check(file);
+		// words take precedence over stems
+		file.add_word("runs", std::string_view("runs def"));
+		REQUIRE(cmp_as_bytes(std::string_view("runs def"), file.find("runs").value()));
+	}
+
+	{
+		dictionary_file file(filename);
+		check(file);
+		REQUIRE(cmp_as_bytes(std::string_view("run def"), file.find("running", true).value()));
+		std::string streamed;
+		REQUIRE(file.find_stream("geese", [&](std::span<const std::byte> piece)
+			{ streamed.append(reinterpret_cast<const char*>(piece.data()), piece.size()); }));
+		REQUIRE(streamed == "goose def");
+	}
+
+	{
+		dictionary_file file;
+		file.open_mapped(filename);
+		check(file);
+		REQUIRE(cmp_as_bytes(std::string_view("goose def"), file.find_view("geese").value()));
+	}
+
+	std::filesystem::remove(filename);
+}
+
+TEST_CASE("fuzzy index", "[sdict]")
+{
+	constexpr std::string_view filename = "test.sdict";
+	if (std::filesystem::exists(filename))
+		{ std::filesystem::remove(filename); }
+
+	REQUIRE(fuzzy::edit_distance("kitten", "sitting", 5) == 3);
+	REQUIRE(fuzzy::edit_distance("kitten", "sitting", 2) == 3);
+	REQUIRE(fuzzy::edit_distance("abcd", "acbd", 2) == 1);
+	REQUIRE(fuzzy::edit_distance("", "abc", 5) == 3);
+	REQUIRE(fuzzy::edit_distance("same", "same", 0) == 0);
+
+	const std::vector<std::string> dict_words = { "apple", "apply", "ample", "maple", "banana", "bandana", "cat", "cart", "act", "dog" };
+	// words at the time the index was built
+	std::vector<std::string> indexed_words = dict_words;
+	// naive search, for comparison
+	const auto expected_suggestions = [&indexed_words](std::string_view word, std::uint32_t max_distance)
+	{
+		std::vector<std::pair<std::uint32_t, std::string_view>> results;
+		for (const auto& w : indexed_words)
+		{
+			const auto distance = fuzzy::edit_distance(word, w, max_distance);
+			if (distance <= max_distance)
+				{ results.emplace_back(distance, w); }
+		}
+		std::ranges::sort(results);
+		std::vector<std::string_view> suggestions;
+		for (const auto& [distance, w] : results)
+			{ suggestions.push_back(w); }
+		return suggestions;
+	};
+	const std::vector<std::string_view> queries = { "aple", "appel", "apples", "banan", "bandanna", "cta", "ca", "dgo", "zzz", "cat", "" };
+	const auto check = [&](const dictionary_file& file, std::uint32_t max_distance)
+	{
+		for (const auto query : queries)
+			{ REQUIRE(file.suggest(query, -1) == expected_suggestions(query, max_distance)); }
+		REQUIRE(file.suggest("aple", 2).size() == std::min<std::size_t>(2, expected_suggestions("aple", max_distance).size()));
+	};
+
+	{
+		dictionary_file file(filename);
+		for (const auto& word : dict_words)
+			{ file.add_word<false>(word, std::string_view("def")); }
+		REQUIRE(file.suggest("aple").empty());
+		file.build_fuzzy_index();
+		check(file, 1);
+		REQUIRE(file.suggest("aple") == std::vector<std::string_view>{ "ample", "apple", "maple" });
+		REQUIRE(file.suggest("cat") == std::vector<std::string_view>{ "cat", "act", "cart" });
+
+		// index is kept as-is through rewrites, until it is rebuilt
+		for (std::size_t i = 0; i < 100; i++)
+			{ file.add_word<false>(random_string(1, 16, 'A', 'Z'), random_bytes(1, 64, 0, 255)); }
+		file.flush();
+		file.compact();
+		check(file, 1);
+		REQUIRE_THROWS_AS(file.build_fuzzy_index(3), std::logic_error);
+	}
+
+	{
+		dictionary_file file(filename);
+		check(file, 1);
+		file.add_word("cast", std::string_view("def"));
+		REQUIRE(file.suggest("cast") == std::vector<std::string_view>{ "cart", "cat" });
+		file.build_fuzzy_index(2);
+		indexed_words.clear();
+		for (const auto word : file.prefix_range(""))
+			{ indexed_words.emplace_back(word); }
+		check(file, 2);
+		REQUIRE(file.suggest("cast").front() == "cast");
+	}
+
+	{
+		dictionary_file file;
+		file.open_mapped(filename);
+		check(file, 2);
+	}
+
+	std::filesystem::remove(filename);
+}
+
+TEST_CASE("text index", "[sdict]")
+{
+	constexpr std::string_view filename = "test.sdict";
+	if (std::filesystem::exists(filename))
+		{ std::filesystem::remove(filename); }
+
+	std::vector<std::string> terms;
+	text_index::for_each_term("Green-leafed PLANTS, 42x; café", [&terms](std::string_view term) { terms.emplace_back(term); });
+	REQUIRE(terms == std::vector<std::string>{ "green", "leafed", "plants", "42x", "café" });
+
+	const std::vector<std::pair<std::string, std::string>> texts =
+	{
+		{ "leaf", "The organ of a plant which carries out photosynthesis." },
+		{ "chlorophyll", "Green pigment used in Photosynthesis by plants." },
+		{ "plant", "A living organism; see leaf." },
+		{ "missing", "photosynthesis" },
+		// merged with the first entry for the word
+		{ "plant", "Performs photosynthesis." }
+	};
+	{
+		dictionary_file file(filename);
+		for (const auto word : { "leaf", "chlorophyll", "plant", "rock" })
+			{ file.add_word<false>(word, std::string_view("def")); }
+		REQUIRE(file.find_text("photosynthesis").empty());
+		file.set_text_index(texts);
+		REQUIRE(file.find_text("photosynthesis") == std::vector<std::string_view>{ "chlorophyll", "leaf", "plant" });
+		REQUIRE(file.find_text("PHOTOSYNTHESIS plants") == std::vector<std::string_view>{ "chlorophyll" });
+		REQUIRE(file.find_text("photosynthesis", 2) == std::vector<std::string_view>{ "chlorophyll", "leaf" });
+		REQUIRE(file.find_text("photosynthesis stone").empty());
+		REQUIRE(file.find_text("").empty());
+		REQUIRE(file.find_text("photo").empty());
+
+		// index is kept as-is through rewrites
+		for (std::size_t i = 0; i < 100; i++)
+			{ file.add_word<false>(random_string(1, 16, 'A', 'Z'), random_bytes(1, 64, 0, 255)); }
+		file.flush();
+		file.compact();
+		REQUIRE(file.find_text("leaf") == std::vector<std::string_view>{ "plant" });
+	}
+
+	{
+		dictionary_file file;
+		file.open_mapped(filename);
+		REQUIRE(file.find_text("photosynthesis") == std::vector<std::string_view>{ "chlorophyll", "leaf", "plant" });
+		REQUIRE(file.find_text("organism, living") == std::vector<std::string_view>{ "plant" });
+	}
+
+	std::filesystem::remove(filename);
+}
+
+TEST_CASE("flat defs", "[sdict]")
+{
+	word_info w;
+	w.id = "test:1";
+	w.stems = { "test", "tests" };
+	w.offensive = true;
+	sense_data full;
+	full.def_text = "{bc}a trial";
+	full.number = "1";
+	full.labels = std::vector<std::string>{ "chiefly British" };
+	full.transitive_verb = false;
+	full.sdsense.emplace();
+	full.sdsense->sense_div = "also";
+	full.sdsense->def_text = "an exam";
+	w.defs.push_back(full);
+	trunc_sense_data trunc;
+	trunc.etymology = "Latin";
+	trunc.inflections = std::vector<std::string>{};
+	w.defs.push_back(trunc);
+	std::vector<word_info> entries = { w, w };
+	entries[1].id = "test:2";
+	entries[1].defs.pop_back();
+
+	const auto check_views = [](const std::vector<def_view::word_info>& views)
+	{
+		REQUIRE(views.size() == 2);
+		REQUIRE(views[0].id == "test:1");
+		REQUIRE(views[1].id == "test:2");
+		REQUIRE(views[0].stems == std::vector<std::string_view>{ "test", "tests" });
+		REQUIRE(views[0].offensive);
+		REQUIRE(views[0].defs.size() == 2);
+		REQUIRE(views[1].defs.size() == 1);
+		const auto& full_view = std::get<def_view::sense_data>(views[0].defs[0]);
+		REQUIRE(full_view.def_text == "{bc}a trial");
+		REQUIRE(full_view.number == "1");
+		REQUIRE(full_view.labels == std::vector<std::string_view>{ "chiefly British" });
+		REQUIRE(full_view.transitive_verb == false);
+		REQUIRE(!full_view.etymology);
+		REQUIRE(!full_view.inflections);
+		REQUIRE(full_view.sdsense);
+		REQUIRE(full_view.sdsense->sense_div == "also");
+		REQUIRE(full_view.sdsense->def_text == "an exam");
+		const auto& trunc_view = std::get<def_view::trunc_sense_data>(views[0].defs[1]);
+		REQUIRE(trunc_view.etymology == "Latin");
+		// an empty list is kept apart from an absent one
+		REQUIRE(trunc_view.inflections);
+		REQUIRE(trunc_view.inflections->empty());
+		REQUIRE(!trunc_view.transitive_verb);
+	};
+	const auto check = [&check_views](const flat_defs& flat)
+	{
+		std::vector<def_view::word_info> views;
+		flat.to_view(views);
+		check_views(views);
+	};
+
+	const auto flat = flat_defs::from(std::span<const word_info>(entries));
+	check(flat);
+	std::vector<std::byte> data;
+	flat.serialize(data);
+	check(flat_defs::deserialize(data).value());
+	// parsed in place, into views of `data`
+	std::vector<def_view::word_info> views;
+	flat_defs::parse(data, views);
+	check_views(views);
+	data.pop_back();
+	REQUIRE(!flat_defs::deserialize(data));
+	views.clear();
+	REQUIRE_THROWS_AS(flat_defs::parse(data, views), std::runtime_error);
+}
+
+TEST_CASE("def encoding", "[sdict]")
+{
+	constexpr std::string_view filename = "test.sdict";
+	if (std::filesystem::exists(filename))
+		{ std::filesystem::remove(filename); }
+
+	// [{"meta": {"id": "test:1", "stems": ["test", "tests"], "offensive": false},
+	//   "def": [{"sseq": [[["sense", {"sn": "1", "dt": [["text", "{bc}a trial"]]}]]]}], "hwi": {}}]
+	std::vector<std::byte> cbor;
+	const auto head = [&cbor](std::uint8_t major, std::size_t len) { cbor.push_back(std::byte(major << 5 | len)); };
+	const auto text = [&cbor, &head](std::string_view s)
+	{
+		head(3, s.size());
+		for (const char c : s)
+			{ cbor.push_back(std::byte(c)); }
+	};
+	head(4, 1);
+	head(5, 3);
+	text("meta");
+	head(5, 3);
+	text("id"); text("test:1");
+	text("stems"); head(4, 2); text("test"); text("tests");
+	text("offensive"); cbor.push_back(std::byte(0xF4));
+	text("def");
+	head(4, 1); head(5, 1); text("sseq");
+	head(4, 1); head(4, 1); head(4, 2); text("sense");
+	head(5, 2); text("sn"); text("1");
+	text("dt"); head(4, 1); head(4, 2); text("text"); text("{bc}a trial");
+	text("hwi"); head(5, 0);
+
+	std::vector<std::byte> buf;
+	REQUIRE(def_encoding::encode(def_encoding::encoding::cbor, cbor, buf).data() == cbor.data());
+	const auto flat = def_encoding::encode(def_encoding::encoding::flat, cbor, buf);
+	const std::vector<std::byte> flat_def(flat.begin(), flat.end());
+	for (const auto& [e, def] : { std::pair(def_encoding::encoding::cbor, std::span<const std::byte>(cbor)),
+		std::pair(def_encoding::encoding::flat, std::span<const std::byte>(flat_def)) })
+	{
+		std::vector<word_info> entries;
+		def_encoding::parse(e, def, entries);
+		REQUIRE(entries.size() == 1);
+		REQUIRE(entries[0].id == "test:1");
+		REQUIRE(entries[0].stems == std::vector<std::string>{ "test", "tests" });
+		REQUIRE(!entries[0].offensive);
+		REQUIRE(entries[0].defs.size() == 1);
+		REQUIRE(std::get<sense_data>(entries[0].defs[0]).number == "1");
+		REQUIRE(std::get<sense_data>(entries[0].defs[0]).def_text == "{bc}a trial");
+	}
+	REQUIRE(def_encoding::from_name("flat") == def_encoding::encoding::flat);
+	REQUIRE(!def_encoding::from_name("json"));
+	REQUIRE(def_encoding::from_id(1) == def_encoding::encoding::flat);
+	REQUIRE_THROWS_AS(def_encoding::from_id(2), std::runtime_error);
+
+	// the encoding is recorded in the file, and kept through rewrites
+	{
+		dictionary_file file(filename, true);
+		REQUIRE(file.def_encoding() == 0);
+		REQUIRE(file.add_word("test", flat));
+		file.set_def_encoding(static_cast<std::uint32_t>(def_encoding::encoding::flat));
+		REQUIRE(file.def_encoding() == 1);
+		for (std::size_t i = 0; i < 100; i++)
+			{ file.add_word<false>(random_string(1, 16, 'A', 'Z'), random_bytes(1, 64, 0, 255)); }
+		file.flush();
+		file.compact();
+		REQUIRE(file.def_encoding() == 1);
+	}
+	{
+		dictionary_file file;
+		file.open_mapped(filename);
+		REQUIRE(file.def_encoding() == 1);
+		std::vector<def_view::word_info> entries;
+		def_encoding::parse(def_encoding::from_id(file.def_encoding()), file.find_view("test").value(), entries);
+		REQUIRE(entries.at(0).id == "test:1");
+		REQUIRE_THROWS_AS(file.set_def_encoding(0), std::logic_error);
+	}
+	{
+		dictionary_file_builder builder(filename);
+		builder.add_word("test", flat);
+		builder.set_def_encoding(1);
+		REQUIRE(builder.finish().def_encoding() == 1);
+	}
+	{
+		const dictionary_file file(filename, false);
+		REQUIRE(file.def_encoding() == 1);
+	}
+
+	std::filesystem::remove(filename);
+}
+
+TEST_CASE("dictionary set", "[sdict]")
+{
+	const std::vector<std::string> filenames = { "test0.sdict", "test1.sdict", "test2.sdict" };
+	constexpr std::string_view overlay_filename = "test_overlay.sdict";
+	for (const auto& filename : filenames)
+	{
+		if (std::filesystem::exists(filename))
+			{ std::filesystem::remove(filename); }
+	}
+	if (std::filesystem::exists(overlay_filename))
+		{ std::filesystem::remove(overlay_filename); }
+
+	const auto to_bytes = [](std::string_view str)
+	{
+		const auto bytes = std::as_bytes(std::span(str));
+		return std::vector<std::byte>(bytes.begin(), bytes.end());
+	};
+	// expected def of each word, taken from the highest precedence layer
+	std::unordered_map<std::string, std::vector<std::byte>> words;
+	// create in reverse order, so lower precedence defs are overwritten
+	for (std::size_t i = filenames.size(); i-- > 0;)
+	{
+		dictionary_file file(filenames[i]);
+		for (std::size_t j = 0; j < 300; j++)
+		{
+			// lowercase words only, so uppercase words are never present
+			std::string word = random_string(1, 8, 'a', 'z');
+			auto def = random_bytes(1, 64, 0, 255);
+			if (file.add_word<false>(word, def))
+				{ words.insert_or_assign(std::move(word), std::move(def)); }
+		}
+		const std::string shared_def = "def " + std::to_string(i);
+		file.add_word<false>("shared", std::string_view(shared_def));
+		words.insert_or_assign("shared", to_bytes(shared_def));
+		file.flush();
+		if (i == 1)
+			{ file.add_bloom_filter(); }
+	}
+
+	dictionary_set set;
+	set.open_mapped(filenames);
+	REQUIRE(set.num_layers() == filenames.size());
+	const auto check = [&words](const dictionary_set& set)
+	{
+		for (const auto& [word, def] : words)
+		{
+			REQUIRE(set.maybe_contains(word));
+			REQUIRE(cmp_as_bytes(def, set.find(word, true).value()));
+		}
+		std::size_t false_positives = 0;
+		for (std::size_t i = 0; i < 4096; i++)
+		{
+			const auto word = random_string(1, 8, 'A', 'Z');
+			REQUIRE(!set.contains(word));
+			REQUIRE(!set.find(word));
+			if (set.maybe_contains(word))
+				{ false_positives++; }
+		}
+		return false_positives;
+	};
+	for (const auto& [word, def] : words)
+		{ REQUIRE(cmp_as_bytes(def, set.find_view(word).value())); }
+	REQUIRE(set.find_layer("shared") == 0);
+	check(set);
+	set.build_filter();
+	REQUIRE(check(set) < 4096 / 20);
+
+	// overlay shadows lower layers, and new words are added to the filter
+	set.add_overlay(overlay_filename);
+	REQUIRE(set.num_layers() == filenames.size() + 1);
+	set.build_filter();
+	REQUIRE(set.add_word("shared", std::string_view("overlay def")));
+	REQUIRE(!set.add_word("shared", std::string_view("other def")));
+	words.insert_or_assign("shared", to_bytes("overlay def"));
+	REQUIRE(set.add_word("0", std::string_view("def")));
+	words.emplace("0", to_bytes("def"));
+	REQUIRE(set.find_layer("shared") == 0);
+	REQUIRE(set.find_layer("0") == 0);
+	REQUIRE(check(set) < 4096 / 20);
+	// overlay layer is not mapped
+	REQUIRE_THROWS_AS(set.find_view("shared"), std::logic_error);
+
+	// existing layers are kept if any file fails to open
+	const std::vector<std::string> bad_filenames = { filenames[0], "nonexistent.sdict" };
+	REQUIRE_THROWS_AS(set.open_mapped(bad_filenames), std::runtime_error);
+	REQUIRE(set.num_layers() == filenames.size() + 1);
+	REQUIRE_THROWS_AS(dictionary_set().add_word("a", std::string_view("def")), std::logic_error);
+
+	set = dictionary_set();
+	for (const auto& filename : filenames)
+		{ std::filesystem::remove(filename); }
+	std::filesystem::remove(overlay_filename);
+}
+
+TEST_CASE("live dictionary", "[sdict]")
+{
+	constexpr std::string_view filename = "test_live.sdict";
+	constexpr std::string_view new_filename = "test_live_new.sdict";
+	const auto write_version = [&](std::string_view word, std::size_t num_words)
+	{
+		if (std::filesystem::exists(new_filename))
+			{ std::filesystem::remove(new_filename); }
+		{
+			dictionary_file file(new_filename);
+			// distinct defs, so that each version has a different size
+			for (std::size_t i = 0; i < num_words; i++)
+			{
+				const auto cur_word = std::string(word) + std::to_string(i);
+				file.add_word(cur_word, std::string_view("def of " + cur_word));
+			}
+		}
+		// replaced, as save_words does, so mappings of the old version stay valid
+		std::filesystem::rename(new_filename, filename);
+	};
+
+	write_version("old", 10);
+	live_dictionary live;
+	REQUIRE(!live.snapshot());
+	REQUIRE(!live.reload_if_changed());
+	live.open_mapped(filename);
+	const auto old_snapshot = live.snapshot();
+	REQUIRE(old_snapshot->contains("old0"));
+	REQUIRE(!live.reload_if_changed());
+
+	write_version("new", 20);
+	REQUIRE(live.reload_if_changed());
+	const auto new_snapshot = live.snapshot();
+	REQUIRE(new_snapshot != old_snapshot);
+	REQUIRE(new_snapshot->contains("new19"));
+	REQUIRE(!new_snapshot->contains("old0"));
+	// lookups through the old snapshot still see the old version
+	REQUIRE(cmp_as_bytes(std::string_view("def of old9"), old_snapshot->find_view("old9").value()));
+	REQUIRE(!old_snapshot->contains("new0"));
+	REQUIRE(!live.reload_if_changed());
+
+	// a version which can't be opened is skipped, keeping the current one
+	{
+		std::ofstream fout{std::string(new_filename), std::ios::binary};
+		fout << "not a dictionary";
+	}
+	std::filesystem::rename(new_filename, filename);
+	REQUIRE(!live.reload_if_changed());
+	REQUIRE(live.snapshot() == new_snapshot);
+
+	std::atomic<int> num_reloads = 0;
+	live.watch(std::chrono::milliseconds(10), [&]() { num_reloads++; });
+	write_version("watched", 30);
+	for (int i = 0; i < 500 && num_reloads == 0; i++)
+		{ std::this_thread::sleep_for(std::chrono::milliseconds(10)); }
+	live.stop_watching();
+	REQUIRE(num_reloads == 1);
+	REQUIRE(live.snapshot()->contains("watched29"));
+
+	std::filesystem::remove(filename);
+}
+
+TEST_CASE("render cache invalidate", "[sdict]")
+{
+	const std::string filename = "test_render_cache.sdict", source_filename = "test_render_source.sdict";
+	std::ofstream(source_filename) << "source";
+	rendered_def a, b;
+	a.text = { 'a' };
+	append_style(a.style, 1, 'A');
+	b.text = { 'b' };
+	append_style(b.style, 1, 'A');
+	{
+		render_cache cache;
+		cache.open(filename, source_filename);
+		REQUIRE(cache.is_open());
+		cache.add("a", a);
+		cache.add("b", b);
+		// in the file, which is cleared, but b is kept in memory
+		cache.invalidate("a");
+		REQUIRE(cache.is_open());
+		REQUIRE(!cache.contains("a"));
+		REQUIRE(cache.find("b")->text == b.text);
+		// not cached at all
+		cache.invalidate("c");
+		cache.save();
+	}
+
+	render_cache cache;
+	cache.open(filename, source_filename);
+	REQUIRE(!cache.contains("a"));
+	REQUIRE(cache.find("b")->text == b.text);
+	// can be added again
+	cache.add("a", b);
+	REQUIRE(cache.find("a")->text == b.text);
+
+	std::filesystem::remove(filename);
+	std::filesystem::remove(source_filename);
+}
+
+TEST_CASE("render cache reopen", "[sdict]")
+{
+	const std::string filename = "test_render_cache.sdict", source_filename = "test_render_source.sdict";
+	std::ofstream(source_filename) << "source";
+	rendered_def a;
+	a.text = { 'a' };
+	append_style(a.style, 1, 'A');
+
+	render_cache cache;
+	cache.open(filename, source_filename);
+	REQUIRE(cache.is_open());
+	// only in memory
+	cache.add("a", a, false);
+	// same source, so kept
+	cache.open(filename, source_filename);
+	REQUIRE(cache.find("a")->text == a.text);
+	cache.add("b", a);
+
+	// the source changed (e.g. reloaded), so neither what's in memory nor in the file is found
+	std::ofstream(source_filename) << "changed source";
+	cache.open(filename, source_filename);
+	REQUIRE(cache.is_open());
+	REQUIRE(!cache.find("a"));
+	REQUIRE(!cache.find("b"));
+	REQUIRE(!cache.contains("a"));
+
+	std::filesystem::remove(filename);
+	std::filesystem::remove(source_filename);
+}
+
+// read the string fields of the top level object as "key=value;"
+static task<void> read_string_fields(json_coro_cursor& cursor, std::string& out)
+{
+	CO_CALL(cursor.init);
+	// begin object
+	CO_CALL(cursor.next_);
+	for (;;)
+	{
+		bool found;
+		CO_CALL(recursive_skip_until_obj, cursor, [&out](const auto& cur_event, std::string_view key) -> task<bool>
+			{
+				if (cur_event.event_type() == jsoncons::staj_event_type::string_value)
+					{ out += std::string(key) + "=" + std::string(cur_event.template get<std::string_view>()) + ";"; }
+				co_return false;
+			}) >> found;
+		if (!found)
+			{ break; }
+	}
+}
+
+TEST_CASE("json cursor keys across chunks", "[json]")
+{
+	// keys in the nested object and array are skipped, and a key is escaped
+	const std::string json = R"({"alpha_key_long":"value one","n":{"x":"y"},"i\u0064":"some\"thing","stems":["a"],"last":"zz"})";
+	for (std::size_t first = 1; first < json.size(); first++)
+	{
+		for (std::size_t second = first; second < json.size(); second++)
+		{
+			std::string fields;
+			json_coro_cursor cursor;
+			task<void> parse_task = read_string_fields(cursor, fields);
+			// chunks are overwritten once added, as the buffer of an HTTP response is reused, so keys must not point into them
+			std::string chunks[] = { json.substr(0, first), json.substr(first, second - first), json.substr(second) };
+			for (auto& chunk : chunks)
+			{
+				parse_task.add_data(chunk);
+				std::ranges::fill(chunk, '#');
+			}
+			INFO("split at " << first << " and " << second);
+			REQUIRE(fields == "alpha_key_long=value one;id=some\"thing;last=zz;");
+		}
+	}
+}
+
+#ifdef SDICT_USE_ZSTD
+TEST_CASE("compress defs", "[sdict]")
+{
+	constexpr std::string_view filename = "test.sdict";
+	if (std::filesystem::exists(filename))
+		{ std::filesystem::remove(filename); }
+
+	std::unordered_map<std::string, std::string> words;
+	{
+		dictionary_file file(filename);
+		for (std::size_t i = 0; i < 4096; i++)
+		{
+			std::string word = random_string(1, 32, 'a', 'z');
+			// repetitive defs, similar to real entries
+			std::string def = "{\"meta\":{\"id\":\"" + word + "\"},\"def\":[{\"sseq\":[[[\"sense\",{\"dt\":[[\"text\",\"" + random_string(1, 64, 'a', 'z') + "\"]]}]]]}]}";
+			if (file.add_word<false>(word, std::string_view(def)))
+				{ words.emplace(std::move(word), std::move(def)); }
+		}
+		file.flush();
+		const auto old_size = std::filesystem::file_size(filename);
+		file.compress_defs();
+		REQUIRE(std::filesystem::file_size(filename) < old_size);
+		REQUIRE_THROWS_AS(file.compress_defs(), std::logic_error);
+		REQUIRE(file.add_word("0", std::string_view("{\"meta\":{\"id\":\"0\"}}")));
+		words.emplace("0", "{\"meta\":{\"id\":\"0\"}}");
+		for (const auto& [word, def] : words)
+			{ REQUIRE(cmp_as_bytes(def, file.find(word, true).value())); }
+	}
+
+	{
+		dictionary_file file;
+		file.open_mapped(filename);
+		REQUIRE(file.num_words() == words.size());
+		for (const auto& [word, def] : words)
+			{ REQUIRE(cmp_as_bytes(def, file.find_view(word, true).value())); }
+	}
+
+	{
+		// streamed decompression of a def larger than one batch
+		dictionary_file file(filename);
+		std::string def = "{\"meta\":{\"id\":\"1\"},\"def\":[";
+		while (def.size() < 4096 * 4)
+			{ def += "{\"sseq\":[[[\"sense\",{\"dt\":[[\"text\",\"" + random_string(1, 64, 'a', 'z') + "\"]]}]]]},"; }
+		def.back() = ']';
+		def += '}';
+		REQUIRE(file.add_word("1", std::string_view(def)));
+		std::string streamed;
+		REQUIRE(file.find_stream("1", [&streamed](std::span<const std::byte> piece)
+			{ streamed.append(reinterpret_cast<const char*>(piece.data()), piece.size()); }, true));
+		REQUIRE(streamed == def);
+	}
+
+	std::filesystem::remove(filename);
+}
+#endif